@@ -20,6 +20,9 @@ local Renderer = require "ItsyScape.Graphics.Renderer"
 local ThirdPersonCamera = require "ItsyScape.Graphics.ThirdPersonCamera"
 local ToolTip = require "ItsyScape.UI.ToolTip"
 local UIView = require "ItsyScape.UI.UIView"
+local NArena = require "nbunny.arena"
+local NFFI = require "nbunny.ffi"
+local NProfiler = require "nbunny.profiler"
 
 local function createGameDB()
 	local t = {
@@ -109,6 +112,7 @@ function Application:new()
 	self.game.onQuit:register(self.quitGame, self)
 
 	self.times = {}
+	self.profilerScopes = {}
 
 	self.gameView:getRenderer():setCamera(self.camera)
 
@@ -127,9 +131,17 @@ function Application:new()
 end
 
 function Application:measure(name, func, ...)
+	local scope = self.profilerScopes[name]
+	if not scope then
+		scope = NProfiler.getScopeID(name)
+		self.profilerScopes[name] = scope
+	end
+
+	NFFI.profiler_begin_scope(scope)
 	local before = love.timer.getTime()
 	func(...)
 	local after = love.timer.getTime()
+	NFFI.profiler_end_scope()
 
 	local index
 	if not self.times[name] then
@@ -390,7 +402,23 @@ function Application:draw()
 				self.times[i].value,
 				1 / self.times[i].value)
 			sum = sum + self.times[i].value
+
+			if NProfiler.isEnabled() then
+				local scope = self.profilerScopes[self.times[i].name]
+				r = r .. string.format(
+					"p50: %.04f p95: %.04f p99: %.04f\n",
+					NProfiler.getPercentile(scope, 0.5),
+					NProfiler.getPercentile(scope, 0.95),
+					NProfiler.getPercentile(scope, 0.99))
+			end
 		end
+		r = r .. string.format(
+			"native: %d allocs, %d KB (%d heap, %d KB reserved)\n",
+			NArena.getNumAllocations(),
+			math.floor(NArena.getNumBytes() / 1024),
+			NArena.getNumHeapAllocations(),
+			math.floor(NArena.getCapacity() / 1024))
+
 		if 1 / sum < 60 then
 			r = r .. string.format(
 					"!!! sum: %.04f (%010d)\n",
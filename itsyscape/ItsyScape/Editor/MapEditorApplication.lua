@@ -259,7 +259,11 @@ function MapEditorApplication:paint()
 		end
 	end
 
-	self:getGame():getStage():updateMap(1)
+	if width and height then
+		self:getGame():getStage():updateMap(1, nil, i, i + width - 1, j, j + height - 1)
+	else
+		self:getGame():getStage():updateMap(1)
+	end
 end
 
 function MapEditorApplication:makeMotionEvent(x, y, button)
@@ -438,7 +442,7 @@ function MapEditorApplication:mouseMove(x, y, dx, dy)
 			local r = self.motion:onMouseMoved(self:makeMotionEvent(x, y))
 
 			if r then
-				self:getGame():getStage():updateMap(1)
+				self:getGame():getStage():updateMap(1, nil, self.motion:getDirtyTiles())
 			end
 		end
 
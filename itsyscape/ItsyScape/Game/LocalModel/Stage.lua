@@ -421,11 +421,14 @@ function LocalStage:newMap(width, height, layer, tileSetID)
 	self:updateMap(layer)
 end
 
-function LocalStage:updateMap(layer, map)
+function LocalStage:updateMap(layer, map, left, right, top, bottom)
 	if self.map[layer] then
 		if map then
 			self.map[layer] = map
 			self.game:getDirector():setMap(layer, map)
+			self.map[layer]:invalidate()
+		else
+			self.map[layer]:invalidate(left, right, top, bottom)
 		end
 
 		love.thread.getChannel('ItsyScape.Map::input'):push({
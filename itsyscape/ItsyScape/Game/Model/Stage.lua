@@ -98,7 +98,11 @@ end
 -- Notifies the Stage that the map at the specified layer has been updated.
 --
 -- Invokes the onMapModified callback with the Map instance and layer.
-function Stage:updateMap(layer)
+--
+-- If map is provided, it replaces the map at the layer. Otherwise, if left,
+-- right, top, and bottom are provided, only the tiles in that rectangle
+-- changed.
+function Stage:updateMap(layer, map, left, right, top, bottom)
 	Class.ABSTRACT()
 end
 
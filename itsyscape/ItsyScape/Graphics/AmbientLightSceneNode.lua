@@ -12,6 +12,7 @@ local Vector = require "ItsyScape.Common.Math.Vector"
 local LightSceneNode = require "ItsyScape.Graphics.LightSceneNode"
 
 local AmbientLightSceneNode = Class(LightSceneNode)
+AmbientLightSceneNode.KIND = "ambient"
 
 function AmbientLightSceneNode:new()
 	LightSceneNode.new(self)
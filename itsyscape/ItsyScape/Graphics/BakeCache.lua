@@ -0,0 +1,152 @@
+--------------------------------------------------------------------------------
+-- ItsyScape/Graphics/BakeCache.lua
+--
+-- This file is a part of ItsyScape.
+--
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+--------------------------------------------------------------------------------
+local ffi = require "ffi"
+local Class = require "ItsyScape.Common.Class"
+local ResourceLoader = require "ItsyScape.Graphics.ResourceLoader"
+local NBakeCache = require "nbunny.bakecache"
+local NBakeHash = require "nbunny.bakehash"
+
+-- Registers the type of the files returned by NBakeCache.load.
+local NBakeFile = require "nbunny.bakefile"
+
+-- Keeps vertices that are slow to make (map chunks, decorations, decoded
+-- models and static meshes) on disk, so they only have to be made once.
+--
+-- Each file is named after a hash of everything the vertices were made from
+-- (see BakeCache.newHash), so nothing has to be invalidated: if the inputs
+-- change, so does the key. Loading a baked file is a single read (the file
+-- is mapped) and a copy into a ByteData, ready for Mesh.setVertices.
+local BakeCache = Class()
+
+-- Relative to the save directory.
+BakeCache.DIRECTORY = "Cache/Bake"
+
+function BakeCache:new(directory)
+	directory = directory or BakeCache.DIRECTORY
+
+	self.directory = directory
+	self._handle = false
+
+	if love.filesystem.createDirectory(directory) then
+		self._handle = NBakeCache(love.filesystem.getSaveDirectory() .. "/" .. directory)
+	end
+end
+
+-- Returns false if the directory couldn't be made; loads always miss and
+-- saves do nothing then.
+function BakeCache:getIsEnabled()
+	return self._handle ~= false
+end
+
+-- Returns the real path of the directory, or nil if not enabled.
+function BakeCache:getDirectory()
+	if self._handle then
+		return self._handle:getDirectory()
+	end
+
+	return nil
+end
+
+-- Returns a hash. Call hash:update(...) with everything the vertices are
+-- made from, then hash:getKey() for the key.
+--
+-- update takes strings, numbers, booleans, and nil. A pointer must be
+-- followed by the size, in bytes, of what it points to.
+function BakeCache.newHash()
+	return NBakeHash()
+end
+
+-- Shortcut to hash a few values. Returns the key.
+function BakeCache.hash(...)
+	local hash = NBakeHash()
+	hash:update(...)
+
+	return hash:getKey()
+end
+
+-- Packs vertex tables (as passed to love.graphics.newMesh) into a ByteData.
+-- Components past the end of format are ignored.
+function BakeCache.packVertices(vertices, format)
+	local stride = ResourceLoader.getStride(format)
+
+	local data = love.data.newByteData(math.max(#vertices, 1) * stride * ResourceLoader.FLOAT_SIZE)
+	local pointer = ffi.cast("float*", data:getPointer())
+	for i = 1, #vertices do
+		local vertex = vertices[i]
+		local offset = (i - 1) * stride
+
+		for j = 1, stride do
+			pointer[offset + j - 1] = vertex[j] or 0
+		end
+	end
+
+	return data
+end
+
+-- Returns the meshes baked from key or nil if there are none.
+--
+-- The result is a list of meshes like ResourceLoader.take returns for a
+-- static mesh, with format and bones fields.
+function BakeCache:load(key)
+	if not self._handle then
+		return nil
+	end
+
+	local file = self._handle:load(key)
+	if not file then
+		return nil
+	end
+
+	local baked = file:getMeshes()
+	local stride = ResourceLoader.getStride(baked.format)
+
+	local result = {
+		format = baked.format,
+		bones = baked.bones
+	}
+
+	for i = 1, #baked.meshes do
+		result[i] = ResourceLoader.copyMesh(baked.meshes[i], stride)
+	end
+
+	file:close()
+
+	return result
+end
+
+-- Bakes meshes under key. Each mesh has name, vertexData, vertexCount,
+-- indexData (or false), indexCount, min, and max, like the ones returned by
+-- BakeCache.load, and all are in format.
+--
+-- Returns true on success, false otherwise.
+function BakeCache:save(key, format, meshes, bones)
+	if not self._handle then
+		return false
+	end
+
+	local m = {}
+	for i = 1, #meshes do
+		local mesh = meshes[i]
+
+		m[i] = {
+			name = mesh.name or "",
+			vertices = mesh.vertexData and mesh.vertexData:getPointer(),
+			vertexCount = mesh.vertexCount,
+			indices = mesh.indexData and mesh.indexData:getPointer(),
+			indexCount = mesh.indexCount or 0,
+			min = { mesh.min.x, mesh.min.y, mesh.min.z },
+			max = { mesh.max.x, mesh.max.y, mesh.max.z }
+		}
+	end
+
+	return self._handle:save(key, format, bones or {}, m)
+end
+
+return BakeCache
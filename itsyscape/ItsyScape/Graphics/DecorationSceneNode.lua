@@ -9,12 +9,16 @@
 --------------------------------------------------------------------------------
 local Class = require "ItsyScape.Common.Class"
 local Vector = require "ItsyScape.Common.Math.Vector"
+local BakeCache = require "ItsyScape.Graphics.BakeCache"
 local SceneNode = require "ItsyScape.Graphics.SceneNode"
 local Decoration = require "ItsyScape.Graphics.Decoration"
 local ShaderResource = require "ItsyScape.Graphics.ShaderResource"
 local StaticMesh = require "ItsyScape.Graphics.StaticMesh"
 
 local DecorationSceneNode = Class(SceneNode)
+
+-- Bump when the vertices made by _generateVertices change.
+DecorationSceneNode.BAKE_VERSION = 1
 DecorationSceneNode.DEFAULT_SHADER = ShaderResource()
 do
 	DecorationSceneNode.DEFAULT_SHADER:loadFromFile("Resources/Shaders/StaticModel")
@@ -186,9 +190,79 @@ function DecorationSceneNode:_generateMesh(min, max, vertices)
 	end
 end
 
-function DecorationSceneNode:fromDecoration(decoration, staticMesh)
+-- Like _generateMesh, but for vertices in a ByteData, as returned by
+-- BakeCache.load.
+function DecorationSceneNode:_generateMeshFromData(t)
+	if self.isOwner and self.mesh then
+		self.mesh:release()
+	end
+
+	if t.vertexCount > 0 then
+		local format = StaticMesh.DEFAULT_FORMAT
+		self.mesh = love.graphics.newMesh(format, t.vertexCount, 'triangles', 'static')
+		self.mesh:setVertices(t.vertexData)
+		for _, element in ipairs(format) do
+			self.mesh:setAttributeEnabled(element[1], true)
+		end
+
+		self.isOwner = true
+		self:setBounds(t.min, t.max)
+	else
+		self:setBounds(Vector(0), Vector(0))
+	end
+end
+
+function DecorationSceneNode:_getBakeKey(decoration, staticMesh)
+	local hash = BakeCache.newHash()
+	hash:update("Decoration", DecorationSceneNode.BAKE_VERSION, staticMesh:getBakeKey())
+
+	for feature in decoration:iterate() do
+		local position = feature:getPosition()
+		local rotation = feature:getRotation()
+		local scale = feature:getScale()
+
+		hash:update(
+			feature:getID(),
+			position.x, position.y, position.z,
+			rotation.x, rotation.y, rotation.z, rotation.w,
+			scale.x, scale.y, scale.z,
+			feature:getColor():get())
+	end
+
+	return hash:getKey()
+end
+
+-- If bakeCache is provided, the vertices are loaded from the cache if they
+-- were baked before, and baked otherwise.
+function DecorationSceneNode:fromDecoration(decoration, staticMesh, bakeCache)
+	local key
+	if bakeCache and bakeCache:getIsEnabled() then
+		key = self:_getBakeKey(decoration, staticMesh)
+
+		local baked = bakeCache:load(key)
+		if baked and baked[1] then
+			self:_generateMeshFromData(baked[1])
+			return
+		end
+	end
+
 	local min, max, vertices = self:_generateVertices(decoration, staticMesh)
-	self:_generateMesh(min, max, vertices)
+	if key and #vertices > 0 then
+		local t = {
+			name = "Decoration",
+			vertexData = BakeCache.packVertices(vertices, StaticMesh.DEFAULT_FORMAT),
+			vertexCount = #vertices,
+			indexData = false,
+			indexCount = 0,
+			min = min,
+			max = max
+		}
+
+		bakeCache:save(key, StaticMesh.DEFAULT_FORMAT, { t })
+		self:_generateMeshFromData(t)
+	else
+		self:_generateMesh(min, max, vertices)
+	end
 end
 
 function DecorationSceneNode:draw(renderer, delta)
@@ -15,9 +15,7 @@ local GBuffer = require "ItsyScape.Graphics.GBuffer"
 local LBuffer = require "ItsyScape.Graphics.LBuffer"
 local AmbientLightSceneNode = require "ItsyScape.Graphics.AmbientLightSceneNode"
 local DirectionalLightSceneNode = require "ItsyScape.Graphics.DirectionalLightSceneNode"
-local LightSceneNode = require "ItsyScape.Graphics.LightSceneNode"
 local PointLightSceneNode = require "ItsyScape.Graphics.PointLightSceneNode"
-local FogSceneNode = require "ItsyScape.Graphics.FogSceneNode"
 
 -- Deferred renderer pass.
 --
@@ -86,40 +84,32 @@ function DeferredRendererPass:setIsFullLit(value)
 end
 
 function DeferredRendererPass:walk(node, delta)
-	local projection, view = self:getRenderer():getCamera():getTransforms()
-	local nodes = node:walkByMaterial(view, projection, delta, self:getRenderer():getCullEnabled())
-
-	for i = 1, #nodes do
-		local n = nodes[i]
-		local material = n:getMaterial()
-		if not material:getIsTranslucent() and
-		   not material:getIsFullLit() and
-		   not Class.isCompatibleType(n, LightSceneNode)
-		then
-			table.insert(self.nodes, n)
-		end
-	end
+	self.nodes = self:getRenderer():getOpaqueNodes()
 end
 
+-- Each light is its own pass, so the clusters themselves aren't used.
 function DeferredRendererPass:walkLights(node, delta)
-	if node:isCompatibleType(LightSceneNode) then
-		if node:isCompatibleType(FogSceneNode) then
-			table.insert(self.fog, node)
-		else
-			table.insert(self.lights, node)
-		end
+	local lightClusters = self:getRenderer():getLightClusters()
+
+	self.lights = {}
+	for _, light in ipairs(lightClusters:getGlobalLights()) do
+		table.insert(self.lights, light)
+	end
+
+	for _, light in ipairs(lightClusters:getLocalLights()) do
+		table.insert(self.lights, light)
 	end
 
-	for child in node:iterate() do
-		self:walkLights(child, delta)
+	for _, light in ipairs(lightClusters:getPointLights()) do
+		if light then
+			table.insert(self.lights, light)
+		end
 	end
+
+	self.fog = lightClusters:getFog()
 end
 
 function DeferredRendererPass:beginDraw(scene, delta)
-	self.nodes = {}
-	self.lights = {}
-	self.fog = {}
-
 	self:walk(scene, delta)
 	self:walkLights(scene, delta)
 end
@@ -351,10 +341,7 @@ function DeferredRendererPass:drawFog(scene, delta)
 	self.fBuffer:use()
 	love.graphics.clear(0, 0, 0, 0, false, false)
 
-	table.sort(self.fog, function(a, b)
-		return a:getFarDistance() < b:getFarDistance()
-	end)
-
+	-- Fog is already nearest far distance first. See SceneNode.walkByKind.
 	for i = 1, #self.fog do
 		self:drawFogNode(self.fog[i], delta)
 	end
@@ -12,6 +12,7 @@ local Vector = require "ItsyScape.Common.Math.Vector"
 local LightSceneNode = require "ItsyScape.Graphics.LightSceneNode"
 
 local DirectionalLightSceneNode = Class(LightSceneNode)
+DirectionalLightSceneNode.KIND = "directional"
 
 function DirectionalLightSceneNode:new()
 	LightSceneNode.new(self)
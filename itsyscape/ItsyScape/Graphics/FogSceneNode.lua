@@ -12,6 +12,7 @@ local Vector = require "ItsyScape.Common.Math.Vector"
 local LightSceneNode = require "ItsyScape.Graphics.LightSceneNode"
 
 local FogSceneNode = Class(LightSceneNode)
+FogSceneNode.KIND = "fog"
 FogSceneNode.FOLLOW_MODE_EYE    = 1
 FogSceneNode.FOLLOW_MODE_TARGET = 2
 
@@ -21,6 +22,14 @@ function FogSceneNode:new()
 	self.nearDistance = 0
 	self.farDistance = 100
 	self.followMode = FogSceneNode.FOLLOW_MODE_EYE
+
+	self:_updateHandle()
+end
+
+-- Fog is sorted by far distance. See SceneNode.walkByKind.
+function FogSceneNode:_updateHandle()
+	self._handle:setKind(self.KIND)
+	self._handle:setLight(false, self.farDistance)
 end
 
 function FogSceneNode:getNearDistance()
@@ -37,6 +46,7 @@ end
 
 function FogSceneNode:setFarDistance(value)
 	self.farDistance = value or self.farDistance
+	self:_updateHandle()
 end
 
 function FogSceneNode:setAttenuation(value)
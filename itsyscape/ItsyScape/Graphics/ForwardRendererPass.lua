@@ -9,10 +9,8 @@
 --------------------------------------------------------------------------------
 local Class = require "ItsyScape.Common.Class"
 local Vector = require "ItsyScape.Common.Math.Vector"
-local FogSceneNode = require "ItsyScape.Graphics.FogSceneNode"
 local RendererPass = require "ItsyScape.Graphics.RendererPass"
 local Light = require "ItsyScape.Graphics.Light"
-local LightSceneNode = require "ItsyScape.Graphics.LightSceneNode"
 
 -- Base renderer pass type. Manages logic for a specific pass.
 local ForwardRendererPass = Class(RendererPass)
@@ -31,9 +29,6 @@ function ForwardRendererPass:new(renderer)
 	self:loadBaseShaderFromFile(
 		"Resources/Renderers/Mobile/Base.frag.glsl",
 		"Resources/Renderers/Mobile/Base.vert.glsl")
-
-	self.lightTypes = {}
-	self.nodeTypes = {}
 end
 
 function ForwardRendererPass:setLBuffer(value)
@@ -45,71 +40,34 @@ function ForwardRendererPass:setLBuffer(value)
 end
 
 function ForwardRendererPass:walk(node, delta)
-	local projection, view = self:getRenderer():getCamera():getTransforms()
-	local nodes = node:walkByPosition(view, projection, delta, self:getRenderer():getCullEnabled())
+	self.nodes = self:getRenderer():getTranslucentNodes()
+end
 
-	for i = 1, #nodes do
-		local n = nodes[i]
-		local material = n:getMaterial()
+function ForwardRendererPass:walkLights(node, delta)
+	self.lightClusters = self:getRenderer():getLightClusters()
 
-		if (material:getIsTranslucent() or material:getIsFullLit()) and
-		   not Class.isCompatibleType(n, LightSceneNode)
-		then
-			table.insert(self.nodes, n)
-		end
+	self.fog = self.lightClusters:getFog()
+	self.globalLights = self.lightClusters:getGlobalLights()
+
+	-- Point lights come from the clusters if they're enabled. Otherwise, the
+	-- nearest point lights are sent like any other light.
+	self.lights = {}
+	for _, light in ipairs(self.lightClusters:getLocalLights()) do
+		table.insert(self.lights, light)
 	end
-end
 
-function ForwardRendererPass:walkLights(node, delta)
-	local nodeType = node:getType()
-	if self.lightTypes[nodeType] or
-	   not self.nodeTypes[nodeType] and node:isCompatibleType(LightSceneNode)
-	then
-		if node:isCompatibleType(FogSceneNode) then
-			table.insert(self.fog, node)
-		else
-			if node:getIsGlobal() then
-				table.insert(self.globalLights, node)
-			else
-				table.insert(self.lights, node)
+	if not self.lightClusters:getIsEnabled() then
+		for _, light in ipairs(self.lightClusters:getPointLights()) do
+			if light then
+				table.insert(self.lights, light)
 			end
 		end
-	else
-		self.nodeTypes[nodeType] = true
-	end
-
-	for child in node:iterate() do
-		self:walkLights(child, delta)
 	end
 end
 
 function ForwardRendererPass:beginDraw(scene, delta)
-	self.nodes = {}
-	self.fog = {}
-	self.lights = {}
-	self.globalLights = {}
-
 	self:walk(scene, delta)
 	self:walkLights(scene, delta)
-
-	local nodeX, nodeY, nodeZ = self:getRenderer():getCamera():getPosition():get()
-	table.sort(self.lights, function(a, b)
-		local distanceA
-		do
-			local transform = a:getTransform():getGlobalDeltaTransform(delta)
-			local x, y, z = transform:transformPoint(0, 0, 0)
-			distanceA = (x - nodeX) ^ 2 + (y - nodeY) ^ 2 + (z - nodeZ) ^ 2
-		end
-
-		local distanceB
-		do
-			local transform = b:getTransform():getGlobalDeltaTransform(delta)
-			local x, y, z = transform:transformPoint(0, 0, 0)
-			distanceB = (x - nodeX) ^ 2 + (y - nodeY) ^ 2 + (z - nodeZ) ^ 2
-		end
-
-		return distanceA < distanceB
-	end)
 end
 
 function ForwardRendererPass:endDraw(scene, delta)
@@ -195,6 +153,9 @@ function ForwardRendererPass:drawNodes(scene, delta)
 				end
 
 				currentShaderProgram:send("scape_NumLights", numLights)
+				self.lightClusters:send(
+					currentShaderProgram,
+					not material:getIsFullLit() and numGlobalLights > 0)
 
 				for i = 1, numFog do
 					local f = self.fog[i]
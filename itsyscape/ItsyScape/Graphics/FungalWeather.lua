@@ -7,7 +7,6 @@
 -- License, v. 2.0. If a copy of the MPL was not distributed with this
 -- file, You can obtain one at http://mozilla.org/MPL/2.0/.
 --------------------------------------------------------------------------------
-local ffi = require "ffi"
 local Class = require "ItsyScape.Common.Class"
 local Vector = require "ItsyScape.Common.Math.Vector"
 local Color = require "ItsyScape.Graphics.Color"
@@ -15,6 +14,7 @@ local SceneNode = require "ItsyScape.Graphics.SceneNode"
 local ShaderResource = require "ItsyScape.Graphics.ShaderResource"
 local Weather = require "ItsyScape.Graphics.Weather"
 local TextureResource = require "ItsyScape.Graphics.TextureResource"
+local NFungalWeather = require "nbunny.fungalweather"
 
 local FungalWeather = Class(Weather)
 
@@ -24,32 +24,8 @@ FungalWeather.MESH_FORMAT = {
 	{ "VertexColor", 'float', 4 }
 }
 
-FungalWeather.QUAD = {
-	{ -1, -1,  0, 0, 0, 1, 1, 1, 1 },
-	{  1, -1,  0, 1, 0, 1, 1, 1, 1 },
-	{  1,  1,  0, 1, 1, 1, 1, 1, 1 },
-	{ -1, -1,  0, 0, 0, 1, 1, 1, 1 },
-	{  1,  1,  0, 1, 1, 1, 1, 1, 1 },
-	{ -1,  1,  0, 0, 1, 1, 1, 1, 1 },
-
-	{  0, -1, -1, 0, 0, 1, 1, 1, 1 },
-	{  0,  1, -1, 1, 0, 1, 1, 1, 1 },
-	{  0,  1,  1, 1, 1, 1, 1, 1, 1 },
-	{  0, -1, -1, 0, 0, 1, 1, 1, 1 },
-	{  0,  1,  1, 1, 1, 1, 1, 1, 1 },
-	{  0, -1,  1, 0, 1, 1, 1, 1, 1 },
-}
-
-ffi.cdef [[
-	typedef struct {
-		float x, y, z;
-		float size;
-		float age;
-		float alpha;
-		int color;
-		bool moving;
-	} scape_SporeParticle;	
-]]
+-- Size of a vertex in MESH_FORMAT, in bytes.
+FungalWeather.VERTEX_SIZE = 9 * 4
 
 FungalWeather.SceneNode = Class(SceneNode)
 FungalWeather.SceneNode.SHADER = ShaderResource()
@@ -131,22 +107,43 @@ function FungalWeather:new(gameView, layer, map, props)
 		end
 	end
 
-	self.particles = ffi.new("scape_SporeParticle[?]", self.heaviness)
+	-- The spores are simulated natively and written straight into the
+	-- vertex data.
+	self._handle = NFungalWeather()
+	self._handle:resize(self.heaviness)
+	self._handle:setGravity(self.gravity:get())
+	self._handle:setWind(self.wind:get())
+	self._handle:setHeight(self.minHeight, self.maxHeight)
+	self._handle:setSize(self.minSize, self.maxSize)
+	self._handle:setCeiling(self.ceiling)
+	do
+		local colors = {}
+		for i = 1, #self.colors do
+			local r, g, b, a = self.colors[i]:get()
+			table.insert(colors, r)
+			table.insert(colors, g)
+			table.insert(colors, b)
+			table.insert(colors, a)
+		end
 
-	self.vertices = {}
-	self.vertexCount = self.heaviness * 12 -- 6 per quad, 2 quads per rain streak
-	for i = 1, self.vertexCount do
-		table.insert(self.vertices, { 0, 0, 0 })
+		self._handle:setColors(unpack(colors))
 	end
 
-	self.mesh = love.graphics.newMesh(
-		FungalWeather.MESH_FORMAT,
-		self.vertices,
-		'triangles',
-		'dynamic')
-	self.mesh:setAttributeEnabled("VertexPosition", true)
-	self.mesh:setAttributeEnabled("VertexTexture", true)
-	self.mesh:setAttributeEnabled("VertexColor", true)
+	self.vertexCount = self._handle:getVertexCount() -- 6 per quad, 2 quads per spore
+	if self.vertexCount > 0 then
+		self.vertices = love.data.newByteData(self.vertexCount * FungalWeather.VERTEX_SIZE)
+		self.mesh = love.graphics.newMesh(
+			FungalWeather.MESH_FORMAT,
+			self.vertexCount,
+			'triangles',
+			'dynamic')
+		self.mesh:setAttributeEnabled("VertexPosition", true)
+		self.mesh:setAttributeEnabled("VertexTexture", true)
+		self.mesh:setAttributeEnabled("VertexColor", true)
+	else
+		self.vertices = false
+		self.mesh = false
+	end
 
 	self.node = FungalWeather.SceneNode(self)
 	self.node:setParent(gameView:getMapSceneNode(layer))
@@ -167,81 +164,17 @@ function FungalWeather:update(delta)
 	local startI, startJ = map:getPosition()
 	local mapWidth, mapHeight = map:getSize()
 	local cellSize = map:getCellSize()
-	local gravity = self.gravity
-	local velocity = (gravity + self.wind) * delta
-	local speed = gravity:getLength() * delta
-	local direction = -(gravity + self.wind):getNormal()
-	local size = self.size
-	local ceiling = self.ceiling
-	local vertexIndex = 1
-	local vertices = FungalWeather.QUAD
-
-	for i = 1, self.heaviness do
-		local p = self.particles + (i - 1)
-
-		if p.alpha >= p.size then
-			local s, t = math.random(), math.random()
-			do
-				s = s * cellSize
-				t = t * cellSize
-			end
-
-
-			local i, j = math.random(startI, startI + mapWidth), math.random(startJ, startJ + mapHeight)
-			local x = (i - 1) * cellSize + s
-			local y = math.random() * (self.maxHeight - self.minHeight) + self.minHeight
-			local z = (j - 1) * cellSize + t
-			local s = math.random() * (self.maxSize - self.minSize) + self.minSize
-
-			p.x, p.y, p.z = x, y, z
-			p.alpha = 0
-			p.age = 0
-			p.size = s / 10
-			p.moving = true
-			p.color = math.random(#self.colors)
-		else
-			p.age = p.age + delta
-
-			if p.moving then
-				local i = math.floor(p.x / cellSize + 1)
-				local j = math.floor(p.z / cellSize + 1)
-
-				local height = math.max(map:getHeightAt(i, j), 0)
-				if p.y <= height and gravity.y <= 0 then
-					p.moving = false
-				elseif p.y >= height + ceiling and gravity.y >= 0 then
-					p.moving = false
-				else
-					p.x = p.x + velocity.x
-					p.y = p.y + velocity.y
-					p.z = p.z + velocity.z
-				end
-			else
-				p.alpha = p.alpha + speed
-			end
-		end
 
-		for j = 1, #vertices do
-			local input = vertices[j]
-			local output = self.vertices[vertexIndex]
-			local r, g, b = self.colors[p.color]:get()
-			local a = 1 - math.max(math.min(p.alpha / p.size,  1), 0)
-
-			output[1] = input[1] * p.size + p.x + math.cos(p.age) * p.size * 2
-			output[2] = input[2] * p.size + p.y + math.sin(p.age) * p.size * 2
-			output[3] = input[3] * p.size + p.z
-			output[4] = input[4]
-			output[5] = input[5]
-			output[6] = r
-			output[7] = g
-			output[8] = b
-			output[9] = a
-
-			vertexIndex = vertexIndex + 1
-		end
+	if self.mesh then
+		self._handle:update(
+			map:getHandle(),
+			mapWidth,
+			mapHeight,
+			delta,
+			self.vertices:getPointer())
+		self.mesh:setVertices(self.vertices)
 	end
 
-	self.mesh:setVertices(self.vertices)
 	self.node:getTransform():setLocalTranslation(Vector(startI * cellSize, 0, startJ * cellSize))
 end
 
@@ -22,12 +22,18 @@ local SpriteManager = require "ItsyScape.Graphics.SpriteManager"
 local ShaderResource = require "ItsyScape.Graphics.ShaderResource"
 local TextureResource = require "ItsyScape.Graphics.TextureResource"
 local WaterMeshSceneNode = require "ItsyScape.Graphics.WaterMeshSceneNode"
+local MapChunks = require "ItsyScape.World.MapChunks"
+local MapMesh = require "ItsyScape.World.MapMesh"
 local TileSet = require "ItsyScape.World.TileSet"
 local WeatherMap = require "ItsyScape.World.WeatherMap"
 
 local GameView = Class()
 GameView.MAP_MESH_DIVISIONS = 16
 
+-- Chunks of a map further than this from the camera are drawn at a lower
+-- level of detail, and twice as far at an even lower level.
+GameView.MAP_LOD_DISTANCE = 64
+
 function GameView:new(game)
 	self.game = game
 	self.actors = {}
@@ -216,10 +222,12 @@ function GameView:addMap(map, layer, tileSetID)
 		tileSetID = tileSetID or "GrassyPlain",
 		map = map,
 		node = SceneNode(),
+		chunks = MapChunks(GameView.MAP_MESH_DIVISIONS),
 		parts = {},
 		weatherMap = WeatherMap(layer, -8, -8, map:getCellSize(), map:getWidth() + 16, map:getHeight() + 16)
 	}
 
+	m.chunks:enableLOD(GameView.MAP_LOD_DISTANCE)
 	m.weatherMap:addMap(m.map)
 
 	self.mapMeshes[layer] = m
@@ -229,14 +237,16 @@ function GameView:removeMap(layer)
 	local m = self.mapMeshes[layer]
 	if m then
 		m.node:setParent(nil)
-
-		for i = 1, #m.parts do
-			m.parts[i]:setMapMesh(nil)
-		end
+		self:_releaseMapParts(m)
 
 		m.weatherMap:removeMap(m.map)
 
 		self.mapMeshes[layer] = nil
+
+		-- No maps left means the area was left.
+		if not next(self.mapMeshes) then
+			self.resourceManager:unpinArea()
+		end
 	end
 end
 
@@ -247,51 +257,139 @@ function GameView:updateMap(map, layer)
 			m.map = map
 		end
 
-		for i = 1, #m.parts do
-			m.parts[i]:setParent(nil)
-			m.parts[i]:setMapMesh(nil)
+		-- Only the chunks with tiles that changed are built again.
+		if m.chunks:setMap(m.map, m.tileSet) then
+			self:_releaseMapParts(m)
 		end
-		m.parts = {}
+		self:_updateMapParts(m)
+
+		m.weatherMap:addMap(m.map)
+	end
+end
 
-		local w, h
-		do
-			local E = 1 / GameView.MAP_MESH_DIVISIONS
-			local partialX = map:getWidth() / GameView.MAP_MESH_DIVISIONS
-			local partialY = map:getHeight() / GameView.MAP_MESH_DIVISIONS
+function GameView:_releaseMapParts(m)
+	for _, part in pairs(m.parts) do
+		part.node:setParent(nil)
+		part.node:setMapMesh(nil)
 
-			w = math.floor(partialX)
-			h = math.floor(partialY)
+		self:_invalidateMapPart(part)
+		if part.mesh then
+			part.mesh:release()
+			part.mesh = false
+		end
 
-			if partialX - math.floor(partialX) >= E then
-				w = w + 1
-			end
+		part.isReleased = true
+	end
+
+	m.parts = {}
+end
 
-			if partialY - math.floor(partialY) >= E then
-				h = h + 1
+-- Releases the meshes of the part, except the one being drawn. That one is
+-- released when the part gets a new mesh.
+function GameView:_invalidateMapPart(part)
+	for _, mesh in pairs(part.meshes) do
+		if mesh ~= part.mesh then
+			mesh:release()
+		end
+	end
+
+	part.meshes = {}
+	part.revision = part.revision + 1
+end
+
+function GameView:_setMapPartMesh(part, mesh)
+	local previousMesh = part.mesh
+
+	part.mesh = mesh
+	part.node:setMapMesh(mesh)
+
+	if previousMesh and previousMesh ~= mesh then
+		local isCached = false
+		for _, cachedMesh in pairs(part.meshes) do
+			if cachedMesh == previousMesh then
+				isCached = true
+				break
 			end
 		end
 
-		for j = 1, h do
-			for i = 1, w do
-				local x = (i - 1) * GameView.MAP_MESH_DIVISIONS + 1
-				local y = (j - 1) * GameView.MAP_MESH_DIVISIONS + 1
-
-				local node = MapMeshSceneNode()
-				node:setParent(m.node)
-				table.insert(m.parts, node)
-				self.resourceManager:queueEvent(function()
-					node:fromMap(
-						m.map,
-						m.tileSet,
-						x, y,
-						GameView.MAP_MESH_DIVISIONS,
-						GameView.MAP_MESH_DIVISIONS)
-					node:getMaterial():setTextures(m.texture)
-				end)
+		if not isCached then
+			previousMesh:release()
+		end
+	end
+end
+
+function GameView:_showMapPart(m, part, level)
+	part.level = level
+
+	local mesh = part.meshes[level]
+	if mesh then
+		self:_setMapPartMesh(part, mesh)
+	elseif level > 0 then
+		mesh = m.chunks:newLODMesh(part.i, part.j, level)
+		part.meshes[level] = mesh
+		self:_setMapPartMesh(part, mesh)
+	elseif part.pendingRevision ~= part.revision then
+		-- Full detail meshes are slow to build, so the part keeps drawing
+		-- whatever mesh it has until this one is ready.
+		local revision = part.revision
+		part.pendingRevision = revision
+
+		self.resourceManager:queueEvent(function()
+			if part.isReleased or part.revision ~= revision then
+				return
 			end
+
+			part.pendingRevision = false
+
+			local left, right, top, bottom = m.chunks:getTiles(part.i, part.j)
+			mesh = MapMesh(
+				m.map, m.tileSet,
+				left, right, top, bottom,
+				self.resourceManager:getBakeCache())
+			part.meshes[0] = mesh
+
+			if part.level == 0 then
+				self:_setMapPartMesh(part, mesh)
+			end
+		end)
+	end
+end
+
+function GameView:_updateMapParts(m)
+	local changes = m.chunks:update()
+	if not changes then
+		return
+	end
+
+	local numChunksWidth = m.chunks:getNumChunks()
+	for k = 1, #changes do
+		local i, j, level, isRebuilt = unpack(changes[k])
+		local index = (j - 1) * numChunksWidth + i
+
+		local part = m.parts[index]
+		if not part then
+			local node = MapMeshSceneNode()
+			node:getMaterial():setTextures(m.texture)
+			node:setParent(m.node)
+
+			part = {
+				node = node,
+				i = i,
+				j = j,
+				level = level,
+				mesh = false,
+				meshes = {},
+				revision = 0,
+				pendingRevision = false,
+				isReleased = false
+			}
+
+			m.parts[index] = part
+		elseif isRebuilt then
+			self:_invalidateMapPart(part)
 		end
 
-		m.weatherMap:addMap(m.map)
+		self:_showMapPart(m, part, level)
 	end
 end
 
@@ -373,7 +471,14 @@ function GameView:addProp(propID, prop)
 	local PropView = r
 	local view = PropView(prop, self)
 	view:attach()
+
+	-- Resources for props closer to the camera are loaded first. Props are
+	-- part of the area, so their resources stay loaded until it's left.
+	self.resourceManager:pushPosition(prop:getPosition())
+	self.resourceManager:pushPinned()
 	view:load()
+	self.resourceManager:popPinned()
+	self.resourceManager:popPosition()
 
 	self.props[prop] = view
 	self.views[prop] = view
@@ -463,6 +568,7 @@ function GameView:decorate(group, decoration, layer)
 	if decoration then
 		local d = {}
 
+		self.resourceManager:pushPinned()
 		self.resourceManager:queueEvent(function()
 			local tileSetFilename = string.format(
 				"Resources/Game/TileSets/%s/Layout.lstatic",
@@ -479,7 +585,10 @@ function GameView:decorate(group, decoration, layer)
 				textureFilename)
 
 			local sceneNode = DecorationSceneNode()
-			sceneNode:fromDecoration(decoration, staticMesh:getResource())
+			sceneNode:fromDecoration(
+				decoration,
+				staticMesh:getResource(),
+				self.resourceManager:getBakeCache())
 			sceneNode:getMaterial():setTextures(texture)
 
 			sceneNode:setParent(map)
@@ -488,20 +597,26 @@ function GameView:decorate(group, decoration, layer)
 			d.decoration = decoration
 			d.name = group
 		end)
+		self.resourceManager:popPinned()
 
 		self.decorations[groupName] = d
 	end
 end
 
 function GameView:flood(key, water, layer)
-	self:drain(key)
-
 	local parent = self:getMapSceneNode((water.layer or 1) - 1 + (layer or 1))
 	if not parent then
 		parent = self.scene
 	end
 
-	local node = WaterMeshSceneNode()
+	-- Flooding the same water again reuses its mesh, so only what changed
+	-- is rebuilt.
+	local node = self.water[key]
+	if not node then
+		node = WaterMeshSceneNode()
+		self.water[key] = node
+	end
+
 	local map = self.game:getStage():getMap(water.layer or 1)
 	node:generate(
 		map,
@@ -511,20 +626,18 @@ function GameView:flood(key, water, layer)
 		water.height or (map:getHeight() - ((water.j or 1) - 1) + 1),
 		water.y,
 		water.finesse)
-	if water.isTranslucent then
-		node:getMaterial():setIsTranslucent(true)
-	end
+	node:getMaterial():setIsTranslucent(water.isTranslucent)
 
 	self.resourceManager:queue(
 		TextureResource,
 		string.format("Resources/Game/Water/%s/Texture.png", water.texture or "LightFoamyWater1"),
 		function(resource)
-			node:getMaterial():setTextures(resource)
-			node:setParent(parent)
+			-- The water may have been drained or flooded again since.
+			if self.water[key] == node then
+				node:getMaterial():setTextures(resource)
+				node:setParent(parent)
+			end
 		end)
-
-
-	self.water[key] = node
 end
 
 function GameView:drain(key)
@@ -626,6 +739,7 @@ function GameView:getDecorations()
 end
 
 function GameView:update(delta)
+	self.resourceManager:setFocus(self.renderer:getCamera():getPosition())
 	self.resourceManager:update()
 
 	for _, actor in pairs(self.actors) do
@@ -656,6 +770,19 @@ function GameView:update(delta)
 
 	self.spriteManager:update(delta)
 
+	do
+		local position = self.renderer:getCamera():getPosition()
+		for _, m in pairs(self.mapMeshes) do
+			if m.chunks:getIsLODEnabled() then
+				local transform = m.node:getTransform():getGlobalTransform()
+				local x, _, z = transform:inverseTransformPoint(position.x, position.y, position.z)
+
+				m.chunks:setFocus(x, z)
+				self:_updateMapParts(m)
+			end
+		end
+	end
+
 	do
 		local actor = self:getActor(self.game:getPlayer():getActor())
 		if actor then
@@ -0,0 +1,172 @@
+--------------------------------------------------------------------------------
+-- ItsyScape/Graphics/LightClusters.lua
+--
+-- This file is a part of ItsyScape.
+--
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+--------------------------------------------------------------------------------
+local Class = require "ItsyScape.Common.Class"
+local NLightClusters = require "nbunny.lightclusters"
+
+-- Collects the lights in a scene and, if enabled, bins the visible point
+-- lights into clusters over the camera's frustum.
+--
+-- The clusters are uploaded to textures that a shader can use to only light
+-- a fragment with the point lights that reach it. See
+-- Resources/Renderers/Mobile/Base.frag.glsl.
+local LightClusters = Class()
+
+-- Formats of the cluster, index, and light textures.
+LightClusters.CLUSTER_FORMAT = 'rg32f'
+LightClusters.INDEX_FORMAT = 'r32f'
+LightClusters.LIGHT_FORMAT = 'rgba32f'
+
+-- Each point light is two texels wide: position and attenuation, then color
+-- and radius.
+LightClusters.LIGHT_TEXTURE_WIDTH = 2
+
+-- Returns true if the textures can be made.
+function LightClusters.getIsSupported()
+	local formats = love.graphics.getImageFormats()
+	return formats[LightClusters.CLUSTER_FORMAT] and
+	       formats[LightClusters.INDEX_FORMAT] and
+	       formats[LightClusters.LIGHT_FORMAT]
+end
+
+-- Constructs the LightClusters.
+--
+-- If enableTextures is falsey, or the textures aren't supported, the lights
+-- are still collected (and point lights culled and sorted) but no textures
+-- are made.
+function LightClusters:new(enableTextures)
+	self._handle = NLightClusters()
+
+	self.globalLights = {}
+	self.localLights = {}
+	self.pointLights = {}
+	self.fog = {}
+
+	self.isEnabled = enableTextures and LightClusters.getIsSupported() or false
+	if self.isEnabled then
+		local width, height, depth = self._handle:getSize()
+		local indexWidth, indexHeight = self._handle:getIndexTextureSize()
+		local maxLights = self._handle:getMaxLights()
+
+		self.clusterImageData = love.image.newImageData(
+			width * height, depth, LightClusters.CLUSTER_FORMAT)
+		self.indexImageData = love.image.newImageData(
+			indexWidth, indexHeight, LightClusters.INDEX_FORMAT)
+		self.lightImageData = love.image.newImageData(
+			LightClusters.LIGHT_TEXTURE_WIDTH, maxLights, LightClusters.LIGHT_FORMAT)
+
+		self.clusterTexture = love.graphics.newImage(self.clusterImageData)
+		self.indexTexture = love.graphics.newImage(self.indexImageData)
+		self.lightTexture = love.graphics.newImage(self.lightImageData)
+
+		self.clusterTexture:setFilter('nearest', 'nearest')
+		self.indexTexture:setFilter('nearest', 'nearest')
+		self.lightTexture:setFilter('nearest', 'nearest')
+	end
+end
+
+-- Returns true if the textures are used.
+function LightClusters:getIsEnabled()
+	return self.isEnabled
+end
+
+-- Walks scene, collecting the lights, and returns the visible opaque and
+-- translucent nodes. See SceneNode.walkByKind.
+--
+-- Point lights that were collected by Lua before the walk ran are false.
+function LightClusters:walk(scene, view, projection, delta, enableCull)
+	local opaque, translucent
+	opaque, translucent, self.globalLights, self.localLights, self.pointLights, self.fog = scene:walkByKind(
+		view,
+		projection,
+		delta,
+		self._handle,
+		enableCull)
+
+	self.view = view
+	self.projection = projection
+
+	if self.isEnabled then
+		self._handle:copyClusters(self.clusterImageData:getPointer())
+		self._handle:copyIndices(self.indexImageData:getPointer())
+
+		for i = 1, #self.pointLights do
+			local node = self.pointLights[i]
+			if node then
+				local light = node:toLight(delta)
+				local position = light:getPosition()
+				local color = light:getColor()
+
+				self.lightImageData:setPixel(
+					0, i - 1,
+					position.x, position.y, position.z, light:getAttenuation())
+				self.lightImageData:setPixel(
+					1, i - 1,
+					color.r, color.g, color.b, node:getRadius())
+			else
+				self.lightImageData:setPixel(0, i - 1, 0, 0, 0, 0)
+				self.lightImageData:setPixel(1, i - 1, 0, 0, 0, 1)
+			end
+		end
+
+		self.clusterTexture:replacePixels(self.clusterImageData)
+		self.indexTexture:replacePixels(self.indexImageData)
+		self.lightTexture:replacePixels(self.lightImageData)
+	end
+
+	return opaque, translucent
+end
+
+-- Lights that light everything (LightSceneNode.getIsGlobal).
+function LightClusters:getGlobalLights()
+	return self.globalLights
+end
+
+-- Lights that aren't global nor point lights (e.g., an ambient light that
+-- isn't global).
+function LightClusters:getLocalLights()
+	return self.localLights
+end
+
+-- Visible point lights that aren't global, nearest to the eye first.
+function LightClusters:getPointLights()
+	return self.pointLights
+end
+
+-- Fog, nearest far distance first.
+function LightClusters:getFog()
+	return self.fog
+end
+
+-- Sends the clusters to shader.
+--
+-- If enabled is falsey, or there's nothing to send, the shader is told there
+-- are no cluster lights.
+function LightClusters:send(shader, enabled)
+	if not shader:hasUniform("scape_NumClusterLights") then
+		return
+	end
+
+	if not enabled or not self.isEnabled or #self.pointLights == 0 then
+		shader:send("scape_NumClusterLights", 0)
+		return
+	end
+
+	local near, far, isPerspective = self._handle:getNearFar()
+
+	shader:send("scape_NumClusterLights", #self.pointLights)
+	shader:send("scape_ClusterTexture", self.clusterTexture)
+	shader:send("scape_ClusterIndexTexture", self.indexTexture)
+	shader:send("scape_ClusterLightTexture", self.lightTexture)
+	shader:send("scape_ClusterView", self.view)
+	shader:send("scape_ClusterProjection", self.projection)
+	shader:send("scape_ClusterNearFar", { near, far, isPerspective and 1 or 0 })
+end
+
+return LightClusters
@@ -15,12 +15,24 @@ local Light = require "ItsyScape.Graphics.Light"
 -- Basic light Scene Node.
 local LightSceneNode = Class(SceneNode)
 
+-- The kind of node, as far as nbunny is concerned. See
+-- SceneNode.walkByKind.
+LightSceneNode.KIND = "light"
+
 function LightSceneNode:new()
 	SceneNode.new(self)
 
 	self.previousColor = false
 	self.color = Color(1, 1, 1)
 	self.isGlobal = false
+
+	self:_updateHandle()
+end
+
+-- Tells nbunny what kind of light this is. See SceneNode.walkByKind.
+function LightSceneNode:_updateHandle()
+	self._handle:setKind(self.KIND)
+	self._handle:setLight(self.isGlobal)
 end
 
 -- Gets if the light is global.
@@ -39,6 +51,8 @@ function LightSceneNode:setIsGlobal(value)
 	else
 		self.isGlobal = true
 	end
+
+	self:_updateHandle()
 end
 
 -- Gets the color of the light.
@@ -49,6 +49,9 @@ function MapMeshSceneNode:setMapMesh(mapMesh)
 	end
 
 	self.mapMesh = mapMesh or false
+	if self.mapMesh then
+		self:setBounds(self.mapMesh:getBounds())
+	end
 end
 
 function MapMeshSceneNode:draw(renderer, delta)
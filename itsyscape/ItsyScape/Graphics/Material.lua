@@ -27,6 +27,14 @@ function Material:new(node, shader, ...)
 	self.zWriteDisabled = false
 	self.color = Color(1, 1, 1, 1)
 	self.uniforms = {}
+
+	self:_updateHandle()
+end
+
+-- Tells nbunny if the node should be drawn with the translucent nodes. See
+-- SceneNode.walkByKind.
+function Material:_updateHandle()
+	self._handle:setIsTranslucent(self:getIsTranslucent() or self:getIsFullLit())
 end
 
 -- Gets the shader this Material uses.
@@ -76,6 +84,7 @@ end
 -- Defaults to 'false'.
 function Material:setIsTranslucent(value)
 	self.isTranslucent = value or false
+	self:_updateHandle()
 end
 
 -- Returns true if the Material should be fully lit, false otherwise.
@@ -85,6 +94,7 @@ end
 
 function Material:setIsFullLit(value)
 	self.isFullLit = value or false
+	self:_updateHandle()
 end
 
 -- Returns true if the Material should not write to the depth buffer, false otherwise.
@@ -102,6 +112,7 @@ end
 
 function Material:setColor(value)
 	self.color = value or self.color
+	self:_updateHandle()
 end
 
 -- Gets the number of textures.
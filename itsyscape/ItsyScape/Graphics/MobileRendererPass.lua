@@ -11,8 +11,6 @@ local Class = require "ItsyScape.Common.Class"
 local Vector = require "ItsyScape.Common.Math.Vector"
 local RendererPass = require "ItsyScape.Graphics.RendererPass"
 local Light = require "ItsyScape.Graphics.Light"
-local LightSceneNode = require "ItsyScape.Graphics.LightSceneNode"
-local FogSceneNode = require "ItsyScape.Graphics.FogSceneNode"
 local MBuffer = require "ItsyScape.Graphics.MBuffer"
 
 -- Base renderer pass type. Manages logic for a specific pass.
@@ -31,9 +29,6 @@ function MobileRendererPass:new(renderer)
 		"Resources/Renderers/Mobile/Base.frag.glsl",
 		"Resources/Renderers/Mobile/Base.vert.glsl")
 
-	self.lightTypes = {}
-	self.nodeTypes = {}
-
 	self.mBuffer = MBuffer()
 end
 
@@ -46,75 +41,35 @@ function MobileRendererPass:resize(width, height)
 end
 
 function MobileRendererPass:walk(node, delta)
-	local projection, view = self:getRenderer():getCamera():getTransforms()
-	local nodes = node:walkByMaterial(view, projection, delta, self:getRenderer():getCullEnabled())
-
-	for i = 1, #nodes do
-		local n = nodes[i]
-		local material = n:getMaterial()
-
-		if not Class.isCompatibleType(n, LightSceneNode) then
-			if material:getIsTranslucent() or material:getIsFullLit() then
-				table.insert(self.translucentNodes, n)
-			else
-				table.insert(self.opaqueNodes, n)
-			end
-		end
-	end
+	self.opaqueNodes = self:getRenderer():getOpaqueNodes()
+	self.translucentNodes = self:getRenderer():getTranslucentNodes()
 end
 
 function MobileRendererPass:walkLights(node, delta)
-	local nodeType = node:getType()
-	if self.lightTypes[nodeType] or
-	   not self.nodeTypes[nodeType] and node:isCompatibleType(LightSceneNode)
-	then
-		self.lightTypes[nodeType] = true
-		if node:isCompatibleType(FogSceneNode) then
-			table.insert(self.fog, node)
-		else
-			if node:getIsGlobal() then
-				table.insert(self.globalLights, node)
-			else
-				table.insert(self.lights, node)
-			end
-		end
-	else
-		self.nodeTypes[nodeType] = true
+	self.lightClusters = self:getRenderer():getLightClusters()
+
+	self.fog = self.lightClusters:getFog()
+	self.globalLights = self.lightClusters:getGlobalLights()
+
+	-- Point lights come from the clusters if they're enabled. Otherwise, the
+	-- nearest point lights are sent like any other light.
+	self.lights = {}
+	for _, light in ipairs(self.lightClusters:getLocalLights()) do
+		table.insert(self.lights, light)
 	end
 
-	for child in node:iterate() do
-		self:walkLights(child, delta)
+	if not self.lightClusters:getIsEnabled() then
+		for _, light in ipairs(self.lightClusters:getPointLights()) do
+			if light then
+				table.insert(self.lights, light)
+			end
+		end
 	end
 end
 
 function MobileRendererPass:beginDraw(scene, delta)
-	self.translucentNodes = {}
-	self.opaqueNodes = {}
-	self.fog = {}
-	self.lights = {}
-	self.globalLights = {}
-
 	self:walk(scene, delta)
 	self:walkLights(scene, delta)
-
-	local nodeX, nodeY, nodeZ = self:getRenderer():getCamera():getPosition():get()
-	table.sort(self.lights, function(a, b)
-		local distanceA
-		do
-			local transform = a:getTransform():getGlobalDeltaTransform(delta)
-			local x, y, z = transform:transformPoint(0, 0, 0)
-			distanceA = (x - nodeX) ^ 2 + (y - nodeY) ^ 2 + (z - nodeZ) ^ 2
-		end
-
-		local distanceB
-		do
-			local transform = b:getTransform():getGlobalDeltaTransform(delta)
-			local x, y, z = transform:transformPoint(0, 0, 0)
-			distanceB = (x - nodeX) ^ 2 + (y - nodeY) ^ 2 + (z - nodeZ) ^ 2
-		end
-
-		return distanceA < distanceB
-	end)
 end
 
 function MobileRendererPass:endDraw(scene, delta)
@@ -199,6 +154,9 @@ function MobileRendererPass:drawNodes(nodes, delta)
 				end
 
 				currentShaderProgram:send("scape_NumLights", numLights)
+				self.lightClusters:send(
+					currentShaderProgram,
+					not material:getIsFullLit() and numGlobalLights > 0)
 
 				for i = 1, numFog do
 					local f = self.fog[i]
@@ -7,8 +7,10 @@
 -- License, v. 2.0. If a copy of the MPL was not distributed with this
 -- file, You can obtain one at http://mozilla.org/MPL/2.0/.
 --------------------------------------------------------------------------------
+local ffi = require "ffi"
 local Class = require "ItsyScape.Common.Class"
 local Vector = require "ItsyScape.Common.Math.Vector"
+local NCodec = require "nbunny.codec"
 
 local Model = Class()
 function Model:new(d, skeleton)
@@ -30,6 +32,11 @@ function Model:loadFromFile(filename, skeleton)
 end
 
 function Model:bindSkeleton(skeleton)
+	if self.vertexData then
+		self:_bindSkeletonData(skeleton)
+		return
+	end
+
 	local vertices = {}
 
 	local LOVE_VERTEX_FORMAT_COUNT_INDEX = 3
@@ -94,12 +101,78 @@ function Model:bindSkeleton(skeleton)
 		self.mesh:setAttributeEnabled(element[1], true)
 	end
 
+	if self.indices then
+		self.mesh:setVertexMap(self.indices)
+	end
+
 	self.min = min
 	self.max = max
 
 	self.skeleton = skeleton or false
 end
 
+-- Like bindSkeleton, but for vertices decoded by a ResourceLoader. Bone slots
+-- are 1-based indices into self.bones (0 if empty) instead of bone names.
+function Model:_bindSkeletonData(skeleton)
+	local LOVE_VERTEX_FORMAT_COUNT_INDEX = 3
+	local LOVE_VERTEX_FORMAT_NAME_INDEX = 1
+
+	local stride = 0
+	local boneIndexOffset = 0
+	local maxBonesPerVertex = 0
+	for i = 1, #self.format do
+		if self.format[i][LOVE_VERTEX_FORMAT_NAME_INDEX] == 'VertexBoneIndex' then
+			boneIndexOffset = stride
+			maxBonesPerVertex = self.format[i][LOVE_VERTEX_FORMAT_COUNT_INDEX]
+		end
+
+		stride = stride + self.format[i][LOVE_VERTEX_FORMAT_COUNT_INDEX]
+	end
+
+	local boneIndices = {}
+	for i = 1, #self.bones do
+		if skeleton then
+			boneIndices[i] = skeleton:getBoneIndex(self.bones[i]) or 1
+		else
+			boneIndices[i] = 1
+		end
+	end
+
+	local data = self.vertexData
+	if maxBonesPerVertex > 0 then
+		data = data:clone()
+
+		local vertices = ffi.cast("float*", data:getPointer())
+		for i = 0, self.vertexCount - 1 do
+			local offset = i * stride + boneIndexOffset
+			for j = 0, maxBonesPerVertex - 1 do
+				vertices[offset + j] = boneIndices[vertices[offset + j]] or 1
+			end
+		end
+	end
+
+	if self.mesh then
+		self.mesh:release()
+	end
+
+	self.mesh = love.graphics.newMesh(self.format, self.vertexCount, 'triangles', 'static')
+	self.mesh:setVertices(data)
+	for _, element in ipairs(self.format) do
+		self.mesh:setAttributeEnabled(element[1], true)
+	end
+
+	if self.indexData then
+		self.mesh:setVertexMap(self.indexData, 'uint32')
+	end
+
+	self.skeleton = skeleton or false
+end
+
+-- Loads the model from a table, like the ones in .lmodel files.
+--
+-- If the table came from a ResourceLoader, the vertices are already in
+-- vertexData (and the vertex map in indexData, 0-based) and the bounds are in
+-- min and max.
 function Model:loadFromTable(t, skeleton)
 	local format = t.format or {
 		{ 'VertexPosition', 'float', 3 },
@@ -108,9 +181,29 @@ function Model:loadFromTable(t, skeleton)
 		{ 'VertexBoneIndex', 'float', 4 },
 		{ 'VertexBoneWeight', 'float', 4 },
 	}
+	if t.vertexData then
+		self.vertexData = t.vertexData
+		self.vertexCount = t.vertexCount
+		self.indexData = t.indexData or false
+		self.indexCount = t.indexCount or 0
+		self.bones = t.bones or {}
+		self.vertices = false
+		self.indices = false
+		self.format = format
+		self.min = t.min
+		self.max = t.max
+
+		self:bindSkeleton(skeleton)
+		return
+	end
+
 	local vertices = t.vertices or { { 0, 0, 0, 0, 0, 1, 0, 0, false, false, false, false, 0, 0, 0, 0 } }
+	if t.vertices and t.compression then
+		vertices = NCodec.decodeVertices(t.vertices, t.compression)
+	end
 
 	self.vertices = vertices
+	self.indices = t.indices or false
 	self.format = format
 
 	self:bindSkeleton(skeleton)
@@ -128,6 +221,39 @@ function Model:getMesh()
 	return self.mesh
 end
 
+-- Gets the (one-based) vertex map, if the model is indexed.
+--
+-- Returns false if the model is a plain triangle list.
+function Model:getIndices()
+	if not self.indices and self.indexData then
+		local data = ffi.cast("uint32_t*", self.indexData:getPointer())
+
+		local indices = {}
+		for i = 1, self.indexCount do
+			indices[i] = data[i - 1] + 1
+		end
+
+		self.indices = indices
+	end
+
+	return self.indices
+end
+
+-- Returns roughly how many bytes the vertices and indices take.
+function Model:getSize()
+	if not self.mesh then
+		return 0
+	end
+
+	local stride = 0
+	for i = 1, #self.format do
+		stride = stride + self.format[i][3]
+	end
+
+	local numIndices = self.indexCount or (self.indices and #self.indices) or 0
+	return (self.mesh:getVertexCount() * stride + numIndices) * 4
+end
+
 function Model:getFormat()
 	return self.format
 end
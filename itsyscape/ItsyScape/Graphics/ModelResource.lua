@@ -32,10 +32,18 @@ function ModelResource:release()
 end
 
 function ModelResource:loadFromFile(filename, _, skeleton)
-	local file = Resource.readLua(filename)
+	local file = Resource.readModel(filename)
 	self.model = Model(file, skeleton or self.skeleton)
 end
 
+function ModelResource:getSize()
+	if self.model then
+		return self.model:getSize()
+	else
+		return false
+	end
+end
+
 function ModelResource:getIsReady()
 	if self.model then
 		return true
@@ -40,6 +40,8 @@ ParticleSceneNode.MESH_DATA = {
 function ParticleSceneNode:new()
 	SceneNode.new(self)
 
+	self._handle:setKind("particles")
+
 	self:getMaterial():setShader(ParticleSceneNode.DEFAULT_SHADER)
 	self:getMaterial():setIsTranslucent(true)
 	self:getMaterial():setIsFullLit(true)
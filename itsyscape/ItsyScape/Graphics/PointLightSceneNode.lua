@@ -12,11 +12,31 @@ local Vector = require "ItsyScape.Common.Math.Vector"
 local LightSceneNode = require "ItsyScape.Graphics.LightSceneNode"
 
 local PointLightSceneNode = Class(LightSceneNode)
+PointLightSceneNode.KIND = "point"
+
+-- The radius is this times the attenuation. Past it, the light adds less
+-- than about 1/64th of its color. See PointLightSceneNode.getRadius.
+PointLightSceneNode.RADIUS_SCALE = 16
 
 function PointLightSceneNode:new()
 	LightSceneNode.new(self)
 
 	self.attenuation = 1
+	self:_updateHandle()
+end
+
+function PointLightSceneNode:_updateHandle()
+	self._handle:setKind(self.KIND)
+	self._handle:setLight(self:getIsGlobal(), self:getRadius())
+end
+
+-- Gets how far the light reaches.
+--
+-- Clustered lighting fades the light out over the last quarter of the
+-- radius.
+function PointLightSceneNode:getRadius()
+	local attenuation = math.max(self.attenuation or 1, self.previousAttenutation or 0)
+	return attenuation * PointLightSceneNode.RADIUS_SCALE
 end
 
 function PointLightSceneNode:getAttenuation()
@@ -25,6 +45,7 @@ end
 
 function PointLightSceneNode:setAttenuation(value)
 	self.attenuation = value or self.attenuation
+	self:_updateHandle()
 end
 
 function PointLightSceneNode:toLight(delta)
@@ -43,12 +64,14 @@ end
 function PointLightSceneNode:fromLight(light)
 	LightSceneNode.fromLight(self, light)
 	self.attenuation = light:getAttenuation()
+	self:_updateHandle()
 end
 
 function PointLightSceneNode:tick()
 	LightSceneNode.tick(self)
 
 	self.previousAttenutation = self.attenuation
+	self:_updateHandle()
 end
 
 return PointLightSceneNode
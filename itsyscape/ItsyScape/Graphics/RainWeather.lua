@@ -7,13 +7,13 @@
 -- License, v. 2.0. If a copy of the MPL was not distributed with this
 -- file, You can obtain one at http://mozilla.org/MPL/2.0/.
 --------------------------------------------------------------------------------
-local ffi = require "ffi"
 local Class = require "ItsyScape.Common.Class"
 local Vector = require "ItsyScape.Common.Math.Vector"
 local Color = require "ItsyScape.Graphics.Color"
 local SceneNode = require "ItsyScape.Graphics.SceneNode"
 local ShaderResource = require "ItsyScape.Graphics.ShaderResource"
 local Weather = require "ItsyScape.Graphics.Weather"
+local NRainWeather = require "nbunny.rainweather"
 
 local RainWeather = Class(Weather)
 
@@ -21,29 +21,8 @@ RainWeather.MESH_FORMAT = {
 	{ "VertexPosition", 'float', 3 }
 }
 
-RainWeather.QUAD = {
-	{ -1,  0,  0 },
-	{  1,  0,  0 },
-	{  1,  1,  0 },
-	{ -1,  0,  0 },
-	{  1,  1,  0 },
-	{ -1,  1,  0 },
-
-	{  0,  0, -1 },
-	{  0,  1, -1 },
-	{  0,  1,  1 },
-	{  0,  0, -1 },
-	{  0,  1,  1 },
-	{  0,  0,  1 }
-}
-
-ffi.cdef [[
-	typedef struct {
-		float x, y, z;
-		float length;
-		bool moving;
-	} scape_RainParticle;	
-]]
+-- Size of a vertex in MESH_FORMAT, in bytes.
+RainWeather.VERTEX_SIZE = 3 * 4
 
 RainWeather.SceneNode = Class(SceneNode)
 RainWeather.SceneNode.SHADER = ShaderResource()
@@ -104,21 +83,30 @@ function RainWeather:new(gameView, layer, map, props)
 	self.size = props.size or 1 / 32
 	self.color = Color(unpack(props.color or { 0.0, 0.6, 0.8, 0.4 }))
 
-	self.particles = ffi.new("scape_RainParticle[?]", self.heaviness)
-
-	self.vertices = {}
-	self.vertexCount = self.heaviness * 12 -- 6 per quad, 2 quads per rain streak
-	for i = 1, self.vertexCount do
-		table.insert(self.vertices, { 0, 0, 0 })
+	-- The streaks are simulated natively and written straight into the
+	-- vertex data.
+	self._handle = NRainWeather()
+	self._handle:resize(self.heaviness)
+	self._handle:setGravity(self.gravity:get())
+	self._handle:setWind(self.wind:get())
+	self._handle:setHeight(self.minHeight, self.maxHeight)
+	self._handle:setLength(self.minLength, self.maxLength)
+	self._handle:setSize(self.size)
+
+	self.vertexCount = self._handle:getVertexCount() -- 6 per quad, 2 quads per rain streak
+	if self.vertexCount > 0 then
+		self.vertices = love.data.newByteData(self.vertexCount * RainWeather.VERTEX_SIZE)
+		self.mesh = love.graphics.newMesh(
+			RainWeather.MESH_FORMAT,
+			self.vertexCount,
+			'triangles',
+			'dynamic')
+		self.mesh:setAttributeEnabled("VertexPosition", true)
+	else
+		self.vertices = false
+		self.mesh = false
 	end
 
-	self.mesh = love.graphics.newMesh(
-		RainWeather.MESH_FORMAT,
-		self.vertices,
-		'triangles',
-		'dynamic')
-	self.mesh:setAttributeEnabled("VertexPosition", true)
-
 	self.node = RainWeather.SceneNode(self)
 	self.node:setParent(gameView:getMapSceneNode(layer))
 
@@ -138,63 +126,17 @@ function RainWeather:update(delta)
 	local startI, startJ = map:getPosition()
 	local mapWidth, mapHeight = map:getSize()
 	local cellSize = map:getCellSize()
-	local velocity = (self.gravity + self.wind) * delta
-	local speed = self.gravity:getLength() * delta
-	local direction = -(self.gravity + self.wind):getNormal()
-	local size = self.size
-	local vertexIndex = 1
-	local vertices = RainWeather.QUAD
-
-	for i = 1, self.heaviness do
-		local p = self.particles + (i - 1)
-
-		if p.length <= 0 then
-			local s, t = math.random(), math.random()
-			do
-				s = s * cellSize
-				t = t * cellSize
-			end
-
-			local i, j = math.random(startI, startI + mapWidth), math.random(startJ, startJ + mapHeight)
-			local x = (i - 1) * cellSize + s
-			local y = math.random() * (self.maxHeight - self.minHeight) + self.minHeight
-			local z = (j - 1) * cellSize + t
-
-			local length = math.random() * (self.maxLength - self.minLength) + self.minLength
-
-			p.x, p.y, p.z = x, y, z
-			p.length = length
-			p.moving = true
-		else
-			if p.moving then
-				local i = math.floor(p.x / cellSize + 1)
-				local j = math.floor(p.z / cellSize + 1)
-
-				local height = math.max(map:getHeightAt(i, j), 0)
-				if p.y <= height then
-					p.moving = false
-				else
-					p.x = p.x + velocity.x
-					p.y = p.y + velocity.y
-					p.z = p.z + velocity.z
-				end
-			else
-				p.length = p.length - speed
-			end
-		end
 
-		for j = 1, #vertices do
-			local input = vertices[j]
-			local output = self.vertices[vertexIndex]
-			output[1] = input[1] * size + p.x + input[2] * direction.x * p.length
-			output[2] = input[2] * size + p.y + input[2] * direction.y * p.length
-			output[3] = input[3] * size + p.z + input[2] * direction.z * p.length
-
-			vertexIndex = vertexIndex + 1
-		end
+	if self.mesh then
+		self._handle:update(
+			map:getHandle(),
+			mapWidth,
+			mapHeight,
+			delta,
+			self.vertices:getPointer())
+		self.mesh:setVertices(self.vertices)
 	end
 
-	self.mesh:setVertices(self.vertices)
 	self.node:getTransform():setLocalTranslation(Vector(startI * cellSize, 0, startJ * cellSize))
 end
 
@@ -11,6 +11,7 @@ local Class = require "ItsyScape.Common.Class"
 local Color = require "ItsyScape.Graphics.Color"
 local DeferredRendererPass = require "ItsyScape.Graphics.DeferredRendererPass"
 local ForwardRendererPass = require "ItsyScape.Graphics.ForwardRendererPass"
+local LightClusters = require "ItsyScape.Graphics.LightClusters"
 local MobileRendererPass = require "ItsyScape.Graphics.MobileRendererPass"
 
 -- Renderer type. Manages rendering resources and logic.
@@ -20,6 +21,10 @@ function Renderer:new(isMobile)
 	self.cachedShaders = {}
 	self.currentShader = false
 
+	self.lightClusters = LightClusters(true)
+	self.opaqueNodes = {}
+	self.translucentNodes = {}
+
 	self.isMobile = isMobile
 	if self.isMobile then
 		self.mobilePass = MobileRendererPass(self)
@@ -69,7 +74,35 @@ function Renderer:clean()
 	self:releaseCachedShaders()
 end
 
+-- Walks the scene once for every pass. Lights are in the LightClusters.
+function Renderer:walk(scene, delta)
+	local projection, view = self.camera:getTransforms()
+	self.opaqueNodes, self.translucentNodes = self.lightClusters:walk(
+		scene,
+		view,
+		projection,
+		delta,
+		self.cull)
+end
+
+-- Visible nodes that aren't lights and aren't translucent, sorted by
+-- material.
+function Renderer:getOpaqueNodes()
+	return self.opaqueNodes
+end
+
+-- Visible nodes that are translucent (or full lit), sorted back to front.
+function Renderer:getTranslucentNodes()
+	return self.translucentNodes
+end
+
+function Renderer:getLightClusters()
+	return self.lightClusters
+end
+
 function Renderer:drawFinalStep(scene, delta)
+	self:walk(scene, delta)
+
 	if self.isMobile then
 		self.mobilePass:beginDraw(scene, delta)
 		self.mobilePass:draw(scene, delta)
@@ -44,49 +44,82 @@ function Resource:loadFromFile(filename, resourceManager)
 	return Class.ABSTRACT()
 end
 
-function Resource.readFile(filename)
-	if coroutine.running() then
-		love.thread.getChannel('ItsyScape.Resource.File::input'):push({
-			type = 'file',
-			filename = filename
-		})
+-- Yielded by coroutines made by Resource.newCoroutine to read a file.
+Resource.READ = setmetatable({}, { __tostring = function() return "Resource.READ" end })
+
+local asyncCoroutines = setmetatable({}, { __mode = 'k' })
 
-		coroutine.yield()
+-- Creates a coroutine where the Resource.read* functions don't block.
+--
+-- Instead of reading, the coroutine yields Resource.READ, what to read the
+-- file as (see ResourceLoader), and the filename. It should be resumed with
+-- the ResourceLoader and the ID of the read once the read is done.
+function Resource.newCoroutine(func)
+	local c = coroutine.create(func)
+	asyncCoroutines[c] = true
+
+	return c
+end
 
-		local s = love.thread.getChannel('ItsyScape.Resource.File::output'):pop()
-		while not s do
-			coroutine.yield()
-			s = love.thread.getChannel('ItsyScape.Resource.File::output'):pop()
-		end
+local function read(kind, filename)
+	local current = coroutine.running()
+	if current and asyncCoroutines[current] then
+		local loader, id = coroutine.yield(Resource.READ, kind, filename)
+		return true, loader:take(id, kind)
+	end
 
-		return s
+	return false
+end
+
+function Resource.readFile(filename)
+	local s, file = read('file', filename)
+	if s then
+		return file
 	else
 		return love.filesystem.read(filename)
 	end
 end
 
 function Resource.readLua(filename)
-	if coroutine.running() then
-		love.thread.getChannel('ItsyScape.Resource.File::input'):push({
-			type = 'lua',
-			filename = filename
-		})
-
-		coroutine.yield()
-
-		local s = love.thread.getChannel('ItsyScape.Resource.File::output'):pop()
-		while not s do
-			coroutine.yield()
-			s = love.thread.getChannel('ItsyScape.Resource.File::output'):pop()
-		end
-
-		return s
+	local s, file = read('lua', filename)
+	if s then
+		return file
 	else
 		local s = "return " .. love.filesystem.read(filename)
 		return assert(setfenv(loadstring(s), {}))()
 	end
 end
 
+-- Like Resource.readLua, but the file may come back as vertex buffers. See
+-- Model.loadFromTable.
+function Resource.readModel(filename)
+	local s, file = read('model', filename)
+	if s then
+		return file
+	else
+		return Resource.readLua(filename)
+	end
+end
+
+-- Like Resource.readLua, but the file may come back as vertex buffers. See
+-- StaticMesh.loadFromTable.
+function Resource.readStaticMesh(filename)
+	local s, file = read('staticmesh', filename)
+	if s then
+		return file
+	else
+		return Resource.readLua(filename)
+	end
+end
+
+-- Returns roughly how many bytes the resource takes, or false if unknown.
+--
+-- Only resources that know their size are kept loaded by the ResourceManager
+-- once nothing else uses them.
+function Resource:getSize()
+	return false
+end
+
 -- Returns a boolean value indicating if the resource is ready (e.g., loaded).
 function Resource:getIsReady()
 	return Class.ABSTRACT()
@@ -0,0 +1,178 @@
+--------------------------------------------------------------------------------
+-- ItsyScape/Graphics/ResourceLoader.lua
+--
+-- This file is a part of ItsyScape.
+--
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+--------------------------------------------------------------------------------
+local ffi = require "ffi"
+local Class = require "ItsyScape.Common.Class"
+local Vector = require "ItsyScape.Common.Math.Vector"
+local NResourceLoader = require "nbunny.resourceloader"
+
+-- Reads and decodes resource files on a pool of native threads. See
+-- ResourceManager.
+--
+-- Lua files (skeletons, animations, and so on) are parsed natively, so only
+-- the tables are made on the main thread. Models and static meshes are
+-- decoded straight into vertex (and index) buffers, ready for a Mesh.
+local ResourceLoader = Class()
+
+-- What to decode a file as.
+ResourceLoader.KIND_FILE        = 'file'
+ResourceLoader.KIND_LUA         = 'lua'
+ResourceLoader.KIND_MODEL       = 'model'
+ResourceLoader.KIND_STATIC_MESH = 'staticmesh'
+
+-- Size of a vertex component and of an index, in bytes.
+ResourceLoader.FLOAT_SIZE = 4
+ResourceLoader.INDEX_SIZE = 4
+
+-- If numThreads is nil or 0, uses one less than the number of cores.
+function ResourceLoader:new(numThreads)
+	self._handle = NResourceLoader(numThreads or 0)
+end
+
+-- Returns where filename really is, or nil if it's in an archive (e.g., the
+-- game is fused). Files in archives are read on the main thread.
+function ResourceLoader.getRealPath(filename)
+	if love.filesystem.isFused() then
+		return nil
+	end
+
+	local directory = love.filesystem.getRealDirectory(filename)
+	if not directory or directory:match("%.love$") or directory:match("%.zip$") then
+		return nil
+	end
+
+	return directory .. "/" .. filename
+end
+
+-- Starts reading filename as kind. Lower priorities are read first.
+--
+-- Returns the ID of the request.
+function ResourceLoader:read(kind, filename, priority)
+	local path = ResourceLoader.getRealPath(filename)
+	if path then
+		return self._handle:submit(kind, path, priority or 0)
+	else
+		local data = love.filesystem.read(filename) or ""
+		return self._handle:submitData(kind, data, priority or 0)
+	end
+end
+
+-- Does nothing if the request was already started.
+function ResourceLoader:setPriority(id, priority)
+	self._handle:setPriority(id, priority)
+end
+
+-- Returns the ID of a finished request, or nil if none are finished.
+function ResourceLoader:poll()
+	return self._handle:poll()
+end
+
+function ResourceLoader:getNumPending()
+	return self._handle:getNumPending()
+end
+
+function ResourceLoader:getNumThreads()
+	return self._handle:getNumThreads()
+end
+
+-- Decoded models and static meshes are baked into bakeCache, and baked ones
+-- are used instead of decoding again. Pass nil to stop.
+function ResourceLoader:setBakeCache(bakeCache)
+	if bakeCache then
+		self._handle:setBakeDirectory(bakeCache:getDirectory())
+	else
+		self._handle:setBakeDirectory(nil)
+	end
+end
+
+local function copy(pointer, size)
+	local data = love.data.newByteData(size)
+	ffi.copy(data:getPointer(), pointer, size)
+
+	return data
+end
+
+-- Returns the number of floats in a vertex of format.
+function ResourceLoader.getStride(format)
+	local stride = 0
+	for i = 1, #format do
+		stride = stride + format[i][3]
+	end
+
+	return stride
+end
+
+-- Copies a native mesh (with vertices and indices as pointers) into one with
+-- vertexData and indexData. See ResourceLoader.take.
+function ResourceLoader.copyMesh(mesh, stride)
+	local result = {
+		name = mesh.name,
+		vertexData = false,
+		vertexCount = mesh.vertexCount,
+		indexData = false,
+		indexCount = mesh.indexCount,
+		min = Vector(unpack(mesh.min or { 0, 0, 0 })),
+		max = Vector(unpack(mesh.max or { 0, 0, 0 }))
+	}
+
+	if mesh.vertexCount > 0 then
+		result.vertexData = copy(mesh.vertices, mesh.vertexCount * stride * ResourceLoader.FLOAT_SIZE)
+	end
+
+	if mesh.indices then
+		result.indexData = copy(mesh.indices, mesh.indexCount * ResourceLoader.INDEX_SIZE)
+	end
+
+	return result
+end
+
+-- Returns the result of a finished request and forgets the request.
+--
+-- Files are strings and Lua files are tables. Models and static meshes are
+-- tables like the ones Model and StaticMesh load from, except each mesh has
+-- vertexData, vertexCount, indexData, indexCount, min, and max instead of
+-- vertices (see Model.loadFromTable).
+--
+-- Raises an error if the file couldn't be read or decoded.
+function ResourceLoader:take(id, kind)
+	local result, isDecoded, data = self._handle:getResult(id)
+	if result == nil then
+		local e = isDecoded
+		self._handle:release(id)
+
+		-- Files with more than literals can still be loaded by Lua.
+		if data and kind ~= ResourceLoader.KIND_FILE then
+			return assert(setfenv(assert(loadstring("return " .. data)), {}))()
+		end
+
+		error(e)
+	end
+
+	if isDecoded then
+		local decoded = result
+
+		local stride = ResourceLoader.getStride(decoded.format)
+		if kind == ResourceLoader.KIND_MODEL then
+			result = ResourceLoader.copyMesh(decoded.meshes[1], stride)
+			result.bones = decoded.bones
+		else
+			result = {}
+			for i = 1, #decoded.meshes do
+				result[i] = ResourceLoader.copyMesh(decoded.meshes[i], stride)
+			end
+		end
+
+		result.format = decoded.format
+	end
+
+	self._handle:release(id)
+	return result
+end
+
+return ResourceLoader
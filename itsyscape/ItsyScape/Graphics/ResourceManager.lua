@@ -9,15 +9,45 @@
 --------------------------------------------------------------------------------
 local Callback = require "ItsyScape.Common.Callback"
 local Class = require "ItsyScape.Common.Class"
+local BakeCache = require "ItsyScape.Graphics.BakeCache"
 local Resource = require "ItsyScape.Graphics.Resource"
+local ResourceLoader = require "ItsyScape.Graphics.ResourceLoader"
+local NResourceCache = require "nbunny.resourcecache"
 
 local ResourceManager = Class()
 ResourceManager.DESKTOP_FRAME_DURATION = 1 / 30
 ResourceManager.MOBILE_FRAME_DURATION  = 1 / 10
 
+-- Most queued loads that can be running at once. Loads waiting on a read
+-- don't take any time, but each keeps a coroutine alive.
+ResourceManager.MAX_RUNNING = 32
+
+-- How many bytes of each type of resource are kept loaded after nothing else
+-- uses them. See ResourceManager.setBudget.
+ResourceManager.DESKTOP_BUDGET = 64 * 1024 * 1024
+ResourceManager.MOBILE_BUDGET  = 16 * 1024 * 1024
+
 function ResourceManager:new()
 	self.resources = {}
+	self.loading = {}
+
+	-- Queued loads and events that haven't started yet, from pendingIndex to
+	-- pendingTail.
 	self.pending = {}
+	self.pendingIndex = 1
+	self.pendingTail = 0
+
+	-- Loads and events that started but haven't finished.
+	self.running = {}
+	self.numRunningEvents = 0
+
+	-- Running loads waiting on a read, by the ID of the read.
+	self.reads = {}
+
+	self.focus = false
+	self.positions = {}
+	self.current = false
+	self.currentUpdate = 0
 
 	if _MOBILE then
 		self.frameDuration = Resource.MOBILE_FRAME_DURATION
@@ -30,8 +60,32 @@ function ResourceManager:new()
 	self.onFinish = Callback()
 	self.wasPending = false
 
-	self.fileIOThread = love.thread.newThread("ItsyScape/Graphics/Threads/Resource.lua")
-	self.fileIOThread:start()
+	self.loader = ResourceLoader()
+
+	-- Decoded models and static meshes, map chunks, and decorations are
+	-- baked here.
+	self.bakeCache = BakeCache()
+	self.loader:setBakeCache(self.bakeCache)
+
+	if _MOBILE then
+		self.cache = NResourceCache(ResourceManager.MOBILE_BUDGET)
+	else
+		self.cache = NResourceCache(ResourceManager.DESKTOP_BUDGET)
+	end
+
+	-- Resources the cache is keeping loaded, by type and filename. The weak
+	-- tables in self.resources only keep track of resources in use.
+	self.retained = {}
+	self.cacheTypes = {}
+	self.cacheTypesByID = {}
+
+	-- Resources pinned to the current area, by type and filename.
+	self.pinned = {}
+	self.pinDepth = 0
+end
+
+function ResourceManager:getBakeCache()
+	return self.bakeCache
 end
 
 -- Sets the frame duration, in seconds.
@@ -41,43 +95,306 @@ end
 
 -- Returns true if pending resources are in the queue, false otherwise.
 function ResourceManager:getIsPending()
-	return #self.pending > 0, #self.pending
+	local count = self.pendingTail - self.pendingIndex + 1 + #self.running
+	return count > 0, count
+end
+
+-- Sets where the camera is. Reads for loads queued closer to the focus go
+-- first. See ResourceManager.pushPosition.
+function ResourceManager:setFocus(position)
+	self.focus = position or false
+
+	for id, entry in pairs(self.reads) do
+		self.loader:setPriority(id, self:_getPriority(entry))
+	end
+end
+
+-- Loads queued until the matching popPosition are for something at position.
+--
+-- Loads queued by a queued load or event are for wherever the load or event
+-- was for. Loads without a position go first.
+function ResourceManager:pushPosition(position)
+	table.insert(self.positions, position)
+end
+
+function ResourceManager:popPosition()
+	table.remove(self.positions)
+end
+
+function ResourceManager:_getPosition()
+	local position = self.positions[#self.positions]
+	if position then
+		return position
+	end
+
+	if self.current then
+		return self.current.position
+	end
+
+	return false
+end
+
+function ResourceManager:_getIsPinned()
+	if self.pinDepth > 0 then
+		return true
+	end
+
+	if self.current then
+		return self.current.isPinned
+	end
+
+	return false
+end
+
+function ResourceManager:_getPriority(entry)
+	if not entry.position or not self.focus then
+		return 0
+	end
+
+	return (entry.position - self.focus):getLength()
+end
+
+function ResourceManager:_push(entry)
+	entry.position = self:_getPosition()
+	entry.isPinned = self:_getIsPinned()
+	entry.read = false
+	entry.isWaiting = false
+	entry.lastUpdate = 0
+
+	self.pendingTail = self.pendingTail + 1
+	self.pending[self.pendingTail] = entry
+end
+
+-- Starts pending entries in order. Events wait for everything before them to
+-- finish, and everything after an event waits for the event to finish.
+function ResourceManager:_start()
+	local count = 0
+	while #self.running < ResourceManager.MAX_RUNNING and self.pendingIndex <= self.pendingTail do
+		local entry = self.pending[self.pendingIndex]
+		if self.numRunningEvents > 0 or (entry.isEvent and #self.running > 0) then
+			break
+		end
+
+		self.pending[self.pendingIndex] = nil
+		self.pendingIndex = self.pendingIndex + 1
+
+		if entry.isEvent then
+			self.numRunningEvents = self.numRunningEvents + 1
+		end
+
+		table.insert(self.running, entry)
+		count = count + 1
+	end
+
+	if self.pendingIndex > self.pendingTail then
+		self.pendingIndex = 1
+		self.pendingTail = 0
+	end
+
+	return count
+end
+
+-- Returns true if the entry finished.
+function ResourceManager:_resume(entry)
+	local previous = self.current
+	self.current = entry
+
+	local s, r, kind, filename
+	if entry.read then
+		s, r, kind, filename = coroutine.resume(entry.callback, self.loader, entry.read)
+		entry.read = false
+	else
+		s, r, kind, filename = coroutine.resume(entry.callback)
+	end
+
+	self.current = previous
+	entry.lastUpdate = self.currentUpdate
+
+	if not s then
+		Log.warn("failed to resume '%s': %s", entry.filename or "event", r)
+		return true
+	end
+
+	if coroutine.status(entry.callback) == 'dead' then
+		return true
+	end
+
+	if r == Resource.READ then
+		local id = self.loader:read(kind, filename, self:_getPriority(entry))
+		self.reads[id] = entry
+		entry.isWaiting = true
+	end
+
+	return false
+end
+
+-- Sets how many bytes of resourceType are kept loaded after nothing else uses
+-- them. The least recently used resources go first.
+--
+-- Only resources that know their size (see Resource.getSize) count.
+function ResourceManager:setBudget(resourceType, bytes)
+	self.cache:setBudget(self:_getCacheType(resourceType), bytes)
+	self:_dropEvicted()
+end
+
+function ResourceManager:getBudget(resourceType)
+	return self.cache:getBudget(self:_getCacheType(resourceType))
+end
+
+-- Returns a table of hits, misses, evictions, count, bytes, pinnedBytes, and
+-- budget for resourceType.
+--
+-- A miss doesn't always mean a read: a resource the cache evicted may still be
+-- in use, in which case it's reused and kept again.
+function ResourceManager:getStats(resourceType)
+	return self.cache:getStats(self:_getCacheType(resourceType))
+end
+
+function ResourceManager:resetStats()
+	self.cache:resetStats()
+end
+
+-- Returns how many bytes of resources the cache is keeping loaded.
+function ResourceManager:getNumCachedBytes()
+	return self.cache:getNumBytes()
+end
+
+-- Resources loaded until the matching popPinned are pinned to the current
+-- area; they're never evicted until unpinArea is called.
+--
+-- Like positions, loads queued by a pinned load or event are pinned.
+function ResourceManager:pushPinned()
+	self.pinDepth = self.pinDepth + 1
+end
+
+function ResourceManager:popPinned()
+	self.pinDepth = math.max(self.pinDepth - 1, 0)
+end
+
+-- Unpins everything pinned to the current area, e.g. when leaving it.
+function ResourceManager:unpinArea()
+	for resourceType, pinnedOfType in pairs(self.pinned) do
+		local typeID = self:_getCacheType(resourceType)
+		for filename in pairs(pinnedOfType) do
+			self.cache:unpin(typeID, filename)
+		end
+	end
+
+	self.pinned = {}
+	self:_dropEvicted()
+end
+
+function ResourceManager:_getCacheType(resourceType)
+	local typeID = self.cacheTypes[resourceType]
+	if not typeID then
+		typeID = #self.cacheTypesByID
+		table.insert(self.cacheTypesByID, resourceType)
+		self.cacheTypes[resourceType] = typeID
+	end
+
+	return typeID
+end
+
+function ResourceManager:_retain(resourceType, filename, resource)
+	local size = resource:getSize()
+	if not size then
+		return
+	end
+
+	local retainedOfType = self.retained[resourceType] or {}
+	retainedOfType[filename] = resource
+	self.retained[resourceType] = retainedOfType
+
+	self.cache:put(self:_getCacheType(resourceType), filename, size)
+end
+
+function ResourceManager:_pin(resourceType, filename)
+	local pinnedOfType = self.pinned[resourceType] or {}
+	if not pinnedOfType[filename] and self.cache:pin(self:_getCacheType(resourceType), filename) then
+		pinnedOfType[filename] = true
+		self.pinned[resourceType] = pinnedOfType
+	end
+end
+
+-- Lets go of the resources the cache evicted. They stay loaded for as long as
+-- something else uses them.
+function ResourceManager:_dropEvicted()
+	local typeID, filename = self.cache:popEvicted()
+	while typeID do
+		local retainedOfType = self.retained[self.cacheTypesByID[typeID + 1]]
+		if retainedOfType then
+			retainedOfType[filename] = nil
+		end
+
+		typeID, filename = self.cache:popEvicted()
+	end
 end
 
 -- Loads async resources.
+--
+-- Files are read and decoded by a ResourceLoader; the coroutines only resume
+-- once their reads are done. Loads that yield otherwise are resumed once per
+-- update.
 function ResourceManager:update()
 	local breakTime = love.timer.getTime() + self.frameDuration
-	local currentTime
 
-	if self:getIsPending() and not self.wasPending then
-		self.onPending(self, #self.pending)
+	local isPending, pendingCount = self:getIsPending()
+	if isPending and not self.wasPending then
+		self.onPending(self, pendingCount)
 		self.wasPending = true
 	end
 
+	self.currentUpdate = self.currentUpdate + 1
+
 	local count = 0
+	local isOutOfTime = false
 	repeat
-		local top = self.pending[1]
-		if not top then
-			break
-		end
+		local id = self.loader:poll()
+		while id do
+			local entry = self.reads[id]
+			self.reads[id] = nil
+
+			entry.read = id
+			entry.isWaiting = false
 
-		local callback = top.callback
-		local status = coroutine.status(callback)
-		if status == 'suspended' then
-			coroutine.resume(callback)
-		elseif status == 'dead' then
-			table.remove(self.pending, 1)
-			count = count + 1
+			id = self.loader:poll()
 		end
 
-		currentTime = love.timer.getTime()
-	until currentTime > breakTime
+		local numResumed = self:_start()
+
+		local index = 1
+		while index <= #self.running and not isOutOfTime do
+			local entry = self.running[index]
+			if not entry.isWaiting and (entry.read or entry.lastUpdate < self.currentUpdate) then
+				numResumed = numResumed + 1
+
+				if self:_resume(entry) then
+					local last = #self.running
+					self.running[index] = self.running[last]
+					self.running[last] = nil
 
+					if entry.isEvent then
+						self.numRunningEvents = self.numRunningEvents - 1
+					end
+
+					count = count + 1
+				else
+					index = index + 1
+				end
+
+				isOutOfTime = love.timer.getTime() > breakTime
+			else
+				index = index + 1
+			end
+		end
+	until isOutOfTime or numResumed == 0
+
+	isPending, pendingCount = self:getIsPending()
 	if count > 0 then
-		self.onUpdate(count, #self.pending)
+		self.onUpdate(count, pendingCount)
 	end
 
-	if #self.pending == 0 and self.wasPending then
+	if not isPending and self.wasPending then
 		self.onFinish(self)
 		self.wasPending = false
 	end
@@ -86,14 +403,44 @@ end
 -- This actually performs the load.
 function ResourceManager:_load(resourceType, filename, ...)
 	local resourcesOfType = self.resources[resourceType] or setmetatable({}, { __mode = 'v' })
-	if not resourcesOfType[filename] then
-		local resource = resourceType()
-		resource:loadFromFile(filename, self, ...)
+	self.resources[resourceType] = resourcesOfType
+
+	local loadingOfType = self.loading[resourceType] or {}
+	self.loading[resourceType] = loadingOfType
+
+	local isCached = self.cache:get(self:_getCacheType(resourceType), filename)
+
+	-- Another queued load is reading the same file; wait for it instead.
+	while not resourcesOfType[filename] and loadingOfType[filename] and self.current do
+		coroutine.yield()
+	end
+
+	local resource = resourcesOfType[filename]
+	if not resource then
+		resource = resourceType()
+
+		loadingOfType[filename] = true
+		local s, e = pcall(resource.loadFromFile, resource, filename, self, ...)
+		loadingOfType[filename] = nil
+
+		if not s then
+			error(e, 0)
+		end
+
 		resourcesOfType[filename] = resource
-		self.resources[resourceType] = resourcesOfType
 	end
 
-	return resourcesOfType[filename]
+	if not isCached then
+		self:_retain(resourceType, filename, resource)
+	end
+
+	if self:_getIsPinned() then
+		self:_pin(resourceType, filename)
+	end
+
+	self:_dropEvicted()
+
+	return resource
 end
 
 function ResourceManager:_blockingLoad(resourceType, filename, ...)
@@ -151,7 +498,7 @@ function ResourceManager:queue(resourceType, filename, callback, ...)
 		end
 	end
 
-	table.insert(self.pending, { filename = filename, callback = coroutine.create(c) })
+	self:_push({ filename = filename, callback = Resource.newCoroutine(c) })
 end
 
 -- Queues a CacheRef.
@@ -169,7 +516,7 @@ function ResourceManager:queueEvent(callback, ...)
 		end
 	end
 
-	table.insert(self.pending, { callback = coroutine.create(c) })
+	self:_push({ callback = Resource.newCoroutine(c), isEvent = true })
 end
 
 return ResourceManager
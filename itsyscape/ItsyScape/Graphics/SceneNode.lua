@@ -156,6 +156,11 @@ function SceneNode:getTransform()
 	return self.transform
 end
 
+-- Returns the nbunny.scenenode.
+function SceneNode:getHandle()
+	return self._handle
+end
+
 function SceneNode:getMaterial()
 	return self.material
 end
@@ -203,6 +208,8 @@ function SceneNode:draw(renderer, delta)
 end
 
 function SceneNode:walkByMaterial(view, projection, delta, enableCull)
+	SceneNodeTransform.flush()
+
 	local camera = NCamera()
 	camera:setView(view:getMatrix())
 	camera:setProjection(projection:getMatrix())
@@ -216,6 +223,8 @@ function SceneNode:walkByMaterial(view, projection, delta, enableCull)
 end
 
 function SceneNode:walkByPosition(view, projection, delta, enableCull)
+	SceneNodeTransform.flush()
+
 	local camera = NCamera()
 	camera:setView(view:getMatrix())
 	camera:setProjection(projection:getMatrix())
@@ -228,4 +237,27 @@ function SceneNode:walkByPosition(view, projection, delta, enableCull)
 	return self._handle:walkByPosition(camera, delta)
 end
 
+-- Walks the nodes under this node once, splitting them by kind (see
+-- nbunny.scenenode.setKind) and collecting the lights into clusters, an
+-- nbunny.lightclusters.
+--
+-- Returns the visible opaque nodes (sorted like walkByMaterial), visible
+-- translucent nodes (farthest from the eye first), global lights, local
+-- lights, visible point lights (nearest to the eye first), and fog (nearest
+-- far distance first). See LightClusters.
+function SceneNode:walkByKind(view, projection, delta, clusters, enableCull)
+	SceneNodeTransform.flush()
+
+	local camera = NCamera()
+	camera:setView(view:getMatrix())
+	camera:setProjection(projection:getMatrix())
+	if enableCull or enableCull == nil then
+		camera:enableCull()
+	else
+		camera:disableCull()
+	end
+
+	return self._handle:walkByKind(camera, delta, clusters)
+end
+
 return SceneNode
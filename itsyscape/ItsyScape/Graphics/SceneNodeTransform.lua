@@ -7,17 +7,118 @@
 -- License, v. 2.0. If a copy of the MPL was not distributed with this
 -- file, You can obtain one at http://mozilla.org/MPL/2.0/.
 --------------------------------------------------------------------------------
+local ffi = require "ffi"
+local bit = require "bit"
 local Class = require "ItsyScape.Common.Class"
 local Vector = require "ItsyScape.Common.Math.Vector"
 local Quaternion = require "ItsyScape.Common.Math.Quaternion"
 local NSceneNodeTransform = require "nbunny.scenenodetransform"
+local NFFI = require "nbunny.ffi"
+
+-- Scratch space for matrices coming back from nbunny.
+local matrix = ffi.new("float[16]")
+
+local function setMatrix(transform)
+	transform:setMatrix(
+		matrix[0], matrix[1], matrix[2], matrix[3],
+		matrix[4], matrix[5], matrix[6], matrix[7],
+		matrix[8], matrix[9], matrix[10], matrix[11],
+		matrix[12], matrix[13], matrix[14], matrix[15])
+end
+
+local TICK                 = ffi.C.NBUNNY_SCENE_NODE_TRANSFORM_TICK
+local PREVIOUS_ROTATION    = ffi.C.NBUNNY_SCENE_NODE_TRANSFORM_PREVIOUS_ROTATION
+local PREVIOUS_SCALE       = ffi.C.NBUNNY_SCENE_NODE_TRANSFORM_PREVIOUS_SCALE
+local PREVIOUS_TRANSLATION = ffi.C.NBUNNY_SCENE_NODE_TRANSFORM_PREVIOUS_TRANSLATION
+local PREVIOUS_OFFSET      = ffi.C.NBUNNY_SCENE_NODE_TRANSFORM_PREVIOUS_OFFSET
+local CURRENT_ROTATION     = ffi.C.NBUNNY_SCENE_NODE_TRANSFORM_CURRENT_ROTATION
+local CURRENT_SCALE        = ffi.C.NBUNNY_SCENE_NODE_TRANSFORM_CURRENT_SCALE
+local CURRENT_TRANSLATION  = ffi.C.NBUNNY_SCENE_NODE_TRANSFORM_CURRENT_TRANSLATION
+local CURRENT_OFFSET       = ffi.C.NBUNNY_SCENE_NODE_TRANSFORM_CURRENT_OFFSET
+
+local PREVIOUS = bit.bor(PREVIOUS_ROTATION, PREVIOUS_SCALE, PREVIOUS_TRANSLATION, PREVIOUS_OFFSET)
+local CURRENT = bit.bor(CURRENT_ROTATION, CURRENT_SCALE, CURRENT_TRANSLATION, CURRENT_OFFSET)
+
+-- Changes to transforms are queued and sent to nbunny in one call by
+-- SceneNodeTransform.flush.
+--
+-- Each transform has at most one open update in the queue. nbunny applies an
+-- update's tick first, then previous values, then current values; if a change
+-- would have to be applied before something already in the open update, a new
+-- update is started instead.
+--
+-- The queue is flushed at the end of every frame (see main.lua) and whenever
+-- it reaches MAX_UPDATES, so it can't grow without bound when nothing reads a
+-- matrix back.
+local MAX_UPDATES = 4096
+local updates = ffi.new("nbunny_scene_node_transform_update[?]", 64)
+local updatesCapacity = 64
+local updatesCount = 0
+local updatedTransforms = {}
+
+local function flush()
+	if updatesCount == 0 then
+		return
+	end
+
+	NFFI.scene_node_transform_apply(updates, updatesCount)
+
+	for i = 1, updatesCount do
+		updatedTransforms[i]._updateIndex = false
+		updatedTransforms[i] = nil
+	end
+
+	updatesCount = 0
+end
+
+local function getUpdate(transform, field, after)
+	local index = transform._updateIndex
+	if not index or bit.band(updates[index].fields, after) ~= 0 then
+		-- Applying the queue early is safe; the order is kept.
+		if updatesCount >= MAX_UPDATES then
+			flush()
+		elseif updatesCount >= updatesCapacity then
+			local newCapacity = updatesCapacity * 2
+			local newUpdates = ffi.new("nbunny_scene_node_transform_update[?]", newCapacity)
+			ffi.copy(newUpdates, updates, ffi.sizeof("nbunny_scene_node_transform_update") * updatesCount)
+
+			updates = newUpdates
+			updatesCapacity = newCapacity
+		end
+
+		index = updatesCount
+		updatesCount = updatesCount + 1
+
+		updates[index].transform = transform._pointer
+		updates[index].fields = 0
+
+		-- Keeps the transform (and thus its nbunny handle) alive until the
+		-- next flush.
+		updatedTransforms[updatesCount] = transform
+		transform._updateIndex = index
+	end
+
+	local update = updates[index]
+	update.fields = bit.bor(update.fields, field)
+
+	return update
+end
 
 -- Represents a hierarchal transform of a SceneNode.
 local SceneNodeTransform = Class()
 
+-- Applies every queued change to the nbunny transforms.
+--
+-- This is called before any matrix is read back, but anything that reads the
+-- nbunny transforms directly (e.g., SceneNode.walkByMaterial) must call it
+-- first.
+SceneNodeTransform.flush = flush
+
 -- Constructs an identity scene transform.
 function SceneNodeTransform:new(node)
 	self._handle = node._handle:getTransform()
+	self._pointer = ffi.cast("nbunny_scene_node_transform*", self._handle:getPointer())
+	self._updateIndex = false
 	self.translation = Vector.ZERO
 	self.scale = Vector.ONE
 	self.rotation = Quaternion.IDENTITY
@@ -59,10 +160,10 @@ end
 -- Does nothing if value is nil.
 function SceneNodeTransform:setLocalTranslation(value)
 	self.translation = value or self.translation
-	self._handle:setCurrentTranslation(
-		self.translation.x,
-		self.translation.y,
-		self.translation.z)
+	local update = getUpdate(self, CURRENT_TRANSLATION, 0)
+	update.current_translation[0] = self.translation.x
+	update.current_translation[1] = self.translation.y
+	update.current_translation[2] = self.translation.z
 
 	self.isTransformDirty = true
 end
@@ -77,11 +178,11 @@ end
 -- value is expected to be a Quaternion. If nil, rotation remains unchanged.
 function SceneNodeTransform:setLocalRotation(value)
 	self.rotation = value or self.rotation
-	self._handle:setCurrentRotation(
-		self.rotation.x,
-		self.rotation.y,
-		self.rotation.z,
-		self.rotation.w)
+	local update = getUpdate(self, CURRENT_ROTATION, 0)
+	update.current_rotation[0] = self.rotation.x
+	update.current_rotation[1] = self.rotation.y
+	update.current_rotation[2] = self.rotation.z
+	update.current_rotation[3] = self.rotation.w
 
 	self.isTransformDirty = true
 end
@@ -96,10 +197,10 @@ end
 -- Does nothing if value is nil.
 function SceneNodeTransform:setLocalScale(value)
 	self.scale = value or self.scale
-	self._handle:setCurrentScale(
-		self.scale.x,
-		self.scale.y,
-		self.scale.z)
+	local update = getUpdate(self, CURRENT_SCALE, 0)
+	update.current_scale[0] = self.scale.x
+	update.current_scale[1] = self.scale.y
+	update.current_scale[2] = self.scale.z
 
 	self.isTransformDirty = true
 end
@@ -114,10 +215,10 @@ end
 -- Does nothing if value is nil.
 function SceneNodeTransform:setLocalOffset(value)
 	self.offset = value or self.offset
-	self._handle:setCurrentOffset(
-		self.offset.x,
-		self.offset.y,
-		self.offset.z)
+	local update = getUpdate(self, CURRENT_OFFSET, 0)
+	update.current_offset[0] = self.offset.x
+	update.current_offset[1] = self.offset.y
+	update.current_offset[2] = self.offset.z
 
 	self.isTransformDirty = true
 end
@@ -141,19 +242,32 @@ function SceneNodeTransform:setPreviousTransform(translation, rotation, scale, o
 	self.previousOffset = offset or self.previousOffset or false
 
 	if self.previousTranslation then
-		self._handle:setPreviousTranslation(self.previousTranslation.x, self.previousTranslation.y, self.previousTranslation.z)
+		local update = getUpdate(self, PREVIOUS_TRANSLATION, CURRENT)
+		update.previous_translation[0] = self.previousTranslation.x
+		update.previous_translation[1] = self.previousTranslation.y
+		update.previous_translation[2] = self.previousTranslation.z
 	end
 
 	if self.previousRotation then
-		self._handle:setPreviousRotation(self.previousRotation.x, self.previousRotation.y, self.previousRotation.z, self.previousRotation.w)
+		local update = getUpdate(self, PREVIOUS_ROTATION, CURRENT)
+		update.previous_rotation[0] = self.previousRotation.x
+		update.previous_rotation[1] = self.previousRotation.y
+		update.previous_rotation[2] = self.previousRotation.z
+		update.previous_rotation[3] = self.previousRotation.w
 	end
 
 	if self.previousScale then
-		self._handle:setPreviousScale(self.previousScale.x, self.previousScale.y, self.previousScale.z)
+		local update = getUpdate(self, PREVIOUS_SCALE, CURRENT)
+		update.previous_scale[0] = self.previousScale.x
+		update.previous_scale[1] = self.previousScale.y
+		update.previous_scale[2] = self.previousScale.z
 	end
 
 	if self.previousOffset then
-		self._handle:setPreviousOffset(self.previousOffset.x, self.previousOffset.y, self.previousOffset.z)
+		local update = getUpdate(self, PREVIOUS_OFFSET, CURRENT)
+		update.previous_offset[0] = self.previousOffset.x
+		update.previous_offset[1] = self.previousOffset.y
+		update.previous_offset[2] = self.previousOffset.z
 	end
 end
 
@@ -190,8 +304,12 @@ function SceneNodeTransform:scale(value)
 end
 
 function SceneNodeTransform:updateTransform()
-	self.localTransform:setMatrix(self._handle:getLocalDeltaTransform(0.0))
-	self.globalTransform:setMatrix(self._handle:getGlobalDeltaTransform(0.0))
+	SceneNodeTransform.flush()
+
+	NFFI.scene_node_transform_get_local_delta_transform(self._pointer, 0.0, matrix)
+	setMatrix(self.localTransform)
+	NFFI.scene_node_transform_get_global_delta_transform(self._pointer, 0.0, matrix)
+	setMatrix(self.globalTransform)
 	self.isTransformDirty = false
 end
 
@@ -205,7 +323,10 @@ function SceneNodeTransform:getLocalTransform()
 end
 
 function SceneNodeTransform:getLocalDeltaTransform(delta)
-	self.localDeltaTransform:setMatrix(self._handle:getLocalDeltaTransform(delta))
+	SceneNodeTransform.flush()
+
+	NFFI.scene_node_transform_get_local_delta_transform(self._pointer, delta, matrix)
+	setMatrix(self.localDeltaTransform)
 	return self.localDeltaTransform
 end
 
@@ -219,12 +340,15 @@ function SceneNodeTransform:getGlobalTransform()
 end
 
 function SceneNodeTransform:getGlobalDeltaTransform(delta)
-	self.globalDeltaTransform:setMatrix(self._handle:getGlobalDeltaTransform(delta))
+	SceneNodeTransform.flush()
+
+	NFFI.scene_node_transform_get_global_delta_transform(self._pointer, delta, matrix)
+	setMatrix(self.globalDeltaTransform)
 	return self.globalDeltaTransform
 end
 
 function SceneNodeTransform:tick()
-	self._handle:tick()
+	getUpdate(self, TICK, bit.bor(PREVIOUS, CURRENT))
 
 	self.previousRotation = self.rotation
 	self.previousScale = self.scale
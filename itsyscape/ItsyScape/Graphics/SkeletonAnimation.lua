@@ -7,10 +7,15 @@
 -- License, v. 2.0. If a copy of the MPL was not distributed with this
 -- file, You can obtain one at http://mozilla.org/MPL/2.0/.
 --------------------------------------------------------------------------------
+local ffi = require "ffi"
 local Class = require "ItsyScape.Common.Class"
 local Quaternion = require "ItsyScape.Common.Math.Quaternion"
 local Vector = require "ItsyScape.Common.Math.Vector"
+local SkeletonAnimationLibrary = require "ItsyScape.Graphics.SkeletonAnimationLibrary"
 local NSkeletonKeyFrame = require "nbunny.skeletonkeyframe"
+local NCodec = require "nbunny.codec"
+local NFFI = require "nbunny.ffi"
+local NProfiler = require "nbunny.profiler"
 
 local SkeletonAnimation = Class()
 SkeletonAnimation.KeyFrame = Class()
@@ -29,16 +34,25 @@ function SkeletonAnimation.KeyFrame:new(time, s, r, t)
 	self.translation = t or Vector(0)
 
 	self._handle = NSkeletonKeyFrame()
-	self._handle:setTime(time)
-	self._handle:setScale(self.scale.x, self.scale.y, self.scale.z)
-	self._handle:setRotation(self.rotation.x, self.rotation.y, self.rotation.z, self.rotation.w)
-	self._handle:setTranslation(self.translation.x, self.translation.y, self.translation.z)
+	self._pointer = ffi.cast("nbunny_keyframe*", self._handle:getPointer())
+	NFFI.keyframe_set_time(self._pointer, self.time)
+	NFFI.keyframe_set_scale(self._pointer, self.scale.x, self.scale.y, self.scale.z)
+	NFFI.keyframe_set_rotation(self._pointer, self.rotation.x, self.rotation.y, self.rotation.z, self.rotation.w)
+	NFFI.keyframe_set_translation(self._pointer, self.translation.x, self.translation.y, self.translation.z)
 	self._transform = love.math.newTransform()
 end
 
+-- Scratch space for matrices coming back from nbunny.
+local matrix = ffi.new("float[16]")
+
 -- Interpolates this key frame with another, storing the result in 'transform'.
 function SkeletonAnimation.KeyFrame:interpolate(other, time, transform)
-	self._transform:setMatrix(self._handle:interpolate(other._handle, time))
+	NFFI.keyframe_interpolate(self._pointer, other._pointer, time, matrix)
+	self._transform:setMatrix(
+		matrix[0], matrix[1], matrix[2], matrix[3],
+		matrix[4], matrix[5], matrix[6], matrix[7],
+		matrix[8], matrix[9], matrix[10], matrix[11],
+		matrix[12], matrix[13], matrix[14], matrix[15])
 	transform:apply(self._transform)
 
 	return transform
@@ -57,6 +71,13 @@ function SkeletonAnimation:new(d, skeleton)
 end
 
 function SkeletonAnimation:loadFromFile(filename, skeleton)
+	local libraryFilename, clipName = SkeletonAnimationLibrary.parseClipFilename(filename)
+	if libraryFilename then
+		local library = SkeletonAnimationLibrary.get(libraryFilename)
+		self:loadFromTable(library:getClipTable(clipName), skeleton)
+		return
+	end
+
 	local data = "return " .. love.filesystem.read(filename)
 	local chunk = assert(loadstring(data))
 	local result = setfenv(chunk, {})()
@@ -67,6 +88,11 @@ end
 function SkeletonAnimation:loadFromTable(t, skeleton)
 	self.bones = {}
 
+	-- Resampled animations (see goober --resample) have keys every
+	-- 1 / frameRate seconds starting at zero for every bone, so the current
+	-- key can be found directly.
+	local frameRate
+
 	local duration = 0
 	local function addFrame(boneName)
 		local boneFramesDefinition = t[boneName]
@@ -82,6 +108,14 @@ function SkeletonAnimation:loadFromTable(t, skeleton)
 		       #boneFramesDefinition.rotation == #boneFramesDefinition.scale,
 		       "Properties must have same number of frames (because NYI)")
 
+		if t[boneName] then
+			if frameRate == nil then
+				frameRate = boneFramesDefinition.frameRate or false
+			elseif frameRate ~= boneFramesDefinition.frameRate then
+				frameRate = false
+			end
+		end
+
 		local boneFrames = {}
 		local count = #boneFramesDefinition.translation
 		for i = 1, count do
@@ -91,7 +125,12 @@ function SkeletonAnimation:loadFromTable(t, skeleton)
 
 			local time = boneFramesDefinition.translation[i].time
 			local scale = Vector(unpack(boneFramesDefinition.scale[i]))
-			local rotation = Quaternion(unpack(boneFramesDefinition.rotation[i]))
+			local rotation
+			if boneFramesDefinition.rotation.encoding == "smallest3" then
+				rotation = Quaternion(NCodec.decodeQuaternion(boneFramesDefinition.rotation[i][1]))
+			else
+				rotation = Quaternion(unpack(boneFramesDefinition.rotation[i]))
+			end
 			local translation = Vector(unpack(boneFramesDefinition.translation[i]))
 
 			self.duration = math.max(self.duration, time)
@@ -117,13 +156,18 @@ function SkeletonAnimation:loadFromTable(t, skeleton)
 
 	self.skeleton = skeleton or false
 	self.duration = duration
+	self.frameRate = frameRate or false
 end
 
 function SkeletonAnimation:getDuration()
 	return self.duration
 end
 
+local COMPUTE_TRANSFORMS_SCOPE = NProfiler.getScopeID("SkeletonAnimation.computeTransforms")
+
 function SkeletonAnimation:computeTransforms(time, transforms, localOnly)
+	NFFI.profiler_begin_scope(COMPUTE_TRANSFORMS_SCOPE)
+
 	for index = 1, self.skeleton:getNumBones() do
 		self:computeTransform(time, transforms, index, localOnly)
 	end
@@ -133,6 +177,8 @@ function SkeletonAnimation:computeTransforms(time, transforms, localOnly)
 			self:applyBindPose(time, transforms, index)
 		end
 	end
+
+	NFFI.profiler_end_scope()
 end
 
 function SkeletonAnimation:computeTransform(time, transforms, index, localOnly)
@@ -161,11 +207,15 @@ function SkeletonAnimation:computeTransform(time, transforms, index, localOnly)
 	end
 
 	local currentFrameIndex = 1
-	for i = 1, #boneFrame do
-		if wrappedTime > boneFrame[i].time then
-			currentFrameIndex = i
-		else
-			break
+	if self.frameRate then
+		currentFrameIndex = math.min(math.floor(wrappedTime * self.frameRate) + 1, #boneFrame)
+	else
+		for i = 1, #boneFrame do
+			if wrappedTime > boneFrame[i].time then
+				currentFrameIndex = i
+			else
+				break
+			end
 		end
 	end
 
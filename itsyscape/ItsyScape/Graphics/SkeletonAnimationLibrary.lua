@@ -0,0 +1,144 @@
+--------------------------------------------------------------------------------
+-- ItsyScape/Graphics/SkeletonAnimationLibrary.lua
+--
+-- This file is a part of ItsyScape.
+--
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+--------------------------------------------------------------------------------
+local Class = require "ItsyScape.Common.Class"
+
+-- A set of animation clips (lanimlib) exported together by goober.
+--
+-- Clips share a single bone table and their tracks are stored back-to-back,
+-- so every clip of an actor is loaded with one read.
+--
+-- A clip can be referenced like any other animation using the filename
+-- "<library filename>#<clip name>".
+local SkeletonAnimationLibrary = Class()
+
+-- Libraries are kept once loaded; every clip of an actor comes from the same
+-- few libraries, and reading one again means parsing every clip in it.
+local libraries = {}
+
+-- Filenames of libraries being read by a coroutine (see Resource.readLua).
+local loading = {}
+
+-- Splits a clip filename ("<library>#<clip>") into the library filename and
+-- clip name.
+--
+-- Returns nil if filename doesn't reference a clip.
+function SkeletonAnimationLibrary.parseClipFilename(filename)
+	return filename:match("^(.+)#(.+)$")
+end
+
+-- Gets the library at filename, only loading it if it isn't already loaded.
+--
+-- readLua is used to read the file, if provided. Otherwise, the file is read
+-- immediately. If another coroutine is already reading the library, this waits
+-- for it instead of reading the library again.
+function SkeletonAnimationLibrary.get(filename, readLua)
+	while not libraries[filename] and loading[filename] and coroutine.running() do
+		coroutine.yield()
+	end
+
+	local library = libraries[filename]
+	if not library then
+		if readLua then
+			loading[filename] = true
+			local s, result = pcall(readLua, filename)
+			loading[filename] = nil
+
+			if not s then
+				error(result, 0)
+			end
+
+			library = SkeletonAnimationLibrary(result)
+		else
+			library = SkeletonAnimationLibrary(filename)
+		end
+
+		libraries[filename] = library
+	end
+
+	return library
+end
+
+function SkeletonAnimationLibrary:new(d)
+	self.bones = {}
+	self.tracks = {}
+	self.clips = {}
+	self.clipTables = {}
+
+	if type(d) == 'string' then
+		self:loadFromFile(d)
+	elseif type(d) == 'table' then
+		self:loadFromTable(d)
+	else
+		error(("expected table or filename (string), got %s"):format(type(d)))
+	end
+end
+
+function SkeletonAnimationLibrary:loadFromFile(filename)
+	local data = "return " .. (love.filesystem.read(filename) or "")
+	local chunk = assert(loadstring(data))
+	local result = setfenv(chunk, {})() or {}
+
+	self:loadFromTable(result)
+end
+
+function SkeletonAnimationLibrary:loadFromTable(t)
+	self.bones = t.bones or {}
+	self.tracks = t.tracks or {}
+
+	self.clips = {}
+	for _, clip in ipairs(t.clips or {}) do
+		self.clips[clip.name] = clip
+	end
+
+	self.clipTables = {}
+end
+
+function SkeletonAnimationLibrary:hasClip(name)
+	return self.clips[name] ~= nil
+end
+
+-- Iterates over the clip names in the library.
+function SkeletonAnimationLibrary:iterate()
+	local current = nil
+
+	return function()
+		current = next(self.clips, current)
+		return current
+	end
+end
+
+-- Gets the clip as a table of tracks keyed by bone name, suitable for
+-- SkeletonAnimation.loadFromTable.
+--
+-- The tracks are shared with the library, not copied.
+function SkeletonAnimationLibrary:getClipTable(name)
+	local clipTable = self.clipTables[name]
+	if clipTable then
+		return clipTable
+	end
+
+	local clip = self.clips[name]
+	if not clip then
+		error(("clip '%s' not in animation library"):format(name))
+	end
+
+	clipTable = {}
+	for index, bone in ipairs(self.bones) do
+		local track = self.tracks[clip.tracks + index - 1]
+		if track then
+			clipTable[bone] = track
+		end
+	end
+
+	self.clipTables[name] = clipTable
+	return clipTable
+end
+
+return SkeletonAnimationLibrary
@@ -9,6 +9,7 @@
 --------------------------------------------------------------------------------
 local Class = require "ItsyScape.Common.Class"
 local SkeletonAnimation = require "ItsyScape.Graphics.SkeletonAnimation"
+local SkeletonAnimationLibrary = require "ItsyScape.Graphics.SkeletonAnimationLibrary"
 local Resource = require "ItsyScape.Graphics.Resource"
 
 local SkeletonAnimationResource = Resource()
@@ -31,8 +32,14 @@ function SkeletonAnimationResource:release()
 end
 
 function SkeletonAnimationResource:loadFromFile(filename, _, skeleton)
-	local file = Resource.readLua(filename)
-	self.animation = SkeletonAnimation(file, skeleton or self.skeleton)
+	local libraryFilename, clipName = SkeletonAnimationLibrary.parseClipFilename(filename)
+	if libraryFilename then
+		local library = SkeletonAnimationLibrary.get(libraryFilename, Resource.readLua)
+		self.animation = SkeletonAnimation(library:getClipTable(clipName), skeleton or self.skeleton)
+	else
+		local file = Resource.readLua(filename)
+		self.animation = SkeletonAnimation(file, skeleton or self.skeleton)
+	end
 end
 
 function SkeletonAnimationResource:getIsReady()
@@ -40,7 +40,7 @@ function SkeletonResource:loadFromFile(filename, resourceManager)
 	self:release()
 
 	local file = Resource.readLua(filename)
-	self.skeleton = Skeleton(filename)
+	self.skeleton = Skeleton(file)
 end
 
 function SkeletonResource:getIsReady()
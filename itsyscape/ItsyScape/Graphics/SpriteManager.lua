@@ -7,8 +7,12 @@
 -- License, v. 2.0. If a copy of the MPL was not distributed with this
 -- file, You can obtain one at http://mozilla.org/MPL/2.0/.
 --------------------------------------------------------------------------------
+local ffi = require "ffi"
 local Class = require "ItsyScape.Common.Class"
 local Vector = require "ItsyScape.Common.Math.Vector"
+local SceneNodeTransform = require "ItsyScape.Graphics.SceneNodeTransform"
+local NCamera = require "nbunny.camera"
+local NSpriteProjector = require "nbunny.spriteprojector"
 
 local SpriteManager = Class()
 
@@ -18,6 +22,12 @@ function SpriteManager:new(resourceManager)
 	self.times = {}
 
 	self.nodes = {}
+
+	self._handle = NSpriteProjector()
+	self._camera = NCamera()
+	self.projection = love.math.newTransform()
+	self.view = love.math.newTransform()
+	self.position = Vector()
 end
 
 function SpriteManager:getResources()
@@ -94,32 +104,40 @@ function SpriteManager:update(delta)
 end
 
 function SpriteManager:draw(camera, delta)
-	camera:apply()
+	local width, height = love.window.getMode()
+
+	-- Same as love.graphics.project after camera:apply(), but the sprites
+	-- are projected and sorted (furthest first) in one go. See
+	-- nbunny.spriteprojector.
+	local projection, view = camera:getTransforms(self.projection, self.view)
+	self._camera:setView(view:getMatrix())
+	self._camera:setProjection(projection:getMatrix())
 
-	local positions = {}
+	SceneNodeTransform.flush()
+
+	self._handle:clear()
 	for i = 1, #self.sprites do
 		local sprite = self.sprites[i]
-		local transform = sprite:getSceneNode():getTransform():getGlobalDeltaTransform(delta)
-		local position = Vector(transform:transformPoint(0, 0, 0)) + sprite:getOffset()
-
-		positions[sprite] = Vector(love.graphics.project(position.x, position.y, position.z))
+		local offset = sprite:getOffset()
+		self._handle:add(sprite:getSceneNode():getHandle(), offset.x, offset.y, offset.z)
 	end
 
-	table.sort(self.sprites, function(a, b)
-		local i = positions[a]
-		local j = positions[b]
-		return i.z > j.z
-	end)
+	local count = self._handle:project(self._camera, delta, width, height)
+	local result = ffi.cast("float*", self._handle:getPointer())
 
-	local width, height = love.window.getMode()
 	love.graphics.setBlendMode('alpha')
 	love.graphics.origin()
 	love.graphics.ortho(width, height)
 
-	for i = 1, #self.sprites do
-		local sprite = self.sprites[i]
+	-- Sprites only read the position while drawing, so one is shared.
+	local position = self.position
+	for i = 0, count - 1 do
+		local sprite = self.sprites[result[i * 4] + 1]
 		local time = self.times[sprite]
-		local position = positions[sprite]
+
+		position.x = result[i * 4 + 1]
+		position.y = result[i * 4 + 2]
+		position.z = result[i * 4 + 3]
 
 		sprite:draw(position, time)
 	end
@@ -7,7 +7,10 @@
 -- License, v. 2.0. If a copy of the MPL was not distributed with this
 -- file, You can obtain one at http://mozilla.org/MPL/2.0/.
 --------------------------------------------------------------------------------
+local ffi = require "ffi"
 local Class = require "ItsyScape.Common.Class"
+local BakeCache = require "ItsyScape.Graphics.BakeCache"
+local NCodec = require "nbunny.codec"
 
 local StaticMesh = Class()
 StaticMesh.DEFAULT_FORMAT = {
@@ -19,6 +22,7 @@ StaticMesh.DEFAULT_FORMAT = {
 
 function StaticMesh:new(d, skeleton)
 	self.groups = {}
+	self.bakeKey = false
 
 	if type(d) == 'string' then
 		self:loadFromFile(d, skeleton)
@@ -47,8 +51,86 @@ function StaticMesh:loadFromTable(t)
 	end
 end
 
+-- Like generate, but for a group decoded by a ResourceLoader. The vertex
+-- tables are only made if needed; see StaticMesh.getVertices.
+function StaticMesh:_generateFromData(t)
+	local m = self.groups[t.name]
+	if m then
+		m.mesh:release()
+	end
+
+	m = {
+		name = t.name,
+		vertexData = t.vertexData,
+		vertexCount = t.vertexCount,
+		indexData = t.indexData or false,
+		indexCount = t.indexCount or 0,
+		vertices = false,
+		indices = false,
+		triangles = false
+	}
+
+	m.mesh = love.graphics.newMesh(self.format, t.vertexCount, 'triangles', 'static')
+	m.mesh:setVertices(t.vertexData)
+
+	self.groups[t.name] = m
+	for _, element in ipairs(self.format) do
+		m.mesh:setAttributeEnabled(element[1], true)
+	end
+
+	if m.indexData then
+		m.mesh:setVertexMap(m.indexData, 'uint32')
+	end
+
+	return true
+end
+
+function StaticMesh:_loadVertices(m)
+	if m.vertices or not m.vertexData then
+		return
+	end
+
+	local stride = 0
+	for i = 1, #self.format do
+		stride = stride + self.format[i][3]
+	end
+
+	local data = ffi.cast("float*", m.vertexData:getPointer())
+	local vertices = {}
+	for i = 1, m.vertexCount do
+		local offset = (i - 1) * stride
+
+		local vertex = {}
+		for j = 1, stride do
+			vertex[j] = data[offset + j - 1]
+		end
+
+		vertices[i] = vertex
+	end
+	m.vertices = vertices
+
+	if m.indexData then
+		local data = ffi.cast("uint32_t*", m.indexData:getPointer())
+		local indices = {}
+		for i = 1, m.indexCount do
+			indices[i] = data[i - 1] + 1
+		end
+
+		m.indices = indices
+	end
+end
+
 function StaticMesh:generate(t)
+	self.bakeKey = false
+
+	if t and t.name and t.vertexData then
+		return self:_generateFromData(t)
+	end
+
 	local vertices = t or { { 0, 0, 0, 0, 0, 1, 0, 0 } }
+	if t and t.compression then
+		vertices = NCodec.decodeVertices(t, t.compression)
+	end
 
 	if t.name then
 		local m = self.groups[t.name]
@@ -61,7 +143,9 @@ function StaticMesh:generate(t)
 
 	local m = {
 		name = t.name,
-		vertices = vertices
+		vertices = vertices,
+		indices = t.indices or false,
+		triangles = false
 	}
 
 	m.mesh = love.graphics.newMesh(self.format, vertices, 'triangles', 'static')
@@ -71,6 +155,10 @@ function StaticMesh:generate(t)
 		m.mesh:setAttributeEnabled(element[1], true)
 	end
 
+	if m.indices then
+		m.mesh:setVertexMap(m.indices)
+	end
+
 	return true
 end
 
@@ -82,8 +170,38 @@ function StaticMesh:getMesh(group)
 	return self.groups[group].mesh
 end
 
+-- Gets the vertices of the group as a triangle list.
+--
+-- If the group is indexed, the vertices are expanded (and cached) so every
+-- three vertices form a triangle.
 function StaticMesh:getVertices(group)
-	return self.groups[group].vertices
+	local m = self.groups[group]
+	self:_loadVertices(m)
+
+	if not m.indices then
+		return m.vertices
+	end
+
+	if not m.triangles then
+		local triangles = {}
+		for i = 1, #m.indices do
+			triangles[i] = m.vertices[m.indices[i]]
+		end
+
+		m.triangles = triangles
+	end
+
+	return m.triangles
+end
+
+-- Gets the unique vertices of the group and the (one-based) vertex map.
+--
+-- If the group isn't indexed, the vertex map is false.
+function StaticMesh:getIndexedVertices(group)
+	local m = self.groups[group]
+	self:_loadVertices(m)
+
+	return m.vertices, m.indices
 end
 
 function StaticMesh:iterate()
@@ -96,6 +214,68 @@ function StaticMesh:iterate()
 	end
 end
 
+-- Returns roughly how many bytes the vertices and indices of every group take.
+function StaticMesh:getSize()
+	local stride = 0
+	for i = 1, #self.format do
+		stride = stride + self.format[i][3]
+	end
+
+	local size = 0
+	for _, m in pairs(self.groups) do
+		local numIndices = m.indexCount or (m.indices and #m.indices) or 0
+		size = size + (m.mesh:getVertexCount() * stride + numIndices) * 4
+	end
+
+	return size
+end
+
+-- Returns a hash of the format and the vertices of every group, for things
+-- baked from the static mesh. See BakeCache.
+function StaticMesh:getBakeKey()
+	if self.bakeKey then
+		return self.bakeKey
+	end
+
+	local hash = BakeCache.newHash()
+	for i = 1, #self.format do
+		hash:update(unpack(self.format[i]))
+	end
+
+	local names = {}
+	for name in pairs(self.groups) do
+		table.insert(names, name)
+	end
+	table.sort(names)
+
+	for i = 1, #names do
+		local m = self.groups[names[i]]
+		hash:update(m.name)
+
+		if m.vertexData then
+			hash:update(m.vertexCount, m.vertexData:getPointer(), m.vertexData:getSize())
+			if m.indexData then
+				hash:update(m.indexCount, m.indexData:getPointer(), m.indexData:getSize())
+			else
+				hash:update(false)
+			end
+		else
+			hash:update(#m.vertices)
+			for j = 1, #m.vertices do
+				hash:update(unpack(m.vertices[j]))
+			end
+
+			hash:update(m.indices and #m.indices or false)
+			for j = 1, m.indices and #m.indices or 0 do
+				hash:update(m.indices[j])
+			end
+		end
+	end
+
+	self.bakeKey = hash:getKey()
+	return self.bakeKey
+end
+
 function StaticMesh:getFormat()
 	return self.format
 end
@@ -106,6 +286,7 @@ function StaticMesh:release()
 	end
 
 	self.groups = {}
+	self.bakeKey = false
 end
 
 return StaticMesh
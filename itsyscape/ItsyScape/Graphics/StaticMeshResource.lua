@@ -32,10 +32,18 @@ function StaticMeshResource:release()
 end
 
 function StaticMeshResource:loadFromFile(filename)
-	local file = Resource.readLua(filename)
+	local file = Resource.readStaticMesh(filename)
 	self.mesh = StaticMesh(file, self.skeleton)
 end
 
+function StaticMeshResource:getSize()
+	if self.mesh then
+		return self.mesh:getSize()
+	else
+		return false
+	end
+end
+
 function StaticMeshResource:getIsReady()
 	if self.mesh then
 		return true
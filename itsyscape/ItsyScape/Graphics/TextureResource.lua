@@ -60,6 +60,15 @@ function TextureResource:loadFromFile(filename, resourceManager)
 	self.image:setFilter('nearest', 'nearest')
 end
 
+-- Assumes 32-bit pixels.
+function TextureResource:getSize()
+	if self.image then
+		return self.image:getWidth() * self.image:getHeight() * 4
+	else
+		return false
+	end
+end
+
 function TextureResource:getIsReady()
 	if self.image then
 		return true
@@ -14,6 +14,10 @@ local WaterMesh = require "ItsyScape.World.WaterMesh"
 local ShaderResource = require "ItsyScape.Graphics.ShaderResource"
 
 local WaterMeshSceneNode = Class(SceneNode)
+
+-- Distance, in quads, from the camera before generated water gets coarser.
+WaterMeshSceneNode.LOD_DISTANCE = 64
+
 WaterMeshSceneNode.DEFAULT_SHADER = ShaderResource()
 do
 	WaterMeshSceneNode.DEFAULT_SHADER:loadFromFile("Resources/Shaders/Water")
@@ -66,14 +70,18 @@ function WaterMeshSceneNode:generate(map, i, j, w, h, y, scale, fine)
 	fine = fine or 2
 	y = y or map:getTileCenter(i + math.floor(w / 2), j + math.floor(h / 2)).y + 0.5
 
-	if self.isOwner and self.waterMesh then
-		self.waterMesh:release()
-	end
-
 	local width, height = w * fine, h * fine
 
-	self.waterMesh = WaterMesh(width, height, scale)
-	self.isOwner = true
+	-- Generating again (e.g., flooding the same water) only rebuilds the
+	-- part of the mesh that changed.
+	if self.isOwner and self.waterMesh then
+		self.waterMesh:setScale(scale)
+		self.waterMesh:resize(width, height)
+	else
+		self.waterMesh = WaterMesh(width, height, scale)
+		self.waterMesh:enableLOD(WaterMeshSceneNode.LOD_DISTANCE)
+		self.isOwner = true
+	end
 
 	local cellSize = map:getCellSize()
 	local x, z = (i - 1) * cellSize, (j - 1) * cellSize
@@ -131,6 +139,15 @@ function WaterMeshSceneNode:draw(renderer, delta)
 	end
 
 	if self.waterMesh then
+		if self.isOwner and self.waterMesh:getIsLODEnabled() then
+			local position = renderer:getCamera():getPosition()
+			local transform = self:getTransform():getGlobalDeltaTransform(delta)
+			local x, _, z = transform:inverseTransformPoint(position.x, position.y, position.z)
+
+			self.waterMesh:setFocus(x, z)
+			self.waterMesh:update()
+		end
+
 		self.waterMesh:draw()
 	end
 end
@@ -14,12 +14,46 @@ local Behavior = require "ItsyScape.Peep.Behavior"
 -- Specifies the position of a Peep.
 local PositionBehavior = Behavior("Position")
 
+-- Fields that call onMove when assigned. They're stored in _fields so
+-- assigning them always goes through __newindex.
+local FIELDS = {
+	position = true,
+	layer = true
+}
+
+function PositionBehavior._METATABLE:__index(key)
+	if FIELDS[key] then
+		return rawget(self, "_fields")[key]
+	end
+
+	return PositionBehavior[key]
+end
+
+function PositionBehavior._METATABLE:__newindex(key, value)
+	if FIELDS[key] then
+		rawget(self, "_fields")[key] = value
+
+		local onMove = rawget(self, "onMove")
+		if onMove then
+			onMove(self)
+		end
+	else
+		rawset(self, key, value)
+	end
+end
+
 -- Constructs a PositionBehavior with the provided position.
 --
 -- Values default to 0.
 function PositionBehavior:new(x, y, z)
 	Behavior.Type.new(self)
+
+	rawset(self, "_fields", {})
 	self.position = Vector(x, y, z)
+
+	-- Called with the behavior when position or layer is assigned. The
+	-- Director uses it to keep its spatial index up to date.
+	self.onMove = false
 end
 
 return PositionBehavior
@@ -20,16 +20,27 @@ local Cortex = Class()
 function Cortex:new()
 	self.peeps = setmetatable({}, { __mode = 'k' })
 	self.requirements = {}
+	self.query = false
 end
 
 -- Called when the Cortex is attached to a Director.
+--
+-- Registers the requirements as a query with the Director's archetype index.
 function Cortex:attach(director)
 	self.director = director
+
+	local behaviors = {}
+	for i = 1, #self.requirements do
+		behaviors[i] = self.requirements[i].ID
+	end
+
+	self.query = director:getArchetypeIndex():addQuery(behaviors)
 end
 
 -- Called when the Cortex is detached from the Director.
 function Cortex:detach()
 	self.director = nil
+	self.query = false
 end
 
 -- Returns the Director, or nil if not attached.
@@ -67,7 +78,7 @@ end
 function Cortex:previewPeep(peep)
 	local exists = self:hasPeep(peep)
 
-	if peep:match(unpack(self.requirements)) then
+	if self:match(peep) then
 		if not exists then
 			self:addPeep(peep)
 		end
@@ -78,6 +89,15 @@ function Cortex:previewPeep(peep)
 	end
 end
 
+-- Returns true if the Peep has every required Behavior, false otherwise.
+function Cortex:match(peep)
+	if self.query then
+		return self.director:getArchetypeIndex():match(peep:getTally(), self.query)
+	else
+		return peep:match(unpack(self.requirements))
+	end
+end
+
 -- Returns true if the Cortex has the Peep, false otherwise.
 function Cortex:hasPeep(peep)
 	return self.peeps[peep] ~= nil
@@ -100,6 +120,17 @@ function Cortex:iterate()
 	return pairs(self.peeps)
 end
 
+-- Called before any Cortex is updated.
+--
+-- Cortexes with native kernels should gather their state here and add the
+-- kernels to the scheduler (see nbunny.kernelscheduler), along with the IDs of
+-- the Behaviors the kernels read and write. The kernels are run, possibly in
+-- parallel, once every Cortex has been scheduled, and before any Cortex is
+-- updated.
+function Cortex:schedule(scheduler, delta)
+	-- Nothing.
+end
+
 -- Updates the Cortex.
 function Cortex:update()
 	-- Nothing.
@@ -8,12 +8,14 @@
 -- file, You can obtain one at http://mozilla.org/MPL/2.0/.
 --------------------------------------------------------------------------------
 
+local ffi = require "ffi"
 local Class = require "ItsyScape.Common.Class"
 local Vector = require "ItsyScape.Common.Math.Vector"
 local Cortex = require "ItsyScape.Peep.Cortex"
 local MovementBehavior = require "ItsyScape.Peep.Behaviors.MovementBehavior"
 local PositionBehavior = require "ItsyScape.Peep.Behaviors.PositionBehavior"
 local TargetTileBehavior = require "ItsyScape.Peep.Behaviors.TargetTileBehavior"
+local NMovementSolver = require "nbunny.movementsolver"
 
 local MovementCortex = Class(Cortex)
 
@@ -32,149 +34,229 @@ MovementCortex.CLAMP_EPSILON = 0.05
 -- roughly consistent no matter the ticks/second.
 MovementCortex.BASE_LINE_TICKS = 10
 
+-- Fields of a state, in the order nbunny.movementsolver expects them.
+MovementCortex.FIELD_LAYER                     = 0
+MovementCortex.FIELD_POSITION                  = 1
+MovementCortex.FIELD_ACCELERATION              = 4
+MovementCortex.FIELD_VELOCITY                  = 7
+MovementCortex.FIELD_ADDITIONAL_ACCELERATION   = 10
+MovementCortex.FIELD_ADDITIONAL_VELOCITY       = 13
+MovementCortex.FIELD_MAX_SPEED                 = 16
+MovementCortex.FIELD_MAX_ACCELERATION          = 17
+MovementCortex.FIELD_VELOCITY_MULTIPLIER       = 18
+MovementCortex.FIELD_ACCELERATION_MULTIPLIER   = 19
+MovementCortex.FIELD_BOUNCE                    = 20
+MovementCortex.FIELD_BOUNCE_THRESHOLD          = 21
+MovementCortex.FIELD_DECAY                     = 22
+MovementCortex.FIELD_STOPPING_FORCE            = 23
+MovementCortex.FIELD_MAX_STEP_HEIGHT           = 24
+MovementCortex.FIELD_FACING                    = 25
+MovementCortex.FIELD_TARGET_FACING             = 26
+MovementCortex.FIELD_IS_ON_GROUND              = 27
+MovementCortex.FIELD_IS_STOPPING               = 28
+MovementCortex.FIELD_IS_CHANGED                = 29
+MovementCortex.NUM_FIELDS                      = 30
+
 function MovementCortex:new()
 	Cortex.new(self)
 
 	self:require(MovementBehavior)
 	self:require(PositionBehavior)
+
+	self.solver = NMovementSolver()
+	self.solverPeeps = {}
+	self.solverPeepsCount = 0
+	self.behaviors = { MovementBehavior.ID, PositionBehavior.ID }
+	self.packedMaps = {}
 end
 
--- Clamps vector following rules of MovementCortex.CLAMP_EPSILON.
-local function clampVector(v)
-	if math.abs(v.x) < MovementCortex.CLAMP_EPSILON then
-		v.x = 0
+-- Packs the map into the solver, if it changed since it was last packed.
+--
+-- Maps are packed again if the Map for the layer is a different one, if the
+-- Map was modified (see Map.invalidate), or if the flags of any of its tiles
+-- changed.
+function MovementCortex:packMap(layer, map)
+	local revision = map:getRevision()
+	local flagsRevision = map:getFlagsRevision()
+
+	local packed = self.packedMaps[layer]
+	if packed and
+	   packed.map == map and
+	   packed.revision == revision and
+	   packed.flagsRevision == flagsRevision
+	then
+		return
 	end
 
-	if math.abs(v.y) < MovementCortex.CLAMP_EPSILON then
-		v.y = 0
+	local width, height = map:getWidth(), map:getHeight()
+	self.solver:setMap(layer, width, height, map:getCellSize())
+
+	for j = 1, height do
+		for i = 1, width do
+			local tile = map:getTile(i, j)
+
+			local flags = 0
+			if tile:hasFlag('impassable') then
+				flags = flags + NMovementSolver.FLAG_IMPASSABLE
+			end
+
+			if tile:hasFlag('door') then
+				flags = flags + NMovementSolver.FLAG_DOOR
+			end
+
+			self.solver:setTile(
+				layer, i, j,
+				tile.topLeft, tile.topRight, tile.bottomLeft, tile.bottomRight,
+				flags)
+		end
 	end
 
-	if math.abs(v.z) < MovementCortex.CLAMP_EPSILON then
-		v.z = 0
+	self.packedMaps[layer] = {
+		map = map,
+		revision = revision,
+		flagsRevision = flagsRevision
+	}
+end
+
+-- Forgets the maps of layers that were unloaded (or given a different Map).
+function MovementCortex:removeUnloadedMaps()
+	local director = self:getDirector()
+	for layer, packed in pairs(self.packedMaps) do
+		if director:getMap(layer) ~= packed.map then
+			self.solver:removeMap(layer)
+			self.packedMaps[layer] = nil
+		end
 	end
 end
 
-function MovementCortex:update(delta)
-	local game = self:getDirector():getGameInstance()
+function MovementCortex:schedule(scheduler, delta)
+	local director = self:getDirector()
+	local game = director:getGameInstance()
 	local gravity = game:getStage():getGravity()
-	local map = game:getStage():getMap()
 
 	local multiplier = 1 + (game:getTicks() - 10) / 200
 
+	self:removeUnloadedMaps()
+
+	local peeps = self.solverPeeps
+	local count = 0
 	for peep in self:iterate() do
-		local movement = peep:getBehavior(MovementBehavior)
 		local position = peep:getBehavior(PositionBehavior)
-		local size = peep:getBehavior(SizeBehavior)
-		local map = self:getDirector():getMap(position.layer or 1)
+		local layer = position.layer or 1
+		local map = director:getMap(layer)
 		if map then
-			movement:clampMovement()
+			self:packMap(layer, map)
+
+			count = count + 1
+			peeps[count] = peep
+		end
+	end
 
-			movement.acceleration = movement.acceleration + movement.acceleration * delta + gravity
-			clampVector(movement.acceleration)
+	local solver = self.solver
+	solver:resize(count)
 
-			local wasMoving
-			do
-				local xzVelocity = movement.velocity * Vector(1, 0, 1)
-				if xzVelocity:getLengthSquared() > 0 then
-					wasMoving = true
-				end
-			end
+	local states = ffi.cast("double*", solver:getStatesPointer())
+	local index = 0
+	for i = 1, count do
+		local peep = peeps[i]
+		local movement = peep:getBehavior(MovementBehavior)
+		local position = peep:getBehavior(PositionBehavior)
 
-			local acceleration = movement.acceleration * delta * movement.accelerationMultiplier + movement.additionalAcceleration
-			movement.velocity = movement.velocity + acceleration * multiplier
-			clampVector(movement.velocity)
-
-			do
-				local xzVelocity = movement.velocity * Vector(1, 0, 1)
-				if xzVelocity:getLengthSquared() == 0 and movement.isOnGround then
-					movement.isStopping = false
-					if wasMoving and movement.targetFacing then
-						movement.facing = movement.targetFacing
-						movement.targetFacing = false
-					end
-				end
-			end
+		local p = position.position
+		local a = movement.acceleration
+		local v = movement.velocity
+		local aa = movement.additionalAcceleration
+		local av = movement.additionalVelocity
 
-			local oldPosition = position.position
-			local oldTile, oldI, oldJ = map:getTileAt(oldPosition.x, oldPosition.z)
-
-			local velocity = (movement.velocity + movement.additionalVelocity) * delta * movement.velocityMultiplier
-			position.position = position.position + velocity * multiplier
-
-			local newTile, newI, newJ = map:getTileAt(position.position.x, position.position.z)
-
-			movement.acceleration = movement.acceleration * 1 / (1 + movement.decay * 8 * delta)
-			movement.velocity = movement.velocity * 1 / (1 + movement.decay * 8 * delta)
-
-			if newTile:hasFlag('impassable') or
-			   newTile:hasFlag('door') or
-			   not map:canMove(oldI, oldJ, newI - oldI, newJ - oldJ) or
-			   map:isOutOfBounds(position.position.x, position.position.z)
-			then
-				local difference = (oldPosition - position.position):getNormal()
-				local reflectionX, reflectionZ = map:snapToTile(
-					position.position.x, position.position.z,
-					oldPosition.x, oldPosition.z)
-				local snappedX = reflectionX + position.position.x
-				local snappedZ = reflectionZ + position.position.z
-				local snappedTile = map:getTileAt(snappedX, snappedZ)
-
-				if not snappedTile:getIsPassable() or map:isOutOfBounds(snappedX, snappedZ) then
-					position.position = Vector(oldPosition:get())
-				else
-					position.position = Vector(snappedX, position.position.y, snappedZ)
-				end
-			end
+		states[index + MovementCortex.FIELD_LAYER] = position.layer or 1
+		states[index + MovementCortex.FIELD_POSITION + 0] = p.x
+		states[index + MovementCortex.FIELD_POSITION + 1] = p.y
+		states[index + MovementCortex.FIELD_POSITION + 2] = p.z
+		states[index + MovementCortex.FIELD_ACCELERATION + 0] = a.x
+		states[index + MovementCortex.FIELD_ACCELERATION + 1] = a.y
+		states[index + MovementCortex.FIELD_ACCELERATION + 2] = a.z
+		states[index + MovementCortex.FIELD_VELOCITY + 0] = v.x
+		states[index + MovementCortex.FIELD_VELOCITY + 1] = v.y
+		states[index + MovementCortex.FIELD_VELOCITY + 2] = v.z
+		states[index + MovementCortex.FIELD_ADDITIONAL_ACCELERATION + 0] = aa.x
+		states[index + MovementCortex.FIELD_ADDITIONAL_ACCELERATION + 1] = aa.y
+		states[index + MovementCortex.FIELD_ADDITIONAL_ACCELERATION + 2] = aa.z
+		states[index + MovementCortex.FIELD_ADDITIONAL_VELOCITY + 0] = av.x
+		states[index + MovementCortex.FIELD_ADDITIONAL_VELOCITY + 1] = av.y
+		states[index + MovementCortex.FIELD_ADDITIONAL_VELOCITY + 2] = av.z
+		states[index + MovementCortex.FIELD_MAX_SPEED] = movement.maxSpeed
+		states[index + MovementCortex.FIELD_MAX_ACCELERATION] = movement.maxAcceleration
+		states[index + MovementCortex.FIELD_VELOCITY_MULTIPLIER] = movement.velocityMultiplier
+		states[index + MovementCortex.FIELD_ACCELERATION_MULTIPLIER] = movement.accelerationMultiplier
+		states[index + MovementCortex.FIELD_BOUNCE] = movement.bounce
+		states[index + MovementCortex.FIELD_BOUNCE_THRESHOLD] = movement.bounceThreshold
+		states[index + MovementCortex.FIELD_DECAY] = movement.decay
+		states[index + MovementCortex.FIELD_STOPPING_FORCE] = movement.stoppingForce
+		states[index + MovementCortex.FIELD_MAX_STEP_HEIGHT] = movement.maxStepHeight
+		states[index + MovementCortex.FIELD_FACING] = movement.facing
+		states[index + MovementCortex.FIELD_TARGET_FACING] = movement.targetFacing or 0
+		states[index + MovementCortex.FIELD_IS_ON_GROUND] = movement.isOnGround and 1 or 0
+		states[index + MovementCortex.FIELD_IS_STOPPING] = movement.isStopping and 1 or 0
+		states[index + MovementCortex.FIELD_IS_CHANGED] = 0
 
-			local y = map:getInterpolatedHeight(
-				position.position.x,
-				position.position.z)
-			if position.position.y < y then
-				if movement.bounce > 0 then
-					movement.acceleration.y = -movement.acceleration.y * movement.bounce
-					movement.velocity.y = -movement.velocity.y * movement.bounce
-					position.position.y = y
-
-					if movement.velocity.y < movement.bounceThreshold then
-						movement.acceleration.y = 0
-						movement.velocity.y = 0
-						movement.isOnGround = true
-					else
-						movement.isOnGround = false
-					end
-				elseif not movement.isOnGround then
-					movement.isOnGround = true
-				end
-			elseif position.position.y > y + MovementCortex.GROUND_EPSILON
-			       and movement.isOnGround
-			then
-				movement.isOnGround = false
-			end
+		index = index + MovementCortex.NUM_FIELDS
+	end
 
-			if movement.isOnGround then
-				position.position.y = y
-				movement.acceleration.y = 0
-				movement.velocity.y = 0
+	solver:setParameters(
+		gravity.x, gravity.y, gravity.z,
+		delta,
+		multiplier,
+		MovementCortex.GROUND_EPSILON,
+		MovementCortex.CLAMP_EPSILON)
 
-				if movement.isStopping then
-					movement.acceleration = movement.acceleration * movement.decay ^ movement.stoppingForce
-					movement.velocity = movement.velocity * movement.decay ^ movement.stoppingForce
-				end
-			else
-				position.position.y = math.max(position.position.y, y)
-			end
+	scheduler:add(solver, self.behaviors, self.behaviors)
+	self.solverPeepsCount = count
+end
+
+function MovementCortex:update(delta)
+	local peeps = self.solverPeeps
+	local count = self.solverPeepsCount
+
+	local states = ffi.cast("double*", self.solver:getStatesPointer())
+	local index = 0
+	for i = 1, count do
+		local peep = peeps[i]
+		if states[index + MovementCortex.FIELD_IS_CHANGED] ~= 0 then
+			local movement = peep:getBehavior(MovementBehavior)
+			local position = peep:getBehavior(PositionBehavior)
+
+			local px = states[index + MovementCortex.FIELD_POSITION + 0]
+			local py = states[index + MovementCortex.FIELD_POSITION + 1]
+			local pz = states[index + MovementCortex.FIELD_POSITION + 2]
 
-			local stepY = position.position.y - oldPosition.y 
-			if stepY > movement.maxStepHeight then
-				position.position = oldPosition
+			local p = position.position
+			if p.x ~= px or p.y ~= py or p.z ~= pz then
+				position.position = Vector(px, py, pz)
 			end
 
-			if movement.velocity.x < -0.5 then
-				movement.facing = MovementBehavior.FACING_LEFT
-			elseif movement.velocity.x > 0.5 then
-				movement.facing = MovementBehavior.FACING_RIGHT
+			movement.acceleration = Vector(
+				states[index + MovementCortex.FIELD_ACCELERATION + 0],
+				states[index + MovementCortex.FIELD_ACCELERATION + 1],
+				states[index + MovementCortex.FIELD_ACCELERATION + 2])
+			movement.velocity = Vector(
+				states[index + MovementCortex.FIELD_VELOCITY + 0],
+				states[index + MovementCortex.FIELD_VELOCITY + 1],
+				states[index + MovementCortex.FIELD_VELOCITY + 2])
+			movement.facing = states[index + MovementCortex.FIELD_FACING]
+
+			local targetFacing = states[index + MovementCortex.FIELD_TARGET_FACING]
+			if targetFacing ~= 0 then
+				movement.targetFacing = targetFacing
+			else
+				movement.targetFacing = false
 			end
+
+			movement.isOnGround = states[index + MovementCortex.FIELD_IS_ON_GROUND] ~= 0
+			movement.isStopping = states[index + MovementCortex.FIELD_IS_STOPPING] ~= 0
 		end
+
+		peeps[i] = nil
+		index = index + MovementCortex.NUM_FIELDS
 	end
 end
 
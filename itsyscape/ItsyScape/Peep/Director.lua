@@ -9,6 +9,10 @@
 --------------------------------------------------------------------------------
 local Class = require "ItsyScape.Common.Class"
 local Peep = require "ItsyScape.Peep.Peep"
+local PositionBehavior = require "ItsyScape.Peep.Behaviors.PositionBehavior"
+local NArchetypeIndex = require "nbunny.archetypeindex"
+local NKernelScheduler = require "nbunny.kernelscheduler"
+local NSpatialIndex = require "nbunny.spatialindex"
 
 -- Director type.
 --
@@ -26,11 +30,34 @@ function Director:new(gameDB)
 	self.oldPeeps = {}
 	self._previewPeep = function(peep, behavior)
 		self.pendingPeeps[peep] = true
+
+		if peep:getBehavior(behavior.id) == behavior then
+			self.archetypeIndex:addComponent(peep:getTally(), behavior.id)
+		else
+			self.archetypeIndex:removeComponent(peep:getTally(), behavior.id)
+		end
+
+		if behavior:isType(PositionBehavior) then
+			self:trackPosition(peep)
+		end
+	end
+	self._movePeep = function(position)
+		local peep = self.peepsByPosition[position]
+		if peep then
+			self:indexPeep(peep)
+		end
 	end
 
 	self.maps = {}
 	self.peepsByLayer = {}
 
+	self.archetypeIndex = NArchetypeIndex()
+	self.kernelScheduler = NKernelScheduler()
+	self.spatialIndex = NSpatialIndex()
+	self.peepsByPosition = {}
+	self.positionsByPeep = {}
+	self.peepsByTally = {}
+
 	self.pendingAssignment = {}
 end
 
@@ -42,6 +69,13 @@ end
 -- Sets the map for the specified layer.
 function Director:setMap(layer, map)
 	self.maps[layer] = map
+
+	-- Tiles depend on the map.
+	for peep, position in pairs(self.positionsByPeep) do
+		if (position.layer or 1) == layer then
+			self:indexPeep(peep)
+		end
+	end
 end
 
 -- Gets the map for the specified layer.
@@ -49,6 +83,21 @@ function Director:getMap(layer)
 	return self.maps[layer]
 end
 
+-- Gets the index that groups Peeps (by tally) by which Behaviors (by ID) they
+-- have. It only tracks membership; Behaviors are still stored on the Peeps.
+--
+-- Cortexes query the index to find the Peeps they're interested in.
+function Director:getArchetypeIndex()
+	return self.archetypeIndex
+end
+
+-- Gets the Peep with the provided tally.
+--
+-- Only returns Peeps that have been assigned.
+function Director:getPeepByTally(tally)
+	return self.peepsByTally[tally]
+end
+
 -- Gets the game instance (i.e., ItsyScape.Game.Model.Game).
 --
 -- If not implemented, returns nil.
@@ -118,6 +167,18 @@ function Director:addPeep(key, peepType, ...)
 	peep.onBehaviorAdded:register(self._previewPeep)
 	peep.onBehaviorRemoved:register(self._previewPeep)
 
+	do
+		-- Behaviors added by the constructor.
+		local behaviors = {}
+		for id in pairs(peep.behaviors) do
+			table.insert(behaviors, id)
+		end
+
+		self.archetypeIndex:setComponents(peep:getTally(), behaviors)
+	end
+
+	self:trackPosition(peep)
+
 	self.newPeeps[peep] = { key = key }
 	self.pendingPeeps[peep] = true
 
@@ -169,6 +230,100 @@ function Director:removeLayer(key)
 	end
 end
 
+-- Re-indexes the Peep whenever its PositionBehavior is moved (see
+-- PositionBehavior.onMove), so the spatial index is never stale.
+--
+-- Called when the Peep is added and when its PositionBehavior is added or
+-- removed.
+function Director:trackPosition(peep)
+	local previousPosition = self.positionsByPeep[peep]
+	local position = peep:getBehavior(PositionBehavior)
+	if previousPosition ~= position then
+		self:untrackPosition(peep)
+
+		if position then
+			position.onMove = self._movePeep
+			self.peepsByPosition[position] = peep
+			self.positionsByPeep[peep] = position
+		end
+	end
+
+	self:indexPeep(peep)
+end
+
+-- Stops tracking the Peep's position and removes it from the spatial index.
+function Director:untrackPosition(peep)
+	local position = self.positionsByPeep[peep]
+	if position then
+		position.onMove = false
+		self.peepsByPosition[position] = nil
+		self.positionsByPeep[peep] = nil
+	end
+
+	self.spatialIndex:remove(peep:getTally())
+end
+
+-- Updates the tile of the Peep in the spatial index.
+--
+-- This mirrors Utility.Peep.getTile.
+function Director:indexPeep(peep)
+	local position = peep:getBehavior(PositionBehavior)
+	if not position then
+		self.spatialIndex:remove(peep:getTally())
+		return
+	end
+
+	local layer = position.layer or 1
+	local map = self.maps[layer]
+	local i, j
+	if map then
+		local p = position.position
+		local _
+		_, i, j = map:getTileAt(p.x, p.z)
+	else
+		i, j = 0, 0
+	end
+
+	self.spatialIndex:update(peep:getTally(), layer, i, j)
+end
+
+-- Returns the Peeps that may match a spatial filter (e.g., Probe.near) in
+-- args, or nil if there's none or searching every Peep would be as fast.
+--
+-- A spatial filter is a callable table with a 'distance' field (in tiles)
+-- and a getTile method that returns the tile (i, j) to search around.
+function Director:getSpatialCandidates(args, peeps)
+	for i = 1, args.n do
+		local filter = args[i]
+		if type(filter) == 'table' and filter.distance then
+			local distance = filter.distance
+			local width = distance * 2 + 1
+			if width * width >= self.spatialIndex:getCount() then
+				return nil
+			end
+
+			local s, t = filter:getTile()
+			local tallies = self.spatialIndex:queryNear(nil, s, t, distance)
+			local result = {}
+			for index = 1, #tallies do
+				local peep = self.peepsByTally[tallies[index]]
+				if peep and peeps[peep] then
+					result[peep] = true
+				end
+			end
+
+			return result
+		end
+	end
+
+	return nil
+end
+
+-- Returns all Peeps that match the filters.
+--
+-- If the first argument is a string, only Peeps on that layer are probed.
+-- Otherwise, every Peep is probed. Filters that provide a position (e.g.,
+-- Probe.near) only consider Peeps in nearby tiles.
 function Director:probe(...)
 	local peeps
 	do
@@ -182,6 +337,7 @@ function Director:probe(...)
 
 
 	local args = { n = select('#', ...), ... }
+	peeps = self:getSpatialCandidates(args, peeps) or peeps
 
 	local result = {}
 	for peep in pairs(peeps) do
@@ -220,12 +376,14 @@ end
 --
 -- First updates Peeps.
 --
--- Then each Cortex, in the order they were added, is updated.
+-- Then each Cortex schedules its native kernels, which are run together. Then
+-- each Cortex, in the order they were added, is updated.
 function Director:update(delta)
 	for peep, info in pairs(self.newPeeps) do
 		self:assignPeep(peep)
 
 		self.peeps[peep] = info
+		self.peepsByTally[peep:getTally()] = peep
 	end
 	self.newPeeps = {}
 
@@ -247,6 +405,9 @@ function Director:update(delta)
 		peep:poof()
 
 		self.peeps[peep] = nil
+		self.peepsByTally[peep:getTally()] = nil
+		self:untrackPosition(peep)
+		self.archetypeIndex:remove(peep:getTally())
 	end
 	self.oldPeeps = {}
 
@@ -261,6 +422,11 @@ function Director:update(delta)
 		peep:preUpdate(self, self:getGameInstance())
 	end
 
+	for _, cortex in ipairs(self.cortexes) do
+		cortex:schedule(self.kernelScheduler, delta)
+	end
+	self.kernelScheduler:run()
+
 	for _, cortex in pairs(self.cortexes) do
 		cortex:update(delta)
 	end
@@ -19,26 +19,40 @@ function Probe.none()
 	end
 end
 
+-- Returned by Probe.near.
+--
+-- The prober's tile is looked up each time the filter is used, so a filter
+-- can be kept and reused while the prober moves. The Director uses getTile
+-- and distance to only probe Peeps in nearby tiles.
+local NearFilter = {}
+NearFilter.__index = NearFilter
+
+function NearFilter:getTile()
+	return Utility.Peep.getTile(self.peep)
+end
+
+function NearFilter:__call(other)
+	local p = other:getBehavior(PositionBehavior)
+	if p then
+		local s, t = self:getTile()
+		local i, j = Utility.Peep.getTile(other)
+		local u = math.abs(s - i)
+		local v = math.abs(t - j)
+		local difference = u + v
+		if difference <= self.distance then
+			return true
+		end
+	end
+
+	return false
+end
+
 function Probe.near(peep, distance)
 	local position = peep:getBehavior(PositionBehavior)
 	if not position then
 		return Probe.none()
 	else
-		return function(other)
-			local p = other:getBehavior(PositionBehavior)
-			if p then
-				local s, t = Utility.Peep.getTile(peep)
-				local i, j = Utility.Peep.getTile(other)
-				local u = math.abs(s - i)
-				local v = math.abs(t - j)
-				local difference = u + v
-				if difference <= distance then
-					return true
-				end
-			end
-
-			return false
-		end
+		return setmetatable({ peep = peep, distance = distance }, NearFilter)
 	end
 end
 
@@ -60,6 +60,7 @@ function FlattenMapMotion:perform(e, distance)
 		tile.topRight = func(min, tile.topRight)
 		tile.bottomLeft = func(min, tile.bottomLeft)
 		tile.bottomRight = func(min, tile.bottomRight)
+		self:markDirty(i, j)
 	end)
 end
 
@@ -53,6 +53,7 @@ function HillMapMotion:perform(e, distance)
 	tile.topRight = func(min, tile.topRight)
 	tile.bottomLeft = func(min, tile.bottomLeft)
 	tile.bottomRight = func(min, tile.bottomRight)
+	self:markDirty(i, j)
 
 	if min == tile.topRight and min == tile.topRight and
 	   min == tile.bottomLeft and min == tile.bottomRight or true
@@ -109,6 +110,7 @@ function HillMapMotion:raiseCorner(x, y, func, elevation)
 		local tile = map:getTile(i, j)
 		local e = tile:getCorner(s, t)
 		tile:setCorner(s, t, func(elevation, e))
+		self:markDirty(i, j)
 	end
 end
 
@@ -31,12 +31,98 @@ function Map:new(width, height, cellSize)
 	self.height = height
 	self.cellSize = cellSize
 
+	-- Shared with the tiles; see Map.getRevision and Map.getFlagsRevision.
+	self.revisions = { map = 0, flags = 0 }
+
+	-- Rectangles passed to Map.invalidate, oldest first; see
+	-- Map.getDirtyTiles.
+	self.dirtyTiles = {}
+	self.dirtyTilesRevision = 0
+
 	self.tiles = {}
 	for j = 1, height do
 		for i = 1, width do
-			self.tiles[j * self.width + i] = Tile()
+			self.tiles[j * self.width + i] = Tile(self.revisions)
+		end
+	end
+end
+
+-- Returns the revision of the map. Incremented by Map.invalidate.
+function Map:getRevision()
+	return self.revisions.map
+end
+
+-- Returns the revision of the flags of the tiles of the map.
+--
+-- If the revision is the same as a previous call, no Tile's flags (and thus
+-- passability) have changed since.
+function Map:getFlagsRevision()
+	return self.revisions.flags
+end
+
+-- How many calls to Map.invalidate Map.getDirtyTiles remembers.
+Map.MAX_DIRTY_TILES = 32
+
+-- Marks the map as modified, e.g. after heights were changed in place.
+--
+-- If left, right, top, and bottom are provided, only the tiles in that
+-- (inclusive) rectangle changed. Otherwise, the whole map did.
+--
+-- Called by Stage.updateMap.
+function Map:invalidate(left, right, top, bottom)
+	self.revisions.map = self.revisions.map + 1
+
+	if left and right and top and bottom then
+		table.insert(self.dirtyTiles, {
+			revision = self.revisions.map,
+			left = math.max(math.min(left, right), 1),
+			right = math.min(math.max(left, right), self.width),
+			top = math.max(math.min(top, bottom), 1),
+			bottom = math.min(math.max(top, bottom), self.height)
+		})
+
+		if #self.dirtyTiles > Map.MAX_DIRTY_TILES then
+			local oldest = table.remove(self.dirtyTiles, 1)
+			self.dirtyTilesRevision = oldest.revision
 		end
+	else
+		self.dirtyTiles = {}
+		self.dirtyTilesRevision = self.revisions.map
+	end
+end
+
+-- Returns the rectangle (left, right, top, bottom) of tiles that changed
+-- since revision, or nil if none did.
+--
+-- If the map doesn't remember back that far (or the whole map was
+-- invalidated since), returns the whole map.
+function Map:getDirtyTiles(revision)
+	if revision >= self.revisions.map then
+		return nil
+	end
+
+	if revision < self.dirtyTilesRevision then
+		return 1, self.width, 1, self.height
 	end
+
+	local left, right, top, bottom = self.width, 1, self.height, 1
+	for i = #self.dirtyTiles, 1, -1 do
+		local dirty = self.dirtyTiles[i]
+		if dirty.revision <= revision then
+			break
+		end
+
+		left = math.min(left, dirty.left)
+		right = math.max(right, dirty.right)
+		top = math.min(top, dirty.top)
+		bottom = math.max(bottom, dirty.bottom)
+	end
+
+	if left > right or top > bottom then
+		return nil
+	end
+
+	return left, right, top, bottom
 end
 
 function Map:getWidth()
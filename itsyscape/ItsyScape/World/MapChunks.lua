@@ -0,0 +1,206 @@
+--------------------------------------------------------------------------------
+-- ItsyScape/World/MapChunks.lua
+--
+-- This file is a part of ItsyScape.
+--
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+--------------------------------------------------------------------------------
+local ffi = require "ffi"
+local Class = require "ItsyScape.Common.Class"
+local MapLODMesh = require "ItsyScape.World.MapLODMesh"
+local NMapChunks = require "nbunny.mapchunks"
+
+-- Splits a map into chunks of chunkSize by chunkSize tiles. Keeps track of
+-- which chunks changed since the last update and which level of detail each
+-- chunk should be drawn at.
+--
+-- Level 0 is a MapMesh of the chunk. Levels above that are MapLODMeshes,
+-- which are much cheaper to build and draw.
+local MapChunks = Class()
+
+-- Fields of a tile, in the order nbunny.mapchunks expects them.
+MapChunks.FIELD_TOP_LEFT        = 0
+MapChunks.FIELD_TOP_RIGHT       = 1
+MapChunks.FIELD_BOTTOM_LEFT     = 2
+MapChunks.FIELD_BOTTOM_RIGHT    = 3
+MapChunks.FIELD_FLAT            = 4
+MapChunks.FIELD_EDGE            = 5
+MapChunks.FIELD_NUM_DECALS      = 6
+MapChunks.FIELD_DECALS          = 7
+MapChunks.FIELD_RED             = 8
+MapChunks.FIELD_GREEN           = 9
+MapChunks.FIELD_BLUE            = 10
+MapChunks.FIELD_TEXTURE_LEFT    = 11
+MapChunks.FIELD_TEXTURE_RIGHT   = 12
+MapChunks.FIELD_TEXTURE_TOP     = 13
+MapChunks.FIELD_TEXTURE_BOTTOM  = 14
+MapChunks.NUM_FIELDS            = 15
+
+-- Decals are stored as a hash, which has to fit in a float.
+MapChunks.DECAL_HASH_MODULUS = 16777216
+
+function MapChunks:new(chunkSize)
+	self._handle = NMapChunks()
+	self.chunkSize = chunkSize or 16
+	self.width = 0
+	self.height = 0
+
+	self.tileSet = false
+	self.tileProperties = {}
+
+	self.map = false
+	self.revision = 0
+end
+
+function MapChunks:getChunkSize()
+	return self.chunkSize
+end
+
+function MapChunks:getNumChunks()
+	return self._handle:getNumChunks()
+end
+
+-- Chunks further than distance from the focus are drawn at a lower level of
+-- detail. Distance is in world units.
+function MapChunks:enableLOD(distance)
+	self._handle:enableLOD(distance)
+end
+
+function MapChunks:disableLOD()
+	self._handle:disableLOD()
+end
+
+function MapChunks:getIsLODEnabled()
+	return self._handle:getIsLODEnabled()
+end
+
+-- Focus is relative to the map (i.e., before the map is moved).
+function MapChunks:setFocus(x, z)
+	self._handle:setFocus(x, z)
+end
+
+function MapChunks:_getTileProperties(index)
+	local properties = self.tileProperties[index]
+	if not properties then
+		local tileSet = self.tileSet
+		properties = {
+			left = tileSet:getTileProperty(index, 'textureLeft', 0),
+			right = tileSet:getTileProperty(index, 'textureRight', 1),
+			top = tileSet:getTileProperty(index, 'textureTop', 0),
+			bottom = tileSet:getTileProperty(index, 'textureBottom', 1),
+			red = tileSet:getTileProperty(index, 'colorRed', 255) / 255,
+			green = tileSet:getTileProperty(index, 'colorGreen', 255) / 255,
+			blue = tileSet:getTileProperty(index, 'colorBlue', 255) / 255
+		}
+
+		self.tileProperties[index] = properties
+	end
+
+	return properties
+end
+
+function MapChunks:_copyTiles(map, left, right, top, bottom)
+	local width = self.width
+	local tiles = ffi.cast("float*", self._handle:getTilesPointer())
+	for j = top, bottom do
+		local index = ((j - 1) * width + (left - 1)) * MapChunks.NUM_FIELDS
+		for i = left, right do
+			local tile = map:getTile(i, j)
+			local properties = self:_getTileProperties(tile.flat)
+
+			local decals = 0
+			for k = 1, #tile.decals do
+				decals = (decals * 31 + tile.decals[k]) % MapChunks.DECAL_HASH_MODULUS
+			end
+
+			tiles[index + MapChunks.FIELD_TOP_LEFT] = tile.topLeft
+			tiles[index + MapChunks.FIELD_TOP_RIGHT] = tile.topRight
+			tiles[index + MapChunks.FIELD_BOTTOM_LEFT] = tile.bottomLeft
+			tiles[index + MapChunks.FIELD_BOTTOM_RIGHT] = tile.bottomRight
+			tiles[index + MapChunks.FIELD_FLAT] = tile.flat
+			tiles[index + MapChunks.FIELD_EDGE] = tile.edge
+			tiles[index + MapChunks.FIELD_NUM_DECALS] = #tile.decals
+			tiles[index + MapChunks.FIELD_DECALS] = decals
+			tiles[index + MapChunks.FIELD_RED] = properties.red * tile.red
+			tiles[index + MapChunks.FIELD_GREEN] = properties.green * tile.green
+			tiles[index + MapChunks.FIELD_BLUE] = properties.blue * tile.blue
+			tiles[index + MapChunks.FIELD_TEXTURE_LEFT] = properties.left
+			tiles[index + MapChunks.FIELD_TEXTURE_RIGHT] = properties.right
+			tiles[index + MapChunks.FIELD_TEXTURE_TOP] = properties.top
+			tiles[index + MapChunks.FIELD_TEXTURE_BOTTOM] = properties.bottom
+
+			index = index + MapChunks.NUM_FIELDS
+		end
+	end
+end
+
+-- Copies the tiles from map. Only tiles that are different from the last
+-- time count as changed.
+--
+-- If it's the same map and tile set as last time, only the tiles in
+-- Map.getDirtyTiles are copied. Otherwise, every tile is.
+--
+-- Returns true if the map changed size, in which case every chunk will be
+-- rebuilt.
+function MapChunks:setMap(map, tileSet)
+	local width, height = map:getWidth(), map:getHeight()
+	local isResized = width ~= self.width or height ~= self.height
+	if isResized then
+		self.width = width
+		self.height = height
+		self._handle:resize(width, height, self.chunkSize)
+	end
+
+	local isTileSetChanged = tileSet ~= self.tileSet
+	if isTileSetChanged then
+		self.tileSet = tileSet
+		self.tileProperties = {}
+	end
+
+	self._handle:setCellSize(map:getCellSize())
+
+	if isResized or isTileSetChanged or map ~= self.map then
+		self:_copyTiles(map, 1, width, 1, height)
+	else
+		local left, right, top, bottom = map:getDirtyTiles(self.revision)
+		if not left then
+			return false
+		end
+
+		self:_copyTiles(map, left, right, top, bottom)
+	end
+
+	self.map = map
+	self.revision = map:getRevision()
+
+	self._handle:invalidateTiles()
+
+	return isResized
+end
+
+-- Returns a list of { i, j, level, isRebuilt } for every chunk that changed
+-- since the last update, or nil if none did. Chunks are 1-based, like tiles.
+--
+-- If isRebuilt is true, any meshes of the chunk are out of date.
+function MapChunks:update()
+	return self._handle:update()
+end
+
+-- Returns the tiles covered by the chunk, as left, right, top, bottom.
+function MapChunks:getTiles(i, j)
+	local left = (i - 1) * self.chunkSize + 1
+	local top = (j - 1) * self.chunkSize + 1
+	local right = math.min(left + self.chunkSize - 1, self.width)
+	local bottom = math.min(top + self.chunkSize - 1, self.height)
+
+	return left, right, top, bottom
+end
+
+-- Level must be above 0.
+function MapChunks:newLODMesh(i, j, level)
+	return MapLODMesh(self._handle, i, j, level)
+end
+
+return MapChunks
@@ -0,0 +1,71 @@
+--------------------------------------------------------------------------------
+-- ItsyScape/World/MapLODMesh.lua
+--
+-- This file is a part of ItsyScape.
+--
+-- This Source Code Form is subject to the terms of the Mozilla Public
+-- License, v. 2.0. If a copy of the MPL was not distributed with this
+-- file, You can obtain one at http://mozilla.org/MPL/2.0/.
+--------------------------------------------------------------------------------
+local ffi = require "ffi"
+local Class = require "ItsyScape.Common.Class"
+local Vector = require "ItsyScape.Common.Math.Vector"
+local MapMesh = require "ItsyScape.World.MapMesh"
+
+-- A chunk of a map at a lower level of detail. Drawn like a MapMesh.
+--
+-- The vertices are built by nbunny.mapchunks (see MapChunks), in
+-- MapMesh.FORMAT.
+local MapLODMesh = Class()
+
+-- Size of a vertex in MapMesh.FORMAT, in bytes.
+MapLODMesh.VERTEX_SIZE = 16 * 4
+
+-- 'chunks' is the nbunny.mapchunks handle; i, j, and level are as in
+-- MapChunks.update.
+function MapLODMesh:new(chunks, i, j, level)
+	self.mesh = false
+	self.level = level
+
+	local minX, minY, minZ, maxX, maxY, maxZ = chunks:getBounds(i, j, level)
+	self.min = Vector(minX, minY, minZ)
+	self.max = Vector(maxX, maxY, maxZ)
+
+	local vertices, count = chunks:getVertices(i, j, level)
+	if vertices then
+		local data = love.data.newByteData(count * MapLODMesh.VERTEX_SIZE)
+		ffi.copy(data:getPointer(), vertices, data:getSize())
+
+		self.mesh = love.graphics.newMesh(MapMesh.FORMAT, count, 'triangles', 'static')
+		self.mesh:setVertices(data)
+		for i = 1, #MapMesh.FORMAT do
+			self.mesh:setAttributeEnabled(MapMesh.FORMAT[i][1], true)
+		end
+
+		data:release()
+	end
+end
+
+function MapLODMesh:getLevel()
+	return self.level
+end
+
+function MapLODMesh:getBounds()
+	return self.min, self.max
+end
+
+function MapLODMesh:release()
+	if self.mesh then
+		self.mesh:release()
+		self.mesh = false
+	end
+end
+
+function MapLODMesh:draw(texture, ...)
+	if self.mesh then
+		self.mesh:setTexture(texture)
+		love.graphics.draw(self.mesh, ...)
+	end
+end
+
+return MapLODMesh
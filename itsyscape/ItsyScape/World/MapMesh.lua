@@ -10,6 +10,7 @@
 
 local Class = require "ItsyScape.Common.Class"
 local Vector = require "ItsyScape.Common.Math.Vector"
+local BakeCache = require "ItsyScape.Graphics.BakeCache"
 local Tile = require "ItsyScape.World.Tile"
 
 -- Map mesh. Builds a mesh from a map.
@@ -35,11 +36,29 @@ MapMesh.FORMAT = {
     { "VertexColor", 'float', 4 }
 }
 
+-- Bump when the vertices made by _buildMesh change.
+MapMesh.BAKE_VERSION = 1
+
+-- Tile set properties that end up in the vertices, and their defaults. See
+-- MapMesh._buildVertex.
+MapMesh.BAKE_TILE_PROPERTIES = {
+	{ 'textureLeft', 0 },
+	{ 'textureRight', 1 },
+	{ 'textureTop', 0 },
+	{ 'textureBottom', 1 },
+	{ 'colorRed', 255 },
+	{ 'colorGreen', 255 },
+	{ 'colorBlue', 255 }
+}
+
 -- Creates a mesh from 'map' using the provided tile set.
 --
 -- If 'left', 'right', 'top', and 'bottom' are provided, only a portion of the
 -- map mesh is generated (those tiles that fall within the bounds).
-function MapMesh:new(map, tileSet, left, right, top, bottom)
+--
+-- If 'bakeCache' is provided, the vertices are loaded from it if the same
+-- tiles were built before, and baked otherwise. See BakeCache.
+function MapMesh:new(map, tileSet, left, right, top, bottom, bakeCache)
 	self.vertices = {}
 	self.map = map
 	self.tileSet = tileSet
@@ -50,7 +69,7 @@ function MapMesh:new(map, tileSet, left, right, top, bottom)
 	top = math.max(top or 1, 1)
 	bottom = math.min(bottom or map.height, map.height)
 
-	self:_buildMesh(left, right, top, bottom)
+	self:_buildMesh(left, right, top, bottom, bakeCache)
 end
 
 function MapMesh:getBounds()
@@ -70,8 +89,82 @@ function MapMesh:draw(texture, ...)
 	love.graphics.draw(self.mesh, ...)
 end
 
+-- Returns a key of everything the vertices of the tiles within the bounds
+-- are built from.
+--
+-- Edges depend on the neighbors, so the tiles just outside the bounds are
+-- hashed too.
+function MapMesh:_getBakeKey(left, right, top, bottom)
+	local hash = BakeCache.newHash()
+	hash:update(
+		"MapMesh", MapMesh.BAKE_VERSION,
+		self.map.width, self.map.height, self.map.cellSize,
+		left, right, top, bottom)
+
+	local tileSetIndices = {}
+	for j = math.max(top - 1, 1), math.min(bottom + 1, self.map.height) do
+		for i = math.max(left - 1, 1), math.min(right + 1, self.map.width) do
+			local tile = self.map:getTile(i, j)
+
+			hash:update(
+				tile.topLeft, tile.topRight, tile.bottomLeft, tile.bottomRight,
+				tile.red, tile.green, tile.blue,
+				tile.flat, tile.edge, #tile.decals,
+				unpack(tile.decals))
+
+			tileSetIndices[tile.flat] = true
+			tileSetIndices[tile.edge] = true
+			for k = 1, #tile.decals do
+				tileSetIndices[tile.decals[k]] = true
+			end
+		end
+	end
+
+	local sortedTileSetIndices = {}
+	for index in pairs(tileSetIndices) do
+		table.insert(sortedTileSetIndices, index)
+	end
+	table.sort(sortedTileSetIndices)
+
+	for i = 1, #sortedTileSetIndices do
+		local index = sortedTileSetIndices[i]
+		hash:update(index)
+
+		for j = 1, #MapMesh.BAKE_TILE_PROPERTIES do
+			local property, defaultValue = unpack(MapMesh.BAKE_TILE_PROPERTIES[j])
+			hash:update(self.tileSet:getTileProperty(index, property, defaultValue))
+		end
+	end
+
+	return hash:getKey()
+end
+
+function MapMesh:_newMesh(vertexData, vertexCount)
+	self.mesh = love.graphics.newMesh(MapMesh.FORMAT, vertexCount, 'triangles', 'static')
+	self.mesh:setVertices(vertexData)
+	for i = 1, #MapMesh.FORMAT do
+		self.mesh:setAttributeEnabled(MapMesh.FORMAT[i][1], true)
+	end
+end
+
 -- Builds a mesh within the provided bounds.
-function MapMesh:_buildMesh(left, right, top, bottom)
+function MapMesh:_buildMesh(left, right, top, bottom, bakeCache)
+	local key
+	if bakeCache and bakeCache:getIsEnabled() then
+		key = self:_getBakeKey(left, right, top, bottom)
+
+		local baked = bakeCache:load(key)
+		if baked and baked[1] then
+			self.min = baked[1].min
+			self.max = baked[1].max
+			self.minY = self.min.y
+			self.maxY = self.max.y
+
+			self:_newMesh(baked[1].vertexData, baked[1].vertexCount)
+			return
+		end
+	end
+
 	-- Build vertices.
 	for j = top, bottom do
 		for i = left, right do
@@ -105,9 +198,24 @@ function MapMesh:_buildMesh(left, right, top, bottom)
 	end
 
 	-- Create mesh and enable all attributes.
-	self.mesh = love.graphics.newMesh(MapMesh.FORMAT, self.vertices, 'triangles', 'static')
-	for i = 1, #MapMesh.FORMAT do
-		self.mesh:setAttributeEnabled(MapMesh.FORMAT[i][1], true)
+	if key and #self.vertices > 0 then
+		local t = {
+			name = "MapMesh",
+			vertexData = BakeCache.packVertices(self.vertices, MapMesh.FORMAT),
+			vertexCount = #self.vertices,
+			indexData = false,
+			indexCount = 0,
+			min = self.min,
+			max = self.max
+		}
+
+		bakeCache:save(key, MapMesh.FORMAT, { t })
+		self:_newMesh(t.vertexData, t.vertexCount)
+	else
+		self.mesh = love.graphics.newMesh(MapMesh.FORMAT, self.vertices, 'triangles', 'static')
+		for i = 1, #MapMesh.FORMAT do
+			self.mesh:setAttributeEnabled(MapMesh.FORMAT[i][1], true)
+		end
 	end
 end
 
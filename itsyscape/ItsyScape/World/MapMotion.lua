@@ -114,6 +114,28 @@ function MapMotion:getMap()
 	return self.map
 end
 
+-- Marks the tile at (i, j) as changed by the current perform.
+function MapMotion:markDirty(i, j)
+	local dirty = self.dirtyTiles
+	if dirty then
+		dirty.left = math.min(dirty.left, i)
+		dirty.right = math.max(dirty.right, i)
+		dirty.top = math.min(dirty.top, j)
+		dirty.bottom = math.max(dirty.bottom, j)
+	else
+		self.dirtyTiles = { left = i, right = i, top = j, bottom = j }
+	end
+end
+
+-- Returns the rectangle (left, right, top, bottom) of tiles changed by the
+-- last perform, or nothing if unknown. See Stage.updateMap.
+function MapMotion:getDirtyTiles()
+	local dirty = self.dirtyTiles
+	if dirty then
+		return dirty.left, dirty.right, dirty.top, dirty.bottom
+	end
+end
+
 -- Called when the mouse is released.
 --
 -- Cancels the current action.
@@ -141,6 +163,7 @@ function MapMotion:onMouseMoved(e)
 		local distance = y - self.referenceY
 
 		if math.abs(distance) >= 1 then
+			self.dirtyTiles = false
 			self:perform(e, distance)
 			self.referenceY = y
 
@@ -165,6 +188,8 @@ function MapMotion:perform(e, distance)
 		self.tile:setCorner(corner.s, corner.t, self.tile:getCorner(corner.s, corner.t) + distance)
 		--self.tile[self.corners[i]] = self.tile[self.corners[i]] + distance
 	end
+
+	self:markDirty(self.tileI, self.tileJ)
 end
 
 return MapMotion
@@ -10,6 +10,15 @@
 
 local Class = require "ItsyScape.Common.Class"
 local Path = require "ItsyScape.World.Path"
+local NFFI = require "nbunny.ffi"
+local NProfiler = require "nbunny.profiler"
+
+local FIND_SCOPE = NProfiler.getScopeID("PathFinder.find")
+
+local function endScope(...)
+	NFFI.profiler_end_scope()
+	return ...
+end
 
 local PathFinder = Class()
 function PathFinder:new(algorithm)
@@ -80,7 +89,8 @@ end
 
 -- Returns a path from start to stop, or nil if no such path exists.
 function PathFinder:find(start, stop, ...)
-	return self.algorithm:find(start, stop, ...)
+	NFFI.profiler_begin_scope(FIND_SCOPE)
+	return endScope(self.algorithm:find(start, stop, ...))
 end
 
 PathFinder.Algorithm = Class()
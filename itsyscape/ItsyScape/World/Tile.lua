@@ -22,7 +22,11 @@ Tile.IMPASSABLE_FLAGS = {
 	'door'
 }
 
-function Tile:new()
+-- 'revisions' is the table of revisions of the Map the Tile belongs to, if
+-- any. See Map.getFlagsRevision.
+function Tile:new(revisions)
+	self.revisions = revisions or false
+
 	-- The edge texture index. Defaults to the first edge texture.
 	self.edge = 1
 
@@ -56,16 +60,26 @@ function Tile:removeLink(link)
 	self.links[link] = false
 end
 
+function Tile:_touchFlags()
+	if self.revisions then
+		self.revisions.flags = self.revisions.flags + 1
+	end
+end
+
 function Tile:iterateLinks()
 	return pairs(self.links)
 end
 
 function Tile:pushFlag(flag)
+	self:_touchFlags()
+
 	local depth = self.runtimeFlags[flag] or 0
 	self.runtimeFlags[flag] = depth + 1
 end
 
 function Tile:popFlag(flag)
+	self:_touchFlags()
+
 	local depth = self.runtimeFlags[flag] or 0
 	if depth <= 1 then
 		self.runtimeFlags[flag] = nil
@@ -75,18 +89,26 @@ function Tile:popFlag(flag)
 end
 
 function Tile:setFlag(f)
+	self:_touchFlags()
+
 	self.flags[tostring(f)] = true
 end
 
 function Tile:setRuntimeFlag(f)
+	self:_touchFlags()
+
 	self.runtimeFlags[tostring(f)] = true
 end
 
 function Tile:unsetFlag(f)
+	self:_touchFlags()
+
 	self.flags[tostring(f)] = nil
 end
 
 function Tile:unsetRuntimeFlag(f)
+	self:_touchFlags()
+
 	self.runtimeFlags[tostring(f)] = nil
 end
 
@@ -117,10 +139,14 @@ function Tile:getIsPassable(flags)
 end
 
 function Tile:setData(key, value)
+	self:_touchFlags()
+
 	self.flags[tostring(key)] = value
 end
 
 function Tile:unsetData(key, value)
+	self:_touchFlags()
+
 	self.flags[tostring(key)] = nil
 end
 
@@ -7,8 +7,10 @@
 -- License, v. 2.0. If a copy of the MPL was not distributed with this
 -- file, You can obtain one at http://mozilla.org/MPL/2.0/.
 --------------------------------------------------------------------------------
+local ffi = require "ffi"
 local Class = require "ItsyScape.Common.Class"
 local Vector = require "ItsyScape.Common.Math.Vector"
+local NWaterMesh = require "nbunny.watermesh"
 
 local WaterMesh = Class()
 
@@ -19,77 +21,137 @@ WaterMesh.FORMAT = {
     { "VertexTexture", 'float', 2 }
 }
 
+-- Size of a vertex in FORMAT and of an index, in bytes.
+WaterMesh.VERTEX_SIZE = 8 * 4
+WaterMesh.INDEX_SIZE = 4
+
+-- The grid is built by nbunny.watermesh, with vertices shared between quads.
+-- Resizing only rebuilds the blocks of quads along the edges that moved.
 function WaterMesh:new(width, height, scale)
-	self.vertices = {}
+	self._handle = NWaterMesh()
+	self._handle:setScale(scale or 3)
+
+	self.mesh = false
+	self.vertices = false
+	self.indices = false
+	self.vertexCount = 0
+	self.indexCount = 0
+
+	self:resize(width, height)
+end
+
+function WaterMesh:resize(width, height)
 	self.width = width
 	self.height = height
-	self.scale = scale or 3
 
-	self:_buildMesh()
+	self.min = Vector(0)
+	self.max = Vector(width, 0, height)
+
+	self._handle:resize(width, height)
+	self:update()
 end
 
-function WaterMesh:release()
-	self.mesh:release()
-	self.mesh = false
+function WaterMesh:getScale()
+	return self._handle:getScale()
 end
 
-function WaterMesh:getBounds()
-	return self.min, self.max
+function WaterMesh:setScale(value)
+	self._handle:setScale(value or 3)
+	self:update()
 end
 
-function WaterMesh:draw(texture, ...)
-	if self.mesh then
-		self.mesh:setTexture(texture)
-		love.graphics.draw(self.mesh, ...)
-	end
+-- With LOD enabled, quads further than distance quads from the focus are
+-- merged into bigger quads, and so on. Call update after moving the focus.
+function WaterMesh:enableLOD(distance)
+	self._handle:enableLOD(distance)
 end
 
-function WaterMesh:_buildMesh()
-	self.min = Vector(math.huge)
-	self.max = Vector(-math.huge)
+function WaterMesh:disableLOD()
+	self._handle:disableLOD()
+end
 
-	for j = 1, self.height do
-		for i = 1, self.width do
-			self:_addFlat(i - 0.5, j - 0.5)
+function WaterMesh:getIsLODEnabled()
+	return self._handle:getIsLODEnabled()
+end
+
+function WaterMesh:setFocus(x, z)
+	self._handle:setFocus(x, z)
+end
+
+function WaterMesh:update()
+	if not self._handle:update() then
+		return
+	end
+
+	local vertexCount = self._handle:getVertexCount()
+	local startVertex, dirtyVertexCount
+	if vertexCount ~= self.vertexCount then
+		if self.mesh then
+			self.mesh:release()
+		end
+
+		self.mesh = false
+		self.vertices = false
+		self.vertexCount = vertexCount
+
+		if vertexCount > 0 then
+			self.vertices = love.data.newByteData(vertexCount * WaterMesh.VERTEX_SIZE)
+			self.mesh = love.graphics.newMesh(WaterMesh.FORMAT, vertexCount, 'triangles', 'dynamic')
+			for i = 1, #WaterMesh.FORMAT do
+				self.mesh:setAttributeEnabled(WaterMesh.FORMAT[i][1], true)
+			end
 		end
+
+		startVertex, dirtyVertexCount = 0, vertexCount
+	else
+		startVertex, dirtyVertexCount = self._handle:getDirtyVertices()
 	end
 
-	self.mesh = love.graphics.newMesh(WaterMesh.FORMAT, self.vertices, 'triangles', 'static')
-	for i = 1, #WaterMesh.FORMAT do
-		self.mesh:setAttributeEnabled(WaterMesh.FORMAT[i][1], true)
+	if not self.mesh then
+		self.indexCount = 0
+		return
 	end
-end
 
-function WaterMesh:_addVertex(position, normal, texture)
-	local vertex = {
-		position.x, position.y, position.z,
-		normal.x, normal.y, normal.z,
-		position.x * 1 / self.scale, position.z * 1 / self.scale
-	}
+	if dirtyVertexCount > 0 then
+		local offset = startVertex * WaterMesh.VERTEX_SIZE
+		local size = dirtyVertexCount * WaterMesh.VERTEX_SIZE
+		ffi.copy(
+			ffi.cast("char*", self.vertices:getPointer()) + offset,
+			ffi.cast("char*", self._handle:getVertexPointer()) + offset,
+			size)
+		self.mesh:setVertices(love.data.newDataView(self.vertices, offset, size), startVertex + 1)
+	end
 
-	self.min = self.min:min(position)
-	self.max = self.max:max(position)
+	self.indexCount = self._handle:getIndexCount()
+	if self.indexCount > 0 then
+		local size = self.indexCount * WaterMesh.INDEX_SIZE
+		if not self.indices or self.indices:getSize() < size then
+			self.indices = love.data.newByteData(size)
+		end
 
-	table.insert(self.vertices, vertex)
+		ffi.copy(self.indices:getPointer(), self._handle:getIndexPointer(), size)
+		self.mesh:setVertexMap(love.data.newDataView(self.indices, 0, size), 'uint32')
+	end
 end
 
-function WaterMesh:_addFlat(i, j)
-	local E = 0.5
-	local topLeft = Vector(-E + i, 0, -E + j)
-	local topRight = Vector(E + i, 0, -E + j)
-	local bottomLeft = Vector(-E + i, 0, E + j)
-	local bottomRight = Vector(E + i, 0, E + j)
-
-	local normal = Vector.UNIT_Y
-	do
-		self:_addVertex(topRight, normal, Vector(1, 0))
-		self:_addVertex(bottomLeft, normal, Vector(0, 1))
-		self:_addVertex(bottomRight, normal, Vector(1, 1))
+function WaterMesh:release()
+	if self.mesh then
+		self.mesh:release()
+		self.mesh = false
 	end
-	do
-		self:_addVertex(topRight, normal, Vector(1, 0))
-		self:_addVertex(topLeft, normal, Vector(0, 0))
-		self:_addVertex(bottomLeft, normal, Vector(0, 1))
+
+	self.vertexCount = 0
+	self.indexCount = 0
+end
+
+function WaterMesh:getBounds()
+	return self.min, self.max
+end
+
+function WaterMesh:draw(texture, ...)
+	if self.mesh and self.indexCount > 0 then
+		self.mesh:setTexture(texture)
+		love.graphics.draw(self.mesh, ...)
 	end
 end
 
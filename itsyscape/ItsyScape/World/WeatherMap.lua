@@ -11,6 +11,7 @@ local ffi = require "ffi"
 local Class = require "ItsyScape.Common.Class"
 local Vector = require "ItsyScape.Common.Math.Vector"
 local Quaternion = require "ItsyScape.Common.Math.Quaternion"
+local NWeatherMap = require "nbunny.weathermap"
 
 local WeatherMap = Class()
 
@@ -29,7 +30,14 @@ function WeatherMap:new(layer, i, j, cellSize, width, height)
 	self.cellSize = cellSize or 2
 	self.position = Vector(0, 0, 0)
 	self.isDirty = true
-
+	self.isResized = true
+
+	-- The heights live in the handle, so weather can sample them natively.
+	-- Each map is rasterized into it by nbunny; only the tiles under a map
+	-- that moved are redone. See WeatherMap.getHandle.
+	self._handle = NWeatherMap()
+	self.nextMapID = 1
+	self.transform = love.math.newTransform()
 	self.tiles = false
 end
 
@@ -49,12 +57,14 @@ function WeatherMap:move(i, j)
 	self.i = i or self.i
 	self.j = j or self.j
 	self.isDirty = true
+	self.isResized = true
 end
 
 function WeatherMap:resize(width, height)
 	self.width = width or self.width
 	self.height = height or self.height
 	self.isDirty = true
+	self.isResized = true
 end
 
 function WeatherMap:getAbsolutePosition()
@@ -66,22 +76,64 @@ function WeatherMap:setAbsolutePosition(position)
 end
 
 function WeatherMap:addMap(map)
-	if not self.maps[map] then
-		self.maps[map] = {
+	local mapTransform = self.maps[map]
+	if not mapTransform then
+		mapTransform = {
+			id = self.nextMapID,
 			translation = Vector(0),
 			rotation = Quaternion(0),
 			scale = Vector(1)
 		}
+
+		self.nextMapID = self.nextMapID + 1
+		self.maps[map] = mapTransform
 	end
 
 	-- This lets us know the map data was updated.
-	if self.maps[map] then
-		self.isDirty = true
+	self:_updateMapHeights(map, mapTransform)
+end
+
+function WeatherMap:_updateMapHeights(map, mapTransform)
+	local width, height = map:getWidth(), map:getHeight()
+
+	self._handle:setMap(mapTransform.id, width, height, map:getCellSize())
+	local heights = ffi.cast("float*", self._handle:getMapPointer(mapTransform.id))
+
+	for j = 1, height do
+		for i = 1, width do
+			local index = (j - 1) * width + (i - 1)
+			if map:getTile(i, j):hasFlag("building") then
+				heights[index] = math.huge
+			else
+				heights[index] = map:getTileCenter(i, j).y
+			end
+		end
 	end
+
+	self._handle:invalidateMap(mapTransform.id)
+	self:_updateMapTransform(mapTransform)
+end
+
+function WeatherMap:_updateMapTransform(mapTransform)
+	local transform = self.transform
+	do
+		local r = mapTransform.rotation
+		local s = mapTransform.scale
+		local t = mapTransform.translation
+
+		transform:reset()
+		transform:translate(t.x, t.y, t.z)
+		transform:applyQuaternion(r.x, r.y, r.z, r.w)
+		transform:scale(s.x, s.y, s.z)
+	end
+
+	self._handle:setMapTransform(mapTransform.id, transform:getMatrix())
+	self.isDirty = true
 end
 
 function WeatherMap:removeMap(map)
 	if map and self.maps[map] then
+		self._handle:removeMap(self.maps[map].id)
 		self.maps[map] = nil
 		self.isDirty = true
 	end
@@ -90,7 +142,7 @@ end
 function WeatherMap:updateMap(map, translation, rotation, scale)
 	translation = translation or Vector(0)
 	rotation = rotation or Quaternion(0)
-	scale = scale or Scale(1)
+	scale = scale or Vector(1)
 
 	local transform = self.maps[map]
 	if transform then
@@ -107,52 +159,38 @@ function WeatherMap:updateMap(map, translation, rotation, scale)
 		then
 			transform.translation = translation
 			transform.rotation = rotation
-			translation.scale = scale
-			self.isDirty = true
+			transform.scale = scale
+			self:_updateMapTransform(transform)
 		end
 	end
 end
 
 function WeatherMap:update()
 	if self.isDirty then
-		self.tiles = ffi.new("float[?]", self.width * self.height, -math.huge)
+		if self.isResized then
+			self._handle:setPosition(self.realI, self.realJ)
+			self._handle:setCellSize(self.cellSize)
+			self._handle:resize(self.width, self.height)
+			self.tiles = ffi.cast("float*", self._handle:getPointer())
 
-		local t = self.tiles
-		local transform = love.math.newTransform()
-
-		for map, mapTransform in pairs(self.maps) do
-			do
-				local r = mapTransform.rotation
-				local s = mapTransform.scale
-				local t = mapTransform.translation
-
-				transform:reset()
-				transform:translate(t.x, t.y, t.z)
-				transform:applyQuaternion(r.x, r.y, r.z, r.w)
-				transform:scale(s.x, s.y, s.z)
-			end
-
-			for j = 0, self.height - 1 do
-				for i = 0, self.width - 1 do
-					local center = map:getTileCenter(i + self.realI, j + self.realJ)
-					center = Vector(transform:transformPoint(center:get()))
-
-					local index = j * self.width + i
-
-					local y = center.y
-					if map:getTile(i, j):hasFlag("building") then
-						y = math.huge
-					end
-
-					t[index] = y
-				end
-			end
+			self.isResized = false
 		end
 
+		self._handle:update()
 		self.isDirty = false
 	end
 end
 
+-- Returns the nbunny.weathermap with the heights, updating it first if
+-- needed.
+function WeatherMap:getHandle()
+	if self.isDirty then
+		self:update()
+	end
+
+	return self._handle
+end
+
 function WeatherMap:getHeightAt(i, j)
 	if self.isDirty then
 		self:update()
@@ -18,6 +18,15 @@
 #define SCAPE_MAX_LIGHTS 16
 #define SCAPE_MAX_FOG    4
 
+// These match nbunny::LightClusters.
+#define SCAPE_MAX_CLUSTER_LIGHTS           64
+#define SCAPE_CLUSTER_WIDTH                16.0
+#define SCAPE_CLUSTER_HEIGHT               8.0
+#define SCAPE_CLUSTER_DEPTH                16.0
+#define SCAPE_CLUSTER_INDEX_TEXTURE_WIDTH  256.0
+#define SCAPE_CLUSTER_INDEX_TEXTURE_HEIGHT 64.0
+#define SCAPE_CLUSTER_LIGHT_TEXTURE_HEIGHT 256.0
+
 varying vec3 frag_Position;
 varying vec3 frag_Normal;
 varying vec2 frag_Texture;
@@ -40,6 +49,18 @@ uniform struct Fog {
 	vec3 position;
 } scape_Fog[SCAPE_MAX_FOG];
 
+// Point lights binned by ItsyScape.Graphics.LightClusters. The cluster
+// texture holds the offset and count of each cluster's lights in the index
+// texture; the light texture holds the position and attenuation, then the
+// color and radius, of each light.
+uniform int scape_NumClusterLights;
+uniform Image scape_ClusterTexture;
+uniform Image scape_ClusterIndexTexture;
+uniform Image scape_ClusterLightTexture;
+uniform mat4 scape_ClusterView;
+uniform mat4 scape_ClusterProjection;
+uniform vec3 scape_ClusterNearFar;
+
 vec3 scapeApplyLight(
 	Light light,
 	vec3 position,
@@ -75,6 +96,82 @@ vec3 scapeApplyLight(
 	return (attenuation * 0.25) * diffuse + ambient;
 }
 
+vec3 scapeApplyPointLight(
+	vec4 positionAttenuation,
+	vec4 colorRadius,
+	vec3 position,
+	vec3 normal,
+	vec3 color)
+{
+	vec3 lightSurfaceDifference = positionAttenuation.xyz - position;
+	float lightSurfaceDistance = length(lightSurfaceDifference);
+	vec3 direction = lightSurfaceDifference / max(lightSurfaceDistance, 0.0001);
+
+	// Same as scapeApplyLight, but faded out before the radius.
+	float attenuation = positionAttenuation.w / lightSurfaceDistance;
+	attenuation *= 1.0 - smoothstep(colorRadius.w * 0.75, colorRadius.w, lightSurfaceDistance);
+
+	float diffuseCoefficient = max(0.0, dot(normal, direction));
+	vec3 diffuse = diffuseCoefficient * color * colorRadius.rgb;
+
+	return (attenuation * 0.25) * diffuse;
+}
+
+vec3 scapeApplyClusterLights(
+	vec3 position,
+	vec3 normal,
+	vec3 color)
+{
+	vec4 viewPosition = scape_ClusterView * vec4(position, 1.0);
+	vec4 clipPosition = scape_ClusterProjection * viewPosition;
+	vec2 tile = (clipPosition.xy / clipPosition.w) * 0.5 + vec2(0.5);
+
+	float nearDistance = scape_ClusterNearFar.x;
+	float farDistance = scape_ClusterNearFar.y;
+	float depth = -viewPosition.z;
+	float slice;
+	if (scape_ClusterNearFar.z != 0.0)
+	{
+		slice = log(max(depth, nearDistance) / nearDistance) / log(farDistance / nearDistance);
+	}
+	else
+	{
+		slice = (depth - nearDistance) / (farDistance - nearDistance);
+	}
+
+	vec3 size = vec3(SCAPE_CLUSTER_WIDTH, SCAPE_CLUSTER_HEIGHT, SCAPE_CLUSTER_DEPTH);
+	vec3 cluster = clamp(floor(vec3(tile, slice) * size), vec3(0.0), size - vec3(1.0));
+	vec2 clusterCoordinate = vec2(
+		(cluster.x + cluster.y * SCAPE_CLUSTER_WIDTH + 0.5) / (SCAPE_CLUSTER_WIDTH * SCAPE_CLUSTER_HEIGHT),
+		(cluster.z + 0.5) / SCAPE_CLUSTER_DEPTH);
+	vec2 offsetCount = Texel(scape_ClusterTexture, clusterCoordinate).rg;
+
+	vec3 result = vec3(0.0);
+	for (int i = 0; i < SCAPE_MAX_CLUSTER_LIGHTS; ++i)
+	{
+		if (float(i) >= offsetCount.y)
+		{
+			break;
+		}
+
+		float index = offsetCount.x + float(i);
+		vec2 indexCoordinate = vec2(
+			(mod(index, SCAPE_CLUSTER_INDEX_TEXTURE_WIDTH) + 0.5) / SCAPE_CLUSTER_INDEX_TEXTURE_WIDTH,
+			(floor(index / SCAPE_CLUSTER_INDEX_TEXTURE_WIDTH) + 0.5) / SCAPE_CLUSTER_INDEX_TEXTURE_HEIGHT);
+		float light = Texel(scape_ClusterIndexTexture, indexCoordinate).r;
+
+		float lightCoordinate = (light + 0.5) / SCAPE_CLUSTER_LIGHT_TEXTURE_HEIGHT;
+		result += scapeApplyPointLight(
+			Texel(scape_ClusterLightTexture, vec2(0.25, lightCoordinate)),
+			Texel(scape_ClusterLightTexture, vec2(0.75, lightCoordinate)),
+			position,
+			normal,
+			color);
+	}
+
+	return result;
+}
+
 vec3 scapeApplyFog(
 	Fog fog,
 	vec3 position,
@@ -113,6 +210,11 @@ vec4 effect(
 			diffuse.rgb);
 	}
 
+	if (scape_NumClusterLights > 0)
+	{
+		result += scapeApplyClusterLights(frag_Position, frag_Normal, diffuse.rgb);
+	}
+
 	for (int i = 0; i < scape_NumFogs; ++i)
 	{
 		result = scapeApplyFog(scape_Fog[i], frag_Position, result);
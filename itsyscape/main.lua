@@ -171,6 +171,22 @@ function love.keypressed(...)
 			_APP.show2D = not _APP.show2D
 		elseif (select(1, ...) == 'f3') then
 			_APP.show3D = not _APP.show3D
+		elseif (select(1, ...) == 'f10') then
+			local NRecorder = require "nbunny.recorder"
+			if NRecorder.isRecording() then
+				love.filesystem.write("itsyscape.replay", NRecorder.stop())
+			else
+				NRecorder.start()
+			end
+		elseif (select(1, ...) == 'f11') then
+			local NProfiler = require "nbunny.profiler"
+			if NProfiler.isEnabled() then
+				NProfiler.disable()
+				love.filesystem.write("itsyscape.trace.json", NProfiler.toChromeTrace())
+			else
+				NProfiler.clear()
+				NProfiler.enable()
+			end
 		elseif (select(1, ...) == 'f12') then
 			local p = require "ProFi"
 			jit.off()
@@ -196,6 +212,21 @@ function love.draw()
 	if _APP then
 		_APP:draw()
 	end
+
+	do
+		-- Don't carry transform changes over into the next frame.
+		local SceneNodeTransform = require "ItsyScape.Graphics.SceneNodeTransform"
+		SceneNodeTransform.flush()
+
+		local NProfiler = require "nbunny.profiler"
+		NProfiler.frame()
+
+		local NRecorder = require "nbunny.recorder"
+		NRecorder.frame()
+
+		local NArena = require "nbunny.arena"
+		NArena.frame()
+	end
 end
 
 function love.quit()
@@ -0,0 +1,69 @@
+////////////////////////////////////////////////////////////////////////////////
+// bench/allocations.cpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "allocations.hpp"
+
+// The replacements live on their own so they can't be inlined into the
+// benchmarks; GCC warns (-Wmismatched-new-delete) when it sees the free
+// from an inlined delete paired with a new.
+static std::atomic<std::size_t> numAllocations(0);
+static std::atomic<std::size_t> numAllocatedBytes(0);
+
+std::size_t getNumAllocations()
+{
+	return numAllocations.load();
+}
+
+std::size_t getNumAllocatedBytes()
+{
+	return numAllocatedBytes.load();
+}
+
+void* operator new(std::size_t size)
+{
+	++numAllocations;
+	numAllocatedBytes += size;
+
+	void* result = std::malloc(size ? size : 1);
+	if (!result)
+	{
+		throw std::bad_alloc();
+	}
+
+	return result;
+}
+
+void* operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+	std::free(pointer);
+}
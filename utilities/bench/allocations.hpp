@@ -0,0 +1,22 @@
+////////////////////////////////////////////////////////////////////////////////
+// bench/allocations.hpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef BENCH_ALLOCATIONS_HPP
+#define BENCH_ALLOCATIONS_HPP
+
+#include <cstddef>
+
+// Totals from the global operator new, which is replaced in allocations.cpp.
+std::size_t getNumAllocations();
+std::size_t getNumAllocatedBytes();
+
+#endif
@@ -0,0 +1,1315 @@
+////////////////////////////////////////////////////////////////////////////////
+// bench/main.cpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "nbunny/arena.hpp"
+#include "nbunny/archetype.hpp"
+#include "nbunny/bake.hpp"
+#include "nbunny/cache.hpp"
+#include "nbunny/light.hpp"
+#include "nbunny/map.hpp"
+#include "nbunny/movement.hpp"
+#include "nbunny/profiler.hpp"
+#include "nbunny/replay.hpp"
+#include "nbunny/resource.hpp"
+#include "nbunny/scene.hpp"
+#include "nbunny/scheduler.hpp"
+#include "nbunny/skeleton.hpp"
+#include "nbunny/spatial.hpp"
+#include "nbunny/sprite.hpp"
+#include "nbunny/water.hpp"
+#include "nbunny/weather.hpp"
+#include "allocations.hpp"
+
+struct Options
+{
+	std::string filter;
+	std::string json;
+	double minTime = 0.5;
+	unsigned int seed = 1;
+	std::vector<std::string> replays;
+};
+
+struct Result
+{
+	std::string name;
+	std::size_t operations;
+	double seconds;
+	std::size_t allocations;
+	std::size_t bytes;
+
+	// Sorted frame times, in seconds, for replays.
+	std::vector<double> frames;
+};
+
+static double getPercentile(const std::vector<double>& sorted, double p)
+{
+	if (sorted.empty())
+	{
+		return 0.0;
+	}
+
+	return sorted[(std::size_t)(p * (sorted.size() - 1) + 0.5)];
+}
+
+// Bucket i holds frames that took from 2^(i - 1) to 2^i microseconds; bucket
+// 0 holds frames under a microsecond.
+static const std::size_t NUM_HISTOGRAM_BUCKETS = 24;
+
+static std::vector<std::size_t> getHistogram(const std::vector<double>& frames)
+{
+	std::vector<std::size_t> result(NUM_HISTOGRAM_BUCKETS, 0);
+	for (auto frame: frames)
+	{
+		std::size_t bucket = 0;
+		double limit = 1.0e-6;
+		while (frame >= limit && bucket + 1 < NUM_HISTOGRAM_BUCKETS)
+		{
+			limit *= 2.0;
+			++bucket;
+		}
+
+		++result[bucket];
+	}
+
+	return result;
+}
+
+struct Bench
+{
+	Options options;
+	std::vector<Result> results;
+
+	// Runs func until at least options.minTime seconds have passed. Each
+	// call to func does numOperations operations.
+	void run(const std::string& name, std::size_t numOperations, const std::function<void()>& func)
+	{
+		if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+		{
+			return;
+		}
+
+		func();
+
+		auto allocationsBefore = getNumAllocations();
+		auto bytesBefore = getNumAllocatedBytes();
+		auto before = std::chrono::steady_clock::now();
+
+		std::size_t runs = 0;
+		double seconds = 0.0;
+		do
+		{
+			func();
+			++runs;
+
+			seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count();
+		} while (seconds < options.minTime);
+
+		Result result;
+		result.name = name;
+		result.operations = runs * numOperations;
+		result.seconds = seconds;
+		result.allocations = getNumAllocations() - allocationsBefore;
+		result.bytes = getNumAllocatedBytes() - bytesBefore;
+		results.push_back(result);
+
+		double operations = (double)result.operations;
+		std::printf(
+			"%-40s %12.2f ns/op %14.0f op/s %10.3f allocs/op %12.1f B/op\n",
+			name.c_str(),
+			seconds * 1.0e9 / operations,
+			operations / seconds,
+			result.allocations / operations,
+			result.bytes / operations);
+		std::fflush(stdout);
+	}
+
+	bool writeJSON() const
+	{
+		auto file = std::fopen(options.json.c_str(), "w");
+		if (!file)
+		{
+			std::fprintf(stderr, "couldn't open %s\n", options.json.c_str());
+			return false;
+		}
+
+		std::fprintf(file, "{\n\t\"results\": [\n");
+		for (std::size_t i = 0; i < results.size(); ++i)
+		{
+			auto& result = results[i];
+			double operations = (double)result.operations;
+
+			std::fprintf(
+				file,
+				"\t\t{ \"name\": \"%s\", \"operations\": %zu, \"seconds\": %.9f, \"nsPerOperation\": %.3f, \"operationsPerSecond\": %.3f, \"allocationsPerOperation\": %.6f, \"bytesPerOperation\": %.3f",
+				result.name.c_str(),
+				result.operations,
+				result.seconds,
+				result.seconds * 1.0e9 / operations,
+				operations / result.seconds,
+				result.allocations / operations,
+				result.bytes / operations);
+
+			if (!result.frames.empty())
+			{
+				std::fprintf(
+					file,
+					", \"frames\": %zu, \"p50\": %.9f, \"p95\": %.9f, \"p99\": %.9f, \"max\": %.9f, \"histogram\": [",
+					result.frames.size(),
+					getPercentile(result.frames, 0.5),
+					getPercentile(result.frames, 0.95),
+					getPercentile(result.frames, 0.99),
+					result.frames.back());
+
+				auto histogram = getHistogram(result.frames);
+				for (std::size_t j = 0; j < histogram.size(); ++j)
+				{
+					std::fprintf(file, "%s%zu", j > 0 ? ", " : " ", histogram[j]);
+				}
+				std::fprintf(file, " ]");
+			}
+
+			std::fprintf(file, " }%s\n", i + 1 < results.size() ? "," : "");
+		}
+		std::fprintf(file, "\t]\n}\n");
+
+		std::fclose(file);
+		return true;
+	}
+};
+
+typedef std::shared_ptr<nbunny::SceneNode> SceneNodePointer;
+
+struct Scene
+{
+	SceneNodePointer root;
+
+	// SceneNode only holds weak references to its children.
+	std::vector<SceneNodePointer> nodes;
+};
+
+static SceneNodePointer addSceneNode(Scene& scene, const SceneNodePointer& parent, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> position(-64.0f, 64.0f);
+	std::uniform_real_distribution<float> height(0.0f, 4.0f);
+
+	auto node = std::make_shared<nbunny::SceneNode>();
+	node->min = glm::vec3(-0.5f);
+	node->max = glm::vec3(0.5f);
+	node->material.shader = (int)(rng() % 8);
+	node->material.textures.push_back((int)(rng() % 16));
+
+	if (parent)
+	{
+		node->parent = parent;
+		node->transform->parent = parent->transform;
+		node->transform->currentTranslation = glm::vec3(position(rng), height(rng), position(rng)) / 8.0f;
+		parent->children.push_back(node);
+	}
+	else
+	{
+		node->transform->currentTranslation = glm::vec3(0.0f);
+	}
+
+	node->transform->currentRotation = glm::angleAxis(position(rng), glm::vec3(0.0f, 1.0f, 0.0f));
+	node->transform->tick();
+
+	scene.nodes.push_back(node);
+	return node;
+}
+
+// Every node is a child of the root.
+static Scene generateFlatScene(std::size_t count, std::mt19937& rng)
+{
+	Scene scene;
+	scene.root = addSceneNode(scene, nullptr, rng);
+
+	while (scene.nodes.size() < count)
+	{
+		addSceneNode(scene, scene.root, rng);
+	}
+
+	return scene;
+}
+
+// Chains of depth nodes hanging off the root.
+static Scene generateDeepScene(std::size_t count, std::size_t depth, std::mt19937& rng)
+{
+	Scene scene;
+	scene.root = addSceneNode(scene, nullptr, rng);
+
+	while (scene.nodes.size() < count)
+	{
+		auto parent = scene.root;
+		for (std::size_t i = 0; i < depth && scene.nodes.size() < count; ++i)
+		{
+			parent = addSceneNode(scene, parent, rng);
+		}
+	}
+
+	return scene;
+}
+
+// A balanced tree where every node has branches children.
+static Scene generateWideScene(std::size_t count, std::size_t branches, std::mt19937& rng)
+{
+	Scene scene;
+	scene.root = addSceneNode(scene, nullptr, rng);
+
+	for (std::size_t i = 0; scene.nodes.size() < count; ++i)
+	{
+		auto parent = scene.nodes[i];
+		for (std::size_t j = 0; j < branches && scene.nodes.size() < count; ++j)
+		{
+			addSceneNode(scene, parent, rng);
+		}
+	}
+
+	return scene;
+}
+
+static nbunny::Camera createCamera()
+{
+	nbunny::Camera camera;
+	camera.view = glm::lookAt(glm::vec3(0.0f, 48.0f, 64.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	camera.projection = glm::perspective(glm::radians(30.0f), 16.0f / 9.0f, 0.1f, 500.0f);
+
+	return camera;
+}
+
+static void benchScene(Bench& bench, const std::string& name, const Scene& scene)
+{
+	auto camera = createCamera();
+	auto count = scene.nodes.size();
+
+	bench.run("scene.walkByMaterial." + name, count, [&]
+	{
+		// Each walk is its own frame.
+		nbunny::FrameArena::get_instance().frame();
+
+		nbunny::FrameVector<SceneNodePointer> result;
+		nbunny::SceneNode::walk_by_material(scene.root, camera, 0.5f, result);
+	});
+
+	bench.run("scene.walkByPosition." + name, count, [&]
+	{
+		// Each walk is its own frame.
+		nbunny::FrameArena::get_instance().frame();
+
+		nbunny::FrameVector<SceneNodePointer> result;
+		nbunny::SceneNode::walk_by_position(scene.root, camera, 0.5f, result);
+	});
+
+	nbunny::LightClusters lights;
+	bench.run("scene.walkByKind." + name, count, [&]
+	{
+		// Each walk is its own frame.
+		nbunny::FrameArena::get_instance().frame();
+
+		nbunny::FrameVector<SceneNodePointer> opaque;
+		nbunny::FrameVector<SceneNodePointer> translucent;
+		nbunny::SceneNode::walk_by_kind(scene.root, camera, 0.5f, opaque, translucent, lights);
+	});
+
+	bench.run("camera.inside." + name, count, [&]
+	{
+		std::size_t visible = 0;
+		for (auto& node: scene.nodes)
+		{
+			visible += camera.inside(*node, 0.5f) ? 1 : 0;
+		}
+
+		if (visible > count)
+		{
+			std::abort();
+		}
+	});
+
+	bench.run("transform.getGlobal." + name, count, [&]
+	{
+		float sum = 0.0f;
+		for (auto& node: scene.nodes)
+		{
+			sum += node->transform->get_global(0.5f)[3][0];
+		}
+
+		if (sum != sum)
+		{
+			std::abort();
+		}
+	});
+}
+
+// Translucent nodes must come back farthest first, so they blend right.
+static bool checkTranslucentOrder()
+{
+	nbunny::FrameArena::get_instance().frame();
+
+	Scene scene;
+	scene.root = std::make_shared<nbunny::SceneNode>();
+	scene.root->transform->tick();
+	scene.nodes.push_back(scene.root);
+
+	// The camera is at +Z looking at the origin, so -Z is farthest.
+	const float DISTANCES[] = { 0.0f, -16.0f, 16.0f, -8.0f };
+	for (auto z: DISTANCES)
+	{
+		auto node = std::make_shared<nbunny::SceneNode>();
+		node->min = glm::vec3(-0.5f);
+		node->max = glm::vec3(0.5f);
+		node->material.is_translucent = true;
+		node->parent = scene.root;
+		node->transform->parent = scene.root->transform;
+		node->transform->currentTranslation = glm::vec3(0.0f, 0.0f, z);
+		node->transform->tick();
+		scene.root->children.push_back(node);
+		scene.nodes.push_back(node);
+	}
+
+	auto camera = createCamera();
+	nbunny::LightClusters lights;
+	nbunny::FrameVector<SceneNodePointer> opaque;
+	nbunny::FrameVector<SceneNodePointer> translucent;
+	nbunny::SceneNode::walk_by_kind(scene.root, camera, 0.5f, opaque, translucent, lights);
+
+	if (translucent.size() != 4)
+	{
+		std::fprintf(stderr, "scene.translucent: expected 4 nodes, got %zu\n", translucent.size());
+		return false;
+	}
+
+	for (std::size_t i = 1; i < translucent.size(); ++i)
+	{
+		auto previous = translucent[i - 1]->transform->currentTranslation.z;
+		auto current = translucent[i]->transform->currentTranslation.z;
+		if (previous > current)
+		{
+			std::fprintf(stderr, "scene.translucent: node at z = %g drawn before node at z = %g\n", previous, current);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Every step-th node in the scene is a point light.
+static void benchLights(Bench& bench, const std::string& name, const Scene& scene, std::size_t step, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> radius(2.0f, 16.0f);
+	for (std::size_t i = 0; i < scene.nodes.size(); i += step)
+	{
+		scene.nodes[i]->kind = nbunny::SCENE_NODE_KIND_POINT_LIGHT;
+		scene.nodes[i]->light_radius = radius(rng);
+	}
+
+	auto camera = createCamera();
+	nbunny::LightClusters clusters;
+	std::vector<float> result(nbunny::LightClusters::MAX_INDICES);
+
+	bench.run("light.build." + name, scene.nodes.size(), [&]
+	{
+		clusters.build(scene.root, camera, 0.5f);
+		clusters.copy_indices(&result[0]);
+	});
+
+	for (std::size_t i = 0; i < scene.nodes.size(); i += step)
+	{
+		scene.nodes[i]->kind = nbunny::SCENE_NODE_KIND_GEOMETRY;
+	}
+}
+
+static nbunny::KeyFrame createKeyFrame(float time, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+	nbunny::KeyFrame result;
+	result.time = time;
+	result.scale = glm::vec3(1.0f + distribution(rng) * 0.1f);
+	result.rotation = glm::normalize(glm::quat(1.0f, distribution(rng), distribution(rng), distribution(rng)));
+	result.translation = glm::vec3(distribution(rng), distribution(rng), distribution(rng));
+
+	return result;
+}
+
+// A skeleton where bone i is a child of bone (i - 1) / 2, with an animation
+// of numFrames key frames per bone.
+struct Animation
+{
+	std::vector<int> parents;
+	std::vector<std::vector<nbunny::KeyFrame>> bones;
+	float duration;
+};
+
+static Animation generateAnimation(std::size_t numBones, std::size_t numFrames, float duration, std::mt19937& rng)
+{
+	Animation animation;
+	animation.duration = duration;
+
+	for (std::size_t i = 0; i < numBones; ++i)
+	{
+		animation.parents.push_back(i == 0 ? -1 : (int)(i - 1) / 2);
+
+		std::vector<nbunny::KeyFrame> frames;
+		for (std::size_t j = 0; j < numFrames; ++j)
+		{
+			frames.push_back(createKeyFrame(duration * j / (numFrames - 1), rng));
+		}
+
+		animation.bones.push_back(frames);
+	}
+
+	return animation;
+}
+
+// Mirrors SkeletonAnimation:computeTransforms.
+static void computeTransforms(const Animation& animation, float time, std::vector<glm::mat4>& transforms)
+{
+	for (std::size_t i = 0; i < animation.bones.size(); ++i)
+	{
+		auto& frames = animation.bones[i];
+		auto next = std::upper_bound(
+			frames.begin() + 1,
+			frames.end() - 1,
+			time,
+			[](float t, const nbunny::KeyFrame& frame) { return t < frame.time; });
+		auto local = nbunny::KeyFrame::interpolate(*(next - 1), *next, time);
+
+		auto parent = animation.parents[i];
+		transforms[i] = parent >= 0 ? transforms[parent] * local : local;
+	}
+}
+
+static void benchAnimation(Bench& bench, std::mt19937& rng)
+{
+	std::vector<nbunny::KeyFrame> frames;
+	for (std::size_t i = 0; i < 4096; ++i)
+	{
+		frames.push_back(createKeyFrame((float)i, rng));
+	}
+
+	bench.run("keyframe.interpolate", frames.size() - 1, [&]
+	{
+		float sum = 0.0f;
+		for (std::size_t i = 0; i + 1 < frames.size(); ++i)
+		{
+			sum += nbunny::KeyFrame::interpolate(frames[i], frames[i + 1], frames[i].time + 0.5f)[3][0];
+		}
+
+		if (sum != sum)
+		{
+			std::abort();
+		}
+	});
+
+	const std::size_t NUM_ANIMATIONS = 16;
+	const std::size_t NUM_BONES = 64;
+
+	std::vector<Animation> animations;
+	for (std::size_t i = 0; i < NUM_ANIMATIONS; ++i)
+	{
+		animations.push_back(generateAnimation(NUM_BONES, 60, 2.0f, rng));
+	}
+
+	std::vector<glm::mat4> transforms(NUM_BONES);
+	float time = 0.0f;
+	bench.run("animation.computeTransforms.64", NUM_ANIMATIONS * NUM_BONES, [&]
+	{
+		for (auto& animation: animations)
+		{
+			computeTransforms(animation, time, transforms);
+		}
+
+		time = std::fmod(time + 1.0f / 60.0f, 2.0f);
+	});
+}
+
+static void generateMovementMap(nbunny::MovementMap& map, std::mt19937& rng)
+{
+	std::uniform_real_distribution<double> height(0.0, 2.0);
+
+	for (int i = 1; i <= map.get_width(); ++i)
+	{
+		for (int j = 1; j <= map.get_height(); ++j)
+		{
+			auto& tile = map.get_tile(i, j);
+			tile.top_left = height(rng);
+			tile.top_right = height(rng);
+			tile.bottom_left = height(rng);
+			tile.bottom_right = height(rng);
+			tile.flags = rng() % 10 == 0 ? nbunny::MovementMap::FLAG_IMPASSABLE : 0;
+		}
+	}
+}
+
+static void benchMovement(Bench& bench, std::mt19937& rng)
+{
+	const int SIZE = 128;
+	const double CELL_SIZE = 2.0;
+	const std::size_t NUM_PEEPS = 4096;
+
+	nbunny::MovementSolver solver;
+	auto& map = solver.set_map(1, SIZE, SIZE, CELL_SIZE);
+	generateMovementMap(map, rng);
+
+	// The closest thing to a path finding grid in nbunny; the path finders
+	// themselves are in Lua.
+	bench.run("movement.canMove.128", SIZE * SIZE * 4, [&]
+	{
+		std::size_t passable = 0;
+		for (int i = 1; i <= SIZE; ++i)
+		{
+			for (int j = 1; j <= SIZE; ++j)
+			{
+				passable += map.can_move(i, j, -1, 0) ? 1 : 0;
+				passable += map.can_move(i, j, 1, 0) ? 1 : 0;
+				passable += map.can_move(i, j, 0, -1) ? 1 : 0;
+				passable += map.can_move(i, j, 0, 1) ? 1 : 0;
+			}
+		}
+
+		if (passable > SIZE * SIZE * 4)
+		{
+			std::abort();
+		}
+	});
+
+	std::uniform_real_distribution<double> position(0.0, SIZE * CELL_SIZE);
+	std::uniform_real_distribution<double> velocity(-8.0, 8.0);
+	for (std::size_t i = 0; i < NUM_PEEPS; ++i)
+	{
+		nbunny::MovementState state;
+		state.position[0] = position(rng);
+		state.position[2] = position(rng);
+		state.velocity[0] = velocity(rng);
+		state.velocity[2] = velocity(rng);
+		state.max_speed = 16.0;
+		state.max_acceleration = 16.0;
+		state.decay = 0.5;
+		solver.add(state);
+	}
+
+	nbunny::MovementSolver::Parameters parameters;
+	parameters.gravity[1] = -18.0;
+	parameters.delta = 1.0 / 10.0;
+
+	bench.run("movement.step.4096", NUM_PEEPS, [&]
+	{
+		solver.step(parameters);
+	});
+
+	nbunny::KernelScheduler scheduler;
+	nbunny::KernelScheduler::Components components;
+	components.set(0);
+
+	bench.run("movement.scheduler.4096", NUM_PEEPS, [&]
+	{
+		solver.set_parameters(parameters);
+		scheduler.add(solver, components, components);
+		scheduler.run();
+	});
+}
+
+// A Peep teleported far away must be found at its new tile, and not at its
+// old one, as soon as it's re-indexed; the Director doesn't widen queries.
+static bool checkSpatialTeleport()
+{
+	const int PEEP = 1;
+	const int PROBER = 2;
+
+	nbunny::SpatialIndex index;
+	index.update(PEEP, 1, 4, 4);
+	index.update(PROBER, 1, 4, 5);
+
+	// Same tick: the Peep teleports, then the prober follows and probes.
+	index.update(PEEP, 1, 200, 200);
+	index.update(PROBER, 1, 200, 201);
+
+	std::vector<int> result;
+	index.query_near(-1, 200, 201, 1, result);
+	if (std::find(result.begin(), result.end(), PEEP) == result.end())
+	{
+		std::fprintf(stderr, "spatial.teleport: peep not found at its new tile\n");
+		return false;
+	}
+
+	result.clear();
+	index.query_near(-1, 4, 5, 1, result);
+	if (std::find(result.begin(), result.end(), PEEP) != result.end())
+	{
+		std::fprintf(stderr, "spatial.teleport: peep still found at its old tile\n");
+		return false;
+	}
+
+	return true;
+}
+
+static void benchSpatial(Bench& bench, std::mt19937& rng)
+{
+	const int SIZE = 256;
+	const std::size_t NUM_HANDLES = 16384;
+	const std::size_t NUM_QUERIES = 1024;
+
+	std::uniform_int_distribution<int> tile(0, SIZE - 1);
+
+	nbunny::SpatialIndex index;
+	for (std::size_t i = 0; i < NUM_HANDLES; ++i)
+	{
+		index.update((int)i, 1, tile(rng), tile(rng));
+	}
+
+	bench.run("spatial.update.16384", NUM_HANDLES, [&]
+	{
+		for (std::size_t i = 0; i < NUM_HANDLES; ++i)
+		{
+			index.update((int)i, 1, tile(rng), tile(rng));
+		}
+	});
+
+	std::vector<int> result;
+	bench.run("spatial.queryNear.8", NUM_QUERIES, [&]
+	{
+		for (std::size_t i = 0; i < NUM_QUERIES; ++i)
+		{
+			result.clear();
+			index.query_near(1, tile(rng), tile(rng), 8, result);
+		}
+	});
+}
+
+static void benchArchetypes(Bench& bench, std::mt19937& rng)
+{
+	const std::size_t NUM_HANDLES = 16384;
+	const std::size_t NUM_COMPONENTS = 16;
+
+	nbunny::ArchetypeIndex index;
+	for (std::size_t i = 0; i < NUM_HANDLES; ++i)
+	{
+		nbunny::ArchetypeIndex::Mask mask;
+		for (std::size_t j = 0; j < NUM_COMPONENTS; ++j)
+		{
+			if (rng() % 3 == 0)
+			{
+				mask.set(j);
+			}
+		}
+
+		index.set_components((int)i, mask);
+	}
+
+	nbunny::ArchetypeIndex::Mask queryMask;
+	queryMask.set(0);
+	queryMask.set(1);
+	auto query = index.add_query(queryMask);
+
+	std::vector<int> result;
+	bench.run("archetype.getQueryHandles.16384", NUM_HANDLES, [&]
+	{
+		result.clear();
+		index.get_query_handles(query, result);
+	});
+
+	bench.run("archetype.match.16384", NUM_HANDLES, [&]
+	{
+		std::size_t matches = 0;
+		for (std::size_t i = 0; i < NUM_HANDLES; ++i)
+		{
+			matches += index.match((int)i, query) ? 1 : 0;
+		}
+
+		if (matches > NUM_HANDLES)
+		{
+			std::abort();
+		}
+	});
+
+	bench.run("archetype.addRemoveComponent.16384", NUM_HANDLES, [&]
+	{
+		for (std::size_t i = 0; i < NUM_HANDLES; ++i)
+		{
+			auto component = rng() % NUM_COMPONENTS;
+			if (index.has_component((int)i, component))
+			{
+				index.remove_component((int)i, component);
+			}
+			else
+			{
+				index.add_component((int)i, component);
+			}
+		}
+	});
+}
+
+// Heavy rain (two streaks per tile) and spores over a hilly map, with a few
+// ships sailing over it.
+static void benchWeather(Bench& bench, std::mt19937& rng)
+{
+	const int SIZE = 128;
+	const std::size_t NUM_PARTICLES = SIZE * SIZE * 2;
+	const int NUM_SHIPS = 4;
+	const int SHIP_WIDTH = 8;
+	const int SHIP_HEIGHT = 24;
+
+	std::uniform_real_distribution<float> height(0.0f, 8.0f);
+
+	nbunny::WeatherMap map;
+	map.resize(SIZE, SIZE);
+	map.set_map(0, SIZE, SIZE, map.get_cell_size());
+	for (int i = 0; i < SIZE * SIZE; ++i)
+	{
+		map.get_map_heights(0)[i] = height(rng);
+	}
+
+	for (int i = 1; i <= NUM_SHIPS; ++i)
+	{
+		map.set_map(i, SHIP_WIDTH, SHIP_HEIGHT, map.get_cell_size());
+		for (int j = 0; j < SHIP_WIDTH * SHIP_HEIGHT; ++j)
+		{
+			map.get_map_heights(i)[j] = 4.0f;
+		}
+	}
+
+	map.update();
+
+	float time = 0.0f;
+	auto sail = [&]
+	{
+		time += 1.0f / 60.0f;
+		for (int i = 1; i <= NUM_SHIPS; ++i)
+		{
+			auto transform = glm::translate(glm::mat4(1.0f), glm::vec3(i * 48.0f + time, 0.0f, 64.0f + i * 16.0f));
+			transform = glm::rotate(transform, time + i, glm::vec3(0.0f, 1.0f, 0.0f));
+			map.set_map_transform(i, transform);
+		}
+	};
+
+	bench.run("weather.map.update.ships.4", 1, [&]
+	{
+		sail();
+		map.update();
+	});
+
+	bench.run("weather.map.update.full", 1, [&]
+	{
+		sail();
+		map.resize(SIZE, SIZE);
+		map.update();
+	});
+
+	nbunny::RainWeather rain;
+	rain.resize(NUM_PARTICLES);
+
+	std::vector<float> rainVertices(NUM_PARTICLES * nbunny::RainWeather::VERTICES_PER_PARTICLE * nbunny::RainWeather::FLOATS_PER_VERTEX);
+	for (int i = 0; i < 100; ++i)
+	{
+		rain.update(map, SIZE, SIZE, 1.0f, &rainVertices[0]);
+	}
+
+	bench.run("weather.rain.update.32768", NUM_PARTICLES, [&]
+	{
+		rain.update(map, SIZE, SIZE, 1.0f / 60.0f, &rainVertices[0]);
+	});
+
+	nbunny::FungalWeather spores;
+	spores.colors = { glm::vec4(1.0f), glm::vec4(0.5f, 1.0f, 0.5f, 1.0f) };
+	spores.resize(NUM_PARTICLES);
+
+	std::vector<float> sporeVertices(NUM_PARTICLES * nbunny::FungalWeather::VERTICES_PER_PARTICLE * nbunny::FungalWeather::FLOATS_PER_VERTEX);
+	for (int i = 0; i < 100; ++i)
+	{
+		spores.update(map, SIZE, SIZE, 1.0f, &sporeVertices[0]);
+	}
+
+	bench.run("weather.fungal.update.32768", NUM_PARTICLES, [&]
+	{
+		spores.update(map, SIZE, SIZE, 1.0f / 60.0f, &sporeVertices[0]);
+	});
+}
+
+// A big fight: a health bar and a few damage splats stacked on each actor.
+static void benchSprites(Bench& bench, const std::string& name, const Scene& scene, std::size_t count, std::mt19937& rng)
+{
+	auto camera = createCamera();
+
+	std::uniform_int_distribution<std::size_t> node(1, scene.nodes.size() - 1);
+	std::uniform_int_distribution<int> stack(0, 3);
+
+	nbunny::SpriteProjector projector;
+	for (std::size_t i = 0; i < count; )
+	{
+		auto actor = scene.nodes[node(rng)];
+		for (int j = stack(rng); j >= 0 && i < count; --j, ++i)
+		{
+			projector.add(actor, glm::vec3(0.0f, 2.0f + j * 0.5f, 0.0f));
+		}
+	}
+
+	bench.run("sprite.project." + name, count, [&]
+	{
+		projector.project(camera, 0.5f, 1920, 1080);
+	});
+}
+
+// An ocean on a sailing map (256 by 256 tiles, two quads per tile).
+static void benchWater(Bench& bench)
+{
+	const int SIZE = 512;
+
+	bench.run("water.build.512", SIZE * SIZE, [&]
+	{
+		nbunny::WaterMesh water;
+		water.resize(SIZE, SIZE);
+		water.update();
+	});
+
+	nbunny::WaterMesh water;
+	water.resize(SIZE, SIZE);
+	water.update();
+
+	int width = SIZE;
+	bench.run("water.resize.512", 1, [&]
+	{
+		width = width == SIZE ? SIZE - 2 : SIZE;
+		water.resize(width, SIZE);
+		water.update();
+	});
+
+	water.resize(SIZE, SIZE);
+	water.enable_lod(32.0f);
+
+	float time = 0.0f;
+	bench.run("water.lod.512", 1, [&]
+	{
+		time += 1.0f / 60.0f;
+		water.set_focus(SIZE / 2 + std::cos(time) * 128.0f, SIZE / 2 + std::sin(time) * 128.0f);
+		water.update();
+	});
+}
+
+// A 128 by 128 hilly map in chunks of 16 by 16 tiles, painted one tile at
+// a time like in the editor.
+static void benchMapChunks(Bench& bench, std::mt19937& rng)
+{
+	const int SIZE = 128;
+	const int CHUNK_SIZE = 16;
+
+	std::uniform_real_distribution<float> height(0.0f, 4.0f);
+	std::uniform_int_distribution<int> tile(0, SIZE - 1);
+
+	nbunny::MapChunks chunks;
+	chunks.resize(SIZE, SIZE, CHUNK_SIZE);
+
+	auto tiles = chunks.get_tiles();
+	for (int i = 0; i < SIZE * SIZE; ++i)
+	{
+		auto t = tiles + i * nbunny::MAP_TILE_NUM_FIELDS;
+		t[nbunny::MAP_TILE_TOP_LEFT] = height(rng);
+		t[nbunny::MAP_TILE_TOP_RIGHT] = height(rng);
+		t[nbunny::MAP_TILE_BOTTOM_LEFT] = height(rng);
+		t[nbunny::MAP_TILE_BOTTOM_RIGHT] = height(rng);
+		t[nbunny::MAP_TILE_FLAT] = 1.0f;
+		t[nbunny::MAP_TILE_RED] = 1.0f;
+		t[nbunny::MAP_TILE_GREEN] = 1.0f;
+		t[nbunny::MAP_TILE_BLUE] = 1.0f;
+		t[nbunny::MAP_TILE_TEXTURE_RIGHT] = 1.0f;
+		t[nbunny::MAP_TILE_TEXTURE_BOTTOM] = 1.0f;
+	}
+
+	bench.run("map.chunks.build.128", SIZE * SIZE, [&]
+	{
+		chunks.set_cell_size(chunks.get_cell_size() == 2.0f ? 1.0f : 2.0f);
+		chunks.update();
+	});
+
+	bench.run("map.chunks.paint.128", 1, [&]
+	{
+		auto t = tiles + (tile(rng) * SIZE + tile(rng)) * nbunny::MAP_TILE_NUM_FIELDS;
+		t[nbunny::MAP_TILE_FLAT] = t[nbunny::MAP_TILE_FLAT] == 1.0f ? 2.0f : 1.0f;
+		chunks.invalidate_tiles();
+		chunks.update();
+	});
+
+	chunks.enable_lod(64.0f);
+
+	float time = 0.0f;
+	bench.run("map.chunks.lod.128", 1, [&]
+	{
+		time += 1.0f / 60.0f;
+		chunks.set_focus(SIZE + std::cos(time) * 64.0f, SIZE + std::sin(time) * 64.0f);
+		chunks.update();
+	});
+}
+
+// Like a skinned model exported by goober's default profile.
+static std::string generateModelText(std::size_t numVertices, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+	std::uniform_int_distribution<int> bone(1, 32);
+
+	std::string result = "{\n\tformat = {\n"
+		"\t\t{ 'VertexPosition', 'float', 3 },\n"
+		"\t\t{ 'VertexNormal', 'float', 3 },\n"
+		"\t\t{ 'VertexTexture', 'float', 2 },\n"
+		"\t\t{ 'VertexBoneIndex', 'float', 4 },\n"
+		"\t\t{ 'VertexBoneWeight', 'float', 4 },\n"
+		"\t},\n\tvertices = {\n";
+
+	char buffer[512];
+	for (std::size_t i = 0; i < numVertices; ++i)
+	{
+		std::snprintf(
+			buffer, sizeof(buffer),
+			"\t\t{ %f, %f, %f, %f, %f, %f, %f, %f, \"Bone.%03d\", false, false, false, 1.000000, 0.000000, 0.000000, 0.000000, },\n",
+			value(rng), value(rng), value(rng),
+			value(rng), value(rng), value(rng),
+			value(rng), value(rng),
+			bone(rng));
+		result += buffer;
+	}
+
+	result += "\t},\n}\n";
+	return result;
+}
+
+static void benchResources(Bench& bench, std::mt19937& rng)
+{
+	const std::size_t NUM_VERTICES = 4096;
+	const std::size_t NUM_MODELS = 64;
+
+	auto model = generateModelText(NUM_VERTICES, rng);
+
+	bench.run("resource.decode.model.4096", NUM_VERTICES, [&]
+	{
+		nbunny::ResourceLoader::Result result;
+		result.data = model;
+		nbunny::ResourceLoader::decode(nbunny::ResourceLoader::KIND_MODEL, result);
+	});
+
+	nbunny::ResourceLoader loader;
+	std::printf("resource.loader: %zu threads\n", loader.get_num_threads());
+
+	bench.run("resource.loader.model.64", NUM_MODELS * NUM_VERTICES, [&]
+	{
+		for (std::size_t i = 0; i < NUM_MODELS; ++i)
+		{
+			loader.submit_data(nbunny::ResourceLoader::KIND_MODEL, model, (float)i);
+		}
+
+		std::size_t remaining = NUM_MODELS;
+		while (remaining > 0)
+		{
+			auto id = loader.poll();
+			if (id)
+			{
+				loader.release(id);
+				--remaining;
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+		}
+	});
+}
+
+static void benchBake(Bench& bench, std::mt19937& rng)
+{
+	const std::size_t NUM_VERTICES = 4096;
+
+	nbunny::ResourceLoader::Result result;
+	result.data = generateModelText(NUM_VERTICES, rng);
+
+	nbunny::BakeHash hash;
+	bench.run("resource.bake.hash.model.4096", NUM_VERTICES, [&]
+	{
+		hash = nbunny::BakeHash();
+		hash.update(result.data.data(), result.data.size());
+	});
+
+	nbunny::ResourceLoader::decode(nbunny::ResourceLoader::KIND_MODEL, result);
+
+	// Bakes into the working directory; the file is removed afterwards.
+	nbunny::BakeCache cache(".");
+	if (!cache.save(hash.get_value(), result.format, result.bones, result.meshes))
+	{
+		std::printf("resource.bake: couldn't save '%s'\n", cache.get_filename(hash.get_value()).c_str());
+		return;
+	}
+
+	bench.run("resource.bake.load.model.4096", NUM_VERTICES, [&]
+	{
+		auto file = cache.load(hash.get_value());
+		if (!file)
+		{
+			std::abort();
+		}
+	});
+
+	std::remove(cache.get_filename(hash.get_value()).c_str());
+}
+
+static void benchResourceCache(Bench& bench, std::mt19937& rng)
+{
+	const std::size_t NUM_KEYS = 4096;
+	const std::size_t NUM_LOADS = 4096;
+	const std::size_t SIZE = 64 * 1024;
+
+	std::vector<std::string> keys;
+	for (std::size_t i = 0; i < NUM_KEYS; ++i)
+	{
+		keys.push_back("Resources/Game/Bodies/Armor" + std::to_string(i) + "/Model.lmodel");
+	}
+
+	// Most loads are for a few resources, like the armor of actors nearby.
+	std::vector<std::size_t> loads;
+	std::geometric_distribution<std::size_t> distribution(0.01);
+	for (std::size_t i = 0; i < NUM_LOADS; ++i)
+	{
+		loads.push_back(std::min(distribution(rng), NUM_KEYS - 1));
+	}
+
+	nbunny::ResourceCache cache(SIZE * NUM_KEYS / 16);
+	for (std::size_t i = 0; i < 64; ++i)
+	{
+		cache.put(0, keys[i * 64], SIZE);
+		cache.pin(0, keys[i * 64]);
+	}
+
+	bench.run("resource.cache.4096", NUM_LOADS, [&]
+	{
+		int type;
+		std::string key;
+
+		for (auto load: loads)
+		{
+			if (!cache.get(0, keys[load]))
+			{
+				cache.put(0, keys[load], SIZE);
+			}
+		}
+
+		while (cache.pop_evicted(type, key))
+		{
+			// Nothing.
+		}
+	});
+
+	auto stats = cache.get_stats(0);
+	std::printf(
+		"resource.cache: %.1f%% hits, %zu evictions, %zu bytes (%zu pinned)\n",
+		stats.hits * 100.0 / (stats.hits + stats.misses),
+		stats.evictions,
+		stats.bytes,
+		stats.pinned_bytes);
+}
+
+static void benchProfiler(Bench& bench)
+{
+	const std::size_t NUM_SCOPES = 4096;
+
+	auto& profiler = nbunny::Profiler::get_instance();
+	auto name = profiler.get_name_id("bench");
+
+	bench.run("profiler.scope.disabled", NUM_SCOPES, [&]
+	{
+		for (std::size_t i = 0; i < NUM_SCOPES; ++i)
+		{
+			nbunny::ProfileScope scope(name);
+		}
+	});
+
+	profiler.enable();
+	bench.run("profiler.scope.enabled", NUM_SCOPES, [&]
+	{
+		for (std::size_t i = 0; i < NUM_SCOPES; ++i)
+		{
+			nbunny::ProfileScope scope(name);
+		}
+	});
+	profiler.disable();
+}
+
+// Replays a recording made in game with nbunny.recorder (F10 in debug
+// builds). The benchmark is the time per frame, followed by a histogram of
+// the individual frame times.
+static bool benchReplay(Bench& bench, const std::string& filename)
+{
+	std::ifstream stream(filename, std::ios::binary);
+	std::string data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+	nbunny::Replay replay;
+	if (!stream.is_open() || !replay.load(data) || replay.get_num_frames() == 0)
+	{
+		std::fprintf(stderr, "couldn't load replay %s\n", filename.c_str());
+		return false;
+	}
+
+	auto name = "replay." + filename.substr(filename.find_last_of("/\\") + 1);
+	if (!bench.options.filter.empty() && name.find(bench.options.filter) == std::string::npos)
+	{
+		return true;
+	}
+
+	bench.run(name, replay.get_num_frames(), [&]
+	{
+		replay.reset();
+		while (replay.play_frame())
+		{
+			// Nothing.
+		}
+	});
+
+	std::vector<double> frames;
+	auto before = std::chrono::steady_clock::now();
+	do
+	{
+		replay.reset();
+
+		bool playing;
+		do
+		{
+			auto frameBefore = std::chrono::steady_clock::now();
+			playing = replay.play_frame();
+			auto frameAfter = std::chrono::steady_clock::now();
+
+			if (playing)
+			{
+				frames.push_back(std::chrono::duration<double>(frameAfter - frameBefore).count());
+			}
+		} while (playing);
+	} while (!frames.empty() && std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count() < bench.options.minTime);
+
+	std::sort(frames.begin(), frames.end());
+
+	std::printf(
+		"  %zu frames, %zu walked nodes, checksum %g\n",
+		replay.get_num_frames(),
+		replay.get_num_walked_nodes(),
+		replay.get_checksum());
+
+	if (frames.empty())
+	{
+		return true;
+	}
+
+	std::printf(
+		"  p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+		getPercentile(frames, 0.5) * 1000.0,
+		getPercentile(frames, 0.95) * 1000.0,
+		getPercentile(frames, 0.99) * 1000.0,
+		frames.back() * 1000.0);
+
+	auto histogram = getHistogram(frames);
+	auto largest = *std::max_element(histogram.begin(), histogram.end());
+	for (std::size_t i = 0; i < histogram.size(); ++i)
+	{
+		if (histogram[i] == 0)
+		{
+			continue;
+		}
+
+		std::printf(
+			"  < %8.0f us %10zu %s\n",
+			std::ldexp(1.0, (int)i),
+			histogram[i],
+			std::string(histogram[i] * 50 / largest, '#').c_str());
+	}
+
+	bench.results.back().frames = std::move(frames);
+
+	return true;
+}
+
+int main(int argc, const char* argv[])
+{
+	Bench bench;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+		{
+			bench.options.filter = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+		{
+			bench.options.json = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--time") == 0 && i + 1 < argc)
+		{
+			bench.options.minTime = std::atof(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+		{
+			bench.options.seed = (unsigned int)std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+		{
+			bench.options.replays.push_back(argv[++i]);
+		}
+		else
+		{
+			std::fprintf(stderr, "%s [--filter <substring>] [--json <output>] [--time <seconds per benchmark>] [--seed <seed>] [--replay <recording>]...\n", argv[0]);
+			return 1;
+		}
+	}
+
+	// Behavior the benchmarks rely on. Cheap, so always checked.
+	if (!checkTranslucentOrder() || !checkSpatialTeleport())
+	{
+		return 1;
+	}
+
+	std::mt19937 rng(bench.options.seed);
+
+	benchScene(bench, "flat.10000", generateFlatScene(10000, rng));
+	benchScene(bench, "flat.50000", generateFlatScene(50000, rng));
+	benchScene(bench, "deep.10000", generateDeepScene(10000, 32, rng));
+	benchScene(bench, "wide.10000", generateWideScene(10000, 16, rng));
+	benchScene(bench, "wide.50000", generateWideScene(50000, 16, rng));
+	benchLights(bench, "flat.10000.100", generateFlatScene(10000, rng), 100, rng);
+	benchLights(bench, "flat.10000.10", generateFlatScene(10000, rng), 10, rng);
+	benchAnimation(bench, rng);
+	benchMovement(bench, rng);
+	benchSpatial(bench, rng);
+	benchArchetypes(bench, rng);
+	benchWeather(bench, rng);
+	benchSprites(bench, "flat.1000.4096", generateFlatScene(1000, rng), 4096, rng);
+	benchWater(bench);
+	benchMapChunks(bench, rng);
+	benchResources(bench, rng);
+	benchBake(bench, rng);
+	benchResourceCache(bench, rng);
+	benchProfiler(bench);
+
+	for (auto& replay: bench.options.replays)
+	{
+		if (!benchReplay(bench, replay))
+		{
+			return 1;
+		}
+	}
+
+	if (!bench.options.json.empty() && !bench.writeJSON())
+	{
+		return 1;
+	}
+
+	return 0;
+}
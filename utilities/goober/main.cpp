@@ -9,81 +9,431 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
 #include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/mesh.h>
 #include <assimp/postprocess.h>
+#include "nbunny/codec.hpp"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
-void exportAnimation(const aiScene* scene, FILE* output)
+struct ExportOptions
 {
-	if (scene->mNumAnimations < 1)
+	// Reorder triangles and vertices for post-transform cache locality.
+	bool optimize = false;
+
+	// Quantize vertex attributes and reduce/quantize key frames.
+	bool compress = false;
+
+	// Maximum error allowed when removing key frames.
+	float translationTolerance = 0.001f;
+	float rotationTolerance = 0.001f; // in radians
+	float scaleTolerance = 0.001f;
+
+	// If positive, resample every channel of an animation to this many keys
+	// per unit of time, starting at zero, so all bones share key times.
+	float frameRate = 0.0f;
+};
+
+static bool isChannelAligned(const aiNodeAnim* channel)
+{
+	if (channel->mNumPositionKeys != channel->mNumRotationKeys ||
+		channel->mNumRotationKeys != channel->mNumScalingKeys)
 	{
-		std::fprintf(stderr, "no animations\n");
+		return false;
+	}
+
+	for (int i = 0; i < channel->mNumPositionKeys; ++i)
+	{
+		if (channel->mPositionKeys[i].mTime != channel->mRotationKeys[i].mTime ||
+			channel->mRotationKeys[i].mTime != channel->mScalingKeys[i].mTime)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static float getVectorError(const aiVectorKey* keys, int first, int last, int current)
+{
+	auto& a = keys[first];
+	auto& b = keys[last];
+	auto& c = keys[current];
+
+	float delta = (float)((c.mTime - a.mTime) / (b.mTime - a.mTime));
+	float x = a.mValue.x + (b.mValue.x - a.mValue.x) * delta - c.mValue.x;
+	float y = a.mValue.y + (b.mValue.y - a.mValue.y) * delta - c.mValue.y;
+	float z = a.mValue.z + (b.mValue.z - a.mValue.z) * delta - c.mValue.z;
+
+	return std::sqrt(x * x + y * y + z * z);
+}
+
+static float getQuaternionError(const aiQuatKey* keys, int first, int last, int current)
+{
+	auto& a = keys[first];
+	auto& b = keys[last];
+	auto& c = keys[current];
+
+	float delta = (float)((c.mTime - a.mTime) / (b.mTime - a.mTime));
+	aiQuaternion q;
+	aiQuaternion::Interpolate(q, a.mValue, b.mValue, delta);
+	q.Normalize();
+
+	float dot = std::abs(
+		q.x * c.mValue.x +
+		q.y * c.mValue.y +
+		q.z * c.mValue.z +
+		q.w * c.mValue.w);
+
+	return 2.0f * std::acos(std::min(dot, 1.0f));
+}
+
+// Removes key frames that can be reproduced (within tolerance) by
+// interpolating their neighbors, in the spirit of Ramer-Douglas-Peucker.
+//
+// Translation, rotation and scale keys are removed together because the
+// runtime expects all three to share the same times. Channels that don't
+// (or when compression is disabled) are left alone.
+void reduceKeyFrames(const aiNodeAnim* channel, const ExportOptions& options, std::vector<int>& result)
+{
+	int count = (int)channel->mNumPositionKeys;
+	if (!options.compress || count <= 2 || !isChannelAligned(channel))
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			result.push_back(i);
+		}
+
 		return;
 	}
 
-	auto animation = scene->mAnimations[0];
-	std::fprintf(output, "{\n");
+	std::vector<bool> isKept(count, false);
+	isKept[0] = true;
+	isKept[count - 1] = true;
+
+	std::vector<std::pair<int, int>> ranges;
+	ranges.push_back(std::make_pair(0, count - 1));
+	while (!ranges.empty())
+	{
+		auto range = ranges.back();
+		ranges.pop_back();
+
+		int worstKey = -1;
+		float worstError = 1.0f;
+		for (int i = range.first + 1; i < range.second; ++i)
+		{
+			float error = std::max(
+				getVectorError(channel->mPositionKeys, range.first, range.second, i) / options.translationTolerance,
+				std::max(
+					getQuaternionError(channel->mRotationKeys, range.first, range.second, i) / options.rotationTolerance,
+					getVectorError(channel->mScalingKeys, range.first, range.second, i) / options.scaleTolerance));
+
+			if (error > worstError)
+			{
+				worstKey = i;
+				worstError = error;
+			}
+		}
+
+		if (worstKey >= 0)
+		{
+			isKept[worstKey] = true;
+			ranges.push_back(std::make_pair(range.first, worstKey));
+			ranges.push_back(std::make_pair(worstKey, range.second));
+		}
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		if (isKept[i])
+		{
+			result.push_back(i);
+		}
+	}
+}
+
+template <typename K>
+static int findKey(const K* keys, int count, double time)
+{
+	int index = 0;
+	while (index + 1 < count && keys[index + 1].mTime <= time)
+	{
+		++index;
+	}
+
+	return index;
+}
+
+static aiVector3D sampleVectorKeys(const aiVectorKey* keys, int count, double time)
+{
+	int current = findKey(keys, count, time);
+	int next = std::min(current + 1, count - 1);
+
+	auto& a = keys[current];
+	auto& b = keys[next];
+
+	float delta = 0.0f;
+	if (b.mTime > a.mTime)
+	{
+		delta = (float)std::min(std::max((time - a.mTime) / (b.mTime - a.mTime), 0.0), 1.0);
+	}
+
+	aiVector3D result;
+	result.x = a.mValue.x + (b.mValue.x - a.mValue.x) * delta;
+	result.y = a.mValue.y + (b.mValue.y - a.mValue.y) * delta;
+	result.z = a.mValue.z + (b.mValue.z - a.mValue.z) * delta;
+
+	return result;
+}
+
+static aiQuaternion sampleQuaternionKeys(const aiQuatKey* keys, int count, double time)
+{
+	int current = findKey(keys, count, time);
+	int next = std::min(current + 1, count - 1);
+
+	auto& a = keys[current];
+	auto& b = keys[next];
+
+	float delta = 0.0f;
+	if (b.mTime > a.mTime)
+	{
+		delta = (float)std::min(std::max((time - a.mTime) / (b.mTime - a.mTime), 0.0), 1.0);
+	}
+
+	aiQuaternion result;
+	aiQuaternion::Interpolate(result, a.mValue, b.mValue, delta);
+	result.Normalize();
+
+	return result;
+}
+
+double getAnimationDuration(const aiAnimation* animation)
+{
+	double duration = 0.0;
 	for (int i = 0; i < animation->mNumChannels; ++i)
 	{
 		auto channel = animation->mChannels[i];
-		auto node = scene->mRootNode->FindNode(channel->mNodeName);
-		std::fprintf(output, "\t[\"%s\"] = {\n", channel->mNodeName.C_Str());
+		if (channel->mNumPositionKeys > 0)
+		{
+			duration = std::max(duration, channel->mPositionKeys[channel->mNumPositionKeys - 1].mTime);
+		}
+
+		if (channel->mNumRotationKeys > 0)
+		{
+			duration = std::max(duration, channel->mRotationKeys[channel->mNumRotationKeys - 1].mTime);
+		}
+
+		if (channel->mNumScalingKeys > 0)
+		{
+			duration = std::max(duration, channel->mScalingKeys[channel->mNumScalingKeys - 1].mTime);
+		}
+	}
+
+	return duration;
+}
+
+// Resamples 'channel' so it has a key every 1 / frameRate units of time from
+// zero until 'duration' (inclusive), with translation, rotation and scale
+// keys all at the same times.
+std::unique_ptr<aiNodeAnim> resampleChannel(const aiNodeAnim* channel, double duration, float frameRate)
+{
+	int count = (int)std::ceil(duration * frameRate - 0.0001) + 1;
+
+	std::unique_ptr<aiNodeAnim> result(new aiNodeAnim());
+	result->mNodeName = channel->mNodeName;
+	result->mNumPositionKeys = count;
+	result->mPositionKeys = new aiVectorKey[count];
+	result->mNumRotationKeys = count;
+	result->mRotationKeys = new aiQuatKey[count];
+	result->mNumScalingKeys = count;
+	result->mScalingKeys = new aiVectorKey[count];
+
+	for (int i = 0; i < count; ++i)
+	{
+		double time = i / (double)frameRate;
 
-		std::fprintf(output, "\t\ttranslation = {\n");
-		for (int j = 0; j < channel->mNumPositionKeys; ++j)
+		result->mPositionKeys[i].mTime = time;
+		result->mPositionKeys[i].mValue = sampleVectorKeys(channel->mPositionKeys, channel->mNumPositionKeys, time);
+
+		result->mRotationKeys[i].mTime = time;
+		result->mRotationKeys[i].mValue = sampleQuaternionKeys(channel->mRotationKeys, channel->mNumRotationKeys, time);
+
+		result->mScalingKeys[i].mTime = time;
+		result->mScalingKeys[i].mValue = sampleVectorKeys(channel->mScalingKeys, channel->mNumScalingKeys, time);
+	}
+
+	return result;
+}
+
+// Exports the translation, rotation, and scale keys of a channel.
+//
+// 'indent' is the indentation of the keys' parent table.
+void exportChannel(const aiNodeAnim* channel, const ExportOptions& options, const char* indent, FILE* output)
+{
+	// Resampled channels must keep every key so the runtime can find keys
+	// by index.
+	std::vector<int> keys;
+	bool isReduced = options.compress && options.frameRate <= 0.0f && isChannelAligned(channel);
+	if (isReduced)
+	{
+		reduceKeyFrames(channel, options, keys);
+	}
+
+	if (options.frameRate > 0.0f)
+	{
+		std::fprintf(output, "%s\tframeRate = %f,\n", indent, options.frameRate);
+	}
+
+	std::fprintf(output, "%s\ttranslation = {\n", indent);
+	for (int j = 0; j < channel->mNumPositionKeys; ++j)
+	{
+		if (isReduced && !std::binary_search(keys.begin(), keys.end(), j))
+		{
+			continue;
+		}
+
+		auto positionKey = &channel->mPositionKeys[j];
+		std::fprintf(
+			output,
+			"%s\t\t{ time = %f, %f, %f, %f },\n",
+			indent,
+			positionKey->mTime,
+			positionKey->mValue.x,
+			positionKey->mValue.y,
+			positionKey->mValue.z);
+	}
+	std::fprintf(output, "%s\t},\n", indent);
+
+	std::fprintf(output, "%s\trotation = {\n", indent);
+	if (options.compress)
+	{
+		std::fprintf(output, "%s\t\tencoding = \"smallest3\",\n", indent);
+	}
+	for (int j = 0; j < channel->mNumRotationKeys; ++j)
+	{
+		if (isReduced && !std::binary_search(keys.begin(), keys.end(), j))
+		{
+			continue;
+		}
+
+		auto rotationKey = &channel->mRotationKeys[j];
+		if (options.compress)
 		{
-			auto positionKey = &channel->mPositionKeys[j];
+			float rotation[4] =
+			{
+				rotationKey->mValue.x,
+				rotationKey->mValue.y,
+				rotationKey->mValue.z,
+				rotationKey->mValue.w
+			};
+
 			std::fprintf(
 				output,
-				"\t\t\t{ time = %f, %f, %f, %f },\n",
-				positionKey->mTime,
-				positionKey->mValue.x,
-				positionKey->mValue.y,
-				positionKey->mValue.z);
+				"%s\t\t{ time = %f, %llu },\n",
+				indent,
+				rotationKey->mTime,
+				(unsigned long long)nbunny::codec::encode_quaternion(rotation));
 		}
-		std::fprintf(output, "\t\t},\n");
-
-		std::fprintf(output, "\t\trotation = {\n");
-		for (int j = 0; j < channel->mNumRotationKeys; ++j)
+		else
 		{
-			auto rotationKey = &channel->mRotationKeys[j];
 			std::fprintf(
 				output,
-				"\t\t\t{ time = %f, %f, %f, %f, %f },\n",
+				"%s\t\t{ time = %f, %f, %f, %f, %f },\n",
+				indent,
 				rotationKey->mTime,
 				rotationKey->mValue.x,
 				rotationKey->mValue.y,
 				rotationKey->mValue.z,
 				rotationKey->mValue.w);
 		}
-		std::fprintf(output, "\t\t},\n");
+	}
+	std::fprintf(output, "%s\t},\n", indent);
 
-		std::fprintf(output, "\t\tscale = {\n");
-		for (int j = 0; j < channel->mNumScalingKeys; ++j)
+	std::fprintf(output, "%s\tscale = {\n", indent);
+	for (int j = 0; j < channel->mNumScalingKeys; ++j)
+	{
+		if (isReduced && !std::binary_search(keys.begin(), keys.end(), j))
 		{
-			auto scaleKey = &channel->mScalingKeys[j];
-			std::fprintf(
-				output,
-				"\t\t\t{ time = %f, %f, %f, %f },\n",
-				scaleKey->mTime,
-				scaleKey->mValue.x,
-				scaleKey->mValue.y,
-				scaleKey->mValue.z);
+			continue;
 		}
-		std::fprintf(output, "\t\t},\n");
 
+		auto scaleKey = &channel->mScalingKeys[j];
+		std::fprintf(
+			output,
+			"%s\t\t{ time = %f, %f, %f, %f },\n",
+			indent,
+			scaleKey->mTime,
+			scaleKey->mValue.x,
+			scaleKey->mValue.y,
+			scaleKey->mValue.z);
+	}
+	std::fprintf(output, "%s\t},\n", indent);
+}
+
+// Exports a channel, resampling it first if requested.
+void exportAnimationChannel(
+	const aiAnimation* animation,
+	const aiNodeAnim* channel,
+	const ExportOptions& options,
+	const char* indent,
+	FILE* output)
+{
+	if (options.frameRate > 0.0f)
+	{
+		auto resampledChannel = resampleChannel(channel, getAnimationDuration(animation), options.frameRate);
+		exportChannel(resampledChannel.get(), options, indent, output);
+	}
+	else
+	{
+		exportChannel(channel, options, indent, output);
+	}
+}
+
+void exportAnimationClip(const aiScene* scene, const aiAnimation* animation, const ExportOptions& options, FILE* output)
+{
+	std::fprintf(output, "{\n");
+	for (int i = 0; i < animation->mNumChannels; ++i)
+	{
+		auto channel = animation->mChannels[i];
+		std::fprintf(output, "\t[\"%s\"] = {\n", channel->mNodeName.C_Str());
+		exportAnimationChannel(animation, channel, options, "\t", output);
 		std::fprintf(output, "\t},\n");
 	}
 	std::fprintf(output, "}\n");
 }
 
+bool exportAnimation(const aiScene* scene, const ExportOptions& options, FILE* output)
+{
+	if (scene->mNumAnimations < 1)
+	{
+		std::fprintf(stderr, "no animations\n");
+		return false;
+	}
+
+	exportAnimationClip(scene, scene->mAnimations[0], options, output);
+
+	return true;
+}
+
 void exportBoneNode(
 	const aiScene* scene,
 	const aiNode* parent,
@@ -116,19 +466,19 @@ void exportBoneNode(
 	}
 }
 
-void exportSkeleton(const aiScene* scene, FILE* output)
+bool exportSkeleton(const aiScene* scene, FILE* output)
 {
 	if (scene->mNumMeshes < 1)
 	{
 		std::fprintf(stderr, "no meshes\n");
-		return;
+		return false;
 	}
 
 	auto node = scene->mRootNode->FindNode("Armature");
-	if (!node && node->mParent != scene->mRootNode)
+	if (!node)
 	{
 		std::fprintf(stderr, "no skeleton (must be node named 'Armature')\n");
-		return;
+		return false;
 	}
 
 	std::fprintf(output, "{\n");
@@ -137,6 +487,8 @@ void exportSkeleton(const aiScene* scene, FILE* output)
 	exportBoneNode(scene, nullptr, node, parent, output);
 
 	std::fprintf(output, "}\n");
+
+	return true;
 }
 
 struct Vertex
@@ -150,246 +502,1479 @@ struct Vertex
 	int bones = 0;
 };
 
-void exportMesh(const aiScene* scene, FILE* output)
+struct StaticVertex
 {
-	if (scene->mNumMeshes < 1)
-	{
-		std::fprintf(stderr, "no meshes\n");
-		return;
-	}
+	float position[3] = { 0, 0, 0 };
+	float normal[3] = { 0, 1, 0 };
+	float texture[2] = { 0, 0 };
+};
 
-	auto mesh = scene->mMeshes[0];
-	std::fprintf(output, "{\n");
-	std::fprintf(output, "\tformat = {\n");
-	std::fprintf(output, "\t\t{ 'VertexPosition', 'float', 3 },\n");
-	std::fprintf(output, "\t\t{ 'VertexNormal', 'float', 3 },\n");
-	std::fprintf(output, "\t\t{ 'VertexTexture', 'float', 2 },\n");
-	std::fprintf(output, "\t\t{ 'VertexBoneIndex', 'float', 4 },\n");
-	std::fprintf(output, "\t\t{ 'VertexBoneWeight', 'float', 4 },\n");
-	if (mesh->GetNumUVChannels() > 1)
+template <typename V>
+struct VertexLess
+{
+	bool operator()(const V& a, const V& b) const
 	{
-		std::fprintf(output, "\t\t{ 'VertexDirection', 'float', 1 },\n");
+		return std::memcmp(&a, &b, sizeof(V)) < 0;
 	}
-	std::fprintf(output, "\t},\n");
+};
 
-	std::map<int, Vertex> vertices;
-	for (int i = 0; i < mesh->mNumBones; ++i)
+// Welds bitwise identical vertices together.
+//
+// 'input' is a triangle list (i.e., one vertex per face index). On return,
+// 'output' contains the unique vertices in order of first use and 'indices'
+// contains one (zero-based) index into 'output' per vertex in 'input'.
+template <typename V>
+void weldVertices(const std::vector<V>& input, std::vector<V>& output, std::vector<unsigned int>& indices)
+{
+	std::map<V, unsigned int, VertexLess<V>> unique;
+
+	output.clear();
+	indices.clear();
+	indices.reserve(input.size());
+
+	for (auto& vertex: input)
 	{
-		auto bone = mesh->mBones[i];
-		for (int j = 0; j < bone->mNumWeights; ++j)
+		auto result = unique.insert(std::make_pair(vertex, (unsigned int)output.size()));
+		if (result.second)
 		{
-			auto& vertex = vertices[bone->mWeights[j].mVertexId];
-			if (vertex.bones < 4)
-			{
-				vertex.boneIndex[vertex.bones] = i;
-				vertex.boneWeight[vertex.bones] = bone->mWeights[j].mWeight;
-				++vertex.bones;
-			}
+			output.push_back(vertex);
 		}
+
+		indices.push_back(result.first->second);
 	}
+}
 
-	for(auto& i: vertices)
+// Scores a vertex based on its position in the simulated post-transform cache
+// and the number of triangles left that use it.
+//
+// See Tom Forsyth, "Linear-Speed Vertex Cache Optimisation".
+static const int VERTEX_CACHE_SIZE = 32;
+static float scoreVertex(int cachePosition, int remainingTriangles)
+{
+	static const float CACHE_DECAY_POWER = 1.5f;
+	static const float LAST_TRIANGLE_SCORE = 0.75f;
+	static const float VALENCE_BOOST_SCALE = 2.0f;
+	static const float VALENCE_BOOST_POWER = 0.5f;
+
+	if (remainingTriangles == 0)
 	{
-		auto& vertex = i.second;
+		return -1.0f;
+	}
 
-		float sum = 0.0f;
-		for (int j = 0; j < vertex.bones; ++j)
+	float score = 0.0f;
+	if (cachePosition >= 0)
+	{
+		if (cachePosition < 3)
 		{
-			sum += vertex.boneWeight[j];
+			score = LAST_TRIANGLE_SCORE;
 		}
-
-		float length = std::sqrt(sum);
-		for (int j = 0; j < vertex.bones; ++j)
+		else
 		{
-			vertex.boneWeight[j] /= length;
+			float scale = 1.0f / (VERTEX_CACHE_SIZE - 3);
+			score = std::pow(1.0f - (cachePosition - 3) * scale, CACHE_DECAY_POWER);
 		}
 	}
 
-	for (int i = 0; i < mesh->mNumVertices; ++i)
+	score += VALENCE_BOOST_SCALE * std::pow((float)remainingTriangles, -VALENCE_BOOST_POWER);
+
+	return score;
+}
+
+// Reorders the triangles in 'indices' to improve post-transform cache hits.
+void optimizeVertexCache(std::vector<unsigned int>& indices, std::size_t vertexCount)
+{
+	std::size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
 	{
-		auto& vertex = vertices[i];
-		vertex.position[0] = mesh->mVertices[i].x;
-		vertex.position[1] = mesh->mVertices[i].y;
-		vertex.position[2] = mesh->mVertices[i].z;
-		vertex.normal[0] = mesh->mNormals[i].x;
-		vertex.normal[1] = mesh->mNormals[i].y;
-		vertex.normal[2] = mesh->mNormals[i].z;
-		vertex.texture[0] = mesh->mTextureCoords[0][i].x;
-		vertex.texture[1] = mesh->mTextureCoords[0][i].y;
+		return;
+	}
 
-		if (mesh->GetNumUVChannels() > 1)
+	std::vector<int> remainingTriangles(vertexCount, 0);
+	for (auto index: indices)
+	{
+		++remainingTriangles[index];
+	}
+
+	std::vector<std::size_t> vertexTriangleOffset(vertexCount + 1, 0);
+	for (std::size_t i = 0; i < vertexCount; ++i)
+	{
+		vertexTriangleOffset[i + 1] = vertexTriangleOffset[i] + remainingTriangles[i];
+	}
+
+	std::vector<std::size_t> vertexTriangles(indices.size());
+	{
+		std::vector<std::size_t> cursor(vertexTriangleOffset.begin(), vertexTriangleOffset.end() - 1);
+		for (std::size_t i = 0; i < indices.size(); ++i)
 		{
-			vertex.direction = mesh->mTextureCoords[1][i].x;
+			vertexTriangles[cursor[indices[i]]++] = i / 3;
 		}
 	}
 
-	std::fprintf(output, "\tvertices = {\n");
-	for (int i = 0; i < mesh->mNumFaces; ++i)
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (std::size_t i = 0; i < vertexCount; ++i)
 	{
-		auto face = mesh->mFaces[i];
-		for (int j = 0; j < face.mNumIndices; ++j)
+		vertexScore[i] = scoreVertex(-1, remainingTriangles[i]);
+	}
+
+	std::vector<bool> isTriangleAdded(triangleCount, false);
+	std::vector<float> triangleScore(triangleCount);
+	for (std::size_t i = 0; i < triangleCount; ++i)
+	{
+		triangleScore[i] =
+			vertexScore[indices[i * 3 + 0]] +
+			vertexScore[indices[i * 3 + 1]] +
+			vertexScore[indices[i * 3 + 2]];
+	}
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+
+	std::vector<unsigned int> cache;
+	std::vector<unsigned int> nextCache;
+	std::size_t scanCursor = 0;
+	long bestTriangle = -1;
+	while (result.size() < indices.size())
+	{
+		// No good candidate from the cache; fall back to the first triangle
+		// that hasn't been emitted yet.
+		if (bestTriangle < 0)
 		{
-			std::fprintf(output, "\t\t{ ");
-			auto& vertex = vertices[face.mIndices[j]];
-			std::fprintf(
-				output,
-				"%f, %f, %f, ",
-				vertex.position[0],
-				vertex.position[1],
-				vertex.position[2]);
-			std::fprintf(
-				output,
-				"%f, %f, %f, ",
-				vertex.normal[0],
-				vertex.normal[1],
-				vertex.normal[2]);
-			std::fprintf(
-				output,
-				"%f, %f, ",
-				vertex.texture[0],
-				vertex.texture[1]);
-			for (int j = 0; j < 4; ++j)
+			while (isTriangleAdded[scanCursor])
 			{
-				if (vertex.boneIndex[j] < 0)
-				{
-					std::fprintf(output, "false, ");
-				}
-				else
+				++scanCursor;
+			}
+
+			bestTriangle = (long)scanCursor;
+		}
+
+		isTriangleAdded[bestTriangle] = true;
+
+		nextCache.clear();
+		for (int i = 0; i < 3; ++i)
+		{
+			auto index = indices[bestTriangle * 3 + i];
+			result.push_back(index);
+			nextCache.push_back(index);
+
+			// Remove the triangle from the vertex's remaining triangles.
+			auto begin = vertexTriangles.begin() + vertexTriangleOffset[index];
+			auto end = begin + remainingTriangles[index];
+			std::iter_swap(std::find(begin, end, (std::size_t)bestTriangle), end - 1);
+			--remainingTriangles[index];
+		}
+
+		for (auto index: cache)
+		{
+			if (std::find(nextCache.begin(), nextCache.end(), index) == nextCache.end())
+			{
+				nextCache.push_back(index);
+			}
+		}
+
+		// Vertices that fell out of the cache need to be rescored too.
+		for (std::size_t i = 0; i < nextCache.size(); ++i)
+		{
+			auto index = nextCache[i];
+			cachePosition[index] = i < (std::size_t)VERTEX_CACHE_SIZE ? (int)i : -1;
+		}
+
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (auto index: nextCache)
+		{
+			float newScore = scoreVertex(cachePosition[index], remainingTriangles[index]);
+			float scoreDelta = newScore - vertexScore[index];
+			vertexScore[index] = newScore;
+
+			auto begin = vertexTriangleOffset[index];
+			auto end = begin + remainingTriangles[index];
+			for (auto j = begin; j < end; ++j)
+			{
+				auto triangle = vertexTriangles[j];
+				triangleScore[triangle] += scoreDelta;
+
+				if (triangleScore[triangle] > bestScore)
 				{
-					auto bone = mesh->mBones[vertex.boneIndex[j]];
-					std::fprintf(output, "\"%s\", ", bone->mName.C_Str());
+					bestScore = triangleScore[triangle];
+					bestTriangle = (long)triangle;
 				}
 			}
+		}
+
+		if (nextCache.size() > (std::size_t)VERTEX_CACHE_SIZE)
+		{
+			nextCache.resize(VERTEX_CACHE_SIZE);
+		}
+
+		std::swap(cache, nextCache);
+	}
+
+	indices.swap(result);
+}
+
+// Reorders vertices into the order they are first referenced by 'indices'
+// and remaps 'indices' to match. This improves pre-transform cache hits.
+template <typename V>
+void optimizeVertexFetch(std::vector<V>& vertices, std::vector<unsigned int>& indices)
+{
+	const unsigned int UNUSED = (unsigned int)-1;
+	std::vector<unsigned int> remap(vertices.size(), UNUSED);
+
+	std::vector<V> result;
+	result.reserve(vertices.size());
+	for (auto& index: indices)
+	{
+		if (remap[index] == UNUSED)
+		{
+			remap[index] = (unsigned int)result.size();
+			result.push_back(vertices[index]);
+		}
+
+		index = remap[index];
+	}
+
+	vertices.swap(result);
+}
+
+template <typename V>
+void buildIndexedMesh(
+	const std::vector<V>& triangles,
+	const ExportOptions& options,
+	std::vector<V>& vertices,
+	std::vector<unsigned int>& indices)
+{
+	weldVertices(triangles, vertices, indices);
+
+	if (options.optimize)
+	{
+		optimizeVertexCache(indices, vertices.size());
+		optimizeVertexFetch(vertices, indices);
+	}
+}
+
+// Writes the indices as a one-based (for LOVE's Mesh:setVertexMap) Lua table.
+void exportIndices(const std::vector<unsigned int>& indices, const char* indent, FILE* output)
+{
+	std::fprintf(output, "%sindices = {\n", indent);
+	for (std::size_t i = 0; i < indices.size(); i += 3)
+	{
+		std::fprintf(output, "%s\t", indent);
+		for (std::size_t j = i; j < i + 3 && j < indices.size(); ++j)
+		{
+			std::fprintf(output, "%u, ", indices[j] + 1);
+		}
+		std::fprintf(output, "\n");
+	}
+	std::fprintf(output, "%s},\n", indent);
+}
+
+struct CompressedVertex
+{
+	std::uint16_t position[3];
+	std::uint16_t normal[2];
+	std::uint16_t texture[2];
+	std::uint8_t boneIndex[4];
+	std::uint8_t boneWeight[4];
+	std::int16_t direction;
+
+	// Zero everything (including any padding) so welding can use memcmp.
+	CompressedVertex()
+	{
+		std::memset(this, 0, sizeof(CompressedVertex));
+	}
+};
+
+struct CompressedStaticVertex
+{
+	std::uint16_t position[3];
+	std::uint16_t normal[2];
+	std::uint16_t texture[2];
+
+	CompressedStaticVertex()
+	{
+		std::memset(this, 0, sizeof(CompressedStaticVertex));
+	}
+};
+
+// Bone indices are stored in 8 bits; zero means no bone.
+static const int MAX_COMPRESSED_BONES = 255;
+
+template <typename V>
+void getBounds(const std::vector<V>& vertices, float min[3], float max[3])
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		min[i] = vertices.empty() ? 0.0f : HUGE_VALF;
+		max[i] = vertices.empty() ? 0.0f : -HUGE_VALF;
+	}
+
+	for (auto& vertex: vertices)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			min[i] = std::min(min[i], vertex.position[i]);
+			max[i] = std::max(max[i], vertex.position[i]);
+		}
+	}
+}
+
+template <typename V, typename C>
+void compressAttributes(const V& vertex, const float min[3], const float max[3], C& result)
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		result.position[i] = nbunny::codec::encode_unorm16(vertex.position[i], min[i], max[i]);
+	}
+
+	nbunny::codec::encode_octahedral(vertex.normal, result.normal);
+
+	result.texture[0] = nbunny::codec::encode_half(vertex.texture[0]);
+	result.texture[1] = nbunny::codec::encode_half(vertex.texture[1]);
+}
+
+void exportCompression(const float min[3], const float max[3], const std::vector<std::string>* bones, const char* indent, FILE* output)
+{
+	std::fprintf(output, "%scompression = {\n", indent);
+	std::fprintf(
+		output,
+		"%s\tposition = { min = { %f, %f, %f }, max = { %f, %f, %f } },\n",
+		indent,
+		min[0], min[1], min[2],
+		max[0], max[1], max[2]);
+	std::fprintf(output, "%s\tnormal = \"octahedral\",\n", indent);
+	std::fprintf(output, "%s\ttexture = \"half\",\n", indent);
+
+	if (bones)
+	{
+		std::fprintf(output, "%s\tbones = { ", indent);
+		for (auto& bone: *bones)
+		{
+			std::fprintf(output, "\"%s\", ", bone.c_str());
+		}
+		std::fprintf(output, "},\n");
+	}
+
+	std::fprintf(output, "%s},\n", indent);
+}
+
+template <typename C>
+void exportCompressedAttributes(const C& vertex, FILE* output)
+{
+	std::fprintf(
+		output,
+		"%u, %u, %u, ",
+		vertex.position[0],
+		vertex.position[1],
+		vertex.position[2]);
+	std::fprintf(
+		output,
+		"%u, %u, ",
+		vertex.normal[0],
+		vertex.normal[1]);
+	std::fprintf(
+		output,
+		"%u, %u, ",
+		vertex.texture[0],
+		vertex.texture[1]);
+}
+
+void exportCompressedMesh(
+	const std::vector<std::string>& bones,
+	bool hasDirection,
+	const std::vector<Vertex>& triangles,
+	const ExportOptions& options,
+	FILE* output)
+{
+	float min[3], max[3];
+	getBounds(triangles, min, max);
+
+	std::vector<CompressedVertex> compressedTriangles;
+	compressedTriangles.reserve(triangles.size());
+	for (auto& vertex: triangles)
+	{
+		CompressedVertex compressedVertex;
+		compressAttributes(vertex, min, max, compressedVertex);
+
+		for (int i = 0; i < 4; ++i)
+		{
+			compressedVertex.boneIndex[i] = (std::uint8_t)(vertex.boneIndex[i] + 1);
+			compressedVertex.boneWeight[i] = nbunny::codec::encode_unorm8(vertex.boneWeight[i]);
+		}
+
+		compressedVertex.direction = (std::int16_t)vertex.direction;
+
+		compressedTriangles.push_back(compressedVertex);
+	}
+
+	std::vector<CompressedVertex> vertices;
+	std::vector<unsigned int> indices;
+	buildIndexedMesh(compressedTriangles, options, vertices, indices);
+
+	exportCompression(min, max, &bones, "\t", output);
+
+	std::fprintf(output, "\tvertices = {\n");
+	for (auto& vertex: vertices)
+	{
+		std::fprintf(output, "\t\t{ ");
+		exportCompressedAttributes(vertex, output);
+		std::fprintf(
+			output,
+			"%u, %u, %u, %u, ",
+			vertex.boneIndex[0],
+			vertex.boneIndex[1],
+			vertex.boneIndex[2],
+			vertex.boneIndex[3]);
+		std::fprintf(
+			output,
+			"%u, %u, %u, %u, ",
+			vertex.boneWeight[0],
+			vertex.boneWeight[1],
+			vertex.boneWeight[2],
+			vertex.boneWeight[3]);
+
+		if (hasDirection)
+		{
+			std::fprintf(output, "%d, ", vertex.direction);
+		}
+
+		std::fprintf(output, "},\n");
+	}
+	std::fprintf(output, "\t},\n");
+
+	exportIndices(indices, "\t", output);
+}
+
+void exportCompressedStaticMesh(
+	const std::vector<StaticVertex>& triangles,
+	const ExportOptions& options,
+	FILE* output)
+{
+	float min[3], max[3];
+	getBounds(triangles, min, max);
+
+	std::vector<CompressedStaticVertex> compressedTriangles;
+	compressedTriangles.reserve(triangles.size());
+	for (auto& vertex: triangles)
+	{
+		CompressedStaticVertex compressedVertex;
+		compressAttributes(vertex, min, max, compressedVertex);
+		compressedTriangles.push_back(compressedVertex);
+	}
+
+	std::vector<CompressedStaticVertex> vertices;
+	std::vector<unsigned int> indices;
+	buildIndexedMesh(compressedTriangles, options, vertices, indices);
+
+	exportCompression(min, max, nullptr, "\t\t", output);
+
+	for (auto& vertex: vertices)
+	{
+		std::fprintf(output, "\t\t{ ");
+		exportCompressedAttributes(vertex, output);
+		std::fprintf(output, "},\n");
+	}
+
+	exportIndices(indices, "\t\t", output);
+}
+
+// Appends the triangles of 'mesh' to 'triangles'.
+//
+// Bone indices are remapped into 'bones', which is shared by every mesh so
+// a model made of several skinned meshes uses one bone palette.
+void appendSkinnedMesh(
+	const aiMesh* mesh,
+	std::vector<std::string>& bones,
+	std::map<std::string, int>& boneIndices,
+	std::vector<Vertex>& triangles)
+{
+	std::map<int, Vertex> vertices;
+	for (int i = 0; i < mesh->mNumBones; ++i)
+	{
+		auto bone = mesh->mBones[i];
+
+		auto boneIndex = boneIndices.find(bone->mName.C_Str());
+		if (boneIndex == boneIndices.end())
+		{
+			boneIndex = boneIndices.insert(std::make_pair(std::string(bone->mName.C_Str()), (int)bones.size())).first;
+			bones.push_back(bone->mName.C_Str());
+		}
+
+		for (int j = 0; j < bone->mNumWeights; ++j)
+		{
+			auto& vertex = vertices[bone->mWeights[j].mVertexId];
+			if (vertex.bones < 4)
+			{
+				vertex.boneIndex[vertex.bones] = boneIndex->second;
+				vertex.boneWeight[vertex.bones] = bone->mWeights[j].mWeight;
+				++vertex.bones;
+			}
+		}
+	}
+
+	for(auto& i: vertices)
+	{
+		auto& vertex = i.second;
+
+		float sum = 0.0f;
+		for (int j = 0; j < vertex.bones; ++j)
+		{
+			sum += vertex.boneWeight[j];
+		}
+
+		float length = std::sqrt(sum);
+		for (int j = 0; j < vertex.bones; ++j)
+		{
+			vertex.boneWeight[j] /= length;
+		}
+	}
+
+	for (int i = 0; i < mesh->mNumVertices; ++i)
+	{
+		auto& vertex = vertices[i];
+		vertex.position[0] = mesh->mVertices[i].x;
+		vertex.position[1] = mesh->mVertices[i].y;
+		vertex.position[2] = mesh->mVertices[i].z;
+		vertex.normal[0] = mesh->mNormals[i].x;
+		vertex.normal[1] = mesh->mNormals[i].y;
+		vertex.normal[2] = mesh->mNormals[i].z;
+		vertex.texture[0] = mesh->mTextureCoords[0][i].x;
+		vertex.texture[1] = mesh->mTextureCoords[0][i].y;
+
+		if (mesh->GetNumUVChannels() > 1)
+		{
+			vertex.direction = mesh->mTextureCoords[1][i].x;
+		}
+	}
+
+	for (int i = 0; i < mesh->mNumFaces; ++i)
+	{
+		auto face = mesh->mFaces[i];
+		for (int j = 0; j < face.mNumIndices; ++j)
+		{
+			triangles.push_back(vertices[face.mIndices[j]]);
+		}
+	}
+}
+
+// Exports every mesh in the scene as a single model.
+bool exportMesh(const aiScene* scene, const ExportOptions& options, FILE* output)
+{
+	if (scene->mNumMeshes < 1)
+	{
+		std::fprintf(stderr, "no meshes\n");
+		return false;
+	}
+
+	bool hasDirection = false;
+	for (int i = 0; i < scene->mNumMeshes; ++i)
+	{
+		hasDirection = hasDirection || scene->mMeshes[i]->GetNumUVChannels() > 1;
+	}
+
+	std::fprintf(output, "{\n");
+	std::fprintf(output, "\tformat = {\n");
+	std::fprintf(output, "\t\t{ 'VertexPosition', 'float', 3 },\n");
+	std::fprintf(output, "\t\t{ 'VertexNormal', 'float', 3 },\n");
+	std::fprintf(output, "\t\t{ 'VertexTexture', 'float', 2 },\n");
+	std::fprintf(output, "\t\t{ 'VertexBoneIndex', 'float', 4 },\n");
+	std::fprintf(output, "\t\t{ 'VertexBoneWeight', 'float', 4 },\n");
+	if (hasDirection)
+	{
+		std::fprintf(output, "\t\t{ 'VertexDirection', 'float', 1 },\n");
+	}
+	std::fprintf(output, "\t},\n");
+
+	std::vector<std::string> bones;
+	std::map<std::string, int> boneIndices;
+	std::vector<Vertex> triangles;
+	for (int i = 0; i < scene->mNumMeshes; ++i)
+	{
+		appendSkinnedMesh(scene->mMeshes[i], bones, boneIndices, triangles);
+	}
+
+	if (options.compress)
+	{
+		if ((int)bones.size() <= MAX_COMPRESSED_BONES)
+		{
+			exportCompressedMesh(bones, hasDirection, triangles, options, output);
+			std::fprintf(output, "}\n");
+			return true;
+		}
+
+		std::fprintf(stderr, "too many bones (%d) to compress; exporting uncompressed\n", (int)bones.size());
+	}
+
+	std::vector<Vertex> uniqueVertices;
+	std::vector<unsigned int> indices;
+	buildIndexedMesh(triangles, options, uniqueVertices, indices);
+
+	std::fprintf(output, "\tvertices = {\n");
+	for (auto& vertex: uniqueVertices)
+	{
+		std::fprintf(output, "\t\t{ ");
+		std::fprintf(
+			output,
+			"%f, %f, %f, ",
+			vertex.position[0],
+			vertex.position[1],
+			vertex.position[2]);
+		std::fprintf(
+			output,
+			"%f, %f, %f, ",
+			vertex.normal[0],
+			vertex.normal[1],
+			vertex.normal[2]);
+		std::fprintf(
+			output,
+			"%f, %f, ",
+			vertex.texture[0],
+			vertex.texture[1]);
+		for (int j = 0; j < 4; ++j)
+		{
+			if (vertex.boneIndex[j] < 0)
+			{
+				std::fprintf(output, "false, ");
+			}
+			else
+			{
+				std::fprintf(output, "\"%s\", ", bones[vertex.boneIndex[j]].c_str());
+			}
+		}
+
+		std::fprintf(
+			output,
+			"%f, %f, %f, %f, ",
+			vertex.boneWeight[0],
+			vertex.boneWeight[1],
+			vertex.boneWeight[2],
+			vertex.boneWeight[3]);
+
+		if (hasDirection)
+		{
+			std::fprintf(output, "%d, ", (int)vertex.direction);
+		}
+
+		std::fprintf(output, "},\n");
+	}
+	std::fprintf(output, "\t},\n");
+
+	exportIndices(indices, "\t", output);
+
+	std::fprintf(output, "}\n");
+
+	return true;
+}
+
+void exportStaticMesh(const aiScene* scene, const aiMesh* mesh, const ExportOptions& options, FILE* output)
+{
+	std::fprintf(output, "\t{\n");
+	std::fprintf(output, "\t\tname = \"%s\",\n", mesh->mName.C_Str());
+
+	std::vector<StaticVertex> triangles;
+	for (int i = 0; i < mesh->mNumFaces; ++i)
+	{
+		auto face = mesh->mFaces[i];
+		for (int j = 0; j < face.mNumIndices; ++j)
+		{
+			auto index = face.mIndices[j];
+			auto& position = mesh->mVertices[index];
+			auto& normal = mesh->mNormals[index];
+			auto& texture = mesh->mTextureCoords[0][index];
+
+			StaticVertex vertex;
+			vertex.position[0] = position.x;
+			vertex.position[1] = position.y;
+			vertex.position[2] = position.z;
+			vertex.normal[0] = normal.x;
+			vertex.normal[1] = normal.y;
+			vertex.normal[2] = normal.z;
+			vertex.texture[0] = texture.x;
+			vertex.texture[1] = texture.y;
+			triangles.push_back(vertex);
+		}
+	}
+
+	if (options.compress)
+	{
+		exportCompressedStaticMesh(triangles, options, output);
+		std::fprintf(output, "\t},\n");
+		return;
+	}
+
+	std::vector<StaticVertex> vertices;
+	std::vector<unsigned int> indices;
+	buildIndexedMesh(triangles, options, vertices, indices);
+
+	for (auto& vertex: vertices)
+	{
+		std::fprintf(output, "\t\t{ ");
+		std::fprintf(
+			output,
+			"%f, %f, %f, ",
+			vertex.position[0],
+			vertex.position[1],
+			vertex.position[2]);
+		std::fprintf(
+			output,
+			"%f, %f, %f, ",
+			vertex.normal[0],
+			vertex.normal[1],
+			vertex.normal[2]);
+		std::fprintf(
+			output,
+			"%f, %f, ",
+			vertex.texture[0],
+			vertex.texture[1]);
+		std::fprintf(output, "},\n");
+	}
+
+	exportIndices(indices, "\t\t", output);
+
+	std::fprintf(output, "\t},\n");
+}
+
+bool exportStaticMeshes(const aiScene* scene, const ExportOptions& options, FILE* output)
+{
+	if (scene->mNumMeshes < 1)
+	{
+		std::fprintf(stderr, "no meshes\n");
+		return false;
+	}
+
+	std::fprintf(output, "{\n");
+	std::fprintf(output, "\tformat =\n");
+	std::fprintf(output, "\t{\n");
+	std::fprintf(output, "\t\t{ 'VertexPosition', 'float', 3 },\n");
+	std::fprintf(output, "\t\t{ 'VertexNormal', 'float', 3 },\n");
+	std::fprintf(output, "\t\t{ 'VertexTexture', 'float', 2 },\n");
+	std::fprintf(output, "\t},\n");
+
+	for (int i = 0; i < scene->mNumMeshes; ++i)
+	{
+		exportStaticMesh(scene, scene->mMeshes[i], options, output);
+	}
+
+	std::fprintf(output, "}\n");
+
+	return true;
+}
+
+// Makes an animation name (e.g., "Armature|Idle") safe to use as a filename.
+std::string getAnimationFilename(const aiAnimation* animation, int index)
+{
+	std::string name = animation->mName.C_Str();
+
+	auto separator = name.find_last_of('|');
+	if (separator != std::string::npos)
+	{
+		name = name.substr(separator + 1);
+	}
+
+	for (auto& c: name)
+	{
+		if (!std::isalnum((unsigned char)c) && c != '_' && c != '-')
+		{
+			c = '_';
+		}
+	}
+
+	if (name.empty())
+	{
+		name = "Animation" + std::to_string(index + 1);
+	}
+
+	return name;
+}
+
+void collectBoneNames(const aiNode* node, std::vector<std::string>& bones, std::map<std::string, int>& boneIndices)
+{
+	if (boneIndices.insert(std::make_pair(std::string(node->mName.C_Str()), (int)bones.size())).second)
+	{
+		bones.push_back(node->mName.C_Str());
+	}
+
+	for (int i = 0; i < node->mNumChildren; ++i)
+	{
+		collectBoneNames(node->mChildren[i], bones, boneIndices);
+	}
+}
+
+// Exports every animation in the scene into a single library.
+//
+// The library has a bone table ('bones'), shared by every clip, and the
+// tracks of every clip stored back-to-back in 'tracks'. The tracks of a
+// clip start at its 'tracks' offset and are in the same order as the bone
+// table; bones that a clip doesn't animate have a 'false' track.
+bool exportAnimationLibrary(const aiScene* scene, const ExportOptions& options, FILE* output)
+{
+	if (scene->mNumAnimations < 1)
+	{
+		std::fprintf(stderr, "no animations\n");
+		return false;
+	}
+
+	std::vector<std::string> bones;
+	std::map<std::string, int> boneIndices;
+
+	auto armature = scene->mRootNode->FindNode("Armature");
+	if (armature)
+	{
+		collectBoneNames(armature, bones, boneIndices);
+	}
+
+	for (int i = 0; i < scene->mNumAnimations; ++i)
+	{
+		auto animation = scene->mAnimations[i];
+		for (int j = 0; j < animation->mNumChannels; ++j)
+		{
+			std::string name = animation->mChannels[j]->mNodeName.C_Str();
+			if (boneIndices.insert(std::make_pair(name, (int)bones.size())).second)
+			{
+				bones.push_back(name);
+			}
+		}
+	}
+
+	std::fprintf(output, "{\n");
+
+	std::fprintf(output, "\tbones = {\n");
+	for (auto& bone: bones)
+	{
+		std::fprintf(output, "\t\t\"%s\",\n", bone.c_str());
+	}
+	std::fprintf(output, "\t},\n");
+
+	std::fprintf(output, "\tclips = {\n");
+	for (int i = 0; i < scene->mNumAnimations; ++i)
+	{
+		std::fprintf(
+			output,
+			"\t\t{ name = \"%s\", tracks = %d },\n",
+			getAnimationFilename(scene->mAnimations[i], i).c_str(),
+			(int)(i * bones.size() + 1));
+	}
+	std::fprintf(output, "\t},\n");
+
+	std::fprintf(output, "\ttracks = {\n");
+	for (int i = 0; i < scene->mNumAnimations; ++i)
+	{
+		auto animation = scene->mAnimations[i];
+
+		std::vector<const aiNodeAnim*> channels(bones.size(), nullptr);
+		for (int j = 0; j < animation->mNumChannels; ++j)
+		{
+			auto channel = animation->mChannels[j];
+			channels[boneIndices[channel->mNodeName.C_Str()]] = channel;
+		}
+
+		std::fprintf(output, "\t\t-- %s\n", getAnimationFilename(animation, i).c_str());
+		for (auto channel: channels)
+		{
+			if (channel)
+			{
+				std::fprintf(output, "\t\t{\n");
+				exportAnimationChannel(animation, channel, options, "\t\t", output);
+				std::fprintf(output, "\t\t},\n");
+			}
+			else
+			{
+				std::fprintf(output, "\t\tfalse,\n");
+			}
+		}
+	}
+	std::fprintf(output, "\t},\n");
+
+	std::fprintf(output, "}\n");
+
+	return true;
+}
+
+bool exportAnimations(const aiScene* scene, const ExportOptions& options, const std::string& directory)
+{
+	if (scene->mNumAnimations < 1)
+	{
+		std::fprintf(stderr, "no animations\n");
+		return false;
+	}
+
+	for (int i = 0; i < scene->mNumAnimations; ++i)
+	{
+		auto animation = scene->mAnimations[i];
+		auto filename = (std::filesystem::path(directory) / (getAnimationFilename(animation, i) + ".lanim")).string();
+
+		FILE* output = std::fopen(filename.c_str(), "w");
+		if (!output)
+		{
+			std::fprintf(stderr, "couldn't open %s for writing\n", filename.c_str());
+			return false;
+		}
+
+		exportAnimationClip(scene, animation, options, output);
+		std::fclose(output);
+	}
+
+	return true;
+}
+
+bool isAction(const std::string& action)
+{
+	return action == "mesh" ||
+	       action == "skeleton" ||
+	       action == "animation" ||
+	       action == "animations" ||
+	       action == "library" ||
+	       action == "static";
+}
+
+bool runExport(const aiScene* scene, const std::string& action, const std::string& filename, const ExportOptions& options)
+{
+	if (!isAction(action))
+	{
+		std::fprintf(stderr, "unknown action %s; must be either mesh, skeleton, animation, animations, library, or static\n", action.c_str());
+		return false;
+	}
+
+	// 'animations' exports every animation into the output directory.
+	if (action == "animations")
+	{
+		return exportAnimations(scene, options, filename);
+	}
+
+	FILE* output = std::fopen(filename.c_str(), "w");
+	if (!output)
+	{
+		std::fprintf(stderr, "couldn't open %s for writing\n", filename.c_str());
+		return false;
+	}
 
-			std::fprintf(
-				output,
-				"%f, %f, %f, %f, ",
-				vertex.boneWeight[0],
-				vertex.boneWeight[1],
-				vertex.boneWeight[2],
-				vertex.boneWeight[3]);
+	bool isSuccess = false;
+	if (action == "mesh")
+	{
+		isSuccess = exportMesh(scene, options, output);
+	}
+	else if (action == "skeleton")
+	{
+		isSuccess = exportSkeleton(scene, output);
+	}
+	else if (action == "animation")
+	{
+		isSuccess = exportAnimation(scene, options, output);
+	}
+	else if (action == "library")
+	{
+		isSuccess = exportAnimationLibrary(scene, options, output);
+	}
+	else if (action == "static")
+	{
+		isSuccess = exportStaticMeshes(scene, options, output);
+	}
 
-			if (mesh->GetNumUVChannels() > 1)
-			{
-				std::fprintf(output, "%d, ", (int)vertex.direction);
-			}
-			
-			std::fprintf(output, "},\n");
+	std::fclose(output);
+
+	// Don't leave a truncated file around to be mistaken for an export.
+	if (!isSuccess)
+	{
+		std::remove(filename.c_str());
+	}
+
+	return isSuccess;
+}
+
+struct BatchExport
+{
+	std::string action;
+	std::string output;
+};
+
+struct BatchJob
+{
+	std::string source;
+	std::vector<BatchExport> exports;
+
+	// Jobs found by walking a directory pick their exports after import,
+	// based on whether the meshes are skinned.
+	bool isAutomatic = false;
+
+	std::uint64_t hash = 0;
+	bool isSuccess = false;
+};
+
+static const std::uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+static const std::uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+std::uint64_t hashBytes(const void* data, std::size_t size, std::uint64_t hash)
+{
+	auto bytes = (const unsigned char*)data;
+	for (std::size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+// Hashes the source file along with everything that affects its outputs.
+bool hashJob(BatchJob& job, const ExportOptions& options)
+{
+	FILE* input = std::fopen(job.source.c_str(), "rb");
+	if (!input)
+	{
+		std::fprintf(stderr, "couldn't open %s for reading\n", job.source.c_str());
+		return false;
+	}
+
+	std::uint64_t hash = FNV_OFFSET_BASIS;
+	hash = hashBytes(&options.optimize, sizeof(bool), hash);
+	hash = hashBytes(&options.compress, sizeof(bool), hash);
+	hash = hashBytes(&options.frameRate, sizeof(float), hash);
+	for (auto& e: job.exports)
+	{
+		hash = hashBytes(e.action.data(), e.action.size() + 1, hash);
+		hash = hashBytes(e.output.data(), e.output.size() + 1, hash);
+	}
+
+	char buffer[64 * 1024];
+	std::size_t count;
+	while ((count = std::fread(buffer, 1, sizeof(buffer), input)) > 0)
+	{
+		hash = hashBytes(buffer, count, hash);
+	}
+
+	std::fclose(input);
+
+	job.hash = hash;
+	return true;
+}
+
+void addAutomaticExports(const aiScene* scene, BatchJob& job)
+{
+	auto source = std::filesystem::path(job.source);
+	auto stem = (source.parent_path() / source.stem()).string();
+
+	bool isSkinned = false;
+	for (int i = 0; i < scene->mNumMeshes; ++i)
+	{
+		if (scene->mMeshes[i]->mNumBones > 0)
+		{
+			isSkinned = true;
+			break;
 		}
 	}
-	std::fprintf(output, "\t},\n");
 
-	std::fprintf(output, "}\n");
+	if (isSkinned)
+	{
+		job.exports.push_back({ "mesh", stem + ".lmodel" });
+		if (scene->mRootNode->FindNode("Armature"))
+		{
+			job.exports.push_back({ "skeleton", stem + ".lskel" });
+		}
+	}
+	else if (scene->mNumMeshes > 0)
+	{
+		job.exports.push_back({ "static", stem + ".lmesh" });
+	}
+
+	if (scene->mNumAnimations > 0)
+	{
+		job.exports.push_back({ "library", stem + ".lanimlib" });
+	}
 }
 
-void exportStaticMesh(const aiScene* scene, const aiMesh* mesh, FILE* output)
+// What the previous run exported from a source. Automatic jobs only know
+// their outputs after import, so they're kept here rather than derived
+// from the job.
+struct CacheEntry
 {
-	std::fprintf(output, "\t{\n");
-	std::fprintf(output, "\t\tname = \"%s\",\n", mesh->mName.C_Str());
+	std::uint64_t hash = 0;
+	std::vector<std::string> outputs;
+};
 
-	for (int i = 0; i < mesh->mNumFaces; ++i)
+bool hasOutputs(const CacheEntry& entry)
+{
+	for (auto& output: entry.outputs)
 	{
-		auto face = mesh->mFaces[i];
-		for (int j = 0; j < face.mNumIndices; ++j)
+		if (!std::filesystem::exists(output))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool runBatchJob(BatchJob& job, const ExportOptions& options)
+{
+	Assimp::Importer importer;
+	auto scene = importer.ReadFile(job.source, aiProcess_Triangulate);
+	if (!scene)
+	{
+		std::fprintf(stderr, "couldn't load %s\n", job.source.c_str());
+		return false;
+	}
+
+	if (job.isAutomatic)
+	{
+		addAutomaticExports(scene, job);
+	}
+
+	bool isSuccess = true;
+	for (auto& e: job.exports)
+	{
+		isSuccess = runExport(scene, e.action, e.output, options) && isSuccess;
+	}
+
+	return isSuccess;
+}
+
+bool isSourceFile(const std::filesystem::path& path)
+{
+	auto extension = path.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+
+	return extension == ".fbx";
+}
+
+// A manifest has one export per line: '<action> <source> <output>'.
+// Lines starting with '#' are comments. Exports are grouped by source so
+// each source is only imported once.
+//
+// Jobs run in parallel, so two sources can't share an output. That includes
+// the directory of an 'animations' export, since the clip names aren't
+// known until the source is imported.
+bool readManifest(const std::string& filename, std::vector<BatchJob>& jobs)
+{
+	std::ifstream manifest(filename);
+	if (!manifest)
+	{
+		std::fprintf(stderr, "couldn't open %s for reading\n", filename.c_str());
+		return false;
+	}
+
+	std::map<std::string, std::size_t> sources;
+	std::map<std::string, std::string> outputs;
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(manifest, line))
+	{
+		++lineNumber;
+
+		std::istringstream stream(line);
+		BatchExport e;
+		std::string source;
+		if (!(stream >> e.action) || e.action[0] == '#')
+		{
+			continue;
+		}
+
+		if (!(stream >> source >> e.output) || !isAction(e.action))
+		{
+			std::fprintf(stderr, "%s:%d: expected '<action> <source> <output>'\n", filename.c_str(), lineNumber);
+			return false;
+		}
+
+		auto output = std::filesystem::path(e.output).lexically_normal();
+		if (!output.has_filename())
+		{
+			output = output.parent_path();
+		}
+
+		auto o = outputs.insert(std::make_pair(output.string(), source)).first;
+		if (o->second != source)
 		{
-			std::fprintf(output, "\t\t{ ");
-			auto index = face.mIndices[j];
-			auto& position = mesh->mVertices[index];
-			auto& normal = mesh->mNormals[index];
-			auto& texture = mesh->mTextureCoords[0][index];
-			std::fprintf(
-				output,
-				"%f, %f, %f, ",
-				position.x,
-				position.y,
-				position.z);
-			std::fprintf(
-				output,
-				"%f, %f, %f, ",
-				normal.x,
-				normal.y,
-				normal.z);
 			std::fprintf(
-				output,
-				"%f, %f, ",
-				texture.x,
-				texture.y);
-			std::fprintf(output, "},\n");
+				stderr,
+				"%s:%d: %s is already an output of %s\n",
+				filename.c_str(), lineNumber, e.output.c_str(), o->second.c_str());
+			return false;
+		}
+
+		auto s = sources.find(source);
+		if (s == sources.end())
+		{
+			s = sources.insert(std::make_pair(source, jobs.size())).first;
+			jobs.emplace_back();
+			jobs.back().source = source;
+		}
+
+		jobs[s->second].exports.push_back(e);
+	}
+
+	return true;
+}
+
+void readDirectory(const std::string& directory, std::vector<BatchJob>& jobs)
+{
+	for (auto& entry: std::filesystem::recursive_directory_iterator(directory))
+	{
+		if (entry.is_regular_file() && isSourceFile(entry.path()))
+		{
+			jobs.emplace_back();
+			jobs.back().source = entry.path().string();
+			jobs.back().isAutomatic = true;
 		}
 	}
-	std::fprintf(output, "\t},\n");
+
+	std::sort(
+		jobs.begin(),
+		jobs.end(),
+		[](const BatchJob& a, const BatchJob& b)
+		{
+			return a.source < b.source;
+		});
 }
 
-void exportStaticMeshes(const aiScene* scene, FILE* output)
+static const char* CACHE_HEADER = "# goober cache 2";
+
+// The cache is a header followed by '<hash> <source>\t<output>\t...' lines
+// from the previous run. Caches without the header (or with another
+// version) are ignored, so everything is exported again.
+void readCache(const std::string& filename, std::map<std::string, CacheEntry>& cache)
 {
-	if (scene->mNumMeshes < 1)
+	std::ifstream input(filename);
+
+	std::string line;
+	if (!std::getline(input, line) || line != CACHE_HEADER)
 	{
-		std::fprintf(stderr, "no meshes\n");
 		return;
 	}
 
-	std::fprintf(output, "{\n");
-	std::fprintf(output, "\tformat =\n");
-	std::fprintf(output, "\t{\n");
-	std::fprintf(output, "\t\t{ 'VertexPosition', 'float', 3 },\n");
-	std::fprintf(output, "\t\t{ 'VertexNormal', 'float', 3 },\n");
-	std::fprintf(output, "\t\t{ 'VertexTexture', 'float', 2 },\n");
-	std::fprintf(output, "\t},\n");
+	while (std::getline(input, line))
+	{
+		std::istringstream stream(line);
+		CacheEntry entry;
+		std::string source;
+		if (!(stream >> std::hex >> entry.hash >> std::ws && std::getline(stream, source, '\t')))
+		{
+			continue;
+		}
 
-	for (int i = 0; i < scene->mNumMeshes; ++i)
+		std::string output;
+		while (std::getline(stream, output, '\t'))
+		{
+			entry.outputs.push_back(output);
+		}
+
+		cache[source] = entry;
+	}
+}
+
+void writeCache(const std::string& filename, const std::map<std::string, CacheEntry>& cache)
+{
+	FILE* output = std::fopen(filename.c_str(), "w");
+	if (!output)
 	{
-		exportStaticMesh(scene, scene->mMeshes[i], output);
+		std::fprintf(stderr, "couldn't open %s for writing\n", filename.c_str());
+		return;
 	}
 
-	std::fprintf(output, "}\n");
+	std::fprintf(output, "%s\n", CACHE_HEADER);
+	for (auto& i: cache)
+	{
+		std::fprintf(output, "%016llx %s", (unsigned long long)i.second.hash, i.first.c_str());
+		for (auto& o: i.second.outputs)
+		{
+			std::fprintf(output, "\t%s", o.c_str());
+		}
+
+		std::fprintf(output, "\n");
+	}
+
+	std::fclose(output);
 }
 
-int main(int argc, const char* argv[])
+int runBatch(int argc, const char* argv[])
 {
-	if (argc < 4)
+	if (argc < 3)
 	{
-		std::fprintf(stderr, "%s <mesh/skeleton/animation> <filename> <output>\n", argv[0]);
+		std::fprintf(stderr, "%s batch <manifest/directory> [--jobs <count>] [--force] [--optimize] [--compress] [--resample <rate>]\n", argv[0]);
 		return 1;
 	}
 
-	Assimp::Importer importer;
-	auto scene = importer.ReadFile(argv[2], aiProcess_Triangulate);
-	if (!scene)
+	ExportOptions options;
+	bool isForced = false;
+	int numThreads = (int)std::max(std::thread::hardware_concurrency(), 1u);
+	for (int i = 3; i < argc; ++i)
 	{
-		std::fprintf(stderr, "couldn't load %s\n", argv[2]);
-		return 1;
+		if (std::strcmp(argv[i], "--optimize") == 0)
+		{
+			options.optimize = true;
+		}
+		else if (std::strcmp(argv[i], "--compress") == 0)
+		{
+			options.compress = true;
+		}
+		else if (std::strcmp(argv[i], "--resample") == 0 && i + 1 < argc)
+		{
+			options.frameRate = (float)std::atof(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--force") == 0)
+		{
+			isForced = true;
+		}
+		else if (std::strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+		{
+			numThreads = std::max(std::atoi(argv[++i]), 1);
+		}
+		else
+		{
+			std::fprintf(stderr, "unknown option %s\n", argv[i]);
+			return 1;
+		}
 	}
 
-	FILE* output = std::fopen(argv[3], "w");
-	if (!output)
+	std::string input = argv[2];
+	std::string cacheFilename;
+	std::vector<BatchJob> jobs;
+	if (std::filesystem::is_directory(input))
 	{
-		std::fprintf(stderr, "couldn't open %s for writing\n", argv[3]);
-		return 1;
+		readDirectory(input, jobs);
+		cacheFilename = (std::filesystem::path(input) / ".goober.cache").string();
 	}
+	else
+	{
+		if (!readManifest(input, jobs))
+		{
+			return 1;
+		}
+
+		cacheFilename = input + ".cache";
+	}
+
+	std::map<std::string, CacheEntry> cache;
+	if (!isForced)
+	{
+		readCache(cacheFilename, cache);
+	}
+
+	std::mutex mutex;
+	std::atomic<std::size_t> nextJob(0);
+	std::atomic<int> numExported(0), numSkipped(0), numFailed(0);
+	auto worker = [&]()
+	{
+		std::size_t index;
+		while ((index = nextJob++) < jobs.size())
+		{
+			auto& job = jobs[index];
+			if (!hashJob(job, options))
+			{
+				++numFailed;
+				continue;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				auto previous = cache.find(job.source);
+				if (previous != cache.end() && previous->second.hash == job.hash && hasOutputs(previous->second))
+				{
+					job.isSuccess = true;
+					++numSkipped;
+					continue;
+				}
+			}
+
+			job.isSuccess = runBatchJob(job, options);
+			if (job.isSuccess)
+			{
+				// Automatic exports have been added by now.
+				CacheEntry entry;
+				entry.hash = job.hash;
+				for (auto& e: job.exports)
+				{
+					entry.outputs.push_back(e.output);
+				}
+
+				std::lock_guard<std::mutex> lock(mutex);
+				cache[job.source] = entry;
+				++numExported;
+			}
+			else
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				cache.erase(job.source);
+				std::fprintf(stderr, "failed to export %s\n", job.source.c_str());
+				++numFailed;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	numThreads = std::min(numThreads, (int)std::max(jobs.size(), (std::size_t)1));
+	for (int i = 0; i < numThreads; ++i)
+	{
+		threads.emplace_back(worker);
+	}
+
+	for (auto& thread: threads)
+	{
+		thread.join();
+	}
+
+	writeCache(cacheFilename, cache);
+
+	std::fprintf(
+		stderr,
+		"%d exported, %d unchanged, %d failed\n",
+		numExported.load(), numSkipped.load(), numFailed.load());
 
-	if (std::strcmp(argv[1], "mesh") == 0)
+	return numFailed > 0 ? 1 : 0;
+}
+
+int main(int argc, const char* argv[])
+{
+	if (argc >= 2 && std::strcmp(argv[1], "batch") == 0)
 	{
-		exportMesh(scene, output);
+		return runBatch(argc, argv);
 	}
-	else if (std::strcmp(argv[1], "skeleton") == 0)
+
+	if (argc < 4)
 	{
-		exportSkeleton(scene, output);
+		std::fprintf(stderr, "%s <mesh/skeleton/animation/animations/library/static> <filename> <output> [--optimize] [--compress] [--resample <rate>]\n", argv[0]);
+		std::fprintf(stderr, "%s batch <manifest/directory> [--jobs <count>] [--force] [--optimize] [--compress] [--resample <rate>]\n", argv[0]);
+		return 1;
 	}
-	else if (std::strcmp(argv[1], "animation") == 0)
+
+	ExportOptions options;
+	for (int i = 4; i < argc; ++i)
 	{
-		exportAnimation(scene, output);
+		if (std::strcmp(argv[i], "--optimize") == 0)
+		{
+			options.optimize = true;
+		}
+		else if (std::strcmp(argv[i], "--compress") == 0)
+		{
+			options.compress = true;
+		}
+		else if (std::strcmp(argv[i], "--resample") == 0 && i + 1 < argc)
+		{
+			options.frameRate = (float)std::atof(argv[++i]);
+		}
+		else
+		{
+			std::fprintf(stderr, "unknown option %s\n", argv[i]);
+			return 1;
+		}
 	}
-	else if (std::strcmp(argv[1], "static") == 0)
+
+	if (!isAction(argv[1]))
 	{
-		exportStaticMeshes(scene, output);
+		std::fprintf(stderr, "unknown action %s; must be either mesh, skeleton, animation, animations, library, or static\n", argv[1]);
+		return 1;
 	}
-	else
+
+	Assimp::Importer importer;
+	auto scene = importer.ReadFile(argv[2], aiProcess_Triangulate);
+	if (!scene)
 	{
-		std::fprintf(stderr, "unknown action %s; must be either mesh, skeleton, animation, or static\n", argv[1]);
+		std::fprintf(stderr, "couldn't load %s\n", argv[2]);
 		return 1;
 	}
 
-	std::fclose(output);
+	if (!runExport(scene, argv[1], argv[3], options))
+	{
+		return 1;
+	}
 
 	return 0;
 }
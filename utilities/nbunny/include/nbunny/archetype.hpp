@@ -0,0 +1,99 @@
+////////////////////////////////////////////////////////////////////////////////
+// nbunny/archetype.hpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NBUNNY_ARCHETYPE_HPP
+#define NBUNNY_ARCHETYPE_HPP
+
+#include <bitset>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+namespace nbunny
+{
+	// Indexes handles (e.g., Peep tallies) by the exact set of components
+	// (e.g., Behavior IDs) they have.
+	//
+	// This only tracks membership: which components each handle has. The
+	// component data itself lives elsewhere (for Peeps, in the Behaviors).
+	//
+	// Handles with the same set of components belong to the same archetype,
+	// listed back-to-back. A query is a set of required components; it
+	// caches the archetypes that match, so collecting the handles of a query
+	// is a walk over a few arrays and testing a handle against a query is a
+	// bit mask comparison.
+	struct ArchetypeIndex
+	{
+	public:
+		static const std::size_t MAX_COMPONENTS = 256;
+		typedef std::bitset<MAX_COMPONENTS> Mask;
+
+		ArchetypeIndex();
+
+		// Adds or removes a component from handle, moving the handle to
+		// the new archetype. The handle is added to the index if necessary.
+		void add_component(int handle, std::size_t component);
+		void remove_component(int handle, std::size_t component);
+
+		// Replaces the components of handle.
+		void set_components(int handle, const Mask& mask);
+
+		// Removes the handle from the index entirely.
+		void remove(int handle);
+
+		bool has(int handle) const;
+		bool has_component(int handle, std::size_t component) const;
+
+		// Returns the index of a query matching handles with every component
+		// in mask. Queries with the same mask are shared.
+		int add_query(const Mask& mask);
+		bool has_query(int query) const;
+		bool match(int handle, int query) const;
+
+		// Collects the handles matching query. Handles in the same archetype
+		// are contiguous.
+		void get_query_handles(int query, std::vector<int>& result) const;
+		std::size_t get_query_count(int query) const;
+
+		std::size_t get_archetype_count() const;
+
+	private:
+		struct Archetype
+		{
+			Mask mask;
+			std::vector<int> handles;
+		};
+
+		struct Location
+		{
+			std::size_t archetype;
+			std::size_t slot;
+		};
+
+		struct Query
+		{
+			Mask mask;
+			std::vector<std::size_t> archetypes;
+		};
+
+		std::size_t get_archetype(const Mask& mask);
+		void move(int handle, const Mask& mask);
+		void erase(const Location& location);
+
+		std::vector<Archetype> archetypes;
+		std::unordered_map<Mask, std::size_t> archetypes_by_mask;
+		std::unordered_map<int, Location> locations;
+		std::vector<Query> queries;
+	};
+}
+
+#endif
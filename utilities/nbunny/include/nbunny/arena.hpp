@@ -0,0 +1,121 @@
+////////////////////////////////////////////////////////////////////////////////
+// nbunny/arena.hpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NBUNNY_ARENA_HPP
+#define NBUNNY_ARENA_HPP
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace nbunny
+{
+	// A linear allocator for memory that only lives until the end of the
+	// frame, like the nodes returned by a walk and the keys used to sort
+	// them.
+	//
+	// Allocations bump a pointer and are never freed on their own; frame()
+	// frees everything at once. If a frame needs more than one block, the
+	// blocks are merged into one at the next frame, so once the arena is
+	// big enough frames don't touch the heap.
+	//
+	// Only the thread running Lua should use the arena.
+	class FrameArena
+	{
+	public:
+		static const std::size_t MIN_BLOCK_SIZE = 1 << 16;
+
+		static FrameArena& get_instance();
+
+		void* allocate(std::size_t size, std::size_t alignment);
+
+		// Frees everything allocated since the last frame. Nothing allocated
+		// from the arena may be used afterwards.
+		void frame();
+
+		// Counters for the last frame (i.e., between the last two calls to
+		// frame()). Heap allocations are the blocks the arena had to add.
+		std::size_t get_num_allocations() const;
+		std::size_t get_num_bytes() const;
+		std::size_t get_num_heap_allocations() const;
+
+		// Total size of the blocks.
+		std::size_t get_capacity() const;
+
+	private:
+		FrameArena() = default;
+
+		struct Block
+		{
+			std::unique_ptr<char[]> memory;
+			std::size_t size;
+		};
+
+		void add_block(std::size_t size);
+
+		std::vector<Block> blocks;
+		std::size_t current_block = 0;
+		std::size_t offset = 0;
+
+		struct Counters
+		{
+			std::size_t num_allocations = 0;
+			std::size_t num_bytes = 0;
+			std::size_t num_heap_allocations = 0;
+		};
+
+		Counters current;
+		Counters previous;
+	};
+
+	// Allocates from the FrameArena; deallocate does nothing.
+	template <typename T>
+	struct FrameAllocator
+	{
+		typedef T value_type;
+
+		FrameAllocator() = default;
+
+		template <typename U>
+		FrameAllocator(const FrameAllocator<U>&)
+		{
+			// Nothing.
+		}
+
+		T* allocate(std::size_t n)
+		{
+			return static_cast<T*>(FrameArena::get_instance().allocate(n * sizeof(T), alignof(T)));
+		}
+
+		void deallocate(T*, std::size_t)
+		{
+			// Nothing.
+		}
+	};
+
+	template <typename T, typename U>
+	bool operator ==(const FrameAllocator<T>&, const FrameAllocator<U>&)
+	{
+		return true;
+	}
+
+	template <typename T, typename U>
+	bool operator !=(const FrameAllocator<T>&, const FrameAllocator<U>&)
+	{
+		return false;
+	}
+
+	template <typename T>
+	using FrameVector = std::vector<T, FrameAllocator<T>>;
+}
+
+#endif
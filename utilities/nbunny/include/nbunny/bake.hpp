@@ -0,0 +1,143 @@
+////////////////////////////////////////////////////////////////////////////////
+// nbunny/bake.hpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NBUNNY_BAKE_HPP
+#define NBUNNY_BAKE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "nbunny/resource.hpp"
+
+namespace nbunny
+{
+	// Hashes the inputs of something baked. The same updates in the same order
+	// always give the same key. Each update is hashed on its own, so "ab" then
+	// "c" isn't the same as "a" then "bc".
+	class BakeHash
+	{
+	public:
+		void update(const void* data, std::size_t size);
+		void update(const std::string& value);
+		void update(double value);
+
+		std::uint64_t get_value() const;
+
+		// The value as 16 hex digits.
+		std::string get_key() const;
+
+	private:
+		std::uint64_t value = 0;
+		std::uint64_t count = 0;
+	};
+
+	// A baked file, mapped into memory. Everything points into the mapping, so
+	// nothing is valid after the file is destroyed.
+	class BakeFile
+	{
+	public:
+		struct Mesh
+		{
+			std::string name;
+
+			const float* vertices;
+			std::size_t vertex_count;
+
+			// 0-based; nullptr if the mesh isn't indexed.
+			const std::uint32_t* indices;
+			std::size_t index_count;
+
+			float min[3], max[3];
+		};
+
+		BakeFile(const BakeFile&) = delete;
+		BakeFile& operator =(const BakeFile&) = delete;
+		~BakeFile();
+
+		// Unmaps the file early. Nothing is valid afterwards.
+		void close();
+
+		// Returns nullptr if the file doesn't exist, wasn't baked from key, or
+		// is from an older version.
+		static std::unique_ptr<BakeFile> open(const std::string& filename, std::uint64_t key);
+
+		const std::vector<ResourceAttribute>& get_format() const;
+		const std::vector<std::string>& get_bones() const;
+		const std::vector<Mesh>& get_meshes() const;
+
+		// Floats per vertex.
+		std::size_t get_stride() const;
+
+	private:
+		BakeFile() = default;
+
+		bool map(const std::string& filename);
+		bool read(std::uint64_t key);
+
+		const std::uint8_t* data = nullptr;
+		std::size_t size = 0;
+
+#ifdef _WIN32
+		void* file_handle = nullptr;
+		void* mapping_handle = nullptr;
+#else
+		int file_descriptor = -1;
+#endif
+
+		std::vector<ResourceAttribute> format;
+		std::vector<std::string> bones;
+		std::vector<Mesh> meshes;
+		std::size_t stride = 0;
+	};
+
+	// A directory of baked vertex buffers, each named after the hash of what
+	// it was baked from. See ItsyScape/Graphics/BakeCache.lua.
+	//
+	// Files are written to a temporary file then renamed, so a file is never
+	// seen half written. Safe to use from many threads at once.
+	class BakeCache
+	{
+	public:
+		// Bump when the file layout or anything baked changes.
+		static const std::uint32_t VERSION = 1;
+
+		// directory must already exist.
+		explicit BakeCache(const std::string& directory);
+
+		const std::string& get_directory() const;
+		std::string get_filename(std::uint64_t key) const;
+
+		std::unique_ptr<BakeFile> load(std::uint64_t key) const;
+
+		// Every mesh must have the same format. vertices and indices of each
+		// mesh are read as in BakeFile::Mesh.
+		bool save(
+			std::uint64_t key,
+			const std::vector<ResourceAttribute>& format,
+			const std::vector<std::string>& bones,
+			const std::vector<BakeFile::Mesh>& meshes) const;
+
+		// Like save, but for meshes decoded by a ResourceLoader.
+		bool save(
+			std::uint64_t key,
+			const std::vector<ResourceAttribute>& format,
+			const std::vector<std::string>& bones,
+			const std::vector<ResourceMesh>& meshes) const;
+
+	private:
+		std::string directory;
+	};
+}
+
+#endif
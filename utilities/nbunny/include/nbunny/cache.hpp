@@ -0,0 +1,129 @@
+////////////////////////////////////////////////////////////////////////////////
+// nbunny/cache.hpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NBUNNY_CACHE_HPP
+#define NBUNNY_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace nbunny
+{
+	// Decides which resources stay loaded. See
+	// ItsyScape/Graphics/ResourceManager.lua.
+	//
+	// The cache only keeps track of keys and sizes; the resources themselves
+	// are kept alive by Lua until the cache evicts them. Each type (a small
+	// integer chosen by the caller) has its own budget, in bytes. When a type
+	// goes over its budget, the least recently used entries that aren't
+	// pinned are evicted until it fits again.
+	class ResourceCache
+	{
+	public:
+		struct Stats
+		{
+			std::size_t hits = 0;
+			std::size_t misses = 0;
+			std::size_t evictions = 0;
+
+			std::size_t count = 0;
+			std::size_t bytes = 0;
+			std::size_t pinned_bytes = 0;
+			std::size_t budget = 0;
+		};
+
+		// Types without a budget get this one.
+		explicit ResourceCache(std::size_t default_budget = 0);
+
+		// Evicts right away if the type is over the new budget.
+		void set_budget(int type, std::size_t budget);
+		std::size_t get_budget(int type) const;
+
+		// Returns true (a hit) and marks the entry as the most recently used
+		// if it's cached. Counts a miss otherwise.
+		bool get(int type, const std::string& key);
+
+		// Like get, but doesn't touch the entry or the counters.
+		bool has(int type, const std::string& key) const;
+
+		// Adds the entry, or updates its size if it's already cached, and
+		// marks it as the most recently used. May evict other entries (but
+		// not this one, even if it's bigger than the budget).
+		void put(int type, const std::string& key, std::size_t size);
+
+		// Doesn't count as an eviction.
+		bool remove(int type, const std::string& key);
+
+		// Pinned entries are never evicted. Pins are counted, so each pin
+		// needs an unpin. Returns false if the entry isn't cached.
+		bool pin(int type, const std::string& key);
+		bool unpin(int type, const std::string& key);
+
+		// Returns false once there are no more evicted entries. Entries are
+		// returned in the order they were evicted.
+		bool pop_evicted(int& type, std::string& key);
+
+		Stats get_stats(int type) const;
+		void reset_stats();
+
+		std::size_t get_num_bytes() const;
+
+	private:
+		static const std::uint32_t NONE = 0xffffffff;
+
+		struct Entry
+		{
+			std::string key;
+			std::size_t size = 0;
+			std::size_t pins = 0;
+
+			// In the list of the type, from most to least recently used.
+			std::uint32_t previous = NONE;
+			std::uint32_t next = NONE;
+		};
+
+		struct Type
+		{
+			std::unordered_map<std::string, std::uint32_t> entries;
+			std::uint32_t head = NONE;
+			std::uint32_t tail = NONE;
+
+			bool has_budget = false;
+			Stats stats;
+		};
+
+		Type& get_type(int type);
+		const Type* find_type(int type) const;
+		std::uint32_t find(int type, const std::string& key) const;
+
+		void link(Type& type, std::uint32_t index);
+		void unlink(Type& type, std::uint32_t index);
+		void free(Type& type, std::uint32_t index);
+		void evict(int type);
+
+		std::size_t default_budget;
+		std::size_t num_bytes = 0;
+
+		std::vector<Type> types;
+		std::vector<Entry> entries;
+		std::vector<std::uint32_t> free_entries;
+
+		std::vector<std::pair<int, std::string>> evicted;
+		std::size_t current_evicted = 0;
+	};
+}
+
+#endif
@@ -0,0 +1,242 @@
+////////////////////////////////////////////////////////////////////////////////
+// nbunny/codec.hpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NBUNNY_CODEC_HPP
+#define NBUNNY_CODEC_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Encoders and decoders for the compressed goober profile.
+//
+// This header is shared with goober (and has no dependencies besides the
+// standard library) so both sides always agree on the encoding.
+namespace nbunny
+{
+	namespace codec
+	{
+		static const float QUATERNION_COMPONENT_RANGE = 0.70710678118f;
+		static const int QUATERNION_COMPONENT_BITS = 15;
+		static const std::uint32_t QUATERNION_COMPONENT_MAX = (1 << QUATERNION_COMPONENT_BITS) - 1;
+
+		inline std::uint32_t encode_unorm(float value, float min, float max, std::uint32_t range)
+		{
+			float extent = max - min;
+			if (extent <= 0.0f)
+			{
+				return 0;
+			}
+
+			float delta = std::min(std::max((value - min) / extent, 0.0f), 1.0f);
+			return (std::uint32_t)std::floor(delta * range + 0.5f);
+		}
+
+		inline float decode_unorm(std::uint32_t value, float min, float max, std::uint32_t range)
+		{
+			return min + (max - min) * ((float)value / range);
+		}
+
+		inline std::uint16_t encode_unorm16(float value, float min, float max)
+		{
+			return (std::uint16_t)encode_unorm(value, min, max, 0xffff);
+		}
+
+		inline float decode_unorm16(std::uint16_t value, float min, float max)
+		{
+			return decode_unorm(value, min, max, 0xffff);
+		}
+
+		inline std::uint8_t encode_unorm8(float value)
+		{
+			return (std::uint8_t)encode_unorm(value, 0.0f, 1.0f, 0xff);
+		}
+
+		inline float decode_unorm8(std::uint8_t value)
+		{
+			return decode_unorm(value, 0.0f, 1.0f, 0xff);
+		}
+
+		inline float sign_not_zero(float value)
+		{
+			return value >= 0.0f ? 1.0f : -1.0f;
+		}
+
+		// Octahedral normal encoding.
+		//
+		// See Cigolle et al., "A Survey of Efficient Representations for
+		// Independent Unit Vectors".
+		inline void encode_octahedral(const float normal[3], std::uint16_t result[2])
+		{
+			float length = std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]);
+			if (length <= 0.0f)
+			{
+				length = 1.0f;
+			}
+
+			float u = normal[0] / length;
+			float v = normal[1] / length;
+			if (normal[2] < 0.0f)
+			{
+				float x = (1.0f - std::abs(v)) * sign_not_zero(u);
+				float y = (1.0f - std::abs(u)) * sign_not_zero(v);
+				u = x;
+				v = y;
+			}
+
+			result[0] = encode_unorm16(u, -1.0f, 1.0f);
+			result[1] = encode_unorm16(v, -1.0f, 1.0f);
+		}
+
+		inline void decode_octahedral(const std::uint16_t value[2], float result[3])
+		{
+			float u = decode_unorm16(value[0], -1.0f, 1.0f);
+			float v = decode_unorm16(value[1], -1.0f, 1.0f);
+			float z = 1.0f - std::abs(u) - std::abs(v);
+			if (z < 0.0f)
+			{
+				float x = (1.0f - std::abs(v)) * sign_not_zero(u);
+				float y = (1.0f - std::abs(u)) * sign_not_zero(v);
+				u = x;
+				v = y;
+			}
+
+			float length = std::sqrt(u * u + v * v + z * z);
+			result[0] = u / length;
+			result[1] = v / length;
+			result[2] = z / length;
+		}
+
+		// IEEE 754 binary16. Denormals are flushed to zero.
+		inline std::uint16_t encode_half(float value)
+		{
+			std::uint32_t bits;
+			std::memcpy(&bits, &value, sizeof(float));
+
+			std::uint32_t sign = (bits >> 16) & 0x8000;
+			std::int32_t exponent = (std::int32_t)((bits >> 23) & 0xff) - 127 + 15;
+			std::uint32_t mantissa = bits & 0x7fffff;
+
+			if (((bits >> 23) & 0xff) == 0xff)
+			{
+				// Infinity or NaN.
+				return (std::uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+			}
+			else if (exponent <= 0)
+			{
+				return (std::uint16_t)sign;
+			}
+			else if (exponent >= 0x1f)
+			{
+				return (std::uint16_t)(sign | 0x7c00);
+			}
+
+			// Round to nearest.
+			std::uint32_t result = sign | (exponent << 10) | (mantissa >> 13);
+			if (mantissa & 0x1000)
+			{
+				++result;
+			}
+
+			return (std::uint16_t)result;
+		}
+
+		inline float decode_half(std::uint16_t value)
+		{
+			std::uint32_t sign = (std::uint32_t)(value & 0x8000) << 16;
+			std::uint32_t exponent = (value >> 10) & 0x1f;
+			std::uint32_t mantissa = value & 0x3ff;
+
+			std::uint32_t bits;
+			if (exponent == 0)
+			{
+				bits = sign;
+			}
+			else if (exponent == 0x1f)
+			{
+				bits = sign | 0x7f800000 | (mantissa << 13);
+			}
+			else
+			{
+				bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+			}
+
+			float result;
+			std::memcpy(&result, &bits, sizeof(float));
+			return result;
+		}
+
+		// Packs a unit quaternion (x, y, z, w) using the 'smallest three'
+		// method: the index of the largest component (2 bits) followed by the
+		// remaining three components (15 bits each).
+		//
+		// The result is 47 bits wide so it fits exactly in a Lua number.
+		inline std::uint64_t encode_quaternion(const float quaternion[4])
+		{
+			int largest = 0;
+			for (int i = 1; i < 4; ++i)
+			{
+				if (std::abs(quaternion[i]) > std::abs(quaternion[largest]))
+				{
+					largest = i;
+				}
+			}
+
+			float sign = quaternion[largest] < 0.0f ? -1.0f : 1.0f;
+
+			std::uint64_t result = (std::uint64_t)largest;
+			for (int i = 0; i < 4; ++i)
+			{
+				if (i != largest)
+				{
+					auto component = encode_unorm(
+						quaternion[i] * sign,
+						-QUATERNION_COMPONENT_RANGE,
+						QUATERNION_COMPONENT_RANGE,
+						QUATERNION_COMPONENT_MAX);
+
+					result = (result << QUATERNION_COMPONENT_BITS) | component;
+				}
+			}
+
+			return result;
+		}
+
+		inline void decode_quaternion(std::uint64_t value, float result[4])
+		{
+			int largest = (int)(value >> (QUATERNION_COMPONENT_BITS * 3)) & 0x3;
+
+			float sum = 0.0f;
+			int shift = QUATERNION_COMPONENT_BITS * 2;
+			for (int i = 0; i < 4; ++i)
+			{
+				if (i != largest)
+				{
+					auto component = (std::uint32_t)(value >> shift) & QUATERNION_COMPONENT_MAX;
+					result[i] = decode_unorm(
+						component,
+						-QUATERNION_COMPONENT_RANGE,
+						QUATERNION_COMPONENT_RANGE,
+						QUATERNION_COMPONENT_MAX);
+					sum += result[i] * result[i];
+
+					shift -= QUATERNION_COMPONENT_BITS;
+				}
+			}
+
+			result[largest] = std::sqrt(std::max(1.0f - sum, 0.0f));
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,146 @@
+////////////////////////////////////////////////////////////////////////////////
+// nbunny/ffi.h
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NBUNNY_FFI_H
+#define NBUNNY_FFI_H
+
+// A plain C API over the scene node, transform, camera, and key frame types
+// for the LuaJIT FFI. Calls through it can be compiled into traces, unlike
+// the sol bindings.
+//
+// Pointers come from the getPointer method of the matching usertype and are
+// only valid while that userdata is alive.
+//
+// Profiler scope names are the IDs from nbunny.profiler's getScopeID.
+//
+// Matrices are 16 floats in row-major order, the same order the sol bindings
+// push them in (and the order Love's Transform.setMatrix expects).
+//
+// nbunny_scene_node_transform_apply applies a batch of transform updates in
+// one call. Each update ticks the transform (if the TICK flag is set), then
+// sets the previous values, then the current values, for the fields in the
+// mask; updates are applied in order, so to set a current value and then
+// tick, use two updates.
+//
+// NBUNNY_FFI_CDEF(X) passes the declarations to X. They're declared below
+// and the same text is given to ffi.cdef by luaopen_nbunny_ffi, so the two
+// can't drift. Comments inside the macro are stripped by the preprocessor.
+#define NBUNNY_FFI_CDEF(X) X( \
+	typedef struct nbunny_scene_node nbunny_scene_node; \
+	typedef struct nbunny_scene_node_transform nbunny_scene_node_transform; \
+	typedef struct nbunny_camera nbunny_camera; \
+	typedef struct nbunny_keyframe nbunny_keyframe; \
+	\
+	void nbunny_scene_node_set_min(nbunny_scene_node* node, float x, float y, float z); \
+	void nbunny_scene_node_set_max(nbunny_scene_node* node, float x, float y, float z); \
+	nbunny_scene_node_transform* nbunny_scene_node_get_transform_pointer(nbunny_scene_node* node); \
+	\
+	void nbunny_scene_node_transform_set_current_rotation(nbunny_scene_node_transform* transform, float x, float y, float z, float w); \
+	void nbunny_scene_node_transform_set_current_scale(nbunny_scene_node_transform* transform, float x, float y, float z); \
+	void nbunny_scene_node_transform_set_current_translation(nbunny_scene_node_transform* transform, float x, float y, float z); \
+	void nbunny_scene_node_transform_set_current_offset(nbunny_scene_node_transform* transform, float x, float y, float z); \
+	void nbunny_scene_node_transform_set_previous_rotation(nbunny_scene_node_transform* transform, float x, float y, float z, float w); \
+	void nbunny_scene_node_transform_set_previous_scale(nbunny_scene_node_transform* transform, float x, float y, float z); \
+	void nbunny_scene_node_transform_set_previous_translation(nbunny_scene_node_transform* transform, float x, float y, float z); \
+	void nbunny_scene_node_transform_set_previous_offset(nbunny_scene_node_transform* transform, float x, float y, float z); \
+	void nbunny_scene_node_transform_tick(nbunny_scene_node_transform* transform); \
+	void nbunny_scene_node_transform_get_local_delta_transform(nbunny_scene_node_transform* transform, float delta, float* matrix); \
+	void nbunny_scene_node_transform_get_global_delta_transform(nbunny_scene_node_transform* transform, float delta, float* matrix); \
+	\
+	enum \
+	{ \
+		NBUNNY_SCENE_NODE_TRANSFORM_TICK                 = 1, \
+		NBUNNY_SCENE_NODE_TRANSFORM_PREVIOUS_ROTATION    = 2, \
+		NBUNNY_SCENE_NODE_TRANSFORM_PREVIOUS_SCALE       = 4, \
+		NBUNNY_SCENE_NODE_TRANSFORM_PREVIOUS_TRANSLATION = 8, \
+		NBUNNY_SCENE_NODE_TRANSFORM_PREVIOUS_OFFSET      = 16, \
+		NBUNNY_SCENE_NODE_TRANSFORM_CURRENT_ROTATION     = 32, \
+		NBUNNY_SCENE_NODE_TRANSFORM_CURRENT_SCALE        = 64, \
+		NBUNNY_SCENE_NODE_TRANSFORM_CURRENT_TRANSLATION  = 128, \
+		NBUNNY_SCENE_NODE_TRANSFORM_CURRENT_OFFSET       = 256 \
+	}; \
+	\
+	typedef struct nbunny_scene_node_transform_update \
+	{ \
+		nbunny_scene_node_transform* transform; \
+		int fields; \
+		float previous_rotation[4]; \
+		float previous_scale[3]; \
+		float previous_translation[3]; \
+		float previous_offset[3]; \
+		float current_rotation[4]; \
+		float current_scale[3]; \
+		float current_translation[3]; \
+		float current_offset[3]; \
+	} nbunny_scene_node_transform_update; \
+	\
+	void nbunny_scene_node_transform_apply(const nbunny_scene_node_transform_update* updates, int count); \
+	\
+	void nbunny_camera_set_view(nbunny_camera* camera, const float* matrix); \
+	void nbunny_camera_set_projection(nbunny_camera* camera, const float* matrix); \
+	\
+	void nbunny_keyframe_set_time(nbunny_keyframe* keyframe, float time); \
+	void nbunny_keyframe_set_rotation(nbunny_keyframe* keyframe, float x, float y, float z, float w); \
+	void nbunny_keyframe_set_scale(nbunny_keyframe* keyframe, float x, float y, float z); \
+	void nbunny_keyframe_set_translation(nbunny_keyframe* keyframe, float x, float y, float z); \
+	void nbunny_keyframe_interpolate(const nbunny_keyframe* self, const nbunny_keyframe* other, float time, float* matrix); \
+	\
+	void nbunny_profiler_begin_scope(unsigned int name); \
+	void nbunny_profiler_end_scope(void); \
+	\
+	typedef struct nbunny_ffi_api \
+	{ \
+		void (*scene_node_set_min)(nbunny_scene_node* node, float x, float y, float z); \
+		void (*scene_node_set_max)(nbunny_scene_node* node, float x, float y, float z); \
+		nbunny_scene_node_transform* (*scene_node_get_transform_pointer)(nbunny_scene_node* node); \
+		\
+		void (*scene_node_transform_set_current_rotation)(nbunny_scene_node_transform* transform, float x, float y, float z, float w); \
+		void (*scene_node_transform_set_current_scale)(nbunny_scene_node_transform* transform, float x, float y, float z); \
+		void (*scene_node_transform_set_current_translation)(nbunny_scene_node_transform* transform, float x, float y, float z); \
+		void (*scene_node_transform_set_current_offset)(nbunny_scene_node_transform* transform, float x, float y, float z); \
+		void (*scene_node_transform_set_previous_rotation)(nbunny_scene_node_transform* transform, float x, float y, float z, float w); \
+		void (*scene_node_transform_set_previous_scale)(nbunny_scene_node_transform* transform, float x, float y, float z); \
+		void (*scene_node_transform_set_previous_translation)(nbunny_scene_node_transform* transform, float x, float y, float z); \
+		void (*scene_node_transform_set_previous_offset)(nbunny_scene_node_transform* transform, float x, float y, float z); \
+		void (*scene_node_transform_tick)(nbunny_scene_node_transform* transform); \
+		void (*scene_node_transform_get_local_delta_transform)(nbunny_scene_node_transform* transform, float delta, float* matrix); \
+		void (*scene_node_transform_get_global_delta_transform)(nbunny_scene_node_transform* transform, float delta, float* matrix); \
+		void (*scene_node_transform_apply)(const nbunny_scene_node_transform_update* updates, int count); \
+		\
+		void (*camera_set_view)(nbunny_camera* camera, const float* matrix); \
+		void (*camera_set_projection)(nbunny_camera* camera, const float* matrix); \
+		\
+		void (*keyframe_set_time)(nbunny_keyframe* keyframe, float time); \
+		void (*keyframe_set_rotation)(nbunny_keyframe* keyframe, float x, float y, float z, float w); \
+		void (*keyframe_set_scale)(nbunny_keyframe* keyframe, float x, float y, float z); \
+		void (*keyframe_set_translation)(nbunny_keyframe* keyframe, float x, float y, float z); \
+		void (*keyframe_interpolate)(const nbunny_keyframe* self, const nbunny_keyframe* other, float time, float* matrix); \
+		\
+		void (*profiler_begin_scope)(unsigned int name); \
+		void (*profiler_end_scope)(void); \
+	} nbunny_ffi_api; \
+)
+
+#define NBUNNY_FFI_DECLARE(...) __VA_ARGS__
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+NBUNNY_FFI_CDEF(NBUNNY_FFI_DECLARE)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,131 @@
+////////////////////////////////////////////////////////////////////////////////
+// nbunny/light.hpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NBUNNY_LIGHT_HPP
+#define NBUNNY_LIGHT_HPP
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "nbunny/scene.hpp"
+
+namespace nbunny
+{
+	// Finds the lights in a scene and bins the visible point lights into a
+	// grid of clusters over the camera's frustum: WIDTH by HEIGHT tiles in
+	// screen space and DEPTH slices from the near plane to the far plane.
+	// Slices are spaced exponentially for perspective projections and
+	// evenly otherwise.
+	//
+	// Each cluster lists the point lights that reach it, so a fragment only
+	// has to look at the lights in its cluster. See
+	// Resources/Renderers/Mobile/Base.frag.glsl for how the lists are read.
+	class LightClusters
+	{
+	public:
+		static const int WIDTH = 16;
+		static const int HEIGHT = 8;
+		static const int DEPTH = 16;
+		static const int NUM_CLUSTERS = WIDTH * HEIGHT * DEPTH;
+
+		// Visible point lights past this many, furthest from the eye first,
+		// are dropped.
+		static const int MAX_LIGHTS = 256;
+
+		// Lights past this many in a cluster, furthest first, are dropped.
+		static const int MAX_CLUSTER_LIGHTS = 64;
+
+		// The index list is sized to fit a texture.
+		static const int INDEX_TEXTURE_WIDTH = 256;
+		static const int INDEX_TEXTURE_HEIGHT = 64;
+		static const int MAX_INDICES = INDEX_TEXTURE_WIDTH * INDEX_TEXTURE_HEIGHT;
+
+		// Walks the scene under root for lights. Point lights outside the
+		// camera are culled (unless culling is disabled); the rest are sorted
+		// by distance to the eye and binned.
+		void build(const std::shared_ptr<SceneNode>& root, const Camera& camera, float delta);
+
+		// Like build, but the lights are given one at a time by another walk
+		// (see SceneNode::walk_by_kind). Nodes that aren't lights are
+		// ignored.
+		void begin(const Camera& camera);
+		void add(const std::shared_ptr<SceneNode>& node, const Camera& camera, float delta);
+		void end(const Camera& camera);
+
+		// Lights by kind, in walk order, except for point lights, which are
+		// nearest to the eye first, and fog, which is nearest far distance
+		// first. Indices in the cluster lists are into the point lights.
+		//
+		// Global lights are lights of any kind with is_global_light set;
+		// local lights are the rest that aren't point lights.
+		const std::vector<std::shared_ptr<SceneNode>>& get_global_lights() const;
+		const std::vector<std::shared_ptr<SceneNode>>& get_local_lights() const;
+		const std::vector<std::shared_ptr<SceneNode>>& get_point_lights() const;
+		const std::vector<std::shared_ptr<SceneNode>>& get_fog() const;
+
+		// Near and far planes taken from the camera's projection.
+		float get_near() const;
+		float get_far() const;
+		bool get_is_perspective() const;
+
+		// Returns the slice for a depth (distance in front of the eye), or -1
+		// if the depth is before the near plane.
+		int get_slice(float depth) const;
+
+		std::size_t get_num_indices() const;
+
+		// Writes NUM_CLUSTERS pairs of floats: the offset of the cluster's
+		// lights in the index list and the number of lights. Cluster (x, y,
+		// z) is at x + y * WIDTH + z * WIDTH * HEIGHT.
+		void copy_clusters(float* result) const;
+
+		// Writes MAX_INDICES floats. Entries past get_num_indices() are 0.
+		void copy_indices(float* result) const;
+
+	private:
+		void collect(const std::shared_ptr<SceneNode>& node, const Camera& camera, float delta);
+		bool get_range(const glm::vec3& position, float radius, const Camera& camera, int range[6]) const;
+		void bin(const Camera& camera);
+
+		struct PointLight
+		{
+			std::shared_ptr<SceneNode> node;
+			glm::vec3 position;
+			float radius;
+			float distance;
+			std::uint32_t order;
+		};
+
+		std::vector<std::shared_ptr<SceneNode>> global_lights;
+		std::vector<std::shared_ptr<SceneNode>> local_lights;
+		std::vector<std::shared_ptr<SceneNode>> point_lights;
+		std::vector<std::shared_ptr<SceneNode>> fog;
+
+		glm::vec3 eye = glm::vec3(0.0f);
+		std::vector<PointLight> candidates;
+
+		float near = 0.1f;
+		float far = 100.0f;
+		bool is_perspective = true;
+
+		// Light i covers the clusters in ranges[i * 6] to ranges[i * 6 + 5]
+		// (x, y, and z, inclusive).
+		std::vector<int> ranges;
+
+		std::vector<std::uint16_t> cluster_counts;
+		std::vector<std::uint16_t> cluster_cursors;
+		std::vector<std::uint32_t> cluster_offsets;
+		std::vector<std::uint16_t> indices;
+	};
+}
+
+#endif
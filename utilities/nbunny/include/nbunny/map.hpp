@@ -0,0 +1,154 @@
+////////////////////////////////////////////////////////////////////////////////
+// nbunny/map.hpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NBUNNY_MAP_HPP
+#define NBUNNY_MAP_HPP
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace nbunny
+{
+	// What's stored for each tile, as floats. Only what changes the mesh is
+	// stored: the corner heights, the tile set indices (the decals are a
+	// count and a hash), and the color and texture bounds of the flat after
+	// the tile set is applied. See ItsyScape/World/Tile.lua.
+	enum MapTileField
+	{
+		MAP_TILE_TOP_LEFT = 0,
+		MAP_TILE_TOP_RIGHT,
+		MAP_TILE_BOTTOM_LEFT,
+		MAP_TILE_BOTTOM_RIGHT,
+		MAP_TILE_FLAT,
+		MAP_TILE_EDGE,
+		MAP_TILE_NUM_DECALS,
+		MAP_TILE_DECALS,
+		MAP_TILE_RED,
+		MAP_TILE_GREEN,
+		MAP_TILE_BLUE,
+		MAP_TILE_TEXTURE_LEFT,
+		MAP_TILE_TEXTURE_RIGHT,
+		MAP_TILE_TEXTURE_TOP,
+		MAP_TILE_TEXTURE_BOTTOM,
+		MAP_TILE_NUM_FIELDS
+	};
+
+	// Splits a map layer into chunks of chunk_size by chunk_size tiles and
+	// keeps track of which chunks need to be built again and which level of
+	// detail each should be drawn at. See GameView.updateMap.
+	//
+	// Level 0 is the full mesh, built by ItsyScape/World/MapMesh.lua. Levels
+	// 1 through MAX_LEVEL are built here whenever a chunk changes: the
+	// corners of every 2^level by 2^level tiles become a heightfield, with
+	// the flat of the tile in the middle stretched over it. Edges are left
+	// out, and a skirt hangs off the sides of the chunk to hide the seams
+	// with chunks at other levels.
+	//
+	// Vertices match MapMesh.FORMAT: FLOATS_PER_VERTEX floats each, three
+	// per triangle, not shared.
+	class MapChunks
+	{
+	public:
+		static const int MAX_LEVEL = 2;
+		static const int FLOATS_PER_VERTEX = 16;
+
+		// A chunk that was rebuilt (its tiles, or the tiles around it,
+		// changed) or has a new level. Chunks are 0-based.
+		struct Change
+		{
+			int i, j;
+			int level;
+			bool is_rebuilt;
+		};
+
+		// Every chunk is rebuilt on the next update.
+		void resize(int width, int height, int chunk_size);
+		int get_width() const;
+		int get_height() const;
+		int get_chunk_size() const;
+		int get_num_chunks_width() const;
+		int get_num_chunks_height() const;
+
+		float get_cell_size() const;
+		void set_cell_size(float value);
+
+		float get_skirt_depth() const;
+		void set_skirt_depth(float value);
+
+		// Chunks past distance from the focus go up a level, and so on,
+		// until MAX_LEVEL.
+		void enable_lod(float distance);
+		void disable_lod();
+		bool get_is_lod_enabled() const;
+
+		// In map space (i.e., before the layer is moved).
+		void set_focus(float x, float z);
+
+		// Width * height * MAP_TILE_NUM_FIELDS floats, row by row. Changes
+		// when the map is resized. Call invalidate_tiles after changing them.
+		//
+		// The whole map can be written each time; only tiles that are
+		// different from the last update count as changed.
+		float* get_tiles();
+		void invalidate_tiles();
+
+		const std::vector<Change>& update();
+
+		// Returns nullptr for level 0 or a chunk outside the map.
+		const float* get_vertices(int i, int j, int level) const;
+		std::size_t get_vertex_count(int i, int j, int level) const;
+
+		// Bounds of the vertices of the chunk at the level.
+		void get_bounds(int i, int j, int level, glm::vec3& min, glm::vec3& max) const;
+
+	private:
+		struct Chunk
+		{
+			int level = -1;
+			bool is_dirty = true;
+
+			std::vector<float> vertices[MAX_LEVEL];
+			glm::vec3 min[MAX_LEVEL];
+			glm::vec3 max[MAX_LEVEL];
+		};
+
+		const Chunk* get_chunk(int i, int j) const;
+
+		void invalidate(int tile_i, int tile_j);
+		int get_level(int i, int j) const;
+
+		float get_corner_height(int x, int z) const;
+		void build(int i, int j);
+
+		int width = 0;
+		int height = 0;
+		int chunk_size = 16;
+		int num_chunks_width = 0;
+		int num_chunks_height = 0;
+		float cell_size = 2.0f;
+		float skirt_depth = 2.0f;
+
+		bool is_lod_enabled = false;
+		float lod_distance = 0.0f;
+		glm::vec2 focus = glm::vec2(0.0f);
+
+		std::vector<float> tiles;
+		std::vector<float> previous_tiles;
+		bool is_tiles_dirty = false;
+
+		std::vector<Chunk> chunks;
+		std::vector<Change> changes;
+	};
+}
+
+#endif
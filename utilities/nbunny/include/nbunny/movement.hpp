@@ -0,0 +1,204 @@
+////////////////////////////////////////////////////////////////////////////////
+// nbunny/movement.hpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NBUNNY_MOVEMENT_HPP
+#define NBUNNY_MOVEMENT_HPP
+
+#include <unordered_map>
+#include <vector>
+#include "nbunny/scheduler.hpp"
+
+namespace nbunny
+{
+	// A packed copy of the parts of an ItsyScape.World.Map that movement
+	// cares about: corner heights and passability.
+	//
+	// Tile indices are 1-based and clamped, like Map.getTile.
+	struct MovementMap
+	{
+	public:
+		enum
+		{
+			FLAG_IMPASSABLE = 1 << 0,
+			FLAG_DOOR       = 1 << 1
+		};
+
+		struct Tile
+		{
+			double top_left = 0.0;
+			double top_right = 0.0;
+			double bottom_left = 0.0;
+			double bottom_right = 0.0;
+			int flags = 0;
+
+			bool is_passable(int impassable_flags = FLAG_IMPASSABLE | FLAG_DOOR) const;
+			double get_height() const;
+		};
+
+		MovementMap() = default;
+		MovementMap(int width, int height, double cell_size);
+
+		int get_width() const;
+		int get_height() const;
+
+		Tile& get_tile(int i, int j);
+		const Tile& get_tile(int i, int j) const;
+		const Tile& get_tile_at(double x, double z, int& i, int& j) const;
+
+		double get_interpolated_height(double x, double z) const;
+		bool is_out_of_bounds(double x, double z) const;
+		bool can_move(int i, int j, int di, int dj) const;
+		void snap_to_tile(double new_x, double new_z, double old_x, double old_z, double& reflection_x, double& reflection_z) const;
+
+	private:
+		void do_snap_to_tile(int i, int j, double new_x, double new_z, double old_x, double old_z, double& reflection_x, double& reflection_z) const;
+
+		int width = 1;
+		int height = 1;
+		double cell_size = 1.0;
+		std::vector<Tile> tiles = std::vector<Tile>(1);
+	};
+
+	// What's stored for each MovementState in MovementSolver, as doubles.
+	// Booleans are 0 or 1; a target facing of 0 means none.
+	//
+	// Only MOVEMENT_STATE_IS_CHANGED is written by the solver; it's 1 if
+	// the last step changed the state.
+	enum MovementStateField
+	{
+		MOVEMENT_STATE_LAYER = 0,
+		MOVEMENT_STATE_POSITION_X,
+		MOVEMENT_STATE_POSITION_Y,
+		MOVEMENT_STATE_POSITION_Z,
+		MOVEMENT_STATE_ACCELERATION_X,
+		MOVEMENT_STATE_ACCELERATION_Y,
+		MOVEMENT_STATE_ACCELERATION_Z,
+		MOVEMENT_STATE_VELOCITY_X,
+		MOVEMENT_STATE_VELOCITY_Y,
+		MOVEMENT_STATE_VELOCITY_Z,
+		MOVEMENT_STATE_ADDITIONAL_ACCELERATION_X,
+		MOVEMENT_STATE_ADDITIONAL_ACCELERATION_Y,
+		MOVEMENT_STATE_ADDITIONAL_ACCELERATION_Z,
+		MOVEMENT_STATE_ADDITIONAL_VELOCITY_X,
+		MOVEMENT_STATE_ADDITIONAL_VELOCITY_Y,
+		MOVEMENT_STATE_ADDITIONAL_VELOCITY_Z,
+		MOVEMENT_STATE_MAX_SPEED,
+		MOVEMENT_STATE_MAX_ACCELERATION,
+		MOVEMENT_STATE_VELOCITY_MULTIPLIER,
+		MOVEMENT_STATE_ACCELERATION_MULTIPLIER,
+		MOVEMENT_STATE_BOUNCE,
+		MOVEMENT_STATE_BOUNCE_THRESHOLD,
+		MOVEMENT_STATE_DECAY,
+		MOVEMENT_STATE_STOPPING_FORCE,
+		MOVEMENT_STATE_MAX_STEP_HEIGHT,
+		MOVEMENT_STATE_FACING,
+		MOVEMENT_STATE_TARGET_FACING,
+		MOVEMENT_STATE_IS_ON_GROUND,
+		MOVEMENT_STATE_IS_STOPPING,
+		MOVEMENT_STATE_IS_CHANGED,
+		MOVEMENT_STATE_NUM_FIELDS
+	};
+
+	// The state of a MovementBehavior and PositionBehavior pair.
+	struct MovementState
+	{
+		int layer = 1;
+
+		double position[3] = { 0.0, 0.0, 0.0 };
+		double acceleration[3] = { 0.0, 0.0, 0.0 };
+		double velocity[3] = { 0.0, 0.0, 0.0 };
+		double additional_acceleration[3] = { 0.0, 0.0, 0.0 };
+		double additional_velocity[3] = { 0.0, 0.0, 0.0 };
+
+		double max_speed = 0.0;
+		double max_acceleration = 0.0;
+		double velocity_multiplier = 1.0;
+		double acceleration_multiplier = 1.0;
+		double bounce = 0.0;
+		double bounce_threshold = 0.0;
+		double decay = 1.0;
+		double stopping_force = 2.0;
+		double max_step_height = 1.0;
+
+		// Facing is -1 (left) or 1 (right); a target facing of 0 means
+		// none.
+		double facing = 1.0;
+		double target_facing = 0.0;
+
+		bool is_on_ground = false;
+		bool is_stopping = false;
+
+		// Reads from or writes to MOVEMENT_STATE_NUM_FIELDS doubles.
+		void unpack(const double* fields);
+		void pack(double* fields) const;
+	};
+
+	// Integrates MovementStates in a batch, mirroring MovementCortex.
+	//
+	// As a Kernel, each chunk is a slice of the states stepped with the
+	// Parameters from the last call to set_parameters.
+	//
+	// States are packed one after another (see MovementStateField), so Lua
+	// can fill them in and read them back through get_states without a
+	// call per state.
+	struct MovementSolver : public Kernel
+	{
+	public:
+		static const std::size_t CHUNK_SIZE = 128;
+
+		struct Parameters
+		{
+			double gravity[3] = { 0.0, 0.0, 0.0 };
+			double delta = 0.0;
+			double multiplier = 1.0;
+			double ground_epsilon = 0.1;
+			double clamp_epsilon = 0.05;
+		};
+
+		MovementMap& set_map(int layer, int width, int height, double cell_size);
+		MovementMap* get_map(int layer);
+		void remove_map(int layer);
+
+		void clear();
+		std::size_t add(const MovementState& state);
+		std::size_t count() const;
+
+		// Makes room for count states. New states are zero; existing ones
+		// are kept. Invalidates the pointer from get_states.
+		void resize(std::size_t count);
+
+		// count() * MOVEMENT_STATE_NUM_FIELDS doubles.
+		double* get_states();
+
+		// Returns true if the state at index was changed by the last step.
+		bool is_changed(std::size_t index) const;
+		MovementState get(std::size_t index) const;
+
+		// Steps every state with a map. States without a map are left
+		// alone.
+		void step(const Parameters& parameters);
+
+		void set_parameters(const Parameters& value);
+		std::size_t get_num_chunks() const override;
+		void run_chunk(std::size_t chunk) override;
+
+		static bool step(MovementState& state, const MovementMap& map, const Parameters& parameters);
+
+	private:
+		std::unordered_map<int, MovementMap> maps;
+		std::vector<double> states;
+
+		Parameters parameters;
+	};
+}
+
+#endif
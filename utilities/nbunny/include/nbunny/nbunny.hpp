@@ -13,6 +13,9 @@
 #ifndef NBUNNY_HPP
 #define NBUNNY_HPP
 
+// NBUNNY_NO_LUA builds only the native core of the modules that support it,
+// e.g. for the benchmarks.
+#ifndef NBUNNY_NO_LUA
 extern "C"
 {
 	#include "lua.h"
@@ -24,6 +27,8 @@ extern "C"
 #define SOL_SAFE_GETTER 1
 
 #include "deps/sol.hpp"
+#endif
+
 #include "skeleton.hpp"
 
 #ifdef NBUNNY_BUILDING_WINDOWS
@@ -0,0 +1,159 @@
+////////////////////////////////////////////////////////////////////////////////
+// nbunny/profiler.hpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NBUNNY_PROFILER_HPP
+#define NBUNNY_PROFILER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace nbunny
+{
+	// Records nested, named scopes from any thread.
+	//
+	// Each thread writes finished scopes to its own ring buffer without
+	// locking. Once a frame, frame() totals the time spent in each scope
+	// name; the last HISTORY_SIZE totals are kept for percentiles. The ring
+	// buffers can also be written out as a Chrome trace.
+	//
+	// Scopes are cheap when the profiler is disabled, which is the default.
+	class Profiler
+	{
+	public:
+		// Nanoseconds since the profiler was created.
+		typedef std::uint64_t Time;
+
+		static const std::size_t BUFFER_SIZE = 1 << 16;
+		static const std::size_t MAX_DEPTH = 64;
+		static const std::size_t HISTORY_SIZE = 120;
+
+		struct Event
+		{
+			std::uint32_t name;
+			std::uint32_t depth;
+			Time begin;
+			Time end;
+		};
+
+		static Profiler& get_instance();
+
+		void enable();
+		void disable();
+		bool is_enabled() const;
+
+		// Names are interned; the ID of a name never changes.
+		std::uint32_t get_name_id(const std::string& name);
+		std::string get_name(std::uint32_t id);
+
+		void begin_scope(std::uint32_t name);
+		void end_scope();
+
+		// Totals the scopes that ended since the last frame. Call this
+		// outside of any scope; scopes left open on the calling thread
+		// (e.g., by an error) are dropped.
+		void frame();
+
+		// Returns the pth percentile (0 to 1) of the frame totals of the
+		// scope, in seconds.
+		double get_percentile(std::uint32_t name, double p);
+
+		// Writes the scopes still in the ring buffers. Scopes written while
+		// this runs may be garbled, so it's best called between frames.
+		void write_chrome_trace(std::ostream& stream);
+
+		// Forgets every event and frame total.
+		void clear();
+
+		Time now() const;
+
+	private:
+		Profiler();
+
+		struct Scope
+		{
+			std::uint32_t name;
+			Time begin;
+			bool recorded;
+		};
+
+		struct ThreadBuffer
+		{
+			std::uint32_t id;
+			std::vector<Event> events = std::vector<Event>(BUFFER_SIZE);
+
+			// Written only by the owning thread.
+			std::atomic<std::uint64_t> head;
+
+			// Read and written only under the profiler's mutex. Events
+			// before first were cleared, and events before tail were
+			// totaled.
+			std::uint64_t first = 0;
+			std::uint64_t tail = 0;
+
+			Scope scopes[MAX_DEPTH];
+			std::size_t depth = 0;
+
+			// False once the owning thread has exited; the buffer is then
+			// given to the next new thread.
+			bool in_use = true;
+		};
+
+		struct ThreadBufferOwner
+		{
+			ThreadBuffer* buffer = nullptr;
+			~ThreadBufferOwner();
+		};
+
+		ThreadBuffer& get_thread_buffer();
+
+		std::atomic<bool> enabled;
+		std::chrono::steady_clock::time_point epoch;
+
+		std::mutex mutex;
+		std::vector<std::unique_ptr<ThreadBuffer>> threads;
+
+		std::unordered_map<std::string, std::uint32_t> name_ids;
+		std::vector<std::string> names;
+
+		// history[name * HISTORY_SIZE + frame % HISTORY_SIZE] is the total
+		// time, in nanoseconds, spent in the scope on that frame.
+		std::vector<Time> history;
+		std::vector<Time> totals;
+		std::size_t num_frames = 0;
+	};
+
+	// Profiles the rest of the enclosing C++ scope.
+	struct ProfileScope
+	{
+	public:
+		explicit ProfileScope(std::uint32_t name);
+		~ProfileScope();
+	};
+}
+
+#define NBUNNY_PROFILE_CONCAT_IMPL(a, b) a##b
+#define NBUNNY_PROFILE_CONCAT(a, b) NBUNNY_PROFILE_CONCAT_IMPL(a, b)
+
+#define NBUNNY_PROFILE_SCOPE(name) \
+	static const std::uint32_t NBUNNY_PROFILE_CONCAT(nbunny_profile_name_, __LINE__) = \
+		nbunny::Profiler::get_instance().get_name_id(name); \
+	nbunny::ProfileScope NBUNNY_PROFILE_CONCAT(nbunny_profile_scope_, __LINE__)( \
+		NBUNNY_PROFILE_CONCAT(nbunny_profile_name_, __LINE__))
+
+#endif
@@ -0,0 +1,194 @@
+////////////////////////////////////////////////////////////////////////////////
+// nbunny/replay.hpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NBUNNY_REPLAY_HPP
+#define NBUNNY_REPLAY_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "nbunny/light.hpp"
+#include "nbunny/scene.hpp"
+#include "nbunny/skeleton.hpp"
+
+namespace nbunny
+{
+	// Commands in a recording. A recording is REPLAY_MAGIC, REPLAY_VERSION,
+	// and then commands, each a byte followed by its arguments. Node IDs
+	// are 32-bit, the first node is 0, and each created node takes the next
+	// ID.
+	enum ReplayCommand : std::uint8_t
+	{
+		// No arguments. Ends the frame.
+		REPLAY_COMMAND_FRAME = 0,
+
+		// Node ID.
+		REPLAY_COMMAND_CREATE_NODE,
+
+		// Node ID.
+		REPLAY_COMMAND_DESTROY_NODE,
+
+		// Node ID and parent ID (REPLAY_NO_NODE for none).
+		REPLAY_COMMAND_SET_PARENT,
+
+		// Node ID, min (3 floats), and max (3 floats).
+		REPLAY_COMMAND_SET_BOUNDS,
+
+		// Node ID, shader, number of textures, and the textures (32-bit
+		// integers).
+		REPLAY_COMMAND_SET_MATERIAL,
+
+		// Node ID, ticked (a byte), and the current then previous rotation
+		// (4 floats), scale, translation, and offset (3 floats each).
+		REPLAY_COMMAND_SET_TRANSFORM,
+
+		// Root node ID, view and projection (16 floats each, column-major),
+		// cull (a byte), and delta (a float).
+		REPLAY_COMMAND_WALK_BY_MATERIAL,
+		REPLAY_COMMAND_WALK_BY_POSITION,
+
+		// Two key frames, each time, rotation, scale, and translation (11
+		// floats), then the time (a float).
+		REPLAY_COMMAND_INTERPOLATE,
+
+		// Node ID, kind, is global light, and is translucent (a byte each),
+		// then the light radius (a float).
+		REPLAY_COMMAND_SET_KIND,
+
+		// Like REPLAY_COMMAND_WALK_BY_MATERIAL.
+		REPLAY_COMMAND_WALK_BY_KIND
+	};
+
+	static const char REPLAY_MAGIC[4] = { 'N', 'B', 'R', 'P' };
+	// Version 1 recordings are a subset of version 2, so they can still be
+	// played.
+	static const std::uint32_t REPLAY_VERSION = 2;
+	static const std::uint32_t REPLAY_NO_NODE = 0xffffffff;
+
+	// Records the scene node, transform, walk, and key frame calls made
+	// through the Lua bindings and the FFI so they can be replayed without
+	// Love (see Replay).
+	//
+	// Nodes that existed before recording started are written out, with
+	// their state and children, the first time a recorded call reaches
+	// them. Nodes collected by Lua are destroyed at the next frame.
+	//
+	// Only the thread running Lua should record.
+	class Recorder
+	{
+	public:
+		static Recorder& get_instance();
+
+		void start();
+		std::string stop();
+		bool is_recording() const;
+
+		void create_node(const std::shared_ptr<SceneNode>& node);
+		void set_parent(const std::shared_ptr<SceneNode>& node);
+		void set_bounds(const SceneNode* node);
+		void set_material(const SceneNodeMaterial* material);
+		void set_transform(const SceneNodeTransform* transform);
+		void set_kind(const SceneNode* node);
+		void set_translucent(const SceneNodeMaterial* material);
+		void walk_by_material(const std::shared_ptr<SceneNode>& root, const Camera& camera, float delta);
+		void walk_by_position(const std::shared_ptr<SceneNode>& root, const Camera& camera, float delta);
+		void walk_by_kind(const std::shared_ptr<SceneNode>& root, const Camera& camera, float delta);
+		void interpolate(const KeyFrame& self, const KeyFrame& other, float time);
+		void frame();
+
+	private:
+		Recorder() = default;
+
+		struct Entry
+		{
+			std::uint32_t id;
+			std::weak_ptr<SceneNode> node;
+			const SceneNodeTransform* transform;
+			const SceneNodeMaterial* material;
+		};
+
+		// Returns REPLAY_NO_NODE if the node hasn't been written or was
+		// collected, in which case its state is written once it's reached
+		// from a shared pointer.
+		std::uint32_t find(const SceneNode* node);
+		std::uint32_t discover(const std::shared_ptr<SceneNode>& node);
+		void forget(const SceneNode* node);
+
+		void write_bounds(std::uint32_t id, const SceneNode& node);
+		void write_material(std::uint32_t id, const SceneNodeMaterial& material);
+		void write_transform(std::uint32_t id, const SceneNodeTransform& transform);
+		void write_kind(std::uint32_t id, const SceneNode& node);
+		void write_walk(ReplayCommand command, const std::shared_ptr<SceneNode>& root, const Camera& camera, float delta);
+
+		void write_byte(std::uint8_t value);
+		void write_int(std::uint32_t value);
+		void write_floats(const float* values, std::size_t count);
+
+		bool recording = false;
+		std::vector<char> buffer;
+
+		std::uint32_t next_id = 0;
+		std::unordered_map<const SceneNode*, Entry> nodes;
+		std::unordered_map<const SceneNodeTransform*, const SceneNode*> transforms;
+		std::unordered_map<const SceneNodeMaterial*, const SceneNode*> materials;
+	};
+
+	// Plays back a recording made by Recorder one frame at a time.
+	class Replay
+	{
+	public:
+		// Returns false if the data isn't a recording.
+		bool load(const std::string& data);
+
+		// Starts over from an empty scene.
+		void reset();
+
+		// Runs the commands up to the end of the next frame. Returns false
+		// once the recording has ended.
+		bool play_frame();
+
+		std::size_t get_num_frames() const;
+
+		// Number of nodes (and lights) returned by the walks and a sum of the
+		// interpolated key frames since the last reset, so the work can't
+		// be skipped and two replays can be compared.
+		std::size_t get_num_walked_nodes() const;
+		float get_checksum() const;
+
+	private:
+		bool read_byte(std::uint8_t& value);
+		bool read_int(std::uint32_t& value);
+		bool read_floats(float* values, std::size_t count);
+
+		std::shared_ptr<SceneNode> get_node(std::uint32_t id) const;
+
+		bool play_command(std::uint8_t command);
+		bool play_walk(std::uint8_t command);
+		bool play_interpolate();
+
+		std::string data;
+		std::size_t offset = 0;
+		std::size_t start = 0;
+		std::size_t num_frames = 0;
+
+		std::vector<std::shared_ptr<SceneNode>> nodes;
+		Camera camera;
+		LightClusters lights;
+
+		std::size_t num_walked_nodes = 0;
+		float checksum = 0.0f;
+	};
+}
+
+#endif
@@ -0,0 +1,307 @@
+////////////////////////////////////////////////////////////////////////////////
+// nbunny/resource.hpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NBUNNY_RESOURCE_HPP
+#define NBUNNY_RESOURCE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace nbunny
+{
+	class BakeCache;
+	class BakeFile;
+
+	// A value from a resource file. Strings and tables are indices into the
+	// ResourceDocument the value came from.
+	struct ResourceValue
+	{
+		enum Type : std::uint8_t
+		{
+			TYPE_NIL = 0,
+			TYPE_BOOLEAN,
+			TYPE_NUMBER,
+			TYPE_STRING,
+			TYPE_TABLE
+		};
+
+		Type type = TYPE_NIL;
+		std::uint32_t index = 0;
+		double number = 0.0;
+
+		bool is_nil() const { return type == TYPE_NIL; }
+		bool is_number() const { return type == TYPE_NUMBER; }
+		bool is_string() const { return type == TYPE_STRING; }
+		bool is_table() const { return type == TYPE_TABLE; }
+
+		// Only false and nil are false, like Lua.
+		bool is_truthy() const { return type != TYPE_NIL && (type != TYPE_BOOLEAN || number != 0.0); }
+	};
+
+	// A Lua table constructor, like the ones in .lmodel, .lmesh, .lskel, and
+	// .lanim files, parsed without Lua. Only literals are allowed: tables,
+	// strings, numbers, booleans, and nil.
+	class ResourceDocument
+	{
+	public:
+		typedef std::pair<ResourceValue, ResourceValue> Field;
+
+		template <typename T>
+		struct Span
+		{
+			const T* values;
+			std::size_t count;
+
+			std::size_t size() const { return count; }
+			bool empty() const { return count == 0; }
+			const T* begin() const { return values; }
+			const T* end() const { return values + count; }
+			const T& operator [](std::size_t index) const { return values[index]; }
+		};
+
+		// Returns false and sets error if the text isn't a single literal.
+		bool parse(const std::string& text, std::string& error);
+		void clear();
+
+		const ResourceValue& get_root() const;
+
+		const std::string& get_string(const ResourceValue& value) const;
+
+		// The positional values and the keyed values of a table. Empty if
+		// value isn't a table.
+		Span<ResourceValue> get_array(const ResourceValue& value) const;
+		Span<Field> get_fields(const ResourceValue& value) const;
+
+		// Returns nil if value isn't a table or has no such field.
+		ResourceValue get_field(const ResourceValue& value, const char* name) const;
+
+	private:
+		class Parser;
+
+		// Tables are stored as ranges of values and fields, so parsing
+		// doesn't allocate for each table.
+		struct Table
+		{
+			std::uint32_t array_offset, array_count;
+			std::uint32_t fields_offset, fields_count;
+		};
+
+		ResourceValue root;
+		std::vector<std::string> strings;
+		std::vector<Table> tables;
+		std::vector<ResourceValue> values;
+		std::vector<Field> fields;
+	};
+
+	// A vertex attribute, as in a love.graphics.newMesh vertex format.
+	struct ResourceAttribute
+	{
+		std::string name;
+		std::string type;
+		int count;
+	};
+
+	// Vertices (and maybe indices) ready to be copied into a love Mesh.
+	struct ResourceMesh
+	{
+		std::string name;
+
+		// vertex_count * stride floats, in the order of the format. Bone
+		// indices are 1-based indices into the bone names of the result (0 if
+		// none), not bone indices.
+		std::vector<float> vertices;
+		std::size_t vertex_count = 0;
+
+		// 0-based.
+		std::vector<std::uint32_t> indices;
+
+		float min[3], max[3];
+	};
+
+	// Node of a MPSCQueue.
+	struct MPSCNode
+	{
+		std::atomic<MPSCNode*> next;
+	};
+
+	// Lock-free queue with many producers and one consumer. Intrusive, so
+	// pushing never allocates.
+	//
+	// See Dmitry Vyukov, "Intrusive MPSC node-based queue".
+	class MPSCQueue
+	{
+	public:
+		MPSCQueue();
+
+		void push(MPSCNode* node);
+
+		// Only safe from the consumer. May return nullptr while a push is
+		// halfway done.
+		MPSCNode* pop();
+
+	private:
+		std::atomic<MPSCNode*> head;
+		MPSCNode* tail;
+		MPSCNode stub;
+	};
+
+	// Reads and decodes resource files on a pool of threads. See
+	// ItsyScape/Graphics/ResourceLoader.lua.
+	//
+	// Requests are taken by lowest priority first, then in the order they
+	// were made. Finished requests are polled from the thread that made them.
+	class ResourceLoader
+	{
+	public:
+		enum Kind
+		{
+			// The bytes of the file.
+			KIND_FILE = 0,
+
+			// A ResourceDocument.
+			KIND_LUA,
+
+			// A ResourceDocument, turned into ResourceMeshes if possible.
+			// Models have one mesh; static meshes have one per group.
+			KIND_MODEL,
+			KIND_STATIC_MESH
+		};
+
+		enum Status
+		{
+			STATUS_PENDING = 0,
+			STATUS_DONE,
+			STATUS_FAILED
+		};
+
+		struct Result
+		{
+			Kind kind = KIND_FILE;
+			Status status = STATUS_PENDING;
+			std::string error;
+
+			// Kept after decoding only if decoding failed.
+			std::string data;
+			ResourceDocument document;
+
+			// Set if the model or static mesh could be decoded; use document
+			// otherwise.
+			bool is_decoded = false;
+			std::vector<ResourceAttribute> format;
+			std::vector<ResourceMesh> meshes;
+			std::vector<std::string> bones;
+
+			// Set instead of meshes if the result came from the bake cache.
+			// The meshes point into the mapped file, so they're only copied
+			// once, when they're taken.
+			std::shared_ptr<const BakeFile> baked;
+		};
+
+		// If num_threads is zero, uses one less than the hardware
+		// concurrency.
+		explicit ResourceLoader(std::size_t num_threads = 0);
+		~ResourceLoader();
+
+		std::size_t get_num_threads() const;
+
+		// Models and static meshes are looked up in the cache (by a hash of
+		// the file) before being decoded, and saved to the cache after. Pass
+		// nullptr to stop.
+		void set_bake_cache(const std::shared_ptr<const BakeCache>& value);
+
+		// Reads the file at filename (a real path, not a love.filesystem
+		// one). Returns the ID of the request, which is never 0.
+		std::uint32_t submit(Kind kind, const std::string& filename, float priority);
+
+		// Like submit, but decodes data instead of reading a file.
+		std::uint32_t submit_data(Kind kind, const std::string& data, float priority);
+
+		// Does nothing if the request was already taken.
+		void set_priority(std::uint32_t id, float priority);
+
+		// Returns the ID of a finished request, or 0 if none.
+		std::uint32_t poll();
+
+		// Only valid for requests returned by poll, until they are
+		// released. Requests that haven't been polled yet might still be in
+		// use by a worker, so they're ignored.
+		const Result* get_result(std::uint32_t id) const;
+		void release(std::uint32_t id);
+
+		// Requests that have not been polled yet.
+		std::size_t get_num_pending() const;
+
+		// Decodes on the calling thread. Used by the workers.
+		static void decode(Kind kind, Result& result);
+
+	private:
+		struct Request : public MPSCNode
+		{
+			std::uint32_t id;
+			std::string filename;
+			bool is_file;
+			float priority;
+
+			// Set by poll. The worker is done with the request after it's
+			// pushed to finished, so only then is result safe to read.
+			bool is_polled = false;
+
+			Result result;
+		};
+
+		// Changing the priority of a request pushes another entry; the old
+		// one is skipped when it comes up.
+		struct Entry
+		{
+			float priority;
+			std::uint64_t order;
+			std::uint32_t id;
+
+			bool operator <(const Entry& other) const;
+		};
+
+		std::uint32_t push(Request* request);
+		void work();
+
+		// Returns false if nothing was baked from the request.
+		bool load_baked(const BakeCache& bake_cache, std::uint64_t key, Result& result);
+
+		std::vector<std::thread> threads;
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool stopping = false;
+
+		// Protected by mutex.
+		std::vector<Entry> queue;
+		std::unordered_map<std::uint32_t, Request*> queued;
+		std::uint64_t current_order = 0;
+		std::shared_ptr<const BakeCache> bake_cache;
+
+		// Only touched by the thread that made the requests.
+		std::unordered_map<std::uint32_t, std::unique_ptr<Request>> requests;
+		std::uint32_t current_id = 0;
+		std::size_t num_pending = 0;
+
+		MPSCQueue finished;
+	};
+}
+
+#endif
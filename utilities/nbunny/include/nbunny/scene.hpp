@@ -22,6 +22,7 @@
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/quaternion.hpp>
+#include "nbunny/arena.hpp"
 
 namespace nbunny
 {
@@ -54,11 +55,38 @@ namespace nbunny
 		int shader = 0;
 		std::vector<int> textures;
 
+		// Translucent or full lit; drawn after the opaque nodes.
+		bool is_translucent = false;
+
 		bool operator <(const SceneNodeMaterial& other) const;
 	};
 
 	struct Camera;
 
+	class LightClusters;
+
+	// What a node is, so one walk can sort nodes into passes. See
+	// SceneNode::walk_by_kind.
+	enum SceneNodeKind
+	{
+		SCENE_NODE_KIND_GEOMETRY = 0,
+
+		// Always drawn with the translucent nodes.
+		SCENE_NODE_KIND_PARTICLES,
+
+		// Any other light.
+		SCENE_NODE_KIND_LIGHT,
+
+		SCENE_NODE_KIND_AMBIENT_LIGHT,
+		SCENE_NODE_KIND_DIRECTIONAL_LIGHT,
+
+		// Lights everything within light_radius.
+		SCENE_NODE_KIND_POINT_LIGHT,
+
+		// light_radius is the far distance.
+		SCENE_NODE_KIND_FOG
+	};
+
 	struct SceneNode
 	{
 		std::weak_ptr<SceneNode> parent;
@@ -72,8 +100,30 @@ namespace nbunny
 
 		int reference;
 
-		static void walk_by_material(const std::shared_ptr<SceneNode>& node, const Camera& camera, float delta, std::vector<std::shared_ptr<SceneNode>>& result);
-		static void walk_by_position(const std::shared_ptr<SceneNode>& node, const Camera& camera, float delta, std::vector<std::shared_ptr<SceneNode>>& result);
+		SceneNodeKind kind = SCENE_NODE_KIND_GEOMETRY;
+		bool is_global_light = false;
+		float light_radius = 0.0f;
+
+		bool is_light() const;
+
+		// Moves node under parent, or detaches it if parent is null.
+		static void set_parent(const std::shared_ptr<SceneNode>& node, const std::shared_ptr<SceneNode>& parent);
+
+		// The results are allocated from the FrameArena.
+		static void walk_by_material(const std::shared_ptr<SceneNode>& node, const Camera& camera, float delta, FrameVector<std::shared_ptr<SceneNode>>& result);
+		static void walk_by_position(const std::shared_ptr<SceneNode>& node, const Camera& camera, float delta, FrameVector<std::shared_ptr<SceneNode>>& result);
+
+		// Sorts everything under node in one walk: visible opaque geometry
+		// (sorted like walk_by_material), visible translucent geometry and
+		// particles (sorted back to front), and lights, which are given to
+		// lights (see LightClusters).
+		static void walk_by_kind(
+			const std::shared_ptr<SceneNode>& node,
+			const Camera& camera,
+			float delta,
+			FrameVector<std::shared_ptr<SceneNode>>& opaque,
+			FrameVector<std::shared_ptr<SceneNode>>& translucent,
+			LightClusters& lights);
 	};
 
 	struct Camera
@@ -0,0 +1,136 @@
+////////////////////////////////////////////////////////////////////////////////
+// nbunny/scheduler.hpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NBUNNY_SCHEDULER_HPP
+#define NBUNNY_SCHEDULER_HPP
+
+#include <atomic>
+#include <bitset>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nbunny
+{
+	// Native work that a Cortex hands off to the KernelScheduler.
+	//
+	// The work is split into chunks. Different chunks of the same kernel may
+	// run at the same time on different threads, so a chunk must only touch
+	// its own slice of the kernel's data.
+	struct Kernel
+	{
+	public:
+		virtual ~Kernel() = default;
+
+		virtual std::size_t get_num_chunks() const = 0;
+		virtual void run_chunk(std::size_t chunk) = 0;
+	};
+
+	// A fixed set of threads with a task deque each. Threads pop from the
+	// back of their own deque and steal from the front of the others.
+	class WorkStealingPool
+	{
+	public:
+		typedef std::function<void()> Task;
+
+		// num_threads is the number of worker threads; the thread calling
+		// run also executes tasks.
+		explicit WorkStealingPool(std::size_t num_threads);
+		~WorkStealingPool();
+
+		// The pool shared by every KernelScheduler, with one less thread
+		// than the hardware concurrency.
+		static WorkStealingPool& get_instance();
+
+		std::size_t get_num_threads() const;
+
+		// Runs every task and returns once they've all finished. Calls from
+		// different threads take turns.
+		void run(std::vector<Task>& tasks);
+
+	private:
+		struct Queue
+		{
+			std::mutex mutex;
+			std::deque<Task*> tasks;
+		};
+
+		bool pop(std::size_t index, Task*& result);
+		void execute(std::size_t index);
+		void work(std::size_t index);
+
+		std::vector<std::unique_ptr<Queue>> queues;
+		std::vector<std::thread> threads;
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::size_t generation = 0;
+		bool stopping = false;
+
+		std::mutex run_mutex;
+
+		// Signalled when pending reaches zero.
+		std::mutex done_mutex;
+		std::condition_variable done_condition;
+		std::atomic<std::size_t> pending;
+	};
+
+	// Runs kernels for a tick.
+	//
+	// Each kernel declares the components (e.g., Behavior IDs) it reads and
+	// writes. Kernels are run in waves: a kernel goes into the wave after the
+	// last earlier kernel it conflicts with (one writes what the other reads
+	// or writes). Kernels in the same wave run concurrently, and there's a
+	// barrier between waves.
+	struct KernelScheduler
+	{
+	public:
+		static const std::size_t MAX_COMPONENTS = 256;
+		typedef std::bitset<MAX_COMPONENTS> Components;
+
+		// If num_threads is zero, uses the shared pool (see
+		// WorkStealingPool::get_instance). Otherwise, makes a pool of its
+		// own.
+		explicit KernelScheduler(std::size_t num_threads = 0);
+
+		std::size_t get_num_threads() const;
+
+		// The kernel must outlive the next call to run.
+		void add(Kernel& kernel, const Components& reads, const Components& writes);
+
+		// Runs every kernel added since the last call, then forgets them.
+		void run();
+
+		std::size_t get_num_waves() const;
+
+	private:
+		struct Entry
+		{
+			Kernel* kernel;
+			Components reads;
+			Components writes;
+			std::size_t wave;
+		};
+
+		std::vector<Entry> entries;
+		std::size_t num_waves = 0;
+
+		std::unique_ptr<WorkStealingPool> own_pool;
+		WorkStealingPool* pool;
+	};
+}
+
+#endif
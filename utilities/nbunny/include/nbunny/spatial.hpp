@@ -0,0 +1,81 @@
+////////////////////////////////////////////////////////////////////////////////
+// nbunny/spatial.hpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NBUNNY_SPATIAL_HPP
+#define NBUNNY_SPATIAL_HPP
+
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+namespace nbunny
+{
+	// A uniform grid of tile buckets, one grid per layer.
+	//
+	// Handles are opaque integers (e.g., Peep tallies). Each handle remembers
+	// the bucket it lives in, so moving a handle within the same tile is free
+	// and moving it to another tile is O(1).
+	struct SpatialIndex
+	{
+	public:
+		// Tile coordinates are clamped to this range.
+		static const int MAX_COORDINATE = (1 << 15) - 1;
+		static const int MIN_COORDINATE = -(1 << 15);
+
+		// Adds handle to the tile (i, j) on layer, moving it if it was
+		// already in the index.
+		void update(int handle, int layer, int i, int j);
+
+		// Removes handle from the index. Does nothing if handle isn't in the
+		// index.
+		void remove(int handle);
+
+		bool has(int handle) const;
+		std::size_t count() const;
+		void clear();
+
+		// Collects the handles in tiles within the rectangle (i1, j1) -
+		// (i2, j2), inclusive, on layer. If layer is negative, every layer is
+		// searched.
+		void query(int layer, int i1, int j1, int i2, int j2, std::vector<int>& result) const;
+
+		// Like query, but only collects handles within distance tiles of
+		// (i, j) (Manhattan distance).
+		void query_near(int layer, int i, int j, int distance, std::vector<int>& result) const;
+
+	private:
+		struct Entry
+		{
+			int layer;
+			int i, j;
+			std::size_t slot;
+		};
+
+		static std::uint64_t get_key(int layer, int i, int j);
+		static int clamp_coordinate(long long value);
+
+		void insert(int handle, Entry& entry);
+		void erase(const Entry& entry);
+
+		template <typename F>
+		void visit(int layer, int i1, int j1, int i2, int j2, F&& f) const;
+
+		std::unordered_map<std::uint64_t, std::vector<int>> buckets;
+		std::unordered_map<int, Entry> entries;
+
+		// Number of handles per layer; used when searching every layer.
+		std::map<int, std::size_t> layers;
+	};
+}
+
+#endif
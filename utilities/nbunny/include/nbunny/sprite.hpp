@@ -0,0 +1,67 @@
+////////////////////////////////////////////////////////////////////////////////
+// nbunny/sprite.hpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NBUNNY_SPRITE_HPP
+#define NBUNNY_SPRITE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "nbunny/scene.hpp"
+
+namespace nbunny
+{
+	// Projects sprites (damage splats, health bars, and so on) attached to
+	// scene nodes onto the screen and sorts them furthest first. See
+	// ItsyScape/Graphics/SpriteManager.lua.
+	//
+	// A sprite is at the origin of its node plus an offset in world space.
+	// Sprites on the same node share one global transform, so a node with a
+	// health bar and a few damage splats only has its transform computed
+	// once.
+	//
+	// The buffers are kept between frames, so once they're big enough
+	// projecting doesn't touch the heap.
+	class SpriteProjector
+	{
+	public:
+		// The index of the sprite (in the order it was added, from 0), the
+		// screen position (x, y) with the origin at the top left, and the
+		// depth (0 at the near plane, 1 at the far plane).
+		static const int FLOATS_PER_SPRITE = 4;
+
+		void clear();
+		void add(const std::shared_ptr<SceneNode>& node, const glm::vec3& offset);
+		std::size_t get_count() const;
+
+		// Like love.graphics.project, with a viewport of width by height.
+		void project(const Camera& camera, float delta, int width, int height);
+
+		// get_count() * FLOATS_PER_SPRITE floats, furthest sprite first. Only
+		// valid until the next call to project.
+		const float* get_result() const;
+
+	private:
+		struct Sprite
+		{
+			std::shared_ptr<SceneNodeTransform> transform;
+			glm::vec3 offset;
+		};
+
+		std::vector<Sprite> sprites;
+		std::vector<glm::vec3> positions;
+		std::vector<std::uint32_t> order;
+		std::vector<float> result;
+	};
+}
+
+#endif
@@ -0,0 +1,119 @@
+////////////////////////////////////////////////////////////////////////////////
+// nbunny/water.hpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NBUNNY_WATER_HPP
+#define NBUNNY_WATER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace nbunny
+{
+	// A flat grid of width by height quads, from (0, 0) to (width, height)
+	// on the XZ plane, for water. See ItsyScape/World/WaterMesh.lua.
+	//
+	// The grid is split into blocks of BLOCK_SIZE by BLOCK_SIZE quads. Each
+	// block has its own slot of VERTICES_PER_BLOCK vertices, shared by the
+	// triangles in the block, so changing a block only rewrites its slot.
+	//
+	// With LOD enabled, blocks further than the LOD distance from the focus
+	// (usually the camera) use quads twice as big, and so on, up to one quad
+	// per block. Where a block meets a coarser one, the triangles along the
+	// edge are stitched to the coarser block's vertices, so the waves in
+	// the shader don't open up cracks.
+	class WaterMesh
+	{
+	public:
+		static const int BLOCK_SIZE = 16;
+		static const int VERTICES_PER_BLOCK = (BLOCK_SIZE + 1) * (BLOCK_SIZE + 1);
+
+		// A position, a normal, and a texture coordinate (see
+		// WaterMesh.FORMAT).
+		static const int FLOATS_PER_VERTEX = 8;
+
+		int get_width() const;
+		int get_height() const;
+
+		// Only the blocks along the edges that moved are rebuilt, unless
+		// the number of blocks changes.
+		void resize(int width, int height);
+
+		// Texture coordinates are the position divided by the scale.
+		float get_scale() const;
+		void set_scale(float value);
+
+		// Distance is in quads.
+		void enable_lod(float distance);
+		void disable_lod();
+		bool get_is_lod_enabled() const;
+
+		void set_focus(float x, float z);
+
+		// Rebuilds the blocks that changed. Returns true if the vertices or
+		// indices changed.
+		bool update();
+
+		// Every slot, used or not. Changes when the number of blocks does.
+		std::size_t get_vertex_count() const;
+		const float* get_vertices() const;
+
+		// The vertices written by the last update, as a range of slots.
+		std::size_t get_dirty_vertex_start() const;
+		std::size_t get_dirty_vertex_count() const;
+
+		// Triangles, into get_vertices().
+		std::size_t get_index_count() const;
+		const std::uint32_t* get_indices() const;
+
+	private:
+		struct Block
+		{
+			int width = 0, height = 0;
+			int step = 1;
+			bool is_dirty = true;
+
+			// Indices change with the step of the block and its neighbors.
+			std::vector<std::uint32_t> indices;
+			bool is_indices_dirty = true;
+		};
+
+		int get_lod_step(int block_i, int block_j) const;
+		int get_step(int block_i, int block_j, int step) const;
+
+		void invalidate_indices(int block_i, int block_j);
+		void build_vertices(int block_i, int block_j);
+		void build_indices(int block_i, int block_j);
+
+		int width = 0;
+		int height = 0;
+		int blocks_width = 0;
+		int blocks_height = 0;
+		float scale = 3.0f;
+
+		bool is_lod_enabled = false;
+		float lod_distance = 0.0f;
+		glm::vec2 focus = glm::vec2(0.0f);
+
+		std::vector<Block> blocks;
+		bool is_dirty = true;
+
+		std::vector<float> vertices;
+		std::size_t dirty_vertex_start = 0;
+		std::size_t dirty_vertex_count = 0;
+
+		std::vector<std::uint32_t> indices;
+	};
+}
+
+#endif
@@ -0,0 +1,206 @@
+////////////////////////////////////////////////////////////////////////////////
+// nbunny/weather.hpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NBUNNY_WEATHER_HPP
+#define NBUNNY_WEATHER_HPP
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace nbunny
+{
+	// The height of each tile under a weather effect, row by row. See
+	// ItsyScape/World/WeatherMap.lua.
+	//
+	// Tiles are 1-based, like in Lua, and start at (i, j).
+	//
+	// The heights come from maps (e.g., the ground and any ships), each with
+	// its own tile heights and transform. Each map is rasterized into the
+	// tiles it covers once it's transformed; where maps overlap, the highest
+	// wins. Only the tiles a changed map covered before and after the change
+	// are rasterized again on update.
+	class WeatherMap
+	{
+	public:
+		int get_i() const;
+		int get_j() const;
+		void set_position(int i, int j);
+
+		float get_cell_size() const;
+		void set_cell_size(float value);
+
+		int get_width() const;
+		int get_height() const;
+
+		// Every map is rasterized again on the next update.
+		void resize(int width, int height);
+
+		// Adds the map with the ID or, if it exists, resizes it. Heights
+		// start at negative infinity (nothing there) and the transform is
+		// the identity.
+		void set_map(int id, int width, int height, float cell_size);
+		void remove_map(int id);
+		bool has_map(int id) const;
+
+		// Width * height floats, row by row, for the height at the center
+		// of each tile in map space, or positive infinity for a tile that
+		// stops weather outright (e.g., a building). Changes when the map is
+		// resized. Call invalidate_map after changing them.
+		float* get_map_heights(int id);
+		void invalidate_map(int id);
+
+		void set_map_transform(int id, const glm::mat4& transform);
+
+		// Rasterizes the maps into the tiles that changed.
+		void update();
+
+		// Returns positive infinity outside the map.
+		//
+		// Like the Lua version, only the index into the grid is checked, so
+		// a tile past the end of a row is the start of the next row.
+		float get_height_at(int i, int j) const;
+
+		// Width * height floats. Changes when the map is resized.
+		float* get_heights();
+
+	private:
+		// Inclusive bounds of tiles, as indices into the grid.
+		struct Area
+		{
+			int min_i = 0, min_j = 0;
+			int max_i = -1, max_j = -1;
+
+			bool is_empty() const;
+			Area merge(const Area& other) const;
+			Area intersect(const Area& other) const;
+		};
+
+		struct Map
+		{
+			int id;
+			int width, height;
+			float cell_size;
+			std::vector<float> heights;
+			glm::mat4 transform = glm::mat4(1.0f);
+			glm::mat4 inverse_transform = glm::mat4(1.0f);
+			Area area;
+		};
+
+		Map* find_map(int id);
+		const Map* find_map(int id) const;
+
+		Area get_area(const Map& map) const;
+		void invalidate(const Area& area);
+		void rasterize(const Map& map, const Area& area);
+
+		int i = 1;
+		int j = 1;
+		int width = 0;
+		int height = 0;
+		float cell_size = 2.0f;
+		std::vector<float> heights;
+
+		std::vector<Map> maps;
+		std::vector<Area> dirty_areas;
+		bool is_dirty = true;
+	};
+
+	// A xorshift generator. Weather only needs a lot of numbers quickly,
+	// not good ones.
+	class WeatherRandom
+	{
+	public:
+		WeatherRandom(std::uint32_t seed = 0x9e3779b9);
+
+		// [0, 1)
+		float next();
+
+		// [min, max]
+		int next(int min, int max);
+
+	private:
+		std::uint32_t state;
+	};
+
+	// Falling streaks of rain that stop at the ground and shrink away. Each
+	// streak is two crossed quads, so VERTICES_PER_PARTICLE vertices of
+	// FLOATS_PER_VERTEX floats (a position). See RainWeather.lua.
+	class RainWeather
+	{
+	public:
+		static const int VERTICES_PER_PARTICLE = 12;
+		static const int FLOATS_PER_VERTEX = 3;
+
+		// Clears the particles; they're all respawned on the next update.
+		void resize(std::size_t count);
+		std::size_t get_count() const;
+
+		glm::vec3 gravity = glm::vec3(0.0f, -20.0f, 0.0f);
+		glm::vec3 wind = glm::vec3(0.0f);
+		float min_height = 30.0f, max_height = 50.0f;
+		float min_length = 2.0f, max_length = 4.0f;
+		float size = 1.0f / 32.0f;
+
+		// Moves the particles and writes the vertices (get_count() *
+		// VERTICES_PER_PARTICLE * FLOATS_PER_VERTEX floats) to result.
+		//
+		// Particles respawn over the tiles from the map's (i, j) to (i +
+		// width, j + height), inclusive.
+		void update(const WeatherMap& map, int width, int height, float delta, float* result);
+
+	private:
+		WeatherRandom random;
+
+		std::vector<float> x, y, z;
+		std::vector<float> length;
+		std::vector<std::uint8_t> moving;
+	};
+
+	// Spores that float up or down, sway, and fade away once they stop. Like
+	// RainWeather, but each vertex is a position, a texture coordinate, and
+	// a color. See FungalWeather.lua.
+	class FungalWeather
+	{
+	public:
+		static const int VERTICES_PER_PARTICLE = 12;
+		static const int FLOATS_PER_VERTEX = 9;
+
+		void resize(std::size_t count);
+		std::size_t get_count() const;
+
+		glm::vec3 gravity = glm::vec3(0.0f, -20.0f, 0.0f);
+		glm::vec3 wind = glm::vec3(0.0f);
+		float min_height = 10.0f, max_height = 30.0f;
+		float min_size = 2.0f, max_size = 4.0f;
+
+		// How far above the ground spores that float up stop.
+		float ceiling = 0.0f;
+
+		// Spores are given a random color from here (or white, if empty).
+		std::vector<glm::vec4> colors = { glm::vec4(1.0f) };
+
+		void update(const WeatherMap& map, int width, int height, float delta, float* result);
+
+	private:
+		WeatherRandom random;
+
+		std::vector<float> x, y, z;
+		std::vector<float> size;
+		std::vector<float> age;
+		std::vector<float> alpha;
+		std::vector<std::uint32_t> color;
+		std::vector<std::uint8_t> moving;
+	};
+}
+
+#endif
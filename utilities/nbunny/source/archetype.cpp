@@ -0,0 +1,371 @@
+////////////////////////////////////////////////////////////////////////////////
+// source/archetype.cpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "nbunny/nbunny.hpp"
+#include "nbunny/archetype.hpp"
+
+nbunny::ArchetypeIndex::ArchetypeIndex()
+{
+	// Handles without any components live in the first archetype.
+	get_archetype(Mask());
+}
+
+std::size_t nbunny::ArchetypeIndex::get_archetype(const Mask& mask)
+{
+	auto existing = archetypes_by_mask.find(mask);
+	if (existing != archetypes_by_mask.end())
+	{
+		return existing->second;
+	}
+
+	std::size_t index = archetypes.size();
+	archetypes.emplace_back();
+	archetypes.back().mask = mask;
+	archetypes_by_mask.emplace(mask, index);
+
+	for (auto& query: queries)
+	{
+		if ((mask & query.mask) == query.mask)
+		{
+			query.archetypes.push_back(index);
+		}
+	}
+
+	return index;
+}
+
+void nbunny::ArchetypeIndex::erase(const Location& location)
+{
+	// Swap with the last handle in the archetype so removal is O(1).
+	auto& handles = archetypes[location.archetype].handles;
+	int last = handles.back();
+	handles[location.slot] = last;
+	handles.pop_back();
+
+	if (location.slot < handles.size())
+	{
+		locations[last].slot = location.slot;
+	}
+}
+
+void nbunny::ArchetypeIndex::move(int handle, const Mask& mask)
+{
+	auto archetype = get_archetype(mask);
+
+	auto existing = locations.find(handle);
+	if (existing != locations.end())
+	{
+		if (existing->second.archetype == archetype)
+		{
+			return;
+		}
+
+		erase(existing->second);
+	}
+
+	auto& handles = archetypes[archetype].handles;
+	auto& location = locations[handle];
+	location.archetype = archetype;
+	location.slot = handles.size();
+	handles.push_back(handle);
+}
+
+void nbunny::ArchetypeIndex::add_component(int handle, std::size_t component)
+{
+	Mask mask;
+
+	auto existing = locations.find(handle);
+	if (existing != locations.end())
+	{
+		mask = archetypes[existing->second.archetype].mask;
+	}
+
+	mask.set(component);
+	move(handle, mask);
+}
+
+void nbunny::ArchetypeIndex::remove_component(int handle, std::size_t component)
+{
+	Mask mask;
+
+	auto existing = locations.find(handle);
+	if (existing != locations.end())
+	{
+		mask = archetypes[existing->second.archetype].mask;
+	}
+
+	mask.reset(component);
+	move(handle, mask);
+}
+
+void nbunny::ArchetypeIndex::set_components(int handle, const Mask& mask)
+{
+	move(handle, mask);
+}
+
+void nbunny::ArchetypeIndex::remove(int handle)
+{
+	auto existing = locations.find(handle);
+	if (existing != locations.end())
+	{
+		erase(existing->second);
+		locations.erase(existing);
+	}
+}
+
+bool nbunny::ArchetypeIndex::has(int handle) const
+{
+	return locations.find(handle) != locations.end();
+}
+
+bool nbunny::ArchetypeIndex::has_component(int handle, std::size_t component) const
+{
+	auto existing = locations.find(handle);
+	if (existing == locations.end())
+	{
+		return false;
+	}
+
+	return archetypes[existing->second.archetype].mask.test(component);
+}
+
+int nbunny::ArchetypeIndex::add_query(const Mask& mask)
+{
+	for (std::size_t i = 0; i < queries.size(); ++i)
+	{
+		if (queries[i].mask == mask)
+		{
+			return (int)i;
+		}
+	}
+
+	Query query;
+	query.mask = mask;
+	for (std::size_t i = 0; i < archetypes.size(); ++i)
+	{
+		if ((archetypes[i].mask & mask) == mask)
+		{
+			query.archetypes.push_back(i);
+		}
+	}
+
+	queries.push_back(query);
+	return (int)queries.size() - 1;
+}
+
+bool nbunny::ArchetypeIndex::match(int handle, int query) const
+{
+	auto existing = locations.find(handle);
+	if (existing == locations.end())
+	{
+		return false;
+	}
+
+	auto& mask = queries.at(query).mask;
+	return (archetypes[existing->second.archetype].mask & mask) == mask;
+}
+
+void nbunny::ArchetypeIndex::get_query_handles(int query, std::vector<int>& result) const
+{
+	for (auto archetype: queries.at(query).archetypes)
+	{
+		auto& handles = archetypes[archetype].handles;
+		result.insert(result.end(), handles.begin(), handles.end());
+	}
+}
+
+bool nbunny::ArchetypeIndex::has_query(int query) const
+{
+	return query >= 0 && query < (int)queries.size();
+}
+
+std::size_t nbunny::ArchetypeIndex::get_query_count(int query) const
+{
+	std::size_t result = 0;
+	for (auto archetype: queries.at(query).archetypes)
+	{
+		result += archetypes[archetype].handles.size();
+	}
+
+	return result;
+}
+
+std::size_t nbunny::ArchetypeIndex::get_archetype_count() const
+{
+	return archetypes.size();
+}
+
+#ifndef NBUNNY_NO_LUA
+
+static std::size_t get_component(lua_State* L, int index)
+{
+	auto component = luaL_checkinteger(L, index);
+	if (component < 0 || component >= (lua_Integer)nbunny::ArchetypeIndex::MAX_COMPONENTS)
+	{
+		luaL_error(L, "component %d out of range", (int)component);
+	}
+
+	return (std::size_t)component;
+}
+
+static nbunny::ArchetypeIndex::Mask get_mask(lua_State* L, int index)
+{
+	luaL_checktype(L, index, LUA_TTABLE);
+
+	nbunny::ArchetypeIndex::Mask result;
+
+	int count = (int)lua_objlen(L, index);
+	for (int i = 1; i <= count; ++i)
+	{
+		lua_rawgeti(L, index, i);
+		result.set(get_component(L, -1));
+		lua_pop(L, 1);
+	}
+
+	return result;
+}
+
+// Queries are 0-based natively and 1-based in Lua.
+static int get_query(lua_State* L, const nbunny::ArchetypeIndex& self, int index)
+{
+	int query = (int)luaL_checkinteger(L, index) - 1;
+	if (!self.has_query(query))
+	{
+		luaL_error(L, "query %d does not exist", query + 1);
+	}
+
+	return query;
+}
+
+static int nbunny_archetype_index_add_component(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ArchetypeIndex>(L, 1);
+	self.add_component((int)luaL_checkinteger(L, 2), get_component(L, 3));
+	return 0;
+}
+
+static int nbunny_archetype_index_remove_component(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ArchetypeIndex>(L, 1);
+	self.remove_component((int)luaL_checkinteger(L, 2), get_component(L, 3));
+	return 0;
+}
+
+static int nbunny_archetype_index_set_components(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ArchetypeIndex>(L, 1);
+	self.set_components((int)luaL_checkinteger(L, 2), get_mask(L, 3));
+	return 0;
+}
+
+static int nbunny_archetype_index_remove(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ArchetypeIndex>(L, 1);
+	self.remove((int)luaL_checkinteger(L, 2));
+	return 0;
+}
+
+static int nbunny_archetype_index_has(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ArchetypeIndex>(L, 1);
+	lua_pushboolean(L, self.has((int)luaL_checkinteger(L, 2)));
+	return 1;
+}
+
+static int nbunny_archetype_index_has_component(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ArchetypeIndex>(L, 1);
+	lua_pushboolean(L, self.has_component((int)luaL_checkinteger(L, 2), get_component(L, 3)));
+	return 1;
+}
+
+static int nbunny_archetype_index_add_query(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ArchetypeIndex>(L, 1);
+	lua_pushinteger(L, self.add_query(get_mask(L, 2)) + 1);
+	return 1;
+}
+
+static int nbunny_archetype_index_match(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ArchetypeIndex>(L, 1);
+	int handle = (int)luaL_checkinteger(L, 2);
+	int query = get_query(L, self, 3);
+	lua_pushboolean(L, self.match(handle, query));
+	return 1;
+}
+
+// Fills the table at argument 3 (or a new table) with the handles matching
+// the query. Returns the table and the number of handles; the table isn't
+// cleared past the count, so it can be reused every update.
+static int nbunny_archetype_index_get_query_handles(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ArchetypeIndex>(L, 1);
+	int query = get_query(L, self, 2);
+
+	std::vector<int> handles;
+	self.get_query_handles(query, handles);
+
+	if (lua_istable(L, 3))
+	{
+		lua_pushvalue(L, 3);
+	}
+	else
+	{
+		lua_createtable(L, (int)handles.size(), 0);
+	}
+
+	for (std::size_t i = 0; i < handles.size(); ++i)
+	{
+		lua_pushinteger(L, handles[i]);
+		lua_rawseti(L, -2, (int)i + 1);
+	}
+
+	lua_pushinteger(L, (lua_Integer)handles.size());
+	return 2;
+}
+
+static int nbunny_archetype_index_get_query_count(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ArchetypeIndex>(L, 1);
+	lua_pushinteger(L, (lua_Integer)self.get_query_count(get_query(L, self, 2)));
+	return 1;
+}
+
+static int nbunny_archetype_index_get_archetype_count(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ArchetypeIndex>(L, 1);
+	lua_pushinteger(L, (lua_Integer)self.get_archetype_count());
+	return 1;
+}
+
+extern "C"
+NBUNNY_EXPORT int luaopen_nbunny_archetypeindex(lua_State* L)
+{
+	sol::usertype<nbunny::ArchetypeIndex> T(
+		sol::call_constructor, sol::constructors<nbunny::ArchetypeIndex()>(),
+		"addComponent", &nbunny_archetype_index_add_component,
+		"removeComponent", &nbunny_archetype_index_remove_component,
+		"setComponents", &nbunny_archetype_index_set_components,
+		"remove", &nbunny_archetype_index_remove,
+		"has", &nbunny_archetype_index_has,
+		"hasComponent", &nbunny_archetype_index_has_component,
+		"addQuery", &nbunny_archetype_index_add_query,
+		"match", &nbunny_archetype_index_match,
+		"getQueryHandles", &nbunny_archetype_index_get_query_handles,
+		"getQueryCount", &nbunny_archetype_index_get_query_count,
+		"getArchetypeCount", &nbunny_archetype_index_get_archetype_count);
+
+	sol::stack::push(L, T);
+
+	return 1;
+}
+
+#endif
@@ -0,0 +1,162 @@
+////////////////////////////////////////////////////////////////////////////////
+// source/arena.cpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstdint>
+#include "nbunny/nbunny.hpp"
+#include "nbunny/arena.hpp"
+
+nbunny::FrameArena& nbunny::FrameArena::get_instance()
+{
+	static FrameArena instance;
+	return instance;
+}
+
+void nbunny::FrameArena::add_block(std::size_t size)
+{
+	Block block;
+	block.memory.reset(new char[size]);
+	block.size = size;
+	blocks.push_back(std::move(block));
+
+	++current.num_heap_allocations;
+}
+
+void* nbunny::FrameArena::allocate(std::size_t size, std::size_t alignment)
+{
+	while (current_block < blocks.size())
+	{
+		auto& block = blocks[current_block];
+		auto address = reinterpret_cast<std::uintptr_t>(block.memory.get()) + offset;
+		auto padding = (alignment - address % alignment) % alignment;
+
+		if (offset + padding + size <= block.size)
+		{
+			offset += padding + size;
+
+			++current.num_allocations;
+			current.num_bytes += size;
+
+			return reinterpret_cast<void*>(address + padding);
+		}
+
+		++current_block;
+		offset = 0;
+	}
+
+	// Each block is at least twice as big as the last, so a growing frame
+	// adds few blocks.
+	auto size_with_padding = size + alignment;
+	auto block_size = std::max(MIN_BLOCK_SIZE, size_with_padding);
+	if (!blocks.empty())
+	{
+		block_size = std::max(block_size, blocks.back().size * 2);
+	}
+
+	add_block(block_size);
+	current_block = blocks.size() - 1;
+	offset = 0;
+
+	return allocate(size, alignment);
+}
+
+void nbunny::FrameArena::frame()
+{
+	if (blocks.size() > 1)
+	{
+		std::size_t capacity = get_capacity();
+
+		blocks.clear();
+		add_block(capacity);
+	}
+
+	current_block = 0;
+	offset = 0;
+
+	previous = current;
+	current = Counters();
+}
+
+std::size_t nbunny::FrameArena::get_num_allocations() const
+{
+	return previous.num_allocations;
+}
+
+std::size_t nbunny::FrameArena::get_num_bytes() const
+{
+	return previous.num_bytes;
+}
+
+std::size_t nbunny::FrameArena::get_num_heap_allocations() const
+{
+	return previous.num_heap_allocations;
+}
+
+std::size_t nbunny::FrameArena::get_capacity() const
+{
+	std::size_t result = 0;
+	for (auto& block: blocks)
+	{
+		result += block.size;
+	}
+
+	return result;
+}
+
+#ifndef NBUNNY_NO_LUA
+
+static int nbunny_arena_frame(lua_State* L)
+{
+	nbunny::FrameArena::get_instance().frame();
+	return 0;
+}
+
+static int nbunny_arena_get_num_allocations(lua_State* L)
+{
+	lua_pushinteger(L, (lua_Integer)nbunny::FrameArena::get_instance().get_num_allocations());
+	return 1;
+}
+
+static int nbunny_arena_get_num_bytes(lua_State* L)
+{
+	lua_pushinteger(L, (lua_Integer)nbunny::FrameArena::get_instance().get_num_bytes());
+	return 1;
+}
+
+static int nbunny_arena_get_num_heap_allocations(lua_State* L)
+{
+	lua_pushinteger(L, (lua_Integer)nbunny::FrameArena::get_instance().get_num_heap_allocations());
+	return 1;
+}
+
+static int nbunny_arena_get_capacity(lua_State* L)
+{
+	lua_pushinteger(L, (lua_Integer)nbunny::FrameArena::get_instance().get_capacity());
+	return 1;
+}
+
+// Like nbunny.profiler, these are called on the module itself.
+extern "C"
+NBUNNY_EXPORT int luaopen_nbunny_arena(lua_State* L)
+{
+	sol::usertype<nbunny::FrameArena> T(
+		sol::no_constructor,
+		"frame", &nbunny_arena_frame,
+		"getNumAllocations", &nbunny_arena_get_num_allocations,
+		"getNumBytes", &nbunny_arena_get_num_bytes,
+		"getNumHeapAllocations", &nbunny_arena_get_num_heap_allocations,
+		"getCapacity", &nbunny_arena_get_capacity);
+
+	sol::stack::push(L, T);
+
+	return 1;
+}
+
+#endif
@@ -0,0 +1,1000 @@
+////////////////////////////////////////////////////////////////////////////////
+// source/bake.cpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include "nbunny/nbunny.hpp"
+#include "nbunny/bake.hpp"
+#include "nbunny/profiler.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// XXH64, by Yann Collet. See https://github.com/Cyan4973/xxHash.
+namespace
+{
+	const std::uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+	const std::uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+	const std::uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+	const std::uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+	const std::uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+	std::uint64_t rotate_left(std::uint64_t value, int bits)
+	{
+		return (value << bits) | (value >> (64 - bits));
+	}
+
+	std::uint64_t read_u64(const std::uint8_t* p)
+	{
+		std::uint64_t result;
+		std::memcpy(&result, p, sizeof(result));
+		return result;
+	}
+
+	std::uint32_t read_u32(const std::uint8_t* p)
+	{
+		std::uint32_t result;
+		std::memcpy(&result, p, sizeof(result));
+		return result;
+	}
+
+	std::uint64_t xxh64_round(std::uint64_t accumulator, std::uint64_t input)
+	{
+		accumulator += input * PRIME64_2;
+		accumulator = rotate_left(accumulator, 31);
+		return accumulator * PRIME64_1;
+	}
+
+	std::uint64_t xxh64_merge(std::uint64_t accumulator, std::uint64_t value)
+	{
+		accumulator ^= xxh64_round(0, value);
+		return accumulator * PRIME64_1 + PRIME64_4;
+	}
+
+	std::uint64_t xxh64(const void* input, std::size_t length, std::uint64_t seed)
+	{
+		auto p = static_cast<const std::uint8_t*>(input);
+		auto end = p + length;
+
+		std::uint64_t hash;
+		if (length >= 32)
+		{
+			auto limit = end - 32;
+			std::uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+			std::uint64_t v2 = seed + PRIME64_2;
+			std::uint64_t v3 = seed;
+			std::uint64_t v4 = seed - PRIME64_1;
+
+			do
+			{
+				v1 = xxh64_round(v1, read_u64(p)); p += 8;
+				v2 = xxh64_round(v2, read_u64(p)); p += 8;
+				v3 = xxh64_round(v3, read_u64(p)); p += 8;
+				v4 = xxh64_round(v4, read_u64(p)); p += 8;
+			} while (p <= limit);
+
+			hash = rotate_left(v1, 1) + rotate_left(v2, 7) + rotate_left(v3, 12) + rotate_left(v4, 18);
+			hash = xxh64_merge(hash, v1);
+			hash = xxh64_merge(hash, v2);
+			hash = xxh64_merge(hash, v3);
+			hash = xxh64_merge(hash, v4);
+		}
+		else
+		{
+			hash = seed + PRIME64_5;
+		}
+
+		hash += (std::uint64_t)length;
+
+		while (p + 8 <= end)
+		{
+			hash ^= xxh64_round(0, read_u64(p));
+			hash = rotate_left(hash, 27) * PRIME64_1 + PRIME64_4;
+			p += 8;
+		}
+
+		if (p + 4 <= end)
+		{
+			hash ^= (std::uint64_t)read_u32(p) * PRIME64_1;
+			hash = rotate_left(hash, 23) * PRIME64_2 + PRIME64_3;
+			p += 4;
+		}
+
+		while (p < end)
+		{
+			hash ^= (*p) * PRIME64_5;
+			hash = rotate_left(hash, 11) * PRIME64_1;
+			++p;
+		}
+
+		hash ^= hash >> 33;
+		hash *= PRIME64_2;
+		hash ^= hash >> 29;
+		hash *= PRIME64_3;
+		hash ^= hash >> 32;
+
+		return hash;
+	}
+
+	enum
+	{
+		TAG_DATA = 1,
+		TAG_STRING,
+		TAG_NUMBER
+	};
+
+	// Everything in a baked file is little endian and (where it matters)
+	// aligned, so the file can be used straight from the mapping.
+	//
+	//   Header
+	//   AttributeRecord[num_attributes]
+	//   BoneRecord[num_bones]
+	//   MeshRecord[num_meshes] (aligned to 8 bytes)
+	//   strings
+	//   vertices, then indices, of each mesh (each aligned to 16 bytes)
+	const char MAGIC[4] = { 'N', 'B', 'B', 'K' };
+
+	struct Header
+	{
+		char magic[4];
+		std::uint32_t version;
+		std::uint64_t key;
+		std::uint32_t num_attributes;
+		std::uint32_t num_bones;
+		std::uint32_t num_meshes;
+		std::uint32_t stride;
+		std::uint64_t size;
+	};
+
+	struct AttributeRecord
+	{
+		std::uint32_t name_offset, name_length;
+		std::uint32_t type_offset, type_length;
+		std::uint32_t count;
+	};
+
+	struct BoneRecord
+	{
+		std::uint32_t offset, length;
+	};
+
+	struct MeshRecord
+	{
+		std::uint32_t name_offset, name_length;
+		std::uint32_t vertex_count, index_count;
+		std::uint64_t vertex_offset, index_offset;
+		float min[3], max[3];
+	};
+
+	static_assert(sizeof(Header) == 40, "Header must be packed");
+	static_assert(sizeof(AttributeRecord) == 20, "AttributeRecord must be packed");
+	static_assert(sizeof(BoneRecord) == 8, "BoneRecord must be packed");
+	static_assert(sizeof(MeshRecord) == 56, "MeshRecord must be packed");
+
+	std::uint64_t align(std::uint64_t value, std::uint64_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+void nbunny::BakeHash::update(const void* data, std::size_t size)
+{
+	++count;
+	value = xxh64(data, size, value + count * PRIME64_1 + TAG_DATA * PRIME64_2);
+}
+
+void nbunny::BakeHash::update(const std::string& value)
+{
+	++count;
+	this->value = xxh64(value.data(), value.size(), this->value + count * PRIME64_1 + TAG_STRING * PRIME64_2);
+}
+
+void nbunny::BakeHash::update(double value)
+{
+	++count;
+	this->value = xxh64(&value, sizeof(value), this->value + count * PRIME64_1 + TAG_NUMBER * PRIME64_2);
+}
+
+std::uint64_t nbunny::BakeHash::get_value() const
+{
+	return value;
+}
+
+std::string nbunny::BakeHash::get_key() const
+{
+	char buffer[17];
+	std::snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)value);
+
+	return buffer;
+}
+
+nbunny::BakeFile::~BakeFile()
+{
+	close();
+}
+
+void nbunny::BakeFile::close()
+{
+	format.clear();
+	bones.clear();
+	meshes.clear();
+	stride = 0;
+
+#ifdef _WIN32
+	if (data)
+	{
+		UnmapViewOfFile(data);
+	}
+
+	if (mapping_handle)
+	{
+		CloseHandle(mapping_handle);
+		mapping_handle = nullptr;
+	}
+
+	if (file_handle)
+	{
+		CloseHandle(file_handle);
+		file_handle = nullptr;
+	}
+#else
+	if (data)
+	{
+		munmap(const_cast<std::uint8_t*>(data), size);
+	}
+
+	if (file_descriptor >= 0)
+	{
+		::close(file_descriptor);
+		file_descriptor = -1;
+	}
+#endif
+
+	data = nullptr;
+	size = 0;
+}
+
+bool nbunny::BakeFile::map(const std::string& filename)
+{
+#ifdef _WIN32
+	auto file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	file_handle = file;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+	{
+		return false;
+	}
+	size = (std::size_t)file_size.QuadPart;
+
+	mapping_handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping_handle)
+	{
+		return false;
+	}
+
+	data = static_cast<const std::uint8_t*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+	return data != nullptr;
+#else
+	file_descriptor = ::open(filename.c_str(), O_RDONLY);
+	if (file_descriptor < 0)
+	{
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(file_descriptor, &info) != 0 || info.st_size <= 0)
+	{
+		return false;
+	}
+
+	auto mapping = mmap(nullptr, (std::size_t)info.st_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+	if (mapping == MAP_FAILED)
+	{
+		return false;
+	}
+
+	data = static_cast<const std::uint8_t*>(mapping);
+	size = (std::size_t)info.st_size;
+	return true;
+#endif
+}
+
+bool nbunny::BakeFile::read(std::uint64_t key)
+{
+	if (size < sizeof(Header))
+	{
+		return false;
+	}
+
+	Header header;
+	std::memcpy(&header, data, sizeof(header));
+	if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+	    header.version != BakeCache::VERSION ||
+	    header.key != key ||
+	    header.size != size)
+	{
+		return false;
+	}
+
+	auto get_string = [&](std::uint32_t offset, std::uint32_t length, std::string& result)
+	{
+		if ((std::uint64_t)offset + length > size)
+		{
+			return false;
+		}
+
+		result.assign(reinterpret_cast<const char*>(data) + offset, length);
+		return true;
+	};
+
+	std::uint64_t offset = sizeof(Header);
+	if (offset + (std::uint64_t)header.num_attributes * sizeof(AttributeRecord) > size)
+	{
+		return false;
+	}
+
+	for (std::uint32_t i = 0; i < header.num_attributes; ++i)
+	{
+		AttributeRecord record;
+		std::memcpy(&record, data + offset, sizeof(record));
+		offset += sizeof(record);
+
+		ResourceAttribute attribute;
+		if (!get_string(record.name_offset, record.name_length, attribute.name) ||
+		    !get_string(record.type_offset, record.type_length, attribute.type) ||
+		    attribute.type != "float")
+		{
+			return false;
+		}
+		attribute.count = (int)record.count;
+
+		stride += record.count;
+		format.push_back(attribute);
+	}
+
+	if (stride != header.stride || stride == 0)
+	{
+		return false;
+	}
+
+	if (offset + (std::uint64_t)header.num_bones * sizeof(BoneRecord) > size)
+	{
+		return false;
+	}
+
+	for (std::uint32_t i = 0; i < header.num_bones; ++i)
+	{
+		BoneRecord record;
+		std::memcpy(&record, data + offset, sizeof(record));
+		offset += sizeof(record);
+
+		std::string bone;
+		if (!get_string(record.offset, record.length, bone))
+		{
+			return false;
+		}
+
+		bones.push_back(bone);
+	}
+
+	offset = align(offset, 8);
+	if (offset + (std::uint64_t)header.num_meshes * sizeof(MeshRecord) > size)
+	{
+		return false;
+	}
+
+	for (std::uint32_t i = 0; i < header.num_meshes; ++i)
+	{
+		MeshRecord record;
+		std::memcpy(&record, data + offset, sizeof(record));
+		offset += sizeof(record);
+
+		Mesh mesh;
+		if (!get_string(record.name_offset, record.name_length, mesh.name))
+		{
+			return false;
+		}
+
+		auto vertices_size = (std::uint64_t)record.vertex_count * stride * sizeof(float);
+		if (record.vertex_offset % alignof(float) != 0 || record.vertex_offset + vertices_size > size)
+		{
+			return false;
+		}
+
+		mesh.vertices = reinterpret_cast<const float*>(data + record.vertex_offset);
+		mesh.vertex_count = record.vertex_count;
+
+		mesh.indices = nullptr;
+		mesh.index_count = record.index_count;
+		if (record.index_count > 0)
+		{
+			auto indices_size = (std::uint64_t)record.index_count * sizeof(std::uint32_t);
+			if (record.index_offset % alignof(std::uint32_t) != 0 || record.index_offset + indices_size > size)
+			{
+				return false;
+			}
+
+			mesh.indices = reinterpret_cast<const std::uint32_t*>(data + record.index_offset);
+			for (std::size_t j = 0; j < mesh.index_count; ++j)
+			{
+				if (mesh.indices[j] >= mesh.vertex_count)
+				{
+					return false;
+				}
+			}
+		}
+
+		std::memcpy(mesh.min, record.min, sizeof(mesh.min));
+		std::memcpy(mesh.max, record.max, sizeof(mesh.max));
+
+		meshes.push_back(mesh);
+	}
+
+	return true;
+}
+
+std::unique_ptr<nbunny::BakeFile> nbunny::BakeFile::open(const std::string& filename, std::uint64_t key)
+{
+	NBUNNY_PROFILE_SCOPE("BakeFile.open");
+
+	std::unique_ptr<BakeFile> file(new BakeFile());
+	if (!file->map(filename) || !file->read(key))
+	{
+		return nullptr;
+	}
+
+	return file;
+}
+
+const std::vector<nbunny::ResourceAttribute>& nbunny::BakeFile::get_format() const
+{
+	return format;
+}
+
+const std::vector<std::string>& nbunny::BakeFile::get_bones() const
+{
+	return bones;
+}
+
+const std::vector<nbunny::BakeFile::Mesh>& nbunny::BakeFile::get_meshes() const
+{
+	return meshes;
+}
+
+std::size_t nbunny::BakeFile::get_stride() const
+{
+	return stride;
+}
+
+nbunny::BakeCache::BakeCache(const std::string& directory) :
+	directory(directory)
+{
+	// Nothing.
+}
+
+const std::string& nbunny::BakeCache::get_directory() const
+{
+	return directory;
+}
+
+std::string nbunny::BakeCache::get_filename(std::uint64_t key) const
+{
+	char buffer[32];
+	std::snprintf(buffer, sizeof(buffer), "/%016llx.bake", (unsigned long long)key);
+
+	return directory + buffer;
+}
+
+std::unique_ptr<nbunny::BakeFile> nbunny::BakeCache::load(std::uint64_t key) const
+{
+	return BakeFile::open(get_filename(key), key);
+}
+
+bool nbunny::BakeCache::save(
+	std::uint64_t key,
+	const std::vector<ResourceAttribute>& format,
+	const std::vector<std::string>& bones,
+	const std::vector<BakeFile::Mesh>& meshes) const
+{
+	NBUNNY_PROFILE_SCOPE("BakeCache.save");
+
+	std::uint32_t stride = 0;
+	for (auto& attribute: format)
+	{
+		if (attribute.type != "float" || attribute.count <= 0)
+		{
+			return false;
+		}
+
+		stride += (std::uint32_t)attribute.count;
+	}
+
+	if (stride == 0)
+	{
+		return false;
+	}
+
+	std::string strings;
+	auto add_string = [&](const std::string& value, std::uint32_t& offset, std::uint32_t& length)
+	{
+		offset = (std::uint32_t)strings.size();
+		length = (std::uint32_t)value.size();
+		strings += value;
+	};
+
+	std::vector<AttributeRecord> attribute_records(format.size());
+	for (std::size_t i = 0; i < format.size(); ++i)
+	{
+		add_string(format[i].name, attribute_records[i].name_offset, attribute_records[i].name_length);
+		add_string(format[i].type, attribute_records[i].type_offset, attribute_records[i].type_length);
+		attribute_records[i].count = (std::uint32_t)format[i].count;
+	}
+
+	std::vector<BoneRecord> bone_records(bones.size());
+	for (std::size_t i = 0; i < bones.size(); ++i)
+	{
+		add_string(bones[i], bone_records[i].offset, bone_records[i].length);
+	}
+
+	std::vector<MeshRecord> mesh_records(meshes.size());
+	for (std::size_t i = 0; i < meshes.size(); ++i)
+	{
+		add_string(meshes[i].name, mesh_records[i].name_offset, mesh_records[i].name_length);
+	}
+
+	// String offsets are relative to the string table until the table is placed.
+	std::uint64_t meshes_offset = align(
+		sizeof(Header) + format.size() * sizeof(AttributeRecord) + bones.size() * sizeof(BoneRecord),
+		8);
+	std::uint64_t strings_offset = meshes_offset + meshes.size() * sizeof(MeshRecord);
+	std::uint64_t current_offset = align(strings_offset + strings.size(), 16);
+
+	for (auto& record: attribute_records)
+	{
+		record.name_offset += (std::uint32_t)strings_offset;
+		record.type_offset += (std::uint32_t)strings_offset;
+	}
+
+	for (auto& record: bone_records)
+	{
+		record.offset += (std::uint32_t)strings_offset;
+	}
+
+	for (std::size_t i = 0; i < meshes.size(); ++i)
+	{
+		auto& mesh = meshes[i];
+		auto& record = mesh_records[i];
+		record.name_offset += (std::uint32_t)strings_offset;
+
+		record.vertex_count = (std::uint32_t)mesh.vertex_count;
+		record.vertex_offset = current_offset;
+		current_offset = align(current_offset + mesh.vertex_count * stride * sizeof(float), 16);
+
+		record.index_count = mesh.indices ? (std::uint32_t)mesh.index_count : 0;
+		record.index_offset = current_offset;
+		current_offset = align(current_offset + record.index_count * sizeof(std::uint32_t), 16);
+
+		std::memcpy(record.min, mesh.min, sizeof(record.min));
+		std::memcpy(record.max, mesh.max, sizeof(record.max));
+	}
+
+	Header header;
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.key = key;
+	header.num_attributes = (std::uint32_t)format.size();
+	header.num_bones = (std::uint32_t)bones.size();
+	header.num_meshes = (std::uint32_t)meshes.size();
+	header.stride = stride;
+	header.size = current_offset;
+
+	std::vector<std::uint8_t> buffer(current_offset, 0);
+	std::size_t offset = 0;
+	auto write = [&](const void* value, std::size_t size)
+	{
+		if (size > 0)
+		{
+			std::memcpy(buffer.data() + offset, value, size);
+		}
+		offset += size;
+	};
+
+	write(&header, sizeof(header));
+	write(attribute_records.data(), attribute_records.size() * sizeof(AttributeRecord));
+	write(bone_records.data(), bone_records.size() * sizeof(BoneRecord));
+
+	offset = (std::size_t)meshes_offset;
+	write(mesh_records.data(), mesh_records.size() * sizeof(MeshRecord));
+	write(strings.data(), strings.size());
+
+	for (std::size_t i = 0; i < meshes.size(); ++i)
+	{
+		auto& mesh = meshes[i];
+		auto& record = mesh_records[i];
+
+		offset = (std::size_t)record.vertex_offset;
+		write(mesh.vertices, mesh.vertex_count * stride * sizeof(float));
+
+		offset = (std::size_t)record.index_offset;
+		write(mesh.indices, record.index_count * sizeof(std::uint32_t));
+	}
+
+	// Another thread may be baking the same thing, so the temporary file
+	// has to be unique.
+	static std::atomic<std::uint64_t> current_temporary(0);
+	auto filename = get_filename(key);
+	auto temporary_filename = filename + "." +
+		std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + "." +
+		std::to_string(++current_temporary) + ".tmp";
+
+	{
+		std::ofstream stream(temporary_filename, std::ios::binary | std::ios::trunc);
+		stream.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+		if (!stream)
+		{
+			stream.close();
+			std::remove(temporary_filename.c_str());
+			return false;
+		}
+	}
+
+	// std::rename won't replace an existing file on Windows.
+#ifdef _WIN32
+	bool is_renamed = MoveFileExA(temporary_filename.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	bool is_renamed = std::rename(temporary_filename.c_str(), filename.c_str()) == 0;
+#endif
+
+	if (!is_renamed)
+	{
+		std::remove(temporary_filename.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool nbunny::BakeCache::save(
+	std::uint64_t key,
+	const std::vector<ResourceAttribute>& format,
+	const std::vector<std::string>& bones,
+	const std::vector<ResourceMesh>& meshes) const
+{
+	std::vector<BakeFile::Mesh> views;
+	for (auto& mesh: meshes)
+	{
+		BakeFile::Mesh view;
+		view.name = mesh.name;
+		view.vertices = mesh.vertices.data();
+		view.vertex_count = mesh.vertex_count;
+		view.indices = mesh.indices.empty() ? nullptr : mesh.indices.data();
+		view.index_count = mesh.indices.size();
+		std::memcpy(view.min, mesh.min, sizeof(view.min));
+		std::memcpy(view.max, mesh.max, sizeof(view.max));
+
+		views.push_back(view);
+	}
+
+	return save(key, format, bones, views);
+}
+
+#ifndef NBUNNY_NO_LUA
+
+static std::uint64_t check_key(lua_State* L, int index)
+{
+	std::size_t length;
+	auto key = luaL_checklstring(L, index, &length);
+
+	char* end = nullptr;
+	auto result = std::strtoull(key, &end, 16);
+	luaL_argcheck(L, length == 16 && end == key + length, index, "expected 16 hex digits");
+
+	return (std::uint64_t)result;
+}
+
+static void push_vector(lua_State* L, const float value[3])
+{
+	lua_createtable(L, 3, 0);
+	for (int i = 0; i < 3; ++i)
+	{
+		lua_pushnumber(L, value[i]);
+		lua_rawseti(L, -2, i + 1);
+	}
+}
+
+// Empty meshes don't need bounds.
+static void get_vector(lua_State* L, int index, const char* name, float result[3])
+{
+	lua_getfield(L, index, name);
+	for (int i = 0; i < 3; ++i)
+	{
+		if (lua_istable(L, -1))
+		{
+			lua_rawgeti(L, -1, i + 1);
+			result[i] = (float)lua_tonumber(L, -1);
+			lua_pop(L, 1);
+		}
+		else
+		{
+			result[i] = 0.0f;
+		}
+	}
+	lua_pop(L, 1);
+}
+
+// Hashes each argument. Pointers (light userdata) must be followed by the
+// size, in bytes, of what they point to.
+static int nbunny_bake_hash_update(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::BakeHash>(L, 1);
+
+	int top = lua_gettop(L);
+	for (int i = 2; i <= top; ++i)
+	{
+		switch (lua_type(L, i))
+		{
+			case LUA_TSTRING:
+				{
+					std::size_t length;
+					auto value = lua_tolstring(L, i, &length);
+					self.update(std::string(value, length));
+				}
+				break;
+			case LUA_TNUMBER:
+				self.update((double)lua_tonumber(L, i));
+				break;
+			case LUA_TBOOLEAN:
+				{
+					// Not the same as 0 or 1.
+					std::uint8_t value = lua_toboolean(L, i) ? 2 : 1;
+					self.update(&value, sizeof(value));
+				}
+				break;
+			case LUA_TNIL:
+				self.update(nullptr, 0);
+				break;
+			case LUA_TLIGHTUSERDATA:
+				{
+					auto pointer = lua_touserdata(L, i);
+					auto size = (std::size_t)luaL_checkinteger(L, i + 1);
+					self.update(pointer, size);
+					++i;
+				}
+				break;
+			default:
+				return luaL_argerror(L, i, "expected string, number, boolean, nil, or pointer and size");
+		}
+	}
+
+	return 0;
+}
+
+extern "C"
+NBUNNY_EXPORT int luaopen_nbunny_bakehash(lua_State* L)
+{
+	sol::usertype<nbunny::BakeHash> T(
+		sol::call_constructor, sol::constructors<nbunny::BakeHash()>(),
+		"update", &nbunny_bake_hash_update,
+		"getKey", &nbunny::BakeHash::get_key);
+
+	sol::stack::push(L, T);
+
+	return 1;
+}
+
+// Returns a table like nbunny.resourceloader does for decoded models and
+// static meshes. Pointers are valid until the file is closed.
+static int nbunny_bake_file_get_meshes(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::BakeFile>(L, 1);
+
+	lua_createtable(L, 0, 3);
+
+	auto& format = self.get_format();
+	lua_createtable(L, (int)format.size(), 0);
+	for (std::size_t i = 0; i < format.size(); ++i)
+	{
+		lua_createtable(L, 3, 0);
+		lua_pushlstring(L, format[i].name.data(), format[i].name.size());
+		lua_rawseti(L, -2, 1);
+		lua_pushlstring(L, format[i].type.data(), format[i].type.size());
+		lua_rawseti(L, -2, 2);
+		lua_pushinteger(L, format[i].count);
+		lua_rawseti(L, -2, 3);
+
+		lua_rawseti(L, -2, (int)i + 1);
+	}
+	lua_setfield(L, -2, "format");
+
+	auto& bones = self.get_bones();
+	lua_createtable(L, (int)bones.size(), 0);
+	for (std::size_t i = 0; i < bones.size(); ++i)
+	{
+		lua_pushlstring(L, bones[i].data(), bones[i].size());
+		lua_rawseti(L, -2, (int)i + 1);
+	}
+	lua_setfield(L, -2, "bones");
+
+	auto& meshes = self.get_meshes();
+	lua_createtable(L, (int)meshes.size(), 0);
+	for (std::size_t i = 0; i < meshes.size(); ++i)
+	{
+		auto& mesh = meshes[i];
+
+		lua_createtable(L, 0, 8);
+
+		lua_pushlstring(L, mesh.name.data(), mesh.name.size());
+		lua_setfield(L, -2, "name");
+
+		lua_pushlightuserdata(L, const_cast<float*>(mesh.vertices));
+		lua_setfield(L, -2, "vertices");
+		lua_pushinteger(L, (lua_Integer)mesh.vertex_count);
+		lua_setfield(L, -2, "vertexCount");
+
+		if (mesh.indices)
+		{
+			lua_pushlightuserdata(L, const_cast<std::uint32_t*>(mesh.indices));
+			lua_setfield(L, -2, "indices");
+		}
+		lua_pushinteger(L, (lua_Integer)(mesh.indices ? mesh.index_count : 0));
+		lua_setfield(L, -2, "indexCount");
+
+		if (mesh.vertex_count > 0)
+		{
+			push_vector(L, mesh.min);
+			lua_setfield(L, -2, "min");
+			push_vector(L, mesh.max);
+			lua_setfield(L, -2, "max");
+		}
+
+		lua_rawseti(L, -2, (int)i + 1);
+	}
+	lua_setfield(L, -2, "meshes");
+
+	return 1;
+}
+
+extern "C"
+NBUNNY_EXPORT int luaopen_nbunny_bakefile(lua_State* L)
+{
+	sol::usertype<nbunny::BakeFile> T(
+		sol::no_constructor,
+		"getMeshes", &nbunny_bake_file_get_meshes,
+		"getStride", &nbunny::BakeFile::get_stride,
+		"close", &nbunny::BakeFile::close);
+
+	sol::stack::push(L, T);
+
+	return 1;
+}
+
+// Returns the file, or nil if nothing was baked from key. Requires
+// nbunny.bakefile.
+static int nbunny_bake_cache_load(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::BakeCache>(L, 1);
+
+	auto file = self.load(check_key(L, 2));
+	if (!file)
+	{
+		lua_pushnil(L);
+	}
+	else
+	{
+		sol::stack::push(L, std::shared_ptr<nbunny::BakeFile>(std::move(file)));
+	}
+
+	return 1;
+}
+
+// Takes the key, the format, the bones, and the meshes, like the ones
+// returned by BakeFile.getMeshes.
+static int nbunny_bake_cache_save(lua_State* L)
+{
+	NBUNNY_PROFILE_SCOPE("nbunny_bake_cache_save");
+
+	auto& self = sol::stack::get<nbunny::BakeCache>(L, 1);
+	auto key = check_key(L, 2);
+	luaL_checktype(L, 3, LUA_TTABLE);
+	luaL_checktype(L, 4, LUA_TTABLE);
+	luaL_checktype(L, 5, LUA_TTABLE);
+
+	std::vector<nbunny::ResourceAttribute> format;
+	for (std::size_t i = 1; i <= lua_objlen(L, 3); ++i)
+	{
+		lua_rawgeti(L, 3, (int)i);
+		luaL_argcheck(L, lua_istable(L, -1), 3, "expected vertex format");
+
+		nbunny::ResourceAttribute attribute;
+		lua_rawgeti(L, -1, 1);
+		attribute.name = luaL_checkstring(L, -1);
+		lua_rawgeti(L, -2, 2);
+		attribute.type = luaL_checkstring(L, -1);
+		lua_rawgeti(L, -3, 3);
+		attribute.count = (int)luaL_checkinteger(L, -1);
+		lua_pop(L, 4);
+
+		format.push_back(attribute);
+	}
+
+	std::vector<std::string> bones;
+	for (std::size_t i = 1; i <= lua_objlen(L, 4); ++i)
+	{
+		lua_rawgeti(L, 4, (int)i);
+		bones.push_back(luaL_checkstring(L, -1));
+		lua_pop(L, 1);
+	}
+
+	std::vector<nbunny::BakeFile::Mesh> meshes;
+	for (std::size_t i = 1; i <= lua_objlen(L, 5); ++i)
+	{
+		lua_rawgeti(L, 5, (int)i);
+		int index = lua_gettop(L);
+		luaL_argcheck(L, lua_istable(L, index), 5, "expected mesh");
+
+		nbunny::BakeFile::Mesh mesh;
+
+		lua_getfield(L, index, "name");
+		mesh.name = lua_isstring(L, -1) ? lua_tostring(L, -1) : "";
+		lua_getfield(L, index, "vertices");
+		mesh.vertices = static_cast<const float*>(lua_touserdata(L, -1));
+		lua_getfield(L, index, "vertexCount");
+		mesh.vertex_count = (std::size_t)lua_tointeger(L, -1);
+		lua_getfield(L, index, "indices");
+		mesh.indices = static_cast<const std::uint32_t*>(lua_touserdata(L, -1));
+		lua_getfield(L, index, "indexCount");
+		mesh.index_count = (std::size_t)lua_tointeger(L, -1);
+		lua_pop(L, 5);
+
+		luaL_argcheck(L, mesh.vertices || mesh.vertex_count == 0, 5, "mesh needs vertices");
+		get_vector(L, index, "min", mesh.min);
+		get_vector(L, index, "max", mesh.max);
+
+		lua_pop(L, 1);
+		meshes.push_back(mesh);
+	}
+
+	lua_pushboolean(L, self.save(key, format, bones, meshes));
+	return 1;
+}
+
+extern "C"
+NBUNNY_EXPORT int luaopen_nbunny_bakecache(lua_State* L)
+{
+	sol::usertype<nbunny::BakeCache> T(
+		sol::call_constructor, sol::constructors<nbunny::BakeCache(const std::string&)>(),
+		"getDirectory", &nbunny::BakeCache::get_directory,
+		"load", &nbunny_bake_cache_load,
+		"save", &nbunny_bake_cache_save);
+
+	sol::stack::push(L, T);
+
+	return 1;
+}
+
+#endif
@@ -0,0 +1,488 @@
+////////////////////////////////////////////////////////////////////////////////
+// source/cache.cpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "nbunny/nbunny.hpp"
+#include "nbunny/cache.hpp"
+#include "nbunny/profiler.hpp"
+
+nbunny::ResourceCache::ResourceCache(std::size_t default_budget) :
+	default_budget(default_budget)
+{
+	// Nothing.
+}
+
+nbunny::ResourceCache::Type& nbunny::ResourceCache::get_type(int type)
+{
+	if ((std::size_t)type >= types.size())
+	{
+		types.resize(type + 1);
+	}
+
+	auto& result = types[type];
+	if (!result.has_budget)
+	{
+		result.stats.budget = default_budget;
+	}
+
+	return result;
+}
+
+const nbunny::ResourceCache::Type* nbunny::ResourceCache::find_type(int type) const
+{
+	if (type < 0 || (std::size_t)type >= types.size())
+	{
+		return nullptr;
+	}
+
+	return &types[type];
+}
+
+std::uint32_t nbunny::ResourceCache::find(int type, const std::string& key) const
+{
+	auto t = find_type(type);
+	if (!t)
+	{
+		return NONE;
+	}
+
+	auto iter = t->entries.find(key);
+	if (iter == t->entries.end())
+	{
+		return NONE;
+	}
+
+	return iter->second;
+}
+
+void nbunny::ResourceCache::link(Type& type, std::uint32_t index)
+{
+	auto& entry = entries[index];
+	entry.previous = NONE;
+	entry.next = type.head;
+
+	if (type.head != NONE)
+	{
+		entries[type.head].previous = index;
+	}
+	type.head = index;
+
+	if (type.tail == NONE)
+	{
+		type.tail = index;
+	}
+}
+
+void nbunny::ResourceCache::unlink(Type& type, std::uint32_t index)
+{
+	auto& entry = entries[index];
+
+	if (entry.previous != NONE)
+	{
+		entries[entry.previous].next = entry.next;
+	}
+	else
+	{
+		type.head = entry.next;
+	}
+
+	if (entry.next != NONE)
+	{
+		entries[entry.next].previous = entry.previous;
+	}
+	else
+	{
+		type.tail = entry.previous;
+	}
+
+	entry.previous = NONE;
+	entry.next = NONE;
+}
+
+void nbunny::ResourceCache::free(Type& type, std::uint32_t index)
+{
+	unlink(type, index);
+
+	auto& entry = entries[index];
+	type.entries.erase(entry.key);
+
+	type.stats.count -= 1;
+	type.stats.bytes -= entry.size;
+	if (entry.pins > 0)
+	{
+		type.stats.pinned_bytes -= entry.size;
+	}
+	num_bytes -= entry.size;
+
+	entry.key.clear();
+	entry.size = 0;
+	entry.pins = 0;
+	free_entries.push_back(index);
+}
+
+void nbunny::ResourceCache::evict(int type)
+{
+	auto& t = types[type];
+
+	// The most recently used entry stays, even if it alone is over budget.
+	auto index = t.tail;
+	while (t.stats.bytes > t.stats.budget && index != NONE && index != t.head)
+	{
+		auto previous = entries[index].previous;
+		if (entries[index].pins == 0)
+		{
+			evicted.emplace_back(type, entries[index].key);
+
+			free(t, index);
+			t.stats.evictions += 1;
+		}
+
+		index = previous;
+	}
+}
+
+void nbunny::ResourceCache::set_budget(int type, std::size_t budget)
+{
+	auto& t = get_type(type);
+	t.has_budget = true;
+	t.stats.budget = budget;
+
+	evict(type);
+}
+
+std::size_t nbunny::ResourceCache::get_budget(int type) const
+{
+	auto t = find_type(type);
+	if (!t || !t->has_budget)
+	{
+		return default_budget;
+	}
+
+	return t->stats.budget;
+}
+
+bool nbunny::ResourceCache::get(int type, const std::string& key)
+{
+	auto& t = get_type(type);
+
+	auto iter = t.entries.find(key);
+	if (iter == t.entries.end())
+	{
+		t.stats.misses += 1;
+		return false;
+	}
+
+	t.stats.hits += 1;
+	if (t.head != iter->second)
+	{
+		unlink(t, iter->second);
+		link(t, iter->second);
+	}
+
+	return true;
+}
+
+bool nbunny::ResourceCache::has(int type, const std::string& key) const
+{
+	return find(type, key) != NONE;
+}
+
+void nbunny::ResourceCache::put(int type, const std::string& key, std::size_t size)
+{
+	NBUNNY_PROFILE_SCOPE("ResourceCache.put");
+
+	auto& t = get_type(type);
+
+	std::uint32_t index;
+	auto iter = t.entries.find(key);
+	if (iter != t.entries.end())
+	{
+		index = iter->second;
+		unlink(t, index);
+
+		auto& entry = entries[index];
+		t.stats.bytes -= entry.size;
+		if (entry.pins > 0)
+		{
+			t.stats.pinned_bytes -= entry.size;
+		}
+		num_bytes -= entry.size;
+	}
+	else
+	{
+		if (free_entries.empty())
+		{
+			index = (std::uint32_t)entries.size();
+			entries.emplace_back();
+		}
+		else
+		{
+			index = free_entries.back();
+			free_entries.pop_back();
+		}
+
+		entries[index].key = key;
+		t.entries.emplace(key, index);
+		t.stats.count += 1;
+	}
+
+	auto& entry = entries[index];
+	entry.size = size;
+	t.stats.bytes += size;
+	if (entry.pins > 0)
+	{
+		t.stats.pinned_bytes += size;
+	}
+	num_bytes += size;
+
+	link(t, index);
+	evict(type);
+}
+
+bool nbunny::ResourceCache::remove(int type, const std::string& key)
+{
+	auto index = find(type, key);
+	if (index == NONE)
+	{
+		return false;
+	}
+
+	free(types[type], index);
+	return true;
+}
+
+bool nbunny::ResourceCache::pin(int type, const std::string& key)
+{
+	auto index = find(type, key);
+	if (index == NONE)
+	{
+		return false;
+	}
+
+	auto& entry = entries[index];
+	if (entry.pins == 0)
+	{
+		types[type].stats.pinned_bytes += entry.size;
+	}
+	entry.pins += 1;
+
+	return true;
+}
+
+bool nbunny::ResourceCache::unpin(int type, const std::string& key)
+{
+	auto index = find(type, key);
+	if (index == NONE || entries[index].pins == 0)
+	{
+		return false;
+	}
+
+	auto& entry = entries[index];
+	entry.pins -= 1;
+	if (entry.pins == 0)
+	{
+		types[type].stats.pinned_bytes -= entry.size;
+
+		// The entry may have been keeping the type over budget.
+		evict(type);
+	}
+
+	return true;
+}
+
+bool nbunny::ResourceCache::pop_evicted(int& type, std::string& key)
+{
+	if (current_evicted >= evicted.size())
+	{
+		evicted.clear();
+		current_evicted = 0;
+		return false;
+	}
+
+	auto& e = evicted[current_evicted++];
+	type = e.first;
+	key.swap(e.second);
+
+	return true;
+}
+
+nbunny::ResourceCache::Stats nbunny::ResourceCache::get_stats(int type) const
+{
+	auto t = find_type(type);
+	if (!t)
+	{
+		Stats result;
+		result.budget = default_budget;
+		return result;
+	}
+
+	return t->stats;
+}
+
+void nbunny::ResourceCache::reset_stats()
+{
+	for (auto& type: types)
+	{
+		type.stats.hits = 0;
+		type.stats.misses = 0;
+		type.stats.evictions = 0;
+	}
+}
+
+std::size_t nbunny::ResourceCache::get_num_bytes() const
+{
+	return num_bytes;
+}
+
+#ifndef NBUNNY_NO_LUA
+
+static int check_type(lua_State* L, int index)
+{
+	auto type = (int)luaL_checkinteger(L, index);
+	luaL_argcheck(L, type >= 0, index, "type must be 0 or more");
+
+	return type;
+}
+
+static int nbunny_resource_cache_set_budget(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ResourceCache>(L, 1);
+	self.set_budget(check_type(L, 2), (std::size_t)luaL_checknumber(L, 3));
+	return 0;
+}
+
+static int nbunny_resource_cache_get_budget(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ResourceCache>(L, 1);
+	lua_pushnumber(L, (lua_Number)self.get_budget(check_type(L, 2)));
+	return 1;
+}
+
+static int nbunny_resource_cache_get(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ResourceCache>(L, 1);
+	lua_pushboolean(L, self.get(check_type(L, 2), luaL_checkstring(L, 3)));
+	return 1;
+}
+
+static int nbunny_resource_cache_has(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ResourceCache>(L, 1);
+	lua_pushboolean(L, self.has(check_type(L, 2), luaL_checkstring(L, 3)));
+	return 1;
+}
+
+static int nbunny_resource_cache_put(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ResourceCache>(L, 1);
+	self.put(check_type(L, 2), luaL_checkstring(L, 3), (std::size_t)luaL_checknumber(L, 4));
+	return 0;
+}
+
+static int nbunny_resource_cache_remove(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ResourceCache>(L, 1);
+	lua_pushboolean(L, self.remove(check_type(L, 2), luaL_checkstring(L, 3)));
+	return 1;
+}
+
+static int nbunny_resource_cache_pin(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ResourceCache>(L, 1);
+	lua_pushboolean(L, self.pin(check_type(L, 2), luaL_checkstring(L, 3)));
+	return 1;
+}
+
+static int nbunny_resource_cache_unpin(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ResourceCache>(L, 1);
+	lua_pushboolean(L, self.unpin(check_type(L, 2), luaL_checkstring(L, 3)));
+	return 1;
+}
+
+// Returns the type and key of the next evicted entry, or nil.
+static int nbunny_resource_cache_pop_evicted(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ResourceCache>(L, 1);
+
+	int type;
+	std::string key;
+	if (!self.pop_evicted(type, key))
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+
+	lua_pushinteger(L, type);
+	lua_pushlstring(L, key.data(), key.size());
+	return 2;
+}
+
+static int nbunny_resource_cache_get_stats(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ResourceCache>(L, 1);
+	auto stats = self.get_stats(check_type(L, 2));
+
+	lua_createtable(L, 0, 7);
+	lua_pushnumber(L, (lua_Number)stats.hits);
+	lua_setfield(L, -2, "hits");
+	lua_pushnumber(L, (lua_Number)stats.misses);
+	lua_setfield(L, -2, "misses");
+	lua_pushnumber(L, (lua_Number)stats.evictions);
+	lua_setfield(L, -2, "evictions");
+	lua_pushnumber(L, (lua_Number)stats.count);
+	lua_setfield(L, -2, "count");
+	lua_pushnumber(L, (lua_Number)stats.bytes);
+	lua_setfield(L, -2, "bytes");
+	lua_pushnumber(L, (lua_Number)stats.pinned_bytes);
+	lua_setfield(L, -2, "pinnedBytes");
+	lua_pushnumber(L, (lua_Number)stats.budget);
+	lua_setfield(L, -2, "budget");
+
+	return 1;
+}
+
+static int nbunny_resource_cache_reset_stats(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ResourceCache>(L, 1);
+	self.reset_stats();
+	return 0;
+}
+
+static int nbunny_resource_cache_get_num_bytes(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ResourceCache>(L, 1);
+	lua_pushnumber(L, (lua_Number)self.get_num_bytes());
+	return 1;
+}
+
+extern "C"
+NBUNNY_EXPORT int luaopen_nbunny_resourcecache(lua_State* L)
+{
+	sol::usertype<nbunny::ResourceCache> T(
+		sol::call_constructor, sol::constructors<nbunny::ResourceCache(), nbunny::ResourceCache(std::size_t)>(),
+		"setBudget", &nbunny_resource_cache_set_budget,
+		"getBudget", &nbunny_resource_cache_get_budget,
+		"get", &nbunny_resource_cache_get,
+		"has", &nbunny_resource_cache_has,
+		"put", &nbunny_resource_cache_put,
+		"remove", &nbunny_resource_cache_remove,
+		"pin", &nbunny_resource_cache_pin,
+		"unpin", &nbunny_resource_cache_unpin,
+		"popEvicted", &nbunny_resource_cache_pop_evicted,
+		"getStats", &nbunny_resource_cache_get_stats,
+		"resetStats", &nbunny_resource_cache_reset_stats,
+		"getNumBytes", &nbunny_resource_cache_get_num_bytes);
+
+	sol::stack::push(L, T);
+
+	return 1;
+}
+
+#endif
@@ -0,0 +1,170 @@
+////////////////////////////////////////////////////////////////////////////////
+// source/codec.cpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "nbunny/nbunny.hpp"
+#include "nbunny/codec.hpp"
+
+static void get_vector(lua_State* L, int index, const char* field, float result[3])
+{
+	lua_getfield(L, index, field);
+	luaL_checktype(L, -1, LUA_TTABLE);
+
+	for (int i = 0; i < 3; ++i)
+	{
+		lua_rawgeti(L, -1, i + 1);
+		result[i] = (float)luaL_checknumber(L, -1);
+		lua_pop(L, 1);
+	}
+
+	lua_pop(L, 1);
+}
+
+static int get_integer(lua_State* L, int vertex, int index)
+{
+	lua_rawgeti(L, vertex, index);
+	int result = (int)lua_tointeger(L, -1);
+	lua_pop(L, 1);
+
+	return result;
+}
+
+// Decodes vertices exported by goober's compressed profile.
+//
+// Argument 1 is the table of compressed vertices and argument 2 is the
+// 'compression' table. Returns a new table of vertices in the uncompressed
+// layout (position, normal, texture, bone names, bone weights, extra).
+static int nbunny_codec_decode_vertices(lua_State* L)
+{
+	luaL_checktype(L, 1, LUA_TTABLE);
+	luaL_checktype(L, 2, LUA_TTABLE);
+
+	float min[3], max[3];
+	lua_getfield(L, 2, "position");
+	luaL_checktype(L, -1, LUA_TTABLE);
+	get_vector(L, lua_gettop(L), "min", min);
+	get_vector(L, lua_gettop(L), "max", max);
+	lua_pop(L, 1);
+
+	lua_getfield(L, 2, "bones");
+	int bones = lua_istable(L, -1) ? lua_gettop(L) : 0;
+	if (!bones)
+	{
+		lua_pop(L, 1);
+	}
+
+	int count = (int)lua_objlen(L, 1);
+	lua_createtable(L, count, 0);
+	int result = lua_gettop(L);
+
+	for (int i = 1; i <= count; ++i)
+	{
+		lua_rawgeti(L, 1, i);
+		int vertex = lua_gettop(L);
+		luaL_checktype(L, vertex, LUA_TTABLE);
+
+		int length = (int)lua_objlen(L, vertex);
+		lua_createtable(L, length + 1, 0);
+		int output = lua_gettop(L);
+		int outputIndex = 1;
+		int inputIndex = 1;
+
+		for (int j = 0; j < 3; ++j)
+		{
+			auto position = (std::uint16_t)get_integer(L, vertex, inputIndex++);
+			lua_pushnumber(L, nbunny::codec::decode_unorm16(position, min[j], max[j]));
+			lua_rawseti(L, output, outputIndex++);
+		}
+
+		std::uint16_t encodedNormal[2];
+		encodedNormal[0] = (std::uint16_t)get_integer(L, vertex, inputIndex++);
+		encodedNormal[1] = (std::uint16_t)get_integer(L, vertex, inputIndex++);
+
+		float normal[3];
+		nbunny::codec::decode_octahedral(encodedNormal, normal);
+		for (int j = 0; j < 3; ++j)
+		{
+			lua_pushnumber(L, normal[j]);
+			lua_rawseti(L, output, outputIndex++);
+		}
+
+		for (int j = 0; j < 2; ++j)
+		{
+			auto texture = (std::uint16_t)get_integer(L, vertex, inputIndex++);
+			lua_pushnumber(L, nbunny::codec::decode_half(texture));
+			lua_rawseti(L, output, outputIndex++);
+		}
+
+		if (bones)
+		{
+			for (int j = 0; j < 4; ++j)
+			{
+				int bone = get_integer(L, vertex, inputIndex++);
+				if (bone == 0)
+				{
+					lua_pushboolean(L, false);
+				}
+				else
+				{
+					lua_rawgeti(L, bones, bone);
+				}
+
+				lua_rawseti(L, output, outputIndex++);
+			}
+
+			for (int j = 0; j < 4; ++j)
+			{
+				auto weight = (std::uint8_t)get_integer(L, vertex, inputIndex++);
+				lua_pushnumber(L, nbunny::codec::decode_unorm8(weight));
+				lua_rawseti(L, output, outputIndex++);
+			}
+		}
+
+		// Anything else (e.g., VertexDirection) is stored as-is.
+		while (inputIndex <= length)
+		{
+			lua_rawgeti(L, vertex, inputIndex++);
+			lua_rawseti(L, output, outputIndex++);
+		}
+
+		lua_rawseti(L, result, i);
+		lua_pop(L, 1);
+	}
+
+	return 1;
+}
+
+static int nbunny_codec_decode_quaternion(lua_State* L)
+{
+	auto value = (std::uint64_t)luaL_checknumber(L, 1);
+
+	float result[4];
+	nbunny::codec::decode_quaternion(value, result);
+
+	for (int i = 0; i < 4; ++i)
+	{
+		lua_pushnumber(L, result[i]);
+	}
+
+	return 4;
+}
+
+extern "C"
+NBUNNY_EXPORT int luaopen_nbunny_codec(lua_State* L)
+{
+	lua_newtable(L);
+
+	lua_pushcfunction(L, &nbunny_codec_decode_vertices);
+	lua_setfield(L, -2, "decodeVertices");
+
+	lua_pushcfunction(L, &nbunny_codec_decode_quaternion);
+	lua_setfield(L, -2, "decodeQuaternion");
+
+	return 1;
+}
@@ -0,0 +1,331 @@
+////////////////////////////////////////////////////////////////////////////////
+// source/ffi.cpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "nbunny/nbunny.hpp"
+#include "nbunny/profiler.hpp"
+#include "nbunny/replay.hpp"
+#include "nbunny/scene.hpp"
+#include "nbunny/skeleton.hpp"
+#include "nbunny/ffi.h"
+
+static nbunny::SceneNode& get_scene_node(nbunny_scene_node* node)
+{
+	return *reinterpret_cast<nbunny::SceneNode*>(node);
+}
+
+static nbunny::SceneNodeTransform& get_scene_node_transform(nbunny_scene_node_transform* transform)
+{
+	return *reinterpret_cast<nbunny::SceneNodeTransform*>(transform);
+}
+
+static nbunny::Camera& get_camera(nbunny_camera* camera)
+{
+	return *reinterpret_cast<nbunny::Camera*>(camera);
+}
+
+static nbunny::KeyFrame& get_keyframe(nbunny_keyframe* keyframe)
+{
+	return *reinterpret_cast<nbunny::KeyFrame*>(keyframe);
+}
+
+static const nbunny::KeyFrame& get_keyframe(const nbunny_keyframe* keyframe)
+{
+	return *reinterpret_cast<const nbunny::KeyFrame*>(keyframe);
+}
+
+static void copy_matrix(const glm::mat4& matrix, float* result)
+{
+	auto transposed = glm::transpose(matrix);
+	auto pointer = glm::value_ptr(transposed);
+
+	for (int i = 0; i < 16; ++i)
+	{
+		result[i] = pointer[i];
+	}
+}
+
+static void set_matrix(glm::mat4& matrix, const float* value)
+{
+	auto pointer = glm::value_ptr(matrix);
+
+	for (int i = 0; i < 16; ++i)
+	{
+		pointer[i] = value[i];
+	}
+
+	matrix = glm::transpose(matrix);
+}
+
+void nbunny_scene_node_set_min(nbunny_scene_node* node, float x, float y, float z)
+{
+	auto& n = get_scene_node(node);
+	n.min = glm::vec3(x, y, z);
+	nbunny::Recorder::get_instance().set_bounds(&n);
+}
+
+void nbunny_scene_node_set_max(nbunny_scene_node* node, float x, float y, float z)
+{
+	auto& n = get_scene_node(node);
+	n.max = glm::vec3(x, y, z);
+	nbunny::Recorder::get_instance().set_bounds(&n);
+}
+
+nbunny_scene_node_transform* nbunny_scene_node_get_transform_pointer(nbunny_scene_node* node)
+{
+	return reinterpret_cast<nbunny_scene_node_transform*>(get_scene_node(node).transform.get());
+}
+
+void nbunny_scene_node_transform_set_current_rotation(nbunny_scene_node_transform* transform, float x, float y, float z, float w)
+{
+	auto& t = get_scene_node_transform(transform);
+	t.currentRotation = glm::quat(w, x, y, z);
+	nbunny::Recorder::get_instance().set_transform(&t);
+}
+
+void nbunny_scene_node_transform_set_current_scale(nbunny_scene_node_transform* transform, float x, float y, float z)
+{
+	auto& t = get_scene_node_transform(transform);
+	t.currentScale = glm::vec3(x, y, z);
+	nbunny::Recorder::get_instance().set_transform(&t);
+}
+
+void nbunny_scene_node_transform_set_current_translation(nbunny_scene_node_transform* transform, float x, float y, float z)
+{
+	auto& t = get_scene_node_transform(transform);
+	t.currentTranslation = glm::vec3(x, y, z);
+	nbunny::Recorder::get_instance().set_transform(&t);
+}
+
+void nbunny_scene_node_transform_set_current_offset(nbunny_scene_node_transform* transform, float x, float y, float z)
+{
+	auto& t = get_scene_node_transform(transform);
+	t.currentOffset = glm::vec3(x, y, z);
+	nbunny::Recorder::get_instance().set_transform(&t);
+}
+
+void nbunny_scene_node_transform_set_previous_rotation(nbunny_scene_node_transform* transform, float x, float y, float z, float w)
+{
+	auto& t = get_scene_node_transform(transform);
+	t.previousRotation = glm::quat(w, x, y, z);
+	nbunny::Recorder::get_instance().set_transform(&t);
+}
+
+void nbunny_scene_node_transform_set_previous_scale(nbunny_scene_node_transform* transform, float x, float y, float z)
+{
+	auto& t = get_scene_node_transform(transform);
+	t.previousScale = glm::vec3(x, y, z);
+	nbunny::Recorder::get_instance().set_transform(&t);
+}
+
+void nbunny_scene_node_transform_set_previous_translation(nbunny_scene_node_transform* transform, float x, float y, float z)
+{
+	auto& t = get_scene_node_transform(transform);
+	t.previousTranslation = glm::vec3(x, y, z);
+	nbunny::Recorder::get_instance().set_transform(&t);
+}
+
+void nbunny_scene_node_transform_set_previous_offset(nbunny_scene_node_transform* transform, float x, float y, float z)
+{
+	auto& t = get_scene_node_transform(transform);
+	t.previousOffset = glm::vec3(x, y, z);
+	nbunny::Recorder::get_instance().set_transform(&t);
+}
+
+void nbunny_scene_node_transform_tick(nbunny_scene_node_transform* transform)
+{
+	auto& t = get_scene_node_transform(transform);
+	t.tick();
+	nbunny::Recorder::get_instance().set_transform(&t);
+}
+
+void nbunny_scene_node_transform_get_local_delta_transform(nbunny_scene_node_transform* transform, float delta, float* matrix)
+{
+	copy_matrix(get_scene_node_transform(transform).get_local(delta), matrix);
+}
+
+void nbunny_scene_node_transform_get_global_delta_transform(nbunny_scene_node_transform* transform, float delta, float* matrix)
+{
+	copy_matrix(get_scene_node_transform(transform).get_global(delta), matrix);
+}
+
+void nbunny_scene_node_transform_apply(const nbunny_scene_node_transform_update* updates, int count)
+{
+	auto& recorder = nbunny::Recorder::get_instance();
+
+	for (int i = 0; i < count; ++i)
+	{
+		auto& update = updates[i];
+		auto& transform = get_scene_node_transform(update.transform);
+		auto fields = update.fields;
+
+		if (fields & NBUNNY_SCENE_NODE_TRANSFORM_TICK)
+		{
+			transform.tick();
+		}
+
+		if (fields & NBUNNY_SCENE_NODE_TRANSFORM_PREVIOUS_ROTATION)
+		{
+			auto r = update.previous_rotation;
+			transform.previousRotation = glm::quat(r[3], r[0], r[1], r[2]);
+		}
+
+		if (fields & NBUNNY_SCENE_NODE_TRANSFORM_PREVIOUS_SCALE)
+		{
+			transform.previousScale = glm::make_vec3(update.previous_scale);
+		}
+
+		if (fields & NBUNNY_SCENE_NODE_TRANSFORM_PREVIOUS_TRANSLATION)
+		{
+			transform.previousTranslation = glm::make_vec3(update.previous_translation);
+		}
+
+		if (fields & NBUNNY_SCENE_NODE_TRANSFORM_PREVIOUS_OFFSET)
+		{
+			transform.previousOffset = glm::make_vec3(update.previous_offset);
+		}
+
+		if (fields & NBUNNY_SCENE_NODE_TRANSFORM_CURRENT_ROTATION)
+		{
+			auto r = update.current_rotation;
+			transform.currentRotation = glm::quat(r[3], r[0], r[1], r[2]);
+		}
+
+		if (fields & NBUNNY_SCENE_NODE_TRANSFORM_CURRENT_SCALE)
+		{
+			transform.currentScale = glm::make_vec3(update.current_scale);
+		}
+
+		if (fields & NBUNNY_SCENE_NODE_TRANSFORM_CURRENT_TRANSLATION)
+		{
+			transform.currentTranslation = glm::make_vec3(update.current_translation);
+		}
+
+		if (fields & NBUNNY_SCENE_NODE_TRANSFORM_CURRENT_OFFSET)
+		{
+			transform.currentOffset = glm::make_vec3(update.current_offset);
+		}
+
+		recorder.set_transform(&transform);
+	}
+}
+
+void nbunny_camera_set_view(nbunny_camera* camera, const float* matrix)
+{
+	auto& c = get_camera(camera);
+	set_matrix(c.view, matrix);
+	c.is_dirty = true;
+}
+
+void nbunny_camera_set_projection(nbunny_camera* camera, const float* matrix)
+{
+	auto& c = get_camera(camera);
+	set_matrix(c.projection, matrix);
+	c.is_dirty = true;
+}
+
+void nbunny_keyframe_set_time(nbunny_keyframe* keyframe, float time)
+{
+	get_keyframe(keyframe).time = time;
+}
+
+void nbunny_keyframe_set_rotation(nbunny_keyframe* keyframe, float x, float y, float z, float w)
+{
+	get_keyframe(keyframe).rotation = glm::quat(w, x, y, z);
+}
+
+void nbunny_keyframe_set_scale(nbunny_keyframe* keyframe, float x, float y, float z)
+{
+	get_keyframe(keyframe).scale = glm::vec3(x, y, z);
+}
+
+void nbunny_keyframe_set_translation(nbunny_keyframe* keyframe, float x, float y, float z)
+{
+	get_keyframe(keyframe).translation = glm::vec3(x, y, z);
+}
+
+void nbunny_keyframe_interpolate(const nbunny_keyframe* self, const nbunny_keyframe* other, float time, float* matrix)
+{
+	auto& a = get_keyframe(self);
+	auto& b = get_keyframe(other);
+	copy_matrix(nbunny::KeyFrame::interpolate(a, b, time), matrix);
+	nbunny::Recorder::get_instance().interpolate(a, b, time);
+}
+
+void nbunny_profiler_begin_scope(unsigned int name)
+{
+	nbunny::Profiler::get_instance().begin_scope(name);
+}
+
+void nbunny_profiler_end_scope(void)
+{
+	nbunny::Profiler::get_instance().end_scope();
+}
+
+static const nbunny_ffi_api nbunny_ffi = {
+	&nbunny_scene_node_set_min,
+	&nbunny_scene_node_set_max,
+	&nbunny_scene_node_get_transform_pointer,
+
+	&nbunny_scene_node_transform_set_current_rotation,
+	&nbunny_scene_node_transform_set_current_scale,
+	&nbunny_scene_node_transform_set_current_translation,
+	&nbunny_scene_node_transform_set_current_offset,
+	&nbunny_scene_node_transform_set_previous_rotation,
+	&nbunny_scene_node_transform_set_previous_scale,
+	&nbunny_scene_node_transform_set_previous_translation,
+	&nbunny_scene_node_transform_set_previous_offset,
+	&nbunny_scene_node_transform_tick,
+	&nbunny_scene_node_transform_get_local_delta_transform,
+	&nbunny_scene_node_transform_get_global_delta_transform,
+	&nbunny_scene_node_transform_apply,
+
+	&nbunny_camera_set_view,
+	&nbunny_camera_set_projection,
+
+	&nbunny_keyframe_set_time,
+	&nbunny_keyframe_set_rotation,
+	&nbunny_keyframe_set_scale,
+	&nbunny_keyframe_set_translation,
+	&nbunny_keyframe_interpolate,
+
+	&nbunny_profiler_begin_scope,
+	&nbunny_profiler_end_scope
+};
+
+#define NBUNNY_FFI_STRINGIFY(...) #__VA_ARGS__
+
+static const char* nbunny_ffi_cdef = NBUNNY_FFI_CDEF(NBUNNY_FFI_STRINGIFY);
+
+// Declares the API with the FFI and returns the table of functions as a
+// 'const nbunny_ffi_api*'.
+//
+// The functions are reached through the table rather than ffi.C or ffi.load
+// because the module is loaded by the Lua loader, which doesn't expose its
+// symbols globally on every platform.
+extern "C"
+NBUNNY_EXPORT int luaopen_nbunny_ffi(lua_State* L)
+{
+	lua_getglobal(L, "require");
+	lua_pushstring(L, "ffi");
+	lua_call(L, 1, 1);
+
+	int ffi = lua_gettop(L);
+
+	lua_getfield(L, ffi, "cdef");
+	lua_pushstring(L, nbunny_ffi_cdef);
+	lua_call(L, 1, 0);
+
+	lua_getfield(L, ffi, "cast");
+	lua_pushstring(L, "const nbunny_ffi_api*");
+	lua_pushlightuserdata(L, const_cast<nbunny_ffi_api*>(&nbunny_ffi));
+	lua_call(L, 2, 1);
+
+	return 1;
+}
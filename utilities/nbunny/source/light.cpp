@@ -0,0 +1,470 @@
+////////////////////////////////////////////////////////////////////////////////
+// source/light.cpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "nbunny/nbunny.hpp"
+#include "nbunny/light.hpp"
+#include "nbunny/profiler.hpp"
+
+static bool is_sphere_visible(const nbunny::Camera& camera, const glm::vec3& position, float radius)
+{
+	for (int i = 0; i < nbunny::Camera::NUM_PLANES; ++i)
+	{
+		auto plane = camera.planes[i];
+		if (glm::dot(glm::vec3(plane), position) + plane.w < -radius)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void nbunny::LightClusters::build(const std::shared_ptr<SceneNode>& root, const Camera& camera, float delta)
+{
+	begin(camera);
+	collect(root, camera, delta);
+	end(camera);
+}
+
+void nbunny::LightClusters::begin(const Camera& camera)
+{
+	global_lights.clear();
+	local_lights.clear();
+	point_lights.clear();
+	fog.clear();
+	candidates.clear();
+
+	camera.compute_planes();
+	eye = glm::vec3(glm::inverse(camera.view)[3]);
+
+	// A perspective projection has -1 in the last row; glm::perspective and
+	// glm::ortho (and Love's equivalents) map the near and far planes to -1
+	// and 1 in the same way, so they can be solved for here.
+	auto& projection = camera.projection;
+	is_perspective = projection[2][3] != 0.0f;
+	if (is_perspective)
+	{
+		near = projection[3][2] / (projection[2][2] - 1.0f);
+		far = projection[3][2] / (projection[2][2] + 1.0f);
+	}
+	else
+	{
+		near = (projection[3][2] + 1.0f) / projection[2][2];
+		far = (projection[3][2] - 1.0f) / projection[2][2];
+	}
+
+	if (!(far > near) || (is_perspective && !(near > 0.0f)))
+	{
+		near = 0.1f;
+		far = 100.0f;
+	}
+}
+
+void nbunny::LightClusters::add(const std::shared_ptr<SceneNode>& node, const Camera& camera, float delta)
+{
+	if (!node->is_light())
+	{
+		return;
+	}
+
+	if (node->kind == SCENE_NODE_KIND_FOG)
+	{
+		// There's only ever a few, so this keeps them in order as they come.
+		auto i = std::upper_bound(
+			fog.begin(),
+			fog.end(),
+			node,
+			[](const std::shared_ptr<SceneNode>& a, const std::shared_ptr<SceneNode>& b)
+			{
+				return a->light_radius < b->light_radius;
+			}
+		);
+
+		fog.insert(i, node);
+	}
+	else if (node->is_global_light)
+	{
+		global_lights.push_back(node);
+	}
+	else if (node->kind == SCENE_NODE_KIND_POINT_LIGHT)
+	{
+		auto position = glm::vec3(node->transform->get_global(delta) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+		auto radius = node->light_radius;
+
+		if (!camera.enable_cull || is_sphere_visible(camera, position, radius))
+		{
+			PointLight light;
+			light.node = node;
+			light.position = position;
+			light.radius = radius;
+			light.distance = glm::dot(position - eye, position - eye);
+			light.order = (std::uint32_t)candidates.size();
+			candidates.push_back(light);
+		}
+	}
+	else
+	{
+		local_lights.push_back(node);
+	}
+}
+
+void nbunny::LightClusters::end(const Camera& camera)
+{
+	std::sort(
+		candidates.begin(),
+		candidates.end(),
+		[](const PointLight& a, const PointLight& b)
+		{
+			if (a.distance < b.distance)
+			{
+				return true;
+			}
+			else if (b.distance < a.distance)
+			{
+				return false;
+			}
+
+			return a.order < b.order;
+		}
+	);
+
+	if (candidates.size() > (std::size_t)MAX_LIGHTS)
+	{
+		candidates.resize(MAX_LIGHTS);
+	}
+
+	for (auto& candidate: candidates)
+	{
+		point_lights.push_back(candidate.node);
+	}
+
+	bin(camera);
+}
+
+void nbunny::LightClusters::collect(const std::shared_ptr<SceneNode>& node, const Camera& camera, float delta)
+{
+	add(node, camera, delta);
+
+	for (auto& child: node->children)
+	{
+		auto c = child.lock();
+		if (c)
+		{
+			collect(c, camera, delta);
+		}
+	}
+}
+
+int nbunny::LightClusters::get_slice(float depth) const
+{
+	if (depth < near)
+	{
+		return -1;
+	}
+
+	float t;
+	if (is_perspective)
+	{
+		t = std::log(depth / near) / std::log(far / near);
+	}
+	else
+	{
+		t = (depth - near) / (far - near);
+	}
+
+	return std::min((int)(t * DEPTH), DEPTH - 1);
+}
+
+bool nbunny::LightClusters::get_range(const glm::vec3& position, float radius, const Camera& camera, int range[6]) const
+{
+	auto center = glm::vec3(camera.view * glm::vec4(position, 1.0f));
+
+	// The camera looks down -Z.
+	float nearest = -center.z - radius;
+	float farthest = -center.z + radius;
+	if (farthest < near || nearest > far)
+	{
+		return false;
+	}
+
+	// The tiles come from the light's bounding box in view space. Corners
+	// behind the near plane are pulled up to it so they project sensibly;
+	// the box still covers everything in front of the near plane.
+	auto min = glm::vec2(std::numeric_limits<float>::infinity());
+	auto max = glm::vec2(-std::numeric_limits<float>::infinity());
+	for (int i = 0; i < 8; ++i)
+	{
+		auto corner = center + glm::vec3(
+			(i & 1) ? radius : -radius,
+			(i & 2) ? radius : -radius,
+			(i & 4) ? radius : -radius);
+
+		if (is_perspective)
+		{
+			corner.z = std::min(corner.z, -near);
+		}
+
+		auto clip = camera.projection * glm::vec4(corner, 1.0f);
+		auto p = glm::vec2(clip) / clip.w;
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+
+	if (max.x < -1.0f || min.x > 1.0f || max.y < -1.0f || min.y > 1.0f)
+	{
+		return false;
+	}
+
+	auto get_tile = [](float p, int count)
+	{
+		int tile = (int)std::floor((p * 0.5f + 0.5f) * count);
+		return std::max(std::min(tile, count - 1), 0);
+	};
+
+	range[0] = get_tile(min.x, WIDTH);
+	range[1] = get_tile(max.x, WIDTH);
+	range[2] = get_tile(min.y, HEIGHT);
+	range[3] = get_tile(max.y, HEIGHT);
+	range[4] = get_slice(std::max(nearest, near));
+	range[5] = get_slice(std::min(farthest, far));
+
+	return true;
+}
+
+void nbunny::LightClusters::bin(const Camera& camera)
+{
+	NBUNNY_PROFILE_SCOPE("LightClusters.bin");
+
+	ranges.resize(candidates.size() * 6);
+	for (std::size_t i = 0; i < candidates.size(); ++i)
+	{
+		auto range = &ranges[i * 6];
+		if (!get_range(candidates[i].position, candidates[i].radius, camera, range))
+		{
+			// An empty range.
+			std::fill(range, range + 6, 0);
+			range[1] = -1;
+		}
+	}
+
+	// Counts the lights in each cluster, then gives each cluster its slice
+	// of the index list, and then fills the slices in. Lights are visited
+	// nearest first, so the nearest lights are kept if a cluster or the
+	// index list is full.
+	cluster_counts.assign(NUM_CLUSTERS, 0);
+	for (std::size_t i = 0; i < candidates.size(); ++i)
+	{
+		auto range = &ranges[i * 6];
+		for (int z = range[4]; z <= range[5]; ++z)
+		{
+			for (int y = range[2]; y <= range[3]; ++y)
+			{
+				for (int x = range[0]; x <= range[1]; ++x)
+				{
+					auto& count = cluster_counts[x + y * WIDTH + z * WIDTH * HEIGHT];
+					if (count < MAX_CLUSTER_LIGHTS)
+					{
+						++count;
+					}
+				}
+			}
+		}
+	}
+
+	cluster_offsets.resize(NUM_CLUSTERS);
+	std::uint32_t offset = 0;
+	for (int i = 0; i < NUM_CLUSTERS; ++i)
+	{
+		cluster_offsets[i] = offset;
+		cluster_counts[i] = (std::uint16_t)std::min<std::uint32_t>(cluster_counts[i], MAX_INDICES - offset);
+		offset += cluster_counts[i];
+	}
+
+	indices.resize(offset);
+	cluster_cursors.assign(NUM_CLUSTERS, 0);
+	for (std::size_t i = 0; i < candidates.size(); ++i)
+	{
+		auto range = &ranges[i * 6];
+		for (int z = range[4]; z <= range[5]; ++z)
+		{
+			for (int y = range[2]; y <= range[3]; ++y)
+			{
+				for (int x = range[0]; x <= range[1]; ++x)
+				{
+					auto cluster = x + y * WIDTH + z * WIDTH * HEIGHT;
+					auto& cursor = cluster_cursors[cluster];
+					if (cursor < cluster_counts[cluster])
+					{
+						indices[cluster_offsets[cluster] + cursor] = (std::uint16_t)i;
+						++cursor;
+					}
+				}
+			}
+		}
+	}
+}
+
+const std::vector<std::shared_ptr<nbunny::SceneNode>>& nbunny::LightClusters::get_global_lights() const
+{
+	return global_lights;
+}
+
+const std::vector<std::shared_ptr<nbunny::SceneNode>>& nbunny::LightClusters::get_local_lights() const
+{
+	return local_lights;
+}
+
+const std::vector<std::shared_ptr<nbunny::SceneNode>>& nbunny::LightClusters::get_point_lights() const
+{
+	return point_lights;
+}
+
+const std::vector<std::shared_ptr<nbunny::SceneNode>>& nbunny::LightClusters::get_fog() const
+{
+	return fog;
+}
+
+float nbunny::LightClusters::get_near() const
+{
+	return near;
+}
+
+float nbunny::LightClusters::get_far() const
+{
+	return far;
+}
+
+bool nbunny::LightClusters::get_is_perspective() const
+{
+	return is_perspective;
+}
+
+std::size_t nbunny::LightClusters::get_num_indices() const
+{
+	return indices.size();
+}
+
+void nbunny::LightClusters::copy_clusters(float* result) const
+{
+	for (std::size_t i = 0; i < cluster_counts.size(); ++i)
+	{
+		result[i * 2] = (float)cluster_offsets[i];
+		result[i * 2 + 1] = (float)cluster_counts[i];
+	}
+
+	// Nothing has been built yet.
+	if (cluster_counts.empty())
+	{
+		std::fill(result, result + NUM_CLUSTERS * 2, 0.0f);
+	}
+}
+
+void nbunny::LightClusters::copy_indices(float* result) const
+{
+	for (std::size_t i = 0; i < indices.size(); ++i)
+	{
+		result[i] = (float)indices[i];
+	}
+
+	std::fill(result + indices.size(), result + MAX_INDICES, 0.0f);
+}
+
+#ifndef NBUNNY_NO_LUA
+
+// The pointer is from Data.getPointer (e.g., an ImageData in the rg32f
+// format, NUM_CLUSTERS wide and DEPTH tall).
+static int nbunny_light_clusters_copy_clusters(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::LightClusters>(L, 1);
+	auto result = (float*)lua_touserdata(L, 2);
+	if (!result)
+	{
+		return luaL_argerror(L, 2, "expected pointer");
+	}
+
+	self.copy_clusters(result);
+	return 0;
+}
+
+// Like copyClusters, but r32f and INDEX_TEXTURE_WIDTH by
+// INDEX_TEXTURE_HEIGHT.
+static int nbunny_light_clusters_copy_indices(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::LightClusters>(L, 1);
+	auto result = (float*)lua_touserdata(L, 2);
+	if (!result)
+	{
+		return luaL_argerror(L, 2, "expected pointer");
+	}
+
+	self.copy_indices(result);
+	return 0;
+}
+
+static int nbunny_light_clusters_get_near_far(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::LightClusters>(L, 1);
+	lua_pushnumber(L, self.get_near());
+	lua_pushnumber(L, self.get_far());
+	lua_pushboolean(L, self.get_is_perspective());
+	return 3;
+}
+
+static int nbunny_light_clusters_get_num_indices(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::LightClusters>(L, 1);
+	lua_pushinteger(L, (lua_Integer)self.get_num_indices());
+	return 1;
+}
+
+static int nbunny_light_clusters_get_size(lua_State* L)
+{
+	lua_pushinteger(L, nbunny::LightClusters::WIDTH);
+	lua_pushinteger(L, nbunny::LightClusters::HEIGHT);
+	lua_pushinteger(L, nbunny::LightClusters::DEPTH);
+	return 3;
+}
+
+static int nbunny_light_clusters_get_index_texture_size(lua_State* L)
+{
+	lua_pushinteger(L, nbunny::LightClusters::INDEX_TEXTURE_WIDTH);
+	lua_pushinteger(L, nbunny::LightClusters::INDEX_TEXTURE_HEIGHT);
+	return 2;
+}
+
+static int nbunny_light_clusters_get_max_lights(lua_State* L)
+{
+	lua_pushinteger(L, nbunny::LightClusters::MAX_LIGHTS);
+	lua_pushinteger(L, nbunny::LightClusters::MAX_CLUSTER_LIGHTS);
+	return 2;
+}
+
+extern "C"
+NBUNNY_EXPORT int luaopen_nbunny_lightclusters(lua_State* L)
+{
+	sol::usertype<nbunny::LightClusters> T(
+		sol::call_constructor, sol::constructors<nbunny::LightClusters()>(),
+		"copyClusters", &nbunny_light_clusters_copy_clusters,
+		"copyIndices", &nbunny_light_clusters_copy_indices,
+		"getNearFar", &nbunny_light_clusters_get_near_far,
+		"getNumIndices", &nbunny_light_clusters_get_num_indices,
+		"getSize", &nbunny_light_clusters_get_size,
+		"getIndexTextureSize", &nbunny_light_clusters_get_index_texture_size,
+		"getMaxLights", &nbunny_light_clusters_get_max_lights);
+
+	sol::stack::push(L, T);
+
+	return 1;
+}
+
+#endif
@@ -0,0 +1,551 @@
+////////////////////////////////////////////////////////////////////////////////
+// source/map.cpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include "nbunny/nbunny.hpp"
+#include "nbunny/map.hpp"
+#include "nbunny/profiler.hpp"
+
+void nbunny::MapChunks::resize(int width, int height, int chunk_size)
+{
+	this->width = std::max(width, 0);
+	this->height = std::max(height, 0);
+	this->chunk_size = std::max(chunk_size, 1);
+
+	num_chunks_width = (this->width + this->chunk_size - 1) / this->chunk_size;
+	num_chunks_height = (this->height + this->chunk_size - 1) / this->chunk_size;
+
+	tiles.assign(this->width * this->height * MAP_TILE_NUM_FIELDS, 0.0f);
+	previous_tiles = tiles;
+
+	chunks.clear();
+	chunks.resize(num_chunks_width * num_chunks_height);
+}
+
+int nbunny::MapChunks::get_width() const
+{
+	return width;
+}
+
+int nbunny::MapChunks::get_height() const
+{
+	return height;
+}
+
+int nbunny::MapChunks::get_chunk_size() const
+{
+	return chunk_size;
+}
+
+int nbunny::MapChunks::get_num_chunks_width() const
+{
+	return num_chunks_width;
+}
+
+int nbunny::MapChunks::get_num_chunks_height() const
+{
+	return num_chunks_height;
+}
+
+float nbunny::MapChunks::get_cell_size() const
+{
+	return cell_size;
+}
+
+void nbunny::MapChunks::set_cell_size(float value)
+{
+	if (cell_size == value)
+	{
+		return;
+	}
+
+	cell_size = value;
+	for (auto& chunk: chunks)
+	{
+		chunk.is_dirty = true;
+	}
+}
+
+float nbunny::MapChunks::get_skirt_depth() const
+{
+	return skirt_depth;
+}
+
+void nbunny::MapChunks::set_skirt_depth(float value)
+{
+	if (skirt_depth == value)
+	{
+		return;
+	}
+
+	skirt_depth = value;
+	for (auto& chunk: chunks)
+	{
+		chunk.is_dirty = true;
+	}
+}
+
+void nbunny::MapChunks::enable_lod(float distance)
+{
+	is_lod_enabled = true;
+	lod_distance = std::max(distance, 1.0f);
+}
+
+void nbunny::MapChunks::disable_lod()
+{
+	is_lod_enabled = false;
+}
+
+bool nbunny::MapChunks::get_is_lod_enabled() const
+{
+	return is_lod_enabled;
+}
+
+void nbunny::MapChunks::set_focus(float x, float z)
+{
+	focus = glm::vec2(x, z);
+}
+
+float* nbunny::MapChunks::get_tiles()
+{
+	return tiles.data();
+}
+
+void nbunny::MapChunks::invalidate_tiles()
+{
+	is_tiles_dirty = true;
+}
+
+const nbunny::MapChunks::Chunk* nbunny::MapChunks::get_chunk(int i, int j) const
+{
+	if (i < 0 || i >= num_chunks_width || j < 0 || j >= num_chunks_height)
+	{
+		return nullptr;
+	}
+
+	return &chunks[j * num_chunks_width + i];
+}
+
+// The edges of a tile depend on its neighbors, so a tile on the side of a
+// chunk changes the chunk next to it too.
+void nbunny::MapChunks::invalidate(int tile_i, int tile_j)
+{
+	int min_i = std::max(tile_i - 1, 0) / chunk_size;
+	int max_i = std::min(tile_i + 1, width - 1) / chunk_size;
+	int min_j = std::max(tile_j - 1, 0) / chunk_size;
+	int max_j = std::min(tile_j + 1, height - 1) / chunk_size;
+
+	for (int j = min_j; j <= max_j; ++j)
+	{
+		for (int i = min_i; i <= max_i; ++i)
+		{
+			chunks[j * num_chunks_width + i].is_dirty = true;
+		}
+	}
+}
+
+int nbunny::MapChunks::get_level(int i, int j) const
+{
+	if (!is_lod_enabled)
+	{
+		return 0;
+	}
+
+	auto min = glm::vec2(i * chunk_size, j * chunk_size) * cell_size;
+	auto max = glm::vec2(std::min((i + 1) * chunk_size, width), std::min((j + 1) * chunk_size, height)) * cell_size;
+	auto distance = glm::length(glm::clamp(focus, min, max) - focus);
+
+	return std::min((int)(distance / lod_distance), (int)MAX_LEVEL);
+}
+
+// Corners are shared by up to four tiles; the heights are averaged, so
+// chunks at the same level always meet.
+float nbunny::MapChunks::get_corner_height(int x, int z) const
+{
+	static const struct
+	{
+		int i, j;
+		int field;
+	} CORNERS[] = {
+		{ -1, -1, MAP_TILE_BOTTOM_RIGHT },
+		{  0, -1, MAP_TILE_BOTTOM_LEFT },
+		{ -1,  0, MAP_TILE_TOP_RIGHT },
+		{  0,  0, MAP_TILE_TOP_LEFT }
+	};
+
+	float sum = 0.0f;
+	int count = 0;
+	for (auto& corner: CORNERS)
+	{
+		int i = x + corner.i;
+		int j = z + corner.j;
+		if (i >= 0 && i < width && j >= 0 && j < height)
+		{
+			sum += tiles[(j * width + i) * MAP_TILE_NUM_FIELDS + corner.field];
+			++count;
+		}
+	}
+
+	return count > 0 ? sum / count : 0.0f;
+}
+
+void nbunny::MapChunks::build(int i, int j)
+{
+	auto& chunk = chunks[j * num_chunks_width + i];
+
+	int left = i * chunk_size;
+	int top = j * chunk_size;
+	int chunk_width = std::min(chunk_size, width - left);
+	int chunk_height = std::min(chunk_size, height - top);
+
+	for (int level = 1; level <= MAX_LEVEL; ++level)
+	{
+		int step = 1 << level;
+		auto& vertices = chunk.vertices[level - 1];
+		vertices.clear();
+
+		auto& min = chunk.min[level - 1];
+		auto& max = chunk.max[level - 1];
+		min = glm::vec3(std::numeric_limits<float>::infinity());
+		max = glm::vec3(-std::numeric_limits<float>::infinity());
+
+		const float* tile;
+		auto add_vertex = [&](const glm::vec3& position, const glm::vec3& normal, float s, float t)
+		{
+			float vertex[FLOATS_PER_VERTEX] = {
+				position.x, position.y, position.z,
+				normal.x, normal.y, normal.z,
+				s, t,
+				tile[MAP_TILE_TEXTURE_LEFT], tile[MAP_TILE_TEXTURE_RIGHT],
+				tile[MAP_TILE_TEXTURE_TOP], tile[MAP_TILE_TEXTURE_BOTTOM],
+				tile[MAP_TILE_RED], tile[MAP_TILE_GREEN], tile[MAP_TILE_BLUE], 1.0f
+			};
+
+			vertices.insert(vertices.end(), vertex, vertex + FLOATS_PER_VERTEX);
+			min = glm::min(min, position);
+			max = glm::max(max, position);
+		};
+
+		// Skirts are seen from both sides, since the chunk next to it may
+		// be above or below.
+		auto add_skirt = [&](const glm::vec3& a, const glm::vec3& b, const glm::vec3& normal, float length)
+		{
+			auto c = a - glm::vec3(0.0f, skirt_depth, 0.0f);
+			auto d = b - glm::vec3(0.0f, skirt_depth, 0.0f);
+
+			add_vertex(a, normal, 0.0f, 0.0f);
+			add_vertex(b, normal, length, 0.0f);
+			add_vertex(d, normal, length, 1.0f);
+			add_vertex(d, normal, length, 1.0f);
+			add_vertex(c, normal, 0.0f, 1.0f);
+			add_vertex(a, normal, 0.0f, 0.0f);
+
+			add_vertex(a, -normal, 0.0f, 0.0f);
+			add_vertex(d, -normal, length, 1.0f);
+			add_vertex(b, -normal, length, 0.0f);
+			add_vertex(d, -normal, length, 1.0f);
+			add_vertex(a, -normal, 0.0f, 0.0f);
+			add_vertex(c, -normal, 0.0f, 1.0f);
+		};
+
+		for (int z = 0; z < chunk_height; z += step)
+		{
+			int top_z = top + z;
+			int bottom_z = top + std::min(z + step, chunk_height);
+
+			for (int x = 0; x < chunk_width; x += step)
+			{
+				int left_x = left + x;
+				int right_x = left + std::min(x + step, chunk_width);
+
+				// The flat of the tile in the middle covers the whole quad.
+				int tile_i = (left_x + right_x) / 2;
+				int tile_j = (top_z + bottom_z) / 2;
+				tile = &tiles[(tile_j * width + tile_i) * MAP_TILE_NUM_FIELDS];
+
+				auto top_left = glm::vec3(left_x * cell_size, get_corner_height(left_x, top_z), top_z * cell_size);
+				auto top_right = glm::vec3(right_x * cell_size, get_corner_height(right_x, top_z), top_z * cell_size);
+				auto bottom_left = glm::vec3(left_x * cell_size, get_corner_height(left_x, bottom_z), bottom_z * cell_size);
+				auto bottom_right = glm::vec3(right_x * cell_size, get_corner_height(right_x, bottom_z), bottom_z * cell_size);
+
+				// Like MapMesh, the flat's texture is flipped along s and
+				// repeats once per tile.
+				float s = (float)(right_x - left_x);
+				float t = (float)(bottom_z - top_z);
+
+				auto normal1 = glm::normalize(glm::cross(top_left - top_right, bottom_right - top_left));
+				add_vertex(top_left, normal1, s, 0.0f);
+				add_vertex(bottom_right, normal1, 0.0f, t);
+				add_vertex(top_right, normal1, 0.0f, 0.0f);
+
+				auto normal2 = glm::normalize(glm::cross(top_left - bottom_right, bottom_left - top_left));
+				add_vertex(bottom_right, normal2, 0.0f, t);
+				add_vertex(top_left, normal2, s, 0.0f);
+				add_vertex(bottom_left, normal2, s, t);
+
+				if (z == 0)
+				{
+					add_skirt(top_left, top_right, glm::vec3(0.0f, 0.0f, -1.0f), s);
+				}
+
+				if (bottom_z == top + chunk_height)
+				{
+					add_skirt(bottom_right, bottom_left, glm::vec3(0.0f, 0.0f, 1.0f), s);
+				}
+
+				if (x == 0)
+				{
+					add_skirt(bottom_left, top_left, glm::vec3(-1.0f, 0.0f, 0.0f), t);
+				}
+
+				if (right_x == left + chunk_width)
+				{
+					add_skirt(top_right, bottom_right, glm::vec3(1.0f, 0.0f, 0.0f), t);
+				}
+			}
+		}
+	}
+}
+
+const std::vector<nbunny::MapChunks::Change>& nbunny::MapChunks::update()
+{
+	NBUNNY_PROFILE_SCOPE("MapChunks.update");
+
+	changes.clear();
+
+	// Usually only a few tiles changed, so whole rows are compared before
+	// tiles.
+	std::size_t row_size = width * MAP_TILE_NUM_FIELDS;
+	if (is_tiles_dirty)
+	{
+		is_tiles_dirty = false;
+
+		for (int j = 0; j < height; ++j)
+		{
+			std::size_t row = j * row_size;
+			if (std::memcmp(&tiles[row], &previous_tiles[row], sizeof(float) * row_size) == 0)
+			{
+				continue;
+			}
+
+			for (int i = 0; i < width; ++i)
+			{
+				std::size_t index = row + i * MAP_TILE_NUM_FIELDS;
+				if (std::memcmp(&tiles[index], &previous_tiles[index], sizeof(float) * MAP_TILE_NUM_FIELDS) != 0)
+				{
+					invalidate(i, j);
+				}
+			}
+
+			std::memcpy(&previous_tiles[row], &tiles[row], sizeof(float) * row_size);
+		}
+	}
+
+	for (int j = 0; j < num_chunks_height; ++j)
+	{
+		for (int i = 0; i < num_chunks_width; ++i)
+		{
+			auto& chunk = chunks[j * num_chunks_width + i];
+			int level = get_level(i, j);
+
+			bool is_rebuilt = chunk.is_dirty;
+			if (is_rebuilt)
+			{
+				build(i, j);
+				chunk.is_dirty = false;
+			}
+
+			if (is_rebuilt || chunk.level != level)
+			{
+				chunk.level = level;
+				changes.push_back({ i, j, level, is_rebuilt });
+			}
+		}
+	}
+
+	return changes;
+}
+
+const float* nbunny::MapChunks::get_vertices(int i, int j, int level) const
+{
+	auto chunk = get_chunk(i, j);
+	if (!chunk || level < 1 || level > MAX_LEVEL)
+	{
+		return nullptr;
+	}
+
+	return chunk->vertices[level - 1].data();
+}
+
+std::size_t nbunny::MapChunks::get_vertex_count(int i, int j, int level) const
+{
+	auto chunk = get_chunk(i, j);
+	if (!chunk || level < 1 || level > MAX_LEVEL)
+	{
+		return 0;
+	}
+
+	return chunk->vertices[level - 1].size() / FLOATS_PER_VERTEX;
+}
+
+void nbunny::MapChunks::get_bounds(int i, int j, int level, glm::vec3& min, glm::vec3& max) const
+{
+	auto chunk = get_chunk(i, j);
+	if (!chunk || level < 1 || level > MAX_LEVEL)
+	{
+		min = glm::vec3(0.0f);
+		max = glm::vec3(0.0f);
+		return;
+	}
+
+	min = chunk->min[level - 1];
+	max = chunk->max[level - 1];
+}
+
+#ifndef NBUNNY_NO_LUA
+
+static int nbunny_map_chunks_resize(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::MapChunks>(L, 1);
+	self.resize(
+		(int)luaL_checkinteger(L, 2),
+		(int)luaL_checkinteger(L, 3),
+		(int)luaL_checkinteger(L, 4));
+	return 0;
+}
+
+static int nbunny_map_chunks_get_size(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::MapChunks>(L, 1);
+	lua_pushinteger(L, self.get_width());
+	lua_pushinteger(L, self.get_height());
+	return 2;
+}
+
+static int nbunny_map_chunks_get_num_chunks(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::MapChunks>(L, 1);
+	lua_pushinteger(L, self.get_num_chunks_width());
+	lua_pushinteger(L, self.get_num_chunks_height());
+	return 2;
+}
+
+static int nbunny_map_chunks_get_tiles_pointer(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::MapChunks>(L, 1);
+	lua_pushlightuserdata(L, self.get_tiles());
+	return 1;
+}
+
+// Returns the chunks that changed as a table of { i, j, level, isRebuilt }
+// tables, or nil if none did. Chunks are 1-based, like tiles.
+static int nbunny_map_chunks_update(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::MapChunks>(L, 1);
+	auto& changes = self.update();
+	if (changes.empty())
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+
+	lua_createtable(L, (int)changes.size(), 0);
+	for (std::size_t i = 0; i < changes.size(); ++i)
+	{
+		auto& change = changes[i];
+
+		lua_createtable(L, 4, 0);
+		lua_pushinteger(L, change.i + 1);
+		lua_rawseti(L, -2, 1);
+		lua_pushinteger(L, change.j + 1);
+		lua_rawseti(L, -2, 2);
+		lua_pushinteger(L, change.level);
+		lua_rawseti(L, -2, 3);
+		lua_pushboolean(L, change.is_rebuilt);
+		lua_rawseti(L, -2, 4);
+
+		lua_rawseti(L, -2, (int)i + 1);
+	}
+
+	return 1;
+}
+
+// Arguments are the chunk (1-based) and level. Returns the pointer and
+// number of vertices, or nil if the chunk has no vertices at the level.
+static int nbunny_map_chunks_get_vertices(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::MapChunks>(L, 1);
+	int i = (int)luaL_checkinteger(L, 2) - 1;
+	int j = (int)luaL_checkinteger(L, 3) - 1;
+	int level = (int)luaL_checkinteger(L, 4);
+
+	auto vertices = self.get_vertices(i, j, level);
+	auto count = self.get_vertex_count(i, j, level);
+	if (!vertices || count == 0)
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+
+	lua_pushlightuserdata(L, const_cast<float*>(vertices));
+	lua_pushinteger(L, (lua_Integer)count);
+	return 2;
+}
+
+static int nbunny_map_chunks_get_bounds(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::MapChunks>(L, 1);
+	int i = (int)luaL_checkinteger(L, 2) - 1;
+	int j = (int)luaL_checkinteger(L, 3) - 1;
+	int level = (int)luaL_checkinteger(L, 4);
+
+	glm::vec3 min, max;
+	self.get_bounds(i, j, level, min, max);
+
+	lua_pushnumber(L, min.x);
+	lua_pushnumber(L, min.y);
+	lua_pushnumber(L, min.z);
+	lua_pushnumber(L, max.x);
+	lua_pushnumber(L, max.y);
+	lua_pushnumber(L, max.z);
+	return 6;
+}
+
+extern "C"
+NBUNNY_EXPORT int luaopen_nbunny_mapchunks(lua_State* L)
+{
+	sol::usertype<nbunny::MapChunks> T(
+		sol::call_constructor, sol::constructors<nbunny::MapChunks()>(),
+		"resize", &nbunny_map_chunks_resize,
+		"getSize", &nbunny_map_chunks_get_size,
+		"getChunkSize", &nbunny::MapChunks::get_chunk_size,
+		"getNumChunks", &nbunny_map_chunks_get_num_chunks,
+		"getCellSize", &nbunny::MapChunks::get_cell_size,
+		"setCellSize", &nbunny::MapChunks::set_cell_size,
+		"getSkirtDepth", &nbunny::MapChunks::get_skirt_depth,
+		"setSkirtDepth", &nbunny::MapChunks::set_skirt_depth,
+		"enableLOD", &nbunny::MapChunks::enable_lod,
+		"disableLOD", &nbunny::MapChunks::disable_lod,
+		"getIsLODEnabled", &nbunny::MapChunks::get_is_lod_enabled,
+		"setFocus", &nbunny::MapChunks::set_focus,
+		"getTilesPointer", &nbunny_map_chunks_get_tiles_pointer,
+		"invalidateTiles", &nbunny::MapChunks::invalidate_tiles,
+		"update", &nbunny_map_chunks_update,
+		"getVertices", &nbunny_map_chunks_get_vertices,
+		"getBounds", &nbunny_map_chunks_get_bounds);
+
+	sol::stack::push(L, T);
+
+	return 1;
+}
+
+#endif
@@ -0,0 +1,771 @@
+////////////////////////////////////////////////////////////////////////////////
+// source/movement.cpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include "nbunny/nbunny.hpp"
+#include "nbunny/movement.hpp"
+#include "nbunny/profiler.hpp"
+
+bool nbunny::MovementMap::Tile::is_passable(int impassable_flags) const
+{
+	return (flags & impassable_flags) == 0;
+}
+
+double nbunny::MovementMap::Tile::get_height() const
+{
+	double min = std::min(std::min(top_left, top_right), std::min(bottom_left, bottom_right));
+	double max = std::max(std::max(top_left, top_right), std::max(bottom_left, bottom_right));
+
+	return (max - min) / 2.0 + min;
+}
+
+nbunny::MovementMap::MovementMap(int width, int height, double cell_size) :
+	width(std::max(width, 1)),
+	height(std::max(height, 1)),
+	cell_size(std::max(cell_size, 1.0)),
+	tiles(std::max(width, 1) * std::max(height, 1))
+{
+	// Nothing.
+}
+
+int nbunny::MovementMap::get_width() const
+{
+	return width;
+}
+
+int nbunny::MovementMap::get_height() const
+{
+	return height;
+}
+
+nbunny::MovementMap::Tile& nbunny::MovementMap::get_tile(int i, int j)
+{
+	i = std::min(std::max(i, 1), width);
+	j = std::min(std::max(j, 1), height);
+
+	return tiles[(j - 1) * width + (i - 1)];
+}
+
+const nbunny::MovementMap::Tile& nbunny::MovementMap::get_tile(int i, int j) const
+{
+	i = std::min(std::max(i, 1), width);
+	j = std::min(std::max(j, 1), height);
+
+	return tiles[(j - 1) * width + (i - 1)];
+}
+
+const nbunny::MovementMap::Tile& nbunny::MovementMap::get_tile_at(double x, double z, int& i, int& j) const
+{
+	i = (int)std::floor(x / cell_size) + 1;
+	j = (int)std::floor(z / cell_size) + 1;
+	i = std::min(std::max(i, 1), width);
+	j = std::min(std::max(j, 1), height);
+
+	return tiles[(j - 1) * width + (i - 1)];
+}
+
+double nbunny::MovementMap::get_interpolated_height(double x, double z) const
+{
+	int i, j;
+	return get_tile_at(x, z, i, j).get_height();
+}
+
+bool nbunny::MovementMap::is_out_of_bounds(double x, double z) const
+{
+	int i = (int)std::floor(x / cell_size) + 1;
+	int j = (int)std::floor(z / cell_size) + 1;
+
+	return i < 1 || i > width || j < 1 || j > height;
+}
+
+// This matches Map.canMove exactly, quirks and all, so native and Lua movement
+// agree.
+bool nbunny::MovementMap::can_move(int i, int j, int di, int dj) const
+{
+	if (std::abs(di) > 1 || std::abs(dj) > 1)
+	{
+		return false;
+	}
+
+	if (di == 0 && dj == 0)
+	{
+		return true;
+	}
+
+	auto& tile = get_tile(i, j);
+
+	bool is_left_passable = false, is_right_passable = false;
+	bool is_top_passable = false, is_bottom_passable = false;
+	if (di < 0 && i > 1)
+	{
+		auto& left = get_tile(i - 1, j);
+		if ((left.top_right <= tile.top_left || left.bottom_right <= tile.bottom_left) &&
+			left.is_passable())
+		{
+			is_left_passable = true;
+		}
+	}
+
+	if (di > 0 && i < width)
+	{
+		auto& right = get_tile(i + 1, j);
+		if ((right.top_left <= tile.top_right || right.bottom_left <= tile.bottom_right) &&
+			right.is_passable())
+		{
+			is_right_passable = true;
+		}
+	}
+
+	if (dj < 0 && j > 1)
+	{
+		auto& top = get_tile(i, j - 1);
+		if ((top.bottom_left <= tile.top_left || top.bottom_right <= tile.top_right) &&
+			top.is_passable())
+		{
+			is_top_passable = true;
+		}
+	}
+
+	if (dj > 0 && j < height)
+	{
+		auto& bottom = get_tile(i, j + 1);
+		if ((bottom.top_left <= tile.bottom_left || bottom.top_right <= tile.bottom_right) &&
+			bottom.is_passable())
+		{
+			is_bottom_passable = true;
+		}
+	}
+
+	if (std::abs(di) + std::abs(dj) > 1)
+	{
+		if (di < 0 && dj < 0 && i > 1 && j > 1)
+		{
+			auto& top_left = get_tile(i - 1, j - 1);
+			if (top_left.bottom_right <= tile.top_left && !top_left.is_passable(FLAG_IMPASSABLE))
+			{
+				return is_top_passable && is_left_passable;
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		if (di < 0 && dj > 1 && i > 1 && j < height)
+		{
+			auto& bottom_left = get_tile(i - 1, j + 1);
+			if (bottom_left.top_right <= tile.bottom_left && !bottom_left.is_passable(FLAG_IMPASSABLE))
+			{
+				return is_bottom_passable && is_left_passable;
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		if (di > 0 && dj < 0 && i < width && j > 1)
+		{
+			auto& top_right = get_tile(i + 1, j - 1);
+			if (top_right.bottom_left <= tile.top_right && !top_right.is_passable(FLAG_IMPASSABLE))
+			{
+				return is_top_passable && is_right_passable;
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		if (di > 0 && dj > 0 && i < width && j < height)
+		{
+			auto& bottom_right = get_tile(i + 1, j + 1);
+			if (bottom_right.top_left <= tile.bottom_right && !bottom_right.is_passable(FLAG_IMPASSABLE))
+			{
+				return is_bottom_passable && is_right_passable;
+			}
+			else
+			{
+				return false;
+			}
+		}
+	}
+
+	return is_left_passable || is_right_passable || is_top_passable || is_bottom_passable;
+}
+
+void nbunny::MovementMap::snap_to_tile(double new_x, double new_z, double old_x, double old_z, double& reflection_x, double& reflection_z) const
+{
+	int new_i, new_j, old_i, old_j;
+	get_tile_at(new_x, new_z, new_i, new_j);
+	get_tile_at(old_x, old_z, old_i, old_j);
+
+	int difference_i = new_i - old_i;
+	int difference_j = new_j - old_j;
+
+	double reflection_x1 = 0.0, reflection_z1 = 0.0;
+	double reflection_x2 = 0.0, reflection_z2 = 0.0;
+	if (difference_i != 0 && difference_j != 0)
+	{
+		auto& tile1 = get_tile(old_i + difference_i, old_j);
+		auto& tile2 = get_tile(old_i, old_j + difference_j);
+		auto& tile3 = get_tile(old_i + difference_i, old_j + difference_j);
+		bool tile1_impassable = !tile1.is_passable() || !can_move(old_i, old_j, difference_i, 0);
+		bool tile2_impassable = !tile2.is_passable() || !can_move(old_i, old_j, 0, difference_j);
+		bool tile3_impassable = !tile3.is_passable() || can_move(old_i, old_j, difference_i, difference_j);
+
+		bool are_adjacent_tiles_impassable = tile1_impassable && tile2_impassable;
+		bool are_adjacent_tiles_passable = !tile1_impassable && !tile2_impassable;
+		bool is_corner_impassable = are_adjacent_tiles_passable && tile3_impassable;
+
+		if (are_adjacent_tiles_impassable || is_corner_impassable)
+		{
+			reflection_x = old_x - new_x;
+			reflection_z = old_z - new_z;
+			return;
+		}
+
+		if (tile1_impassable)
+		{
+			do_snap_to_tile(old_i + difference_i, old_j, new_x, new_z, old_x, old_z, reflection_x1, reflection_z1);
+		}
+
+		if (tile2_impassable)
+		{
+			do_snap_to_tile(old_i, old_j + difference_j, new_x, new_z, old_x, old_z, reflection_x2, reflection_z2);
+		}
+	}
+	else
+	{
+		do_snap_to_tile(new_i, new_j, new_x, new_z, old_x, old_z, reflection_x1, reflection_z1);
+	}
+
+	reflection_x = reflection_x1 + reflection_x2;
+	reflection_z = reflection_z1 + reflection_z2;
+}
+
+void nbunny::MovementMap::do_snap_to_tile(int i, int j, double new_x, double new_z, double old_x, double old_z, double& reflection_x, double& reflection_z) const
+{
+	double center_x = (i - 0.5) * cell_size;
+	double center_z = (j - 0.5) * cell_size;
+	double min_x = center_x - cell_size / 2.0;
+	double min_z = center_z - cell_size / 2.0;
+	double max_x = center_x + cell_size / 2.0;
+	double max_z = center_z + cell_size / 2.0;
+
+	if (old_x > min_x && old_x < max_x && old_z > min_z && old_z < max_z)
+	{
+		reflection_x = 0.0;
+		reflection_z = 0.0;
+		return;
+	}
+
+	double normal_x = 0.0, normal_z = 0.0;
+	if (old_x < min_x && old_z > min_z && old_z < max_z)
+	{
+		normal_x = -1.0;
+	}
+	else if (old_x > max_x && old_z > min_z && old_z < max_z)
+	{
+		normal_x = 1.0;
+	}
+	else if (old_z < min_z && old_x > min_x && old_x < max_x)
+	{
+		normal_z = -1.0;
+	}
+	else if (old_z > max_z && old_x > min_x && old_x < max_x)
+	{
+		normal_z = 1.0;
+	}
+
+	double direction_x = new_x - old_x;
+	double direction_z = new_z - old_z;
+	double dot = direction_x * normal_x + direction_z * normal_z;
+
+	reflection_x = direction_x - 2.0 * dot * normal_x;
+	reflection_z = direction_z - 2.0 * dot * normal_z;
+}
+
+void nbunny::MovementState::unpack(const double* fields)
+{
+	layer = (int)fields[MOVEMENT_STATE_LAYER];
+
+	for (int i = 0; i < 3; ++i)
+	{
+		position[i] = fields[MOVEMENT_STATE_POSITION_X + i];
+		acceleration[i] = fields[MOVEMENT_STATE_ACCELERATION_X + i];
+		velocity[i] = fields[MOVEMENT_STATE_VELOCITY_X + i];
+		additional_acceleration[i] = fields[MOVEMENT_STATE_ADDITIONAL_ACCELERATION_X + i];
+		additional_velocity[i] = fields[MOVEMENT_STATE_ADDITIONAL_VELOCITY_X + i];
+	}
+
+	max_speed = fields[MOVEMENT_STATE_MAX_SPEED];
+	max_acceleration = fields[MOVEMENT_STATE_MAX_ACCELERATION];
+	velocity_multiplier = fields[MOVEMENT_STATE_VELOCITY_MULTIPLIER];
+	acceleration_multiplier = fields[MOVEMENT_STATE_ACCELERATION_MULTIPLIER];
+	bounce = fields[MOVEMENT_STATE_BOUNCE];
+	bounce_threshold = fields[MOVEMENT_STATE_BOUNCE_THRESHOLD];
+	decay = fields[MOVEMENT_STATE_DECAY];
+	stopping_force = fields[MOVEMENT_STATE_STOPPING_FORCE];
+	max_step_height = fields[MOVEMENT_STATE_MAX_STEP_HEIGHT];
+	facing = fields[MOVEMENT_STATE_FACING];
+	target_facing = fields[MOVEMENT_STATE_TARGET_FACING];
+	is_on_ground = fields[MOVEMENT_STATE_IS_ON_GROUND] != 0.0;
+	is_stopping = fields[MOVEMENT_STATE_IS_STOPPING] != 0.0;
+}
+
+void nbunny::MovementState::pack(double* fields) const
+{
+	fields[MOVEMENT_STATE_LAYER] = layer;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		fields[MOVEMENT_STATE_POSITION_X + i] = position[i];
+		fields[MOVEMENT_STATE_ACCELERATION_X + i] = acceleration[i];
+		fields[MOVEMENT_STATE_VELOCITY_X + i] = velocity[i];
+		fields[MOVEMENT_STATE_ADDITIONAL_ACCELERATION_X + i] = additional_acceleration[i];
+		fields[MOVEMENT_STATE_ADDITIONAL_VELOCITY_X + i] = additional_velocity[i];
+	}
+
+	fields[MOVEMENT_STATE_MAX_SPEED] = max_speed;
+	fields[MOVEMENT_STATE_MAX_ACCELERATION] = max_acceleration;
+	fields[MOVEMENT_STATE_VELOCITY_MULTIPLIER] = velocity_multiplier;
+	fields[MOVEMENT_STATE_ACCELERATION_MULTIPLIER] = acceleration_multiplier;
+	fields[MOVEMENT_STATE_BOUNCE] = bounce;
+	fields[MOVEMENT_STATE_BOUNCE_THRESHOLD] = bounce_threshold;
+	fields[MOVEMENT_STATE_DECAY] = decay;
+	fields[MOVEMENT_STATE_STOPPING_FORCE] = stopping_force;
+	fields[MOVEMENT_STATE_MAX_STEP_HEIGHT] = max_step_height;
+	fields[MOVEMENT_STATE_FACING] = facing;
+	fields[MOVEMENT_STATE_TARGET_FACING] = target_facing;
+	fields[MOVEMENT_STATE_IS_ON_GROUND] = is_on_ground ? 1.0 : 0.0;
+	fields[MOVEMENT_STATE_IS_STOPPING] = is_stopping ? 1.0 : 0.0;
+}
+
+nbunny::MovementMap& nbunny::MovementSolver::set_map(int layer, int width, int height, double cell_size)
+{
+	auto& map = maps[layer];
+	map = MovementMap(width, height, cell_size);
+
+	return map;
+}
+
+nbunny::MovementMap* nbunny::MovementSolver::get_map(int layer)
+{
+	auto map = maps.find(layer);
+	if (map == maps.end())
+	{
+		return nullptr;
+	}
+
+	return &map->second;
+}
+
+void nbunny::MovementSolver::remove_map(int layer)
+{
+	maps.erase(layer);
+}
+
+void nbunny::MovementSolver::clear()
+{
+	states.clear();
+}
+
+std::size_t nbunny::MovementSolver::add(const MovementState& state)
+{
+	auto index = count();
+	resize(index + 1);
+	state.pack(&states[index * MOVEMENT_STATE_NUM_FIELDS]);
+
+	return index;
+}
+
+std::size_t nbunny::MovementSolver::count() const
+{
+	return states.size() / MOVEMENT_STATE_NUM_FIELDS;
+}
+
+void nbunny::MovementSolver::resize(std::size_t count)
+{
+	states.resize(count * MOVEMENT_STATE_NUM_FIELDS, 0.0);
+}
+
+double* nbunny::MovementSolver::get_states()
+{
+	return states.data();
+}
+
+bool nbunny::MovementSolver::is_changed(std::size_t index) const
+{
+	return states.at(index * MOVEMENT_STATE_NUM_FIELDS + MOVEMENT_STATE_IS_CHANGED) != 0.0;
+}
+
+nbunny::MovementState nbunny::MovementSolver::get(std::size_t index) const
+{
+	MovementState result;
+	result.unpack(&states.at(index * MOVEMENT_STATE_NUM_FIELDS));
+
+	return result;
+}
+
+void nbunny::MovementSolver::step(const Parameters& parameters)
+{
+	set_parameters(parameters);
+
+	for (std::size_t i = 0; i < get_num_chunks(); ++i)
+	{
+		run_chunk(i);
+	}
+}
+
+void nbunny::MovementSolver::set_parameters(const Parameters& value)
+{
+	parameters = value;
+}
+
+std::size_t nbunny::MovementSolver::get_num_chunks() const
+{
+	return (count() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+}
+
+void nbunny::MovementSolver::run_chunk(std::size_t chunk)
+{
+	NBUNNY_PROFILE_SCOPE("MovementSolver.runChunk");
+
+	std::size_t start = chunk * CHUNK_SIZE;
+	std::size_t stop = std::min(start + CHUNK_SIZE, count());
+
+	for (std::size_t i = start; i < stop; ++i)
+	{
+		double* fields = &states[i * MOVEMENT_STATE_NUM_FIELDS];
+		fields[MOVEMENT_STATE_IS_CHANGED] = 0.0;
+
+		MovementState state;
+		state.unpack(fields);
+
+		auto map = maps.find(state.layer);
+		if (map != maps.end() && step(state, map->second, parameters))
+		{
+			state.pack(fields);
+			fields[MOVEMENT_STATE_IS_CHANGED] = 1.0;
+		}
+	}
+}
+
+static double get_length_squared(const double v[3])
+{
+	return v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+}
+
+static void clamp_length(double v[3], double max)
+{
+	double length = std::sqrt(get_length_squared(v));
+	if (length > max)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			v[i] = v[i] / length * max;
+		}
+	}
+}
+
+static void clamp_vector(double v[3], double epsilon)
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		if (std::abs(v[i]) < epsilon)
+		{
+			v[i] = 0.0;
+		}
+	}
+}
+
+// This is a straight port of MovementCortex.update for a single Peep.
+bool nbunny::MovementSolver::step(MovementState& state, const MovementMap& map, const Parameters& parameters)
+{
+	const MovementState original = state;
+	double delta = parameters.delta;
+	double multiplier = parameters.multiplier;
+
+	clamp_length(state.velocity, state.max_speed);
+	clamp_length(state.acceleration, state.max_acceleration);
+
+	for (int i = 0; i < 3; ++i)
+	{
+		state.acceleration[i] = state.acceleration[i] + state.acceleration[i] * delta + parameters.gravity[i];
+	}
+	clamp_vector(state.acceleration, parameters.clamp_epsilon);
+
+	bool was_moving = state.velocity[0] * state.velocity[0] + state.velocity[2] * state.velocity[2] > 0.0;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		double acceleration = state.acceleration[i] * delta * state.acceleration_multiplier + state.additional_acceleration[i];
+		state.velocity[i] = state.velocity[i] + acceleration * multiplier;
+	}
+	clamp_vector(state.velocity, parameters.clamp_epsilon);
+
+	if (state.velocity[0] * state.velocity[0] + state.velocity[2] * state.velocity[2] == 0.0 && state.is_on_ground)
+	{
+		state.is_stopping = false;
+		if (was_moving && state.target_facing != 0.0)
+		{
+			state.facing = state.target_facing;
+			state.target_facing = 0.0;
+		}
+	}
+
+	double old_position[3] = { state.position[0], state.position[1], state.position[2] };
+	int old_i, old_j;
+	map.get_tile_at(old_position[0], old_position[2], old_i, old_j);
+
+	for (int i = 0; i < 3; ++i)
+	{
+		double velocity = (state.velocity[i] + state.additional_velocity[i]) * delta * state.velocity_multiplier;
+		state.position[i] = state.position[i] + velocity * multiplier;
+	}
+
+	int new_i, new_j;
+	auto& new_tile = map.get_tile_at(state.position[0], state.position[2], new_i, new_j);
+
+	for (int i = 0; i < 3; ++i)
+	{
+		state.acceleration[i] = state.acceleration[i] * 1.0 / (1.0 + state.decay * 8.0 * delta);
+		state.velocity[i] = state.velocity[i] * 1.0 / (1.0 + state.decay * 8.0 * delta);
+	}
+
+	if (!new_tile.is_passable() ||
+		!map.can_move(old_i, old_j, new_i - old_i, new_j - old_j) ||
+		map.is_out_of_bounds(state.position[0], state.position[2]))
+	{
+		double reflection_x, reflection_z;
+		map.snap_to_tile(
+			state.position[0], state.position[2],
+			old_position[0], old_position[2],
+			reflection_x, reflection_z);
+		double snapped_x = reflection_x + state.position[0];
+		double snapped_z = reflection_z + state.position[2];
+
+		int snapped_i, snapped_j;
+		auto& snapped_tile = map.get_tile_at(snapped_x, snapped_z, snapped_i, snapped_j);
+		if (!snapped_tile.is_passable() || map.is_out_of_bounds(snapped_x, snapped_z))
+		{
+			std::copy(old_position, old_position + 3, state.position);
+		}
+		else
+		{
+			state.position[0] = snapped_x;
+			state.position[2] = snapped_z;
+		}
+	}
+
+	double y = map.get_interpolated_height(state.position[0], state.position[2]);
+	if (state.position[1] < y)
+	{
+		if (state.bounce > 0.0)
+		{
+			state.acceleration[1] = -state.acceleration[1] * state.bounce;
+			state.velocity[1] = -state.velocity[1] * state.bounce;
+			state.position[1] = y;
+
+			if (state.velocity[1] < state.bounce_threshold)
+			{
+				state.acceleration[1] = 0.0;
+				state.velocity[1] = 0.0;
+				state.is_on_ground = true;
+			}
+			else
+			{
+				state.is_on_ground = false;
+			}
+		}
+		else if (!state.is_on_ground)
+		{
+			state.is_on_ground = true;
+		}
+	}
+	else if (state.position[1] > y + parameters.ground_epsilon && state.is_on_ground)
+	{
+		state.is_on_ground = false;
+	}
+
+	if (state.is_on_ground)
+	{
+		state.position[1] = y;
+		state.acceleration[1] = 0.0;
+		state.velocity[1] = 0.0;
+
+		if (state.is_stopping)
+		{
+			double stopping = std::pow(state.decay, state.stopping_force);
+			for (int i = 0; i < 3; ++i)
+			{
+				state.acceleration[i] *= stopping;
+				state.velocity[i] *= stopping;
+			}
+		}
+	}
+	else
+	{
+		state.position[1] = std::max(state.position[1], y);
+	}
+
+	double step_y = state.position[1] - old_position[1];
+	if (step_y > state.max_step_height)
+	{
+		std::copy(old_position, old_position + 3, state.position);
+	}
+
+	if (state.velocity[0] < -0.5)
+	{
+		state.facing = -1.0;
+	}
+	else if (state.velocity[0] > 0.5)
+	{
+		state.facing = 1.0;
+	}
+
+	return !std::equal(state.position, state.position + 3, original.position) ||
+	       !std::equal(state.acceleration, state.acceleration + 3, original.acceleration) ||
+	       !std::equal(state.velocity, state.velocity + 3, original.velocity) ||
+	       state.facing != original.facing ||
+	       state.target_facing != original.target_facing ||
+	       state.is_on_ground != original.is_on_ground ||
+	       state.is_stopping != original.is_stopping;
+}
+
+#ifndef NBUNNY_NO_LUA
+
+static int nbunny_movement_solver_set_map(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::MovementSolver>(L, 1);
+	int layer = (int)luaL_checkinteger(L, 2);
+	int width = (int)luaL_checkinteger(L, 3);
+	int height = (int)luaL_checkinteger(L, 4);
+	double cell_size = luaL_checknumber(L, 5);
+	self.set_map(layer, width, height, cell_size);
+	return 0;
+}
+
+static int nbunny_movement_solver_remove_map(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::MovementSolver>(L, 1);
+	self.remove_map((int)luaL_checkinteger(L, 2));
+	return 0;
+}
+
+// Arguments are layer, i, j, topLeft, topRight, bottomLeft, bottomRight, and
+// flags (MovementMap::FLAG_*).
+static int nbunny_movement_solver_set_tile(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::MovementSolver>(L, 1);
+	auto map = self.get_map((int)luaL_checkinteger(L, 2));
+	if (!map)
+	{
+		return luaL_error(L, "map for layer %d not set", (int)luaL_checkinteger(L, 2));
+	}
+
+	int i = (int)luaL_checkinteger(L, 3);
+	int j = (int)luaL_checkinteger(L, 4);
+	auto& tile = map->get_tile(i, j);
+	tile.top_left = luaL_checknumber(L, 5);
+	tile.top_right = luaL_checknumber(L, 6);
+	tile.bottom_left = luaL_checknumber(L, 7);
+	tile.bottom_right = luaL_checknumber(L, 8);
+	tile.flags = (int)luaL_optinteger(L, 9, 0);
+	return 0;
+}
+
+static int nbunny_movement_solver_clear(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::MovementSolver>(L, 1);
+	self.clear();
+	return 0;
+}
+
+static void get_vector(lua_State* L, int& index, double result[3])
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		result[i] = luaL_checknumber(L, index++);
+	}
+}
+
+static int nbunny_movement_solver_resize(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::MovementSolver>(L, 1);
+	self.resize((std::size_t)luaL_checkinteger(L, 2));
+	return 0;
+}
+
+// Returns a pointer to count * NUM_FIELDS doubles, for use with the FFI. See
+// MovementCortex.
+static int nbunny_movement_solver_get_states_pointer(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::MovementSolver>(L, 1);
+	lua_pushlightuserdata(L, self.get_states());
+	return 1;
+}
+
+// Arguments are gravity (x, y, z), delta, multiplier, ground epsilon, and
+// clamp epsilon.
+static nbunny::MovementSolver::Parameters get_parameters(lua_State* L, int index)
+{
+	nbunny::MovementSolver::Parameters parameters;
+	get_vector(L, index, parameters.gravity);
+	parameters.delta = luaL_checknumber(L, index++);
+	parameters.multiplier = luaL_checknumber(L, index++);
+	parameters.ground_epsilon = luaL_optnumber(L, index++, parameters.ground_epsilon);
+	parameters.clamp_epsilon = luaL_optnumber(L, index++, parameters.clamp_epsilon);
+
+	return parameters;
+}
+
+static int nbunny_movement_solver_step(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::MovementSolver>(L, 1);
+	self.step(get_parameters(L, 2));
+	return 0;
+}
+
+// Like step, but only sets the parameters. The states are stepped when the
+// solver is run as a kernel (see nbunny.kernelscheduler).
+static int nbunny_movement_solver_set_parameters(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::MovementSolver>(L, 1);
+	self.set_parameters(get_parameters(L, 2));
+	return 0;
+}
+
+extern "C"
+NBUNNY_EXPORT int luaopen_nbunny_movementsolver(lua_State* L)
+{
+	sol::usertype<nbunny::MovementSolver> T(
+		sol::call_constructor, sol::constructors<nbunny::MovementSolver()>(),
+		sol::base_classes, sol::bases<nbunny::Kernel>(),
+		"FLAG_IMPASSABLE", sol::var((int)nbunny::MovementMap::FLAG_IMPASSABLE),
+		"FLAG_DOOR", sol::var((int)nbunny::MovementMap::FLAG_DOOR),
+		"setMap", &nbunny_movement_solver_set_map,
+		"removeMap", &nbunny_movement_solver_remove_map,
+		"setTile", &nbunny_movement_solver_set_tile,
+		"clear", &nbunny_movement_solver_clear,
+		"resize", &nbunny_movement_solver_resize,
+		"getStatesPointer", &nbunny_movement_solver_get_states_pointer,
+		"step", &nbunny_movement_solver_step,
+		"setParameters", &nbunny_movement_solver_set_parameters);
+
+	sol::stack::push(L, T);
+
+	return 1;
+}
+
+#endif
@@ -0,0 +1,418 @@
+////////////////////////////////////////////////////////////////////////////////
+// source/profiler.cpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include "nbunny/nbunny.hpp"
+#include "nbunny/profiler.hpp"
+
+nbunny::Profiler& nbunny::Profiler::get_instance()
+{
+	static Profiler instance;
+	return instance;
+}
+
+nbunny::Profiler::Profiler() :
+	enabled(false),
+	epoch(std::chrono::steady_clock::now())
+{
+	// Nothing.
+}
+
+void nbunny::Profiler::enable()
+{
+	enabled = true;
+}
+
+void nbunny::Profiler::disable()
+{
+	enabled = false;
+}
+
+bool nbunny::Profiler::is_enabled() const
+{
+	return enabled.load(std::memory_order_relaxed);
+}
+
+std::uint32_t nbunny::Profiler::get_name_id(const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto iter = name_ids.find(name);
+	if (iter != name_ids.end())
+	{
+		return iter->second;
+	}
+
+	auto id = (std::uint32_t)names.size();
+	name_ids.insert(std::make_pair(name, id));
+	names.push_back(name);
+
+	history.resize(names.size() * HISTORY_SIZE, 0);
+	totals.resize(names.size(), 0);
+
+	return id;
+}
+
+std::string nbunny::Profiler::get_name(std::uint32_t id)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (id < names.size())
+	{
+		return names[id];
+	}
+
+	return std::string();
+}
+
+nbunny::Profiler::ThreadBufferOwner::~ThreadBufferOwner()
+{
+	if (buffer)
+	{
+		auto& profiler = Profiler::get_instance();
+		std::lock_guard<std::mutex> lock(profiler.mutex);
+
+		buffer->depth = 0;
+		buffer->in_use = false;
+	}
+}
+
+nbunny::Profiler::ThreadBuffer& nbunny::Profiler::get_thread_buffer()
+{
+	thread_local ThreadBufferOwner owner;
+
+	if (!owner.buffer)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (auto& buffer: threads)
+		{
+			if (!buffer->in_use)
+			{
+				buffer->in_use = true;
+				owner.buffer = buffer.get();
+				break;
+			}
+		}
+
+		if (!owner.buffer)
+		{
+			threads.emplace_back(new ThreadBuffer());
+			owner.buffer = threads.back().get();
+			owner.buffer->id = (std::uint32_t)(threads.size() - 1);
+			owner.buffer->head = 0;
+		}
+	}
+
+	return *owner.buffer;
+}
+
+void nbunny::Profiler::begin_scope(std::uint32_t name)
+{
+	auto& buffer = get_thread_buffer();
+
+	// Deeper scopes are counted, so end_scope stays balanced, but not
+	// recorded.
+	if (buffer.depth >= MAX_DEPTH)
+	{
+		++buffer.depth;
+		return;
+	}
+
+	auto& scope = buffer.scopes[buffer.depth];
+	scope.name = name;
+	scope.recorded = is_enabled();
+	scope.begin = scope.recorded ? now() : 0;
+
+	++buffer.depth;
+}
+
+void nbunny::Profiler::end_scope()
+{
+	auto& buffer = get_thread_buffer();
+	if (buffer.depth == 0)
+	{
+		return;
+	}
+
+	--buffer.depth;
+	if (buffer.depth >= MAX_DEPTH)
+	{
+		return;
+	}
+
+	auto& scope = buffer.scopes[buffer.depth];
+	if (!scope.recorded)
+	{
+		return;
+	}
+
+	auto head = buffer.head.load(std::memory_order_relaxed);
+
+	auto& event = buffer.events[head % BUFFER_SIZE];
+	event.name = scope.name;
+	event.depth = (std::uint32_t)buffer.depth;
+	event.begin = scope.begin;
+	event.end = now();
+
+	buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void nbunny::Profiler::frame()
+{
+	get_thread_buffer().depth = 0;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (auto& buffer: threads)
+	{
+		auto head = buffer->head.load(std::memory_order_acquire);
+		auto start = std::max(buffer->tail, head > BUFFER_SIZE ? head - BUFFER_SIZE : 0);
+
+		for (auto i = start; i < head; ++i)
+		{
+			auto& event = buffer->events[i % BUFFER_SIZE];
+			if (event.name < totals.size())
+			{
+				totals[event.name] += event.end - event.begin;
+			}
+		}
+
+		buffer->tail = head;
+	}
+
+	auto index = num_frames % HISTORY_SIZE;
+	for (std::size_t i = 0; i < totals.size(); ++i)
+	{
+		history[i * HISTORY_SIZE + index] = totals[i];
+		totals[i] = 0;
+	}
+
+	++num_frames;
+}
+
+double nbunny::Profiler::get_percentile(std::uint32_t name, double p)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto count = num_frames < HISTORY_SIZE ? num_frames : HISTORY_SIZE;
+	if (name >= names.size() || count == 0)
+	{
+		return 0.0;
+	}
+
+	auto begin = history.begin() + name * HISTORY_SIZE;
+	std::vector<Time> values(begin, begin + count);
+
+	p = std::min(std::max(p, 0.0), 1.0);
+	auto n = values.begin() + (std::size_t)(p * (count - 1) + 0.5);
+	std::nth_element(values.begin(), n, values.end());
+
+	return *n / 1.0e9;
+}
+
+static void write_json_string(std::ostream& stream, const std::string& value)
+{
+	stream << '"';
+	for (auto c: value)
+	{
+		if (c == '"' || c == '\\')
+		{
+			stream << '\\' << c;
+		}
+		else if ((unsigned char)c < 0x20)
+		{
+			stream << ' ';
+		}
+		else
+		{
+			stream << c;
+		}
+	}
+	stream << '"';
+}
+
+void nbunny::Profiler::write_chrome_trace(std::ostream& stream)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	stream << std::fixed << std::setprecision(3);
+	stream << "{\"traceEvents\":[";
+
+	bool first_event = true;
+	for (auto& buffer: threads)
+	{
+		auto head = buffer->head.load(std::memory_order_acquire);
+		auto start = std::max(buffer->first, head > BUFFER_SIZE ? head - BUFFER_SIZE : 0);
+
+		for (auto i = start; i < head; ++i)
+		{
+			auto& event = buffer->events[i % BUFFER_SIZE];
+			if (event.name >= names.size())
+			{
+				continue;
+			}
+
+			if (!first_event)
+			{
+				stream << ",";
+			}
+			first_event = false;
+
+			stream << "\n{\"name\":";
+			write_json_string(stream, names[event.name]);
+			stream << ",\"cat\":\"nbunny\",\"ph\":\"X\"";
+			stream << ",\"ts\":" << event.begin / 1000.0;
+			stream << ",\"dur\":" << (event.end - event.begin) / 1000.0;
+			stream << ",\"pid\":1,\"tid\":" << buffer->id << "}";
+		}
+	}
+
+	stream << "\n]}\n";
+}
+
+void nbunny::Profiler::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (auto& buffer: threads)
+	{
+		auto head = buffer->head.load(std::memory_order_acquire);
+		buffer->first = head;
+		buffer->tail = head;
+	}
+
+	std::fill(history.begin(), history.end(), 0);
+	std::fill(totals.begin(), totals.end(), 0);
+	num_frames = 0;
+}
+
+nbunny::Profiler::Time nbunny::Profiler::now() const
+{
+	auto duration = std::chrono::steady_clock::now() - epoch;
+	return (Time)std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+}
+
+nbunny::ProfileScope::ProfileScope(std::uint32_t name)
+{
+	Profiler::get_instance().begin_scope(name);
+}
+
+nbunny::ProfileScope::~ProfileScope()
+{
+	Profiler::get_instance().end_scope();
+}
+
+#ifndef NBUNNY_NO_LUA
+
+static std::uint32_t get_name_id(lua_State* L, int index)
+{
+	if (lua_type(L, index) == LUA_TNUMBER)
+	{
+		return (std::uint32_t)luaL_checkinteger(L, index);
+	}
+
+	return nbunny::Profiler::get_instance().get_name_id(luaL_checkstring(L, index));
+}
+
+static int nbunny_profiler_enable(lua_State* L)
+{
+	nbunny::Profiler::get_instance().enable();
+	return 0;
+}
+
+static int nbunny_profiler_disable(lua_State* L)
+{
+	nbunny::Profiler::get_instance().disable();
+	return 0;
+}
+
+static int nbunny_profiler_is_enabled(lua_State* L)
+{
+	lua_pushboolean(L, nbunny::Profiler::get_instance().is_enabled());
+	return 1;
+}
+
+static int nbunny_profiler_get_scope_id(lua_State* L)
+{
+	lua_pushinteger(L, get_name_id(L, 1));
+	return 1;
+}
+
+// Argument 1 is the scope name or the ID from getScopeID.
+static int nbunny_profiler_begin_scope(lua_State* L)
+{
+	nbunny::Profiler::get_instance().begin_scope(get_name_id(L, 1));
+	return 0;
+}
+
+static int nbunny_profiler_end_scope(lua_State* L)
+{
+	nbunny::Profiler::get_instance().end_scope();
+	return 0;
+}
+
+static int nbunny_profiler_frame(lua_State* L)
+{
+	nbunny::Profiler::get_instance().frame();
+	return 0;
+}
+
+// Argument 1 is the scope and argument 2 is the percentile, from 0 to 1.
+static int nbunny_profiler_get_percentile(lua_State* L)
+{
+	auto name = get_name_id(L, 1);
+	auto p = luaL_checknumber(L, 2);
+	lua_pushnumber(L, nbunny::Profiler::get_instance().get_percentile(name, p));
+	return 1;
+}
+
+static int nbunny_profiler_to_chrome_trace(lua_State* L)
+{
+	std::stringstream stream;
+	nbunny::Profiler::get_instance().write_chrome_trace(stream);
+
+	auto result = stream.str();
+	lua_pushlstring(L, result.data(), result.size());
+	return 1;
+}
+
+static int nbunny_profiler_clear(lua_State* L)
+{
+	nbunny::Profiler::get_instance().clear();
+	return 0;
+}
+
+// The profiler is shared, so these are called on the module itself, e.g.
+// NProfiler.beginScope("foo").
+extern "C"
+NBUNNY_EXPORT int luaopen_nbunny_profiler(lua_State* L)
+{
+	sol::usertype<nbunny::Profiler> T(
+		sol::no_constructor,
+		"enable", &nbunny_profiler_enable,
+		"disable", &nbunny_profiler_disable,
+		"isEnabled", &nbunny_profiler_is_enabled,
+		"getScopeID", &nbunny_profiler_get_scope_id,
+		"beginScope", &nbunny_profiler_begin_scope,
+		"endScope", &nbunny_profiler_end_scope,
+		"frame", &nbunny_profiler_frame,
+		"getPercentile", &nbunny_profiler_get_percentile,
+		"toChromeTrace", &nbunny_profiler_to_chrome_trace,
+		"clear", &nbunny_profiler_clear);
+
+	sol::stack::push(L, T);
+
+	return 1;
+}
+
+#endif
@@ -0,0 +1,833 @@
+////////////////////////////////////////////////////////////////////////////////
+// source/replay.cpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>
+#include "nbunny/nbunny.hpp"
+#include "nbunny/replay.hpp"
+
+nbunny::Recorder& nbunny::Recorder::get_instance()
+{
+	static Recorder instance;
+	return instance;
+}
+
+void nbunny::Recorder::start()
+{
+	buffer.clear();
+	buffer.insert(buffer.end(), REPLAY_MAGIC, REPLAY_MAGIC + sizeof(REPLAY_MAGIC));
+	write_int(REPLAY_VERSION);
+
+	next_id = 0;
+	nodes.clear();
+	transforms.clear();
+	materials.clear();
+
+	recording = true;
+}
+
+std::string nbunny::Recorder::stop()
+{
+	std::string result(buffer.begin(), buffer.end());
+
+	recording = false;
+	buffer.clear();
+	buffer.shrink_to_fit();
+	nodes.clear();
+	transforms.clear();
+	materials.clear();
+
+	return result;
+}
+
+bool nbunny::Recorder::is_recording() const
+{
+	return recording;
+}
+
+void nbunny::Recorder::create_node(const std::shared_ptr<SceneNode>& node)
+{
+	if (recording)
+	{
+		discover(node);
+	}
+}
+
+void nbunny::Recorder::set_parent(const std::shared_ptr<SceneNode>& node)
+{
+	if (!recording)
+	{
+		return;
+	}
+
+	auto id = discover(node);
+	auto parent = node->parent.lock();
+	auto parentID = parent ? discover(parent) : REPLAY_NO_NODE;
+
+	write_byte(REPLAY_COMMAND_SET_PARENT);
+	write_int(id);
+	write_int(parentID);
+}
+
+void nbunny::Recorder::set_bounds(const SceneNode* node)
+{
+	if (!recording)
+	{
+		return;
+	}
+
+	auto id = find(node);
+	if (id != REPLAY_NO_NODE)
+	{
+		write_bounds(id, *node);
+	}
+}
+
+void nbunny::Recorder::set_material(const SceneNodeMaterial* material)
+{
+	if (!recording)
+	{
+		return;
+	}
+
+	auto iter = materials.find(material);
+	if (iter == materials.end())
+	{
+		return;
+	}
+
+	auto id = find(iter->second);
+	if (id != REPLAY_NO_NODE)
+	{
+		write_material(id, *material);
+	}
+}
+
+void nbunny::Recorder::set_transform(const SceneNodeTransform* transform)
+{
+	if (!recording)
+	{
+		return;
+	}
+
+	auto iter = transforms.find(transform);
+	if (iter == transforms.end())
+	{
+		return;
+	}
+
+	auto id = find(iter->second);
+	if (id != REPLAY_NO_NODE)
+	{
+		write_transform(id, *transform);
+	}
+}
+
+void nbunny::Recorder::set_kind(const SceneNode* node)
+{
+	if (!recording)
+	{
+		return;
+	}
+
+	auto id = find(node);
+	if (id != REPLAY_NO_NODE)
+	{
+		write_kind(id, *node);
+	}
+}
+
+void nbunny::Recorder::set_translucent(const SceneNodeMaterial* material)
+{
+	if (!recording)
+	{
+		return;
+	}
+
+	auto iter = materials.find(material);
+	if (iter == materials.end())
+	{
+		return;
+	}
+
+	auto id = find(iter->second);
+	if (id != REPLAY_NO_NODE)
+	{
+		write_kind(id, *iter->second);
+	}
+}
+
+void nbunny::Recorder::walk_by_material(const std::shared_ptr<SceneNode>& root, const Camera& camera, float delta)
+{
+	if (recording)
+	{
+		write_walk(REPLAY_COMMAND_WALK_BY_MATERIAL, root, camera, delta);
+	}
+}
+
+void nbunny::Recorder::walk_by_position(const std::shared_ptr<SceneNode>& root, const Camera& camera, float delta)
+{
+	if (recording)
+	{
+		write_walk(REPLAY_COMMAND_WALK_BY_POSITION, root, camera, delta);
+	}
+}
+
+void nbunny::Recorder::walk_by_kind(const std::shared_ptr<SceneNode>& root, const Camera& camera, float delta)
+{
+	if (recording)
+	{
+		write_walk(REPLAY_COMMAND_WALK_BY_KIND, root, camera, delta);
+	}
+}
+
+static void get_keyframe(const nbunny::KeyFrame& keyFrame, float* result)
+{
+	result[0] = keyFrame.time;
+	result[1] = keyFrame.rotation.x;
+	result[2] = keyFrame.rotation.y;
+	result[3] = keyFrame.rotation.z;
+	result[4] = keyFrame.rotation.w;
+	result[5] = keyFrame.scale.x;
+	result[6] = keyFrame.scale.y;
+	result[7] = keyFrame.scale.z;
+	result[8] = keyFrame.translation.x;
+	result[9] = keyFrame.translation.y;
+	result[10] = keyFrame.translation.z;
+}
+
+static void set_keyframe(nbunny::KeyFrame& keyFrame, const float* value)
+{
+	keyFrame.time = value[0];
+	keyFrame.rotation = glm::quat(value[4], value[1], value[2], value[3]);
+	keyFrame.scale = glm::vec3(value[5], value[6], value[7]);
+	keyFrame.translation = glm::vec3(value[8], value[9], value[10]);
+}
+
+void nbunny::Recorder::interpolate(const KeyFrame& self, const KeyFrame& other, float time)
+{
+	if (!recording)
+	{
+		return;
+	}
+
+	float values[23];
+	get_keyframe(self, values);
+	get_keyframe(other, values + 11);
+	values[22] = time;
+
+	write_byte(REPLAY_COMMAND_INTERPOLATE);
+	write_floats(values, 23);
+}
+
+void nbunny::Recorder::frame()
+{
+	if (!recording)
+	{
+		return;
+	}
+
+	std::vector<const SceneNode*> collected;
+	for (auto& i: nodes)
+	{
+		if (i.second.node.expired())
+		{
+			collected.push_back(i.first);
+		}
+	}
+
+	for (auto node: collected)
+	{
+		forget(node);
+	}
+
+	write_byte(REPLAY_COMMAND_FRAME);
+}
+
+std::uint32_t nbunny::Recorder::find(const SceneNode* node)
+{
+	auto iter = nodes.find(node);
+	if (iter == nodes.end())
+	{
+		return REPLAY_NO_NODE;
+	}
+
+	// The node was collected and something else now lives at its address.
+	if (iter->second.node.expired())
+	{
+		forget(node);
+		return REPLAY_NO_NODE;
+	}
+
+	return iter->second.id;
+}
+
+void nbunny::Recorder::forget(const SceneNode* node)
+{
+	auto iter = nodes.find(node);
+	if (iter == nodes.end())
+	{
+		return;
+	}
+
+	write_byte(REPLAY_COMMAND_DESTROY_NODE);
+	write_int(iter->second.id);
+
+	transforms.erase(iter->second.transform);
+	materials.erase(iter->second.material);
+	nodes.erase(iter);
+}
+
+std::uint32_t nbunny::Recorder::discover(const std::shared_ptr<SceneNode>& node)
+{
+	auto id = find(node.get());
+	if (id != REPLAY_NO_NODE)
+	{
+		return id;
+	}
+
+	id = next_id++;
+	nodes[node.get()] = Entry { id, node, node->transform.get(), &node->material };
+	transforms[node->transform.get()] = node.get();
+	materials[&node->material] = node.get();
+
+	write_byte(REPLAY_COMMAND_CREATE_NODE);
+	write_int(id);
+	write_bounds(id, *node);
+	write_material(id, node->material);
+	write_transform(id, *node->transform);
+	write_kind(id, *node);
+
+	auto parent = node->parent.lock();
+	if (parent)
+	{
+		auto parentID = find(parent.get());
+		if (parentID != REPLAY_NO_NODE)
+		{
+			write_byte(REPLAY_COMMAND_SET_PARENT);
+			write_int(id);
+			write_int(parentID);
+		}
+	}
+
+	// Children that were already written need to be attached here; the
+	// rest attach themselves above.
+	for (auto& weakChild: node->children)
+	{
+		auto child = weakChild.lock();
+		if (!child)
+		{
+			continue;
+		}
+
+		auto childID = find(child.get());
+		if (childID == REPLAY_NO_NODE)
+		{
+			discover(child);
+		}
+		else
+		{
+			write_byte(REPLAY_COMMAND_SET_PARENT);
+			write_int(childID);
+			write_int(id);
+		}
+	}
+
+	return id;
+}
+
+void nbunny::Recorder::write_bounds(std::uint32_t id, const SceneNode& node)
+{
+	write_byte(REPLAY_COMMAND_SET_BOUNDS);
+	write_int(id);
+	write_floats(glm::value_ptr(node.min), 3);
+	write_floats(glm::value_ptr(node.max), 3);
+}
+
+void nbunny::Recorder::write_material(std::uint32_t id, const SceneNodeMaterial& material)
+{
+	write_byte(REPLAY_COMMAND_SET_MATERIAL);
+	write_int(id);
+	write_int((std::uint32_t)material.shader);
+	write_int((std::uint32_t)material.textures.size());
+	for (auto texture: material.textures)
+	{
+		write_int((std::uint32_t)texture);
+	}
+}
+
+void nbunny::Recorder::write_transform(std::uint32_t id, const SceneNodeTransform& transform)
+{
+	const glm::quat* rotations[] = { &transform.currentRotation, &transform.previousRotation };
+	const glm::vec3* vectors[] = {
+		&transform.currentScale, &transform.currentTranslation, &transform.currentOffset,
+		&transform.previousScale, &transform.previousTranslation, &transform.previousOffset
+	};
+
+	write_byte(REPLAY_COMMAND_SET_TRANSFORM);
+	write_int(id);
+	write_byte(transform.ticked ? 1 : 0);
+
+	for (int i = 0; i < 2; ++i)
+	{
+		float rotation[] = { rotations[i]->x, rotations[i]->y, rotations[i]->z, rotations[i]->w };
+		write_floats(rotation, 4);
+		write_floats(glm::value_ptr(*vectors[i * 3 + 0]), 3);
+		write_floats(glm::value_ptr(*vectors[i * 3 + 1]), 3);
+		write_floats(glm::value_ptr(*vectors[i * 3 + 2]), 3);
+	}
+}
+
+void nbunny::Recorder::write_kind(std::uint32_t id, const SceneNode& node)
+{
+	write_byte(REPLAY_COMMAND_SET_KIND);
+	write_int(id);
+	write_byte((std::uint8_t)node.kind);
+	write_byte(node.is_global_light ? 1 : 0);
+	write_byte(node.material.is_translucent ? 1 : 0);
+	write_floats(&node.light_radius, 1);
+}
+
+void nbunny::Recorder::write_walk(ReplayCommand command, const std::shared_ptr<SceneNode>& root, const Camera& camera, float delta)
+{
+	auto id = discover(root);
+
+	write_byte(command);
+	write_int(id);
+	write_floats(glm::value_ptr(camera.view), 16);
+	write_floats(glm::value_ptr(camera.projection), 16);
+	write_byte(camera.enable_cull ? 1 : 0);
+	write_floats(&delta, 1);
+}
+
+void nbunny::Recorder::write_byte(std::uint8_t value)
+{
+	buffer.push_back((char)value);
+}
+
+void nbunny::Recorder::write_int(std::uint32_t value)
+{
+	auto p = reinterpret_cast<const char*>(&value);
+	buffer.insert(buffer.end(), p, p + sizeof(value));
+}
+
+void nbunny::Recorder::write_floats(const float* values, std::size_t count)
+{
+	auto p = reinterpret_cast<const char*>(values);
+	buffer.insert(buffer.end(), p, p + sizeof(float) * count);
+}
+
+bool nbunny::Replay::load(const std::string& value)
+{
+	data = value;
+	offset = 0;
+
+	char magic[sizeof(REPLAY_MAGIC)];
+	std::uint32_t version;
+	if (data.size() < sizeof(magic) + sizeof(version))
+	{
+		return false;
+	}
+
+	std::memcpy(magic, data.data(), sizeof(magic));
+	std::memcpy(&version, data.data() + sizeof(magic), sizeof(version));
+	if (std::memcmp(magic, REPLAY_MAGIC, sizeof(magic)) != 0 || version < 1 || version > REPLAY_VERSION)
+	{
+		return false;
+	}
+
+	start = sizeof(magic) + sizeof(version);
+	reset();
+
+	num_frames = 0;
+	while (play_frame())
+	{
+		++num_frames;
+	}
+
+	reset();
+
+	return true;
+}
+
+void nbunny::Replay::reset()
+{
+	offset = start;
+	nodes.clear();
+	camera = Camera();
+	num_walked_nodes = 0;
+	checksum = 0.0f;
+}
+
+bool nbunny::Replay::play_frame()
+{
+	// Like the game, everything allocated from the arena during the last
+	// frame is freed at the start of the next.
+	FrameArena::get_instance().frame();
+
+	std::uint8_t command;
+	while (read_byte(command))
+	{
+		if (command == REPLAY_COMMAND_FRAME)
+		{
+			return true;
+		}
+
+		if (!play_command(command))
+		{
+			break;
+		}
+	}
+
+	// Truncated or unknown commands end the recording.
+	offset = data.size();
+	return false;
+}
+
+std::size_t nbunny::Replay::get_num_frames() const
+{
+	return num_frames;
+}
+
+std::size_t nbunny::Replay::get_num_walked_nodes() const
+{
+	return num_walked_nodes;
+}
+
+float nbunny::Replay::get_checksum() const
+{
+	return checksum;
+}
+
+bool nbunny::Replay::read_byte(std::uint8_t& value)
+{
+	if (offset + 1 > data.size())
+	{
+		return false;
+	}
+
+	value = (std::uint8_t)data[offset];
+	++offset;
+
+	return true;
+}
+
+bool nbunny::Replay::read_int(std::uint32_t& value)
+{
+	if (offset + sizeof(value) > data.size())
+	{
+		return false;
+	}
+
+	std::memcpy(&value, data.data() + offset, sizeof(value));
+	offset += sizeof(value);
+
+	return true;
+}
+
+bool nbunny::Replay::read_floats(float* values, std::size_t count)
+{
+	if (offset + sizeof(float) * count > data.size())
+	{
+		return false;
+	}
+
+	std::memcpy(values, data.data() + offset, sizeof(float) * count);
+	offset += sizeof(float) * count;
+
+	return true;
+}
+
+std::shared_ptr<nbunny::SceneNode> nbunny::Replay::get_node(std::uint32_t id) const
+{
+	if (id < nodes.size())
+	{
+		return nodes[id];
+	}
+
+	return nullptr;
+}
+
+bool nbunny::Replay::play_command(std::uint8_t command)
+{
+	std::uint32_t id;
+
+	switch (command)
+	{
+		case REPLAY_COMMAND_CREATE_NODE:
+			if (!read_int(id))
+			{
+				return false;
+			}
+
+			// IDs are handed out in order, so a new node always takes the
+			// next one. Anything past that is a corrupt recording, and
+			// would otherwise grow nodes to whatever size it asks for.
+			if (id > nodes.size())
+			{
+				return false;
+			}
+
+			if (id == nodes.size())
+			{
+				nodes.emplace_back();
+			}
+			nodes[id] = std::make_shared<SceneNode>();
+			return true;
+
+		case REPLAY_COMMAND_DESTROY_NODE:
+			if (!read_int(id))
+			{
+				return false;
+			}
+
+			// Walks expect every child to be alive.
+			if (id < nodes.size() && nodes[id])
+			{
+				SceneNode::set_parent(nodes[id], nullptr);
+				nodes[id].reset();
+			}
+			return true;
+
+		case REPLAY_COMMAND_SET_PARENT:
+			{
+				std::uint32_t parentID;
+				if (!read_int(id) || !read_int(parentID))
+				{
+					return false;
+				}
+
+				auto node = get_node(id);
+				if (node)
+				{
+					SceneNode::set_parent(node, get_node(parentID));
+				}
+			}
+			return true;
+
+		case REPLAY_COMMAND_SET_BOUNDS:
+			{
+				float bounds[6];
+				if (!read_int(id) || !read_floats(bounds, 6))
+				{
+					return false;
+				}
+
+				auto node = get_node(id);
+				if (node)
+				{
+					node->min = glm::make_vec3(bounds);
+					node->max = glm::make_vec3(bounds + 3);
+				}
+			}
+			return true;
+
+		case REPLAY_COMMAND_SET_MATERIAL:
+			{
+				std::uint32_t shader, count;
+				if (!read_int(id) || !read_int(shader) || !read_int(count))
+				{
+					return false;
+				}
+
+				SceneNodeMaterial material;
+				material.shader = (int)shader;
+				for (std::uint32_t i = 0; i < count; ++i)
+				{
+					std::uint32_t texture;
+					if (!read_int(texture))
+					{
+						return false;
+					}
+
+					material.textures.push_back((int)texture);
+				}
+
+				auto node = get_node(id);
+				if (node)
+				{
+					node->material = material;
+				}
+			}
+			return true;
+
+		case REPLAY_COMMAND_SET_TRANSFORM:
+			{
+				std::uint8_t ticked;
+				float values[26];
+				if (!read_int(id) || !read_byte(ticked) || !read_floats(values, 26))
+				{
+					return false;
+				}
+
+				auto node = get_node(id);
+				if (node)
+				{
+					auto& transform = *node->transform;
+					transform.ticked = ticked != 0;
+					transform.currentRotation = glm::quat(values[3], values[0], values[1], values[2]);
+					transform.currentScale = glm::make_vec3(values + 4);
+					transform.currentTranslation = glm::make_vec3(values + 7);
+					transform.currentOffset = glm::make_vec3(values + 10);
+					transform.previousRotation = glm::quat(values[16], values[13], values[14], values[15]);
+					transform.previousScale = glm::make_vec3(values + 17);
+					transform.previousTranslation = glm::make_vec3(values + 20);
+					transform.previousOffset = glm::make_vec3(values + 23);
+				}
+			}
+			return true;
+
+		case REPLAY_COMMAND_SET_KIND:
+			{
+				std::uint8_t kind, global, translucent;
+				float radius;
+				if (!read_int(id) || !read_byte(kind) || !read_byte(global) || !read_byte(translucent) || !read_floats(&radius, 1))
+				{
+					return false;
+				}
+
+				if (kind > SCENE_NODE_KIND_FOG)
+				{
+					return false;
+				}
+
+				auto node = get_node(id);
+				if (node)
+				{
+					node->kind = (SceneNodeKind)kind;
+					node->is_global_light = global != 0;
+					node->material.is_translucent = translucent != 0;
+					node->light_radius = radius;
+				}
+			}
+			return true;
+
+		case REPLAY_COMMAND_WALK_BY_MATERIAL:
+		case REPLAY_COMMAND_WALK_BY_POSITION:
+		case REPLAY_COMMAND_WALK_BY_KIND:
+			return play_walk(command);
+
+		case REPLAY_COMMAND_INTERPOLATE:
+			return play_interpolate();
+
+		default:
+			return false;
+	}
+}
+
+bool nbunny::Replay::play_walk(std::uint8_t command)
+{
+	std::uint32_t id;
+	float view[16], projection[16], delta;
+	std::uint8_t cull;
+	if (!read_int(id) || !read_floats(view, 16) || !read_floats(projection, 16) || !read_byte(cull) || !read_floats(&delta, 1))
+	{
+		return false;
+	}
+
+	auto root = get_node(id);
+	if (!root)
+	{
+		return true;
+	}
+
+	std::memcpy(glm::value_ptr(camera.view), view, sizeof(view));
+	std::memcpy(glm::value_ptr(camera.projection), projection, sizeof(projection));
+	camera.enable_cull = cull != 0;
+	camera.is_dirty = true;
+
+	FrameVector<std::shared_ptr<SceneNode>> result;
+	if (command == REPLAY_COMMAND_WALK_BY_MATERIAL)
+	{
+		SceneNode::walk_by_material(root, camera, delta, result);
+	}
+	else if (command == REPLAY_COMMAND_WALK_BY_POSITION)
+	{
+		SceneNode::walk_by_position(root, camera, delta, result);
+	}
+	else
+	{
+		FrameVector<std::shared_ptr<SceneNode>> translucent;
+		SceneNode::walk_by_kind(root, camera, delta, result, translucent, lights);
+
+		num_walked_nodes += translucent.size();
+		num_walked_nodes += lights.get_global_lights().size();
+		num_walked_nodes += lights.get_local_lights().size();
+		num_walked_nodes += lights.get_point_lights().size();
+		num_walked_nodes += lights.get_fog().size();
+	}
+
+	num_walked_nodes += result.size();
+
+	return true;
+}
+
+bool nbunny::Replay::play_interpolate()
+{
+	float values[23];
+	if (!read_floats(values, 23))
+	{
+		return false;
+	}
+
+	KeyFrame self, other;
+	set_keyframe(self, values);
+	set_keyframe(other, values + 11);
+
+	auto result = KeyFrame::interpolate(self, other, values[22]);
+	checksum += result[3][0] + result[3][1] + result[3][2];
+
+	return true;
+}
+
+#ifndef NBUNNY_NO_LUA
+
+static int nbunny_recorder_start(lua_State* L)
+{
+	nbunny::Recorder::get_instance().start();
+	return 0;
+}
+
+// Returns the recording as a string.
+static int nbunny_recorder_stop(lua_State* L)
+{
+	auto result = nbunny::Recorder::get_instance().stop();
+	lua_pushlstring(L, result.data(), result.size());
+	return 1;
+}
+
+static int nbunny_recorder_is_recording(lua_State* L)
+{
+	lua_pushboolean(L, nbunny::Recorder::get_instance().is_recording());
+	return 1;
+}
+
+static int nbunny_recorder_frame(lua_State* L)
+{
+	nbunny::Recorder::get_instance().frame();
+	return 0;
+}
+
+// Like nbunny.profiler, these are called on the module itself.
+extern "C"
+NBUNNY_EXPORT int luaopen_nbunny_recorder(lua_State* L)
+{
+	sol::usertype<nbunny::Recorder> T(
+		sol::no_constructor,
+		"start", &nbunny_recorder_start,
+		"stop", &nbunny_recorder_stop,
+		"isRecording", &nbunny_recorder_is_recording,
+		"frame", &nbunny_recorder_frame);
+
+	sol::stack::push(L, T);
+
+	return 1;
+}
+
+#endif
@@ -0,0 +1,1794 @@
+////////////////////////////////////////////////////////////////////////////////
+// source/resource.cpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include "nbunny/nbunny.hpp"
+#include "nbunny/bake.hpp"
+#include "nbunny/codec.hpp"
+#include "nbunny/profiler.hpp"
+#include "nbunny/resource.hpp"
+
+class nbunny::ResourceDocument::Parser
+{
+public:
+	// Deeper tables than this are an error, so a bad file can't overflow the
+	// stack.
+	static const int MAX_DEPTH = 128;
+
+	Parser(ResourceDocument& document, const std::string& text);
+
+	bool parse(ResourceValue& result, std::string& error);
+
+private:
+	bool fail(const std::string& message);
+
+	void skip_whitespace();
+	bool is_name_start(char c) const;
+	bool is_name(char c) const;
+
+	bool parse_value(ResourceValue& result, int depth);
+	bool parse_table(ResourceValue& result, int depth);
+	bool parse_name(std::string& result);
+	bool parse_number(double& result);
+	bool parse_string(std::string& result);
+	bool parse_long_string(std::string& result);
+
+	ResourceValue add_string(std::string& value);
+
+	ResourceDocument& document;
+	const char* current;
+	const char* end;
+	int line = 1;
+	std::string error;
+
+	// Values and fields of the tables being parsed, by depth. Sized up
+	// front so they never move.
+	std::vector<std::vector<ResourceValue>> values;
+	std::vector<std::vector<Field>> fields;
+};
+
+nbunny::ResourceDocument::Parser::Parser(ResourceDocument& document, const std::string& text) :
+	document(document),
+	current(text.c_str()),
+	end(text.c_str() + text.size()),
+	values(MAX_DEPTH + 1),
+	fields(MAX_DEPTH + 1)
+{
+	// Nothing.
+}
+
+bool nbunny::ResourceDocument::Parser::fail(const std::string& message)
+{
+	if (error.empty())
+	{
+		std::stringstream stream;
+		stream << "line " << line << ": " << message;
+		error = stream.str();
+	}
+
+	return false;
+}
+
+void nbunny::ResourceDocument::Parser::skip_whitespace()
+{
+	while (current < end)
+	{
+		char c = *current;
+		if (c == '\n')
+		{
+			++line;
+			++current;
+		}
+		else if (c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v')
+		{
+			++current;
+		}
+		else if (c == '-' && current + 1 < end && current[1] == '-')
+		{
+			current += 2;
+
+			std::string comment;
+			if (current < end && *current == '[' && parse_long_string(comment))
+			{
+				continue;
+			}
+
+			while (current < end && *current != '\n')
+			{
+				++current;
+			}
+		}
+		else
+		{
+			break;
+		}
+	}
+}
+
+bool nbunny::ResourceDocument::Parser::is_name_start(char c) const
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+bool nbunny::ResourceDocument::Parser::is_name(char c) const
+{
+	return is_name_start(c) || (c >= '0' && c <= '9');
+}
+
+nbunny::ResourceValue nbunny::ResourceDocument::Parser::add_string(std::string& value)
+{
+	ResourceValue result;
+	result.type = ResourceValue::TYPE_STRING;
+	result.index = (std::uint32_t)document.strings.size();
+	document.strings.push_back(std::move(value));
+
+	return result;
+}
+
+bool nbunny::ResourceDocument::Parser::parse(ResourceValue& result, std::string& error)
+{
+	skip_whitespace();
+	bool success = parse_value(result, 0);
+	if (success)
+	{
+		skip_whitespace();
+		if (current != end)
+		{
+			success = fail("expected end of file");
+		}
+	}
+
+	error = this->error;
+	return success;
+}
+
+bool nbunny::ResourceDocument::Parser::parse_value(ResourceValue& result, int depth)
+{
+	if (current >= end)
+	{
+		return fail("unexpected end of file");
+	}
+
+	char c = *current;
+	if (c == '{')
+	{
+		return parse_table(result, depth + 1);
+	}
+	else if (c == '"' || c == '\'')
+	{
+		std::string value;
+		if (!parse_string(value))
+		{
+			return false;
+		}
+
+		result = add_string(value);
+		return true;
+	}
+	else if (c == '[')
+	{
+		std::string value;
+		if (!parse_long_string(value))
+		{
+			return fail("expected long string");
+		}
+
+		result = add_string(value);
+		return true;
+	}
+	else if (c == '-' || c == '.' || (c >= '0' && c <= '9'))
+	{
+		result.type = ResourceValue::TYPE_NUMBER;
+		return parse_number(result.number);
+	}
+	else if (is_name_start(c))
+	{
+		std::string name;
+		parse_name(name);
+
+		if (name == "true" || name == "false")
+		{
+			result.type = ResourceValue::TYPE_BOOLEAN;
+			result.number = name == "true" ? 1.0 : 0.0;
+			return true;
+		}
+		else if (name == "nil")
+		{
+			result.type = ResourceValue::TYPE_NIL;
+			return true;
+		}
+
+		return fail("unexpected '" + name + "'");
+	}
+
+	return fail(std::string("unexpected '") + c + "'");
+}
+
+bool nbunny::ResourceDocument::Parser::parse_table(ResourceValue& result, int depth)
+{
+	if (depth > MAX_DEPTH)
+	{
+		return fail("tables nested too deep");
+	}
+
+	// Skip '{'.
+	++current;
+
+	auto& table_values = values[depth];
+	auto& table_fields = fields[depth];
+	table_values.clear();
+	table_fields.clear();
+
+	while (true)
+	{
+		skip_whitespace();
+		if (current >= end)
+		{
+			return fail("expected '}'");
+		}
+
+		if (*current == '}')
+		{
+			++current;
+			break;
+		}
+
+		ResourceValue key;
+		bool has_key = false;
+		if (*current == '[' && current + 1 < end && current[1] != '[' && current[1] != '=')
+		{
+			++current;
+			skip_whitespace();
+			if (!parse_value(key, depth))
+			{
+				return false;
+			}
+
+			skip_whitespace();
+			if (current >= end || *current != ']')
+			{
+				return fail("expected ']'");
+			}
+			++current;
+
+			skip_whitespace();
+			if (current >= end || *current != '=')
+			{
+				return fail("expected '='");
+			}
+			++current;
+
+			if (key.is_nil())
+			{
+				return fail("table index is nil");
+			}
+
+			has_key = true;
+		}
+		else if (is_name_start(*current))
+		{
+			// A name is a key if it's followed by '=' (but not '==').
+			auto start = current;
+			auto start_line = line;
+
+			std::string name;
+			parse_name(name);
+			skip_whitespace();
+
+			if (current < end && *current == '=' && (current + 1 >= end || current[1] != '='))
+			{
+				++current;
+				key = add_string(name);
+				has_key = true;
+			}
+			else
+			{
+				current = start;
+				line = start_line;
+			}
+		}
+
+		skip_whitespace();
+		ResourceValue value;
+		if (!parse_value(value, depth))
+		{
+			return false;
+		}
+
+		if (has_key)
+		{
+			table_fields.emplace_back(key, value);
+		}
+		else
+		{
+			table_values.push_back(value);
+		}
+
+		skip_whitespace();
+		if (current < end && (*current == ',' || *current == ';'))
+		{
+			++current;
+		}
+		else if (current < end && *current != '}')
+		{
+			return fail("expected ',' or '}'");
+		}
+	}
+
+	ResourceDocument::Table table;
+	table.array_offset = (std::uint32_t)document.values.size();
+	table.array_count = (std::uint32_t)table_values.size();
+	table.fields_offset = (std::uint32_t)document.fields.size();
+	table.fields_count = (std::uint32_t)table_fields.size();
+	document.values.insert(document.values.end(), table_values.begin(), table_values.end());
+	document.fields.insert(document.fields.end(), table_fields.begin(), table_fields.end());
+
+	result.type = ResourceValue::TYPE_TABLE;
+	result.index = (std::uint32_t)document.tables.size();
+	document.tables.push_back(table);
+	return true;
+}
+
+bool nbunny::ResourceDocument::Parser::parse_name(std::string& result)
+{
+	auto start = current;
+	while (current < end && is_name(*current))
+	{
+		++current;
+	}
+
+	result.assign(start, current);
+	return !result.empty();
+}
+
+// Clinger's fast path: a decimal with no exponent whose digits fit in a
+// double, divided by an exact power of ten, is correctly rounded. Most of
+// the numbers in a resource file are like this, and strtod is much slower.
+static bool parse_simple_decimal(const char* current, const char* end, double& result, const char*& number_end)
+{
+	static const double POWERS_OF_TEN[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	static const std::uint64_t MAX_MANTISSA = (std::uint64_t(1) << 53) / 10;
+
+	std::uint64_t mantissa = 0;
+	int num_digits = 0;
+	int num_fraction_digits = 0;
+	bool is_fraction = false;
+
+	auto p = current;
+	for (; p < end; ++p)
+	{
+		char c = *p;
+		if (c >= '0' && c <= '9')
+		{
+			if (mantissa >= MAX_MANTISSA)
+			{
+				return false;
+			}
+
+			mantissa = mantissa * 10 + (c - '0');
+			++num_digits;
+			if (is_fraction)
+			{
+				++num_fraction_digits;
+			}
+		}
+		else if (c == '.' && !is_fraction)
+		{
+			is_fraction = true;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	if (num_digits == 0 || num_fraction_digits > 22 || (p < end && (*p == 'e' || *p == 'E' || *p == 'x' || *p == 'X')))
+	{
+		return false;
+	}
+
+	result = (double)mantissa / POWERS_OF_TEN[num_fraction_digits];
+	number_end = p;
+	return true;
+}
+
+bool nbunny::ResourceDocument::Parser::parse_number(double& result)
+{
+	bool is_negative = false;
+	while (current < end && *current == '-')
+	{
+		is_negative = !is_negative;
+		++current;
+		skip_whitespace();
+	}
+
+	if (current >= end)
+	{
+		return fail("expected number");
+	}
+
+	// The text always ends in a NUL, so strtod won't run off the end.
+	const char* number_end = nullptr;
+	if (current + 1 < end && current[0] == '0' && (current[1] == 'x' || current[1] == 'X'))
+	{
+		char* hex_end;
+		result = (double)std::strtoull(current, &hex_end, 16);
+		number_end = hex_end;
+	}
+	else if ((*current >= '0' && *current <= '9') || *current == '.')
+	{
+		if (!parse_simple_decimal(current, end, result, number_end))
+		{
+			char* decimal_end;
+			result = std::strtod(current, &decimal_end);
+			number_end = decimal_end;
+		}
+	}
+
+	if (!number_end || number_end == current || (number_end < end && is_name(*number_end)))
+	{
+		return fail("malformed number");
+	}
+
+	current = number_end;
+	if (is_negative)
+	{
+		result = -result;
+	}
+
+	return true;
+}
+
+bool nbunny::ResourceDocument::Parser::parse_string(std::string& result)
+{
+	char quote = *current;
+	++current;
+
+	while (current < end && *current != quote)
+	{
+		char c = *current;
+		if (c == '\n')
+		{
+			return fail("unfinished string");
+		}
+
+		++current;
+		if (c != '\\')
+		{
+			result.push_back(c);
+			continue;
+		}
+
+		if (current >= end)
+		{
+			break;
+		}
+
+		c = *current;
+		++current;
+		switch (c)
+		{
+			case 'a': result.push_back('\a'); break;
+			case 'b': result.push_back('\b'); break;
+			case 'f': result.push_back('\f'); break;
+			case 'n': result.push_back('\n'); break;
+			case 'r': result.push_back('\r'); break;
+			case 't': result.push_back('\t'); break;
+			case 'v': result.push_back('\v'); break;
+			case '\n':
+				++line;
+				result.push_back('\n');
+				break;
+			case 'x':
+				{
+					int value = 0;
+					for (int i = 0; i < 2; ++i)
+					{
+						if (current >= end || !std::isxdigit((unsigned char)*current))
+						{
+							return fail("invalid escape sequence");
+						}
+
+						char digit = *current++;
+						value = value * 16 + (std::isdigit((unsigned char)digit) ? digit - '0' : (std::tolower((unsigned char)digit) - 'a' + 10));
+					}
+
+					result.push_back((char)value);
+				}
+				break;
+			default:
+				if (c >= '0' && c <= '9')
+				{
+					int value = c - '0';
+					for (int i = 0; i < 2 && current < end && *current >= '0' && *current <= '9'; ++i)
+					{
+						value = value * 10 + (*current++ - '0');
+					}
+
+					if (value > 255)
+					{
+						return fail("invalid escape sequence");
+					}
+
+					result.push_back((char)value);
+				}
+				else
+				{
+					// Includes \\, \", and \'.
+					result.push_back(c);
+				}
+				break;
+		}
+	}
+
+	if (current >= end)
+	{
+		return fail("unfinished string");
+	}
+
+	// Skip the closing quote.
+	++current;
+	return true;
+}
+
+bool nbunny::ResourceDocument::Parser::parse_long_string(std::string& result)
+{
+	auto start = current;
+	auto start_line = line;
+
+	// Skip '[' and count the '='.
+	++current;
+	int level = 0;
+	while (current < end && *current == '=')
+	{
+		++level;
+		++current;
+	}
+
+	if (current >= end || *current != '[')
+	{
+		current = start;
+		return false;
+	}
+	++current;
+
+	// A newline right after the opening bracket is skipped, like Lua.
+	if (current < end && *current == '\r')
+	{
+		++current;
+	}
+	if (current < end && *current == '\n')
+	{
+		++line;
+		++current;
+	}
+
+	auto content = current;
+	while (current < end)
+	{
+		if (*current == ']')
+		{
+			auto close = current + 1;
+			int close_level = 0;
+			while (close < end && *close == '=')
+			{
+				++close_level;
+				++close;
+			}
+
+			if (close_level == level && close < end && *close == ']')
+			{
+				result.assign(content, current);
+				current = close + 1;
+				return true;
+			}
+		}
+		else if (*current == '\n')
+		{
+			++line;
+		}
+
+		++current;
+	}
+
+	current = start;
+	line = start_line;
+	return fail("unfinished long string");
+}
+
+bool nbunny::ResourceDocument::parse(const std::string& text, std::string& error)
+{
+	NBUNNY_PROFILE_SCOPE("ResourceDocument.parse");
+
+	clear();
+
+	Parser parser(*this, text);
+	if (!parser.parse(root, error))
+	{
+		clear();
+		return false;
+	}
+
+	return true;
+}
+
+void nbunny::ResourceDocument::clear()
+{
+	root = ResourceValue();
+	strings.clear();
+	strings.shrink_to_fit();
+	tables.clear();
+	tables.shrink_to_fit();
+	values.clear();
+	values.shrink_to_fit();
+	fields.clear();
+	fields.shrink_to_fit();
+}
+
+const nbunny::ResourceValue& nbunny::ResourceDocument::get_root() const
+{
+	return root;
+}
+
+const std::string& nbunny::ResourceDocument::get_string(const ResourceValue& value) const
+{
+	return strings.at(value.index);
+}
+
+nbunny::ResourceDocument::Span<nbunny::ResourceValue> nbunny::ResourceDocument::get_array(const ResourceValue& value) const
+{
+	if (!value.is_table())
+	{
+		return { nullptr, 0 };
+	}
+
+	auto& table = tables.at(value.index);
+	return { values.data() + table.array_offset, table.array_count };
+}
+
+nbunny::ResourceDocument::Span<nbunny::ResourceDocument::Field> nbunny::ResourceDocument::get_fields(const ResourceValue& value) const
+{
+	if (!value.is_table())
+	{
+		return { nullptr, 0 };
+	}
+
+	auto& table = tables.at(value.index);
+	return { fields.data() + table.fields_offset, table.fields_count };
+}
+
+nbunny::ResourceValue nbunny::ResourceDocument::get_field(const ResourceValue& value, const char* name) const
+{
+	if (!value.is_table())
+	{
+		return ResourceValue();
+	}
+
+	// The last of the same key wins, like Lua.
+	auto table_fields = get_fields(value);
+	for (std::size_t i = table_fields.size(); i > 0; --i)
+	{
+		auto& field = table_fields[i - 1];
+		if (field.first.is_string() && get_string(field.first) == name)
+		{
+			return field.second;
+		}
+	}
+
+	return ResourceValue();
+}
+
+nbunny::MPSCQueue::MPSCQueue() :
+	head(&stub),
+	tail(&stub)
+{
+	stub.next = nullptr;
+}
+
+void nbunny::MPSCQueue::push(MPSCNode* node)
+{
+	node->next.store(nullptr, std::memory_order_relaxed);
+	auto previous = head.exchange(node, std::memory_order_acq_rel);
+	previous->next.store(node, std::memory_order_release);
+}
+
+nbunny::MPSCNode* nbunny::MPSCQueue::pop()
+{
+	auto current = tail;
+	auto next = current->next.load(std::memory_order_acquire);
+
+	if (current == &stub)
+	{
+		if (!next)
+		{
+			return nullptr;
+		}
+
+		tail = next;
+		current = next;
+		next = next->next.load(std::memory_order_acquire);
+	}
+
+	if (next)
+	{
+		tail = next;
+		return current;
+	}
+
+	// current is the last node; it can only be taken once the stub is
+	// behind it.
+	if (current != head.load(std::memory_order_acquire))
+	{
+		return nullptr;
+	}
+
+	push(&stub);
+
+	next = current->next.load(std::memory_order_acquire);
+	if (next)
+	{
+		tail = next;
+		return current;
+	}
+
+	return nullptr;
+}
+
+// Where the bone indices and position are in a vertex, and how big a vertex
+// is, in floats.
+struct VertexLayout
+{
+	std::size_t stride = 0;
+	std::size_t bone_offset = 0;
+	std::size_t bone_count = 0;
+	std::size_t position_offset = 0;
+	std::size_t position_count = 0;
+};
+
+// Bone names, by the order they were first seen. IDs are 1-based.
+struct BoneNames
+{
+	std::vector<std::string>& names;
+	std::unordered_map<std::string, std::size_t> ids;
+
+	std::size_t get(const std::string& name)
+	{
+		auto i = ids.find(name);
+		if (i != ids.end())
+		{
+			return i->second;
+		}
+
+		names.push_back(name);
+		ids.emplace(name, names.size());
+		return names.size();
+	}
+};
+
+static bool get_format(
+	const nbunny::ResourceDocument& document,
+	const nbunny::ResourceValue& value,
+	std::vector<nbunny::ResourceAttribute>& result,
+	VertexLayout& layout)
+{
+	if (value.is_table())
+	{
+		result.clear();
+
+		for (auto& element: document.get_array(value))
+		{
+			if (!element.is_table())
+			{
+				return false;
+			}
+
+			auto attribute = document.get_array(element);
+			if (attribute.size() < 3 || !attribute[0].is_string() || !attribute[1].is_string() || !attribute[2].is_number())
+			{
+				return false;
+			}
+
+			result.push_back({
+				document.get_string(attribute[0]),
+				document.get_string(attribute[1]),
+				(int)attribute[2].number
+			});
+		}
+	}
+
+	layout = VertexLayout();
+	for (auto& attribute: result)
+	{
+		// Anything else would need to be packed differently.
+		if (attribute.type != "float" || attribute.count < 1 || attribute.count > 4)
+		{
+			return false;
+		}
+
+		if (attribute.name == "VertexBoneIndex")
+		{
+			layout.bone_offset = layout.stride;
+			layout.bone_count = attribute.count;
+		}
+		else if (attribute.name == "VertexPosition")
+		{
+			layout.position_offset = layout.stride;
+			layout.position_count = std::min(attribute.count, 3);
+		}
+
+		layout.stride += attribute.count;
+	}
+
+	return layout.stride > 0;
+}
+
+// Decodes a vertex from goober's compressed profile into the uncompressed
+// layout (see nbunny.codec.decodeVertices). Bones are stored as their index
+// in compression.bones.
+static bool decode_compressed_vertex(
+	const nbunny::ResourceDocument::Span<nbunny::ResourceValue>& values,
+	const float min[3], const float max[3],
+	bool has_bones,
+	std::vector<float>& result)
+{
+	std::size_t index = 0;
+	auto next = [&](double& value)
+	{
+		if (index >= values.size() || !values[index].is_number())
+		{
+			return false;
+		}
+
+		value = values[index++].number;
+		return true;
+	};
+
+	result.clear();
+
+	double value;
+	for (int i = 0; i < 3; ++i)
+	{
+		if (!next(value))
+		{
+			return false;
+		}
+
+		result.push_back(nbunny::codec::decode_unorm16((std::uint16_t)value, min[i], max[i]));
+	}
+
+	double u, v;
+	if (!next(u) || !next(v))
+	{
+		return false;
+	}
+
+	std::uint16_t encoded_normal[2] = { (std::uint16_t)u, (std::uint16_t)v };
+	float normal[3];
+	nbunny::codec::decode_octahedral(encoded_normal, normal);
+	result.insert(result.end(), normal, normal + 3);
+
+	for (int i = 0; i < 2; ++i)
+	{
+		if (!next(value))
+		{
+			return false;
+		}
+
+		result.push_back(nbunny::codec::decode_half((std::uint16_t)value));
+	}
+
+	if (has_bones)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			if (!next(value))
+			{
+				return false;
+			}
+
+			result.push_back((float)value);
+		}
+
+		for (int i = 0; i < 4; ++i)
+		{
+			if (!next(value))
+			{
+				return false;
+			}
+
+			result.push_back(nbunny::codec::decode_unorm8((std::uint8_t)value));
+		}
+	}
+
+	while (index < values.size())
+	{
+		if (!next(value))
+		{
+			return false;
+		}
+
+		result.push_back((float)value);
+	}
+
+	return true;
+}
+
+static bool get_vector(const nbunny::ResourceDocument& document, const nbunny::ResourceValue& value, const char* name, float result[3])
+{
+	auto vector = document.get_field(value, name);
+	if (!vector.is_table())
+	{
+		return false;
+	}
+
+	auto array = document.get_array(vector);
+	if (array.size() < 3)
+	{
+		return false;
+	}
+
+	for (int i = 0; i < 3; ++i)
+	{
+		if (!array[i].is_number())
+		{
+			return false;
+		}
+
+		result[i] = (float)array[i].number;
+	}
+
+	return true;
+}
+
+// Like Model.loadFromTable and StaticMesh.generate, but straight into a
+// buffer. bone_names is null if bone names aren't allowed.
+static bool decode_mesh(
+	const nbunny::ResourceDocument& document,
+	const nbunny::ResourceValue& vertices,
+	const nbunny::ResourceValue& indices,
+	const nbunny::ResourceValue& compression,
+	const VertexLayout& layout,
+	BoneNames* bone_names,
+	nbunny::ResourceMesh& result)
+{
+	if (!vertices.is_table())
+	{
+		return false;
+	}
+
+	float min[3], max[3];
+	bool has_bones = false;
+	std::vector<std::size_t> compressed_bone_ids;
+	if (compression.is_truthy())
+	{
+		auto position = document.get_field(compression, "position");
+		if (!get_vector(document, position, "min", min) || !get_vector(document, position, "max", max))
+		{
+			return false;
+		}
+
+		auto bones = document.get_field(compression, "bones");
+		if (bones.is_table())
+		{
+			if (!bone_names)
+			{
+				return false;
+			}
+
+			has_bones = true;
+			for (auto& bone: document.get_array(bones))
+			{
+				if (!bone.is_string())
+				{
+					return false;
+				}
+
+				compressed_bone_ids.push_back(bone_names->get(document.get_string(bone)));
+			}
+		}
+	}
+
+	auto array = document.get_array(vertices);
+	result.vertex_count = array.size();
+	result.vertices.assign(result.vertex_count * layout.stride, 0.0f);
+
+	for (int i = 0; i < 3; ++i)
+	{
+		result.min[i] = std::numeric_limits<float>::infinity();
+		result.max[i] = -std::numeric_limits<float>::infinity();
+	}
+
+	std::vector<float> decoded;
+	for (std::size_t i = 0; i < array.size(); ++i)
+	{
+		if (!array[i].is_table())
+		{
+			return false;
+		}
+
+		auto vertex = document.get_array(array[i]);
+		auto output = &result.vertices[i * layout.stride];
+
+		if (compression.is_truthy())
+		{
+			if (!decode_compressed_vertex(vertex, min, max, has_bones, decoded))
+			{
+				return false;
+			}
+
+			for (std::size_t j = 0; j < layout.stride && j < decoded.size(); ++j)
+			{
+				bool is_bone = j >= layout.bone_offset && j < layout.bone_offset + layout.bone_count;
+				if (is_bone)
+				{
+					auto bone = (std::size_t)decoded[j];
+					if (bone > compressed_bone_ids.size())
+					{
+						return false;
+					}
+
+					output[j] = bone == 0 ? 0.0f : (float)compressed_bone_ids[bone - 1];
+				}
+				else
+				{
+					output[j] = decoded[j];
+				}
+			}
+		}
+		else
+		{
+			for (std::size_t j = 0; j < layout.stride && j < vertex.size(); ++j)
+			{
+				auto& value = vertex[j];
+				bool is_bone = bone_names && layout.bone_count > 0 &&
+					j >= layout.bone_offset && j < layout.bone_offset + layout.bone_count;
+
+				if (is_bone)
+				{
+					// Anything but a name (e.g., false) is no bone.
+					if (value.is_string())
+					{
+						output[j] = (float)bone_names->get(document.get_string(value));
+					}
+				}
+				else if (value.is_number())
+				{
+					output[j] = (float)value.number;
+				}
+				else if (!value.is_nil())
+				{
+					return false;
+				}
+			}
+		}
+
+		for (std::size_t j = 0; j < layout.position_count; ++j)
+		{
+			result.min[j] = std::min(result.min[j], output[layout.position_offset + j]);
+			result.max[j] = std::max(result.max[j], output[layout.position_offset + j]);
+		}
+	}
+
+	if (indices.is_table())
+	{
+		auto index_array = document.get_array(indices);
+		result.indices.reserve(index_array.size());
+		for (auto& index: index_array)
+		{
+			if (!index.is_number() || index.number < 1 || index.number > result.vertex_count)
+			{
+				return false;
+			}
+
+			result.indices.push_back((std::uint32_t)index.number - 1);
+		}
+	}
+
+	return true;
+}
+
+static bool decode_model(nbunny::ResourceLoader::Result& result)
+{
+	auto& document = result.document;
+	auto root = document.get_root();
+	if (!root.is_table())
+	{
+		return false;
+	}
+
+	// Model.loadFromTable handles a missing vertices field.
+	auto vertices = document.get_field(root, "vertices");
+	if (!vertices.is_table())
+	{
+		return false;
+	}
+
+	result.format = {
+		{ "VertexPosition", "float", 3 },
+		{ "VertexNormal", "float", 3 },
+		{ "VertexTexture", "float", 2 },
+		{ "VertexBoneIndex", "float", 4 },
+		{ "VertexBoneWeight", "float", 4 }
+	};
+
+	VertexLayout layout;
+	if (!get_format(document, document.get_field(root, "format"), result.format, layout))
+	{
+		return false;
+	}
+
+	BoneNames bone_names { result.bones, {} };
+	result.meshes.emplace_back();
+	return decode_mesh(
+		document,
+		vertices,
+		document.get_field(root, "indices"),
+		document.get_field(root, "compression"),
+		layout,
+		&bone_names,
+		result.meshes.back());
+}
+
+static bool decode_static_mesh(nbunny::ResourceLoader::Result& result)
+{
+	auto& document = result.document;
+	auto root = document.get_root();
+	if (!root.is_table())
+	{
+		return false;
+	}
+
+	result.format = {
+		{ "VertexPosition", "float", 3 },
+		{ "VertexNormal", "float", 3 },
+		{ "VertexTexture", "float", 2 },
+		{ "VertexColor", "float", 4 }
+	};
+
+	VertexLayout layout;
+	if (!get_format(document, document.get_field(root, "format"), result.format, layout))
+	{
+		return false;
+	}
+
+	for (auto& group: document.get_array(root))
+	{
+		auto name = document.get_field(group, "name");
+		if (!name.is_string())
+		{
+			// StaticMesh.generate skips groups without names.
+			continue;
+		}
+
+		result.meshes.emplace_back();
+		auto& mesh = result.meshes.back();
+		mesh.name = document.get_string(name);
+
+		bool success = decode_mesh(
+			document,
+			group,
+			document.get_field(group, "indices"),
+			document.get_field(group, "compression"),
+			layout,
+			nullptr,
+			mesh);
+		if (!success)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void nbunny::ResourceLoader::decode(Kind kind, Result& result)
+{
+	NBUNNY_PROFILE_SCOPE("ResourceLoader.decode");
+
+	result.kind = kind;
+	if (kind == KIND_FILE)
+	{
+		result.status = STATUS_DONE;
+		return;
+	}
+
+	if (!result.document.parse(result.data, result.error))
+	{
+		// Lua might still be able to make sense of it.
+		result.status = STATUS_FAILED;
+		return;
+	}
+
+	if (kind == KIND_MODEL || kind == KIND_STATIC_MESH)
+	{
+		bool success;
+		if (kind == KIND_MODEL)
+		{
+			success = decode_model(result);
+		}
+		else
+		{
+			success = decode_static_mesh(result);
+		}
+
+		if (success)
+		{
+			result.is_decoded = true;
+			result.document.clear();
+		}
+		else
+		{
+			result.format.clear();
+			result.meshes.clear();
+			result.bones.clear();
+		}
+	}
+
+	result.data.clear();
+	result.data.shrink_to_fit();
+	result.status = STATUS_DONE;
+}
+
+bool nbunny::ResourceLoader::Entry::operator <(const Entry& other) const
+{
+	// std::push_heap puts the greatest entry first, so the lowest priority
+	// (then the earliest request) has to be the greatest.
+	if (priority != other.priority)
+	{
+		return priority > other.priority;
+	}
+
+	return order > other.order;
+}
+
+nbunny::ResourceLoader::ResourceLoader(std::size_t num_threads)
+{
+	if (num_threads == 0)
+	{
+		auto concurrency = std::thread::hardware_concurrency();
+		num_threads = concurrency > 1 ? concurrency - 1 : 1;
+	}
+
+	for (std::size_t i = 0; i < num_threads; ++i)
+	{
+		threads.emplace_back(&ResourceLoader::work, this);
+	}
+}
+
+nbunny::ResourceLoader::~ResourceLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	condition.notify_all();
+
+	for (auto& thread: threads)
+	{
+		thread.join();
+	}
+}
+
+std::size_t nbunny::ResourceLoader::get_num_threads() const
+{
+	return threads.size();
+}
+
+void nbunny::ResourceLoader::set_bake_cache(const std::shared_ptr<const BakeCache>& value)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	bake_cache = value;
+}
+
+std::uint32_t nbunny::ResourceLoader::push(Request* request)
+{
+	request->id = ++current_id;
+	requests.emplace(request->id, std::unique_ptr<Request>(request));
+	++num_pending;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queued.emplace(request->id, request);
+		queue.push_back({ request->priority, current_order++, request->id });
+		std::push_heap(queue.begin(), queue.end());
+	}
+	condition.notify_one();
+
+	return request->id;
+}
+
+std::uint32_t nbunny::ResourceLoader::submit(Kind kind, const std::string& filename, float priority)
+{
+	auto request = new Request();
+	request->filename = filename;
+	request->is_file = true;
+	request->priority = priority;
+	request->result.kind = kind;
+
+	return push(request);
+}
+
+std::uint32_t nbunny::ResourceLoader::submit_data(Kind kind, const std::string& data, float priority)
+{
+	auto request = new Request();
+	request->is_file = false;
+	request->priority = priority;
+	request->result.kind = kind;
+	request->result.data = data;
+
+	return push(request);
+}
+
+void nbunny::ResourceLoader::set_priority(std::uint32_t id, float priority)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto i = queued.find(id);
+	if (i == queued.end() || i->second->priority == priority)
+	{
+		return;
+	}
+
+	i->second->priority = priority;
+	queue.push_back({ priority, current_order++, id });
+	std::push_heap(queue.begin(), queue.end());
+}
+
+std::uint32_t nbunny::ResourceLoader::poll()
+{
+	auto node = finished.pop();
+	if (!node)
+	{
+		return 0;
+	}
+
+	auto request = static_cast<Request*>(node);
+	request->is_polled = true;
+
+	--num_pending;
+	return request->id;
+}
+
+const nbunny::ResourceLoader::Result* nbunny::ResourceLoader::get_result(std::uint32_t id) const
+{
+	auto i = requests.find(id);
+	if (i == requests.end() || !i->second->is_polled)
+	{
+		return nullptr;
+	}
+
+	return &i->second->result;
+}
+
+void nbunny::ResourceLoader::release(std::uint32_t id)
+{
+	auto i = requests.find(id);
+	if (i != requests.end() && i->second->is_polled)
+	{
+		requests.erase(i);
+	}
+}
+
+std::size_t nbunny::ResourceLoader::get_num_pending() const
+{
+	return num_pending;
+}
+
+void nbunny::ResourceLoader::work()
+{
+	while (true)
+	{
+		Request* request;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [&] { return stopping || !queue.empty(); });
+
+			if (stopping)
+			{
+				return;
+			}
+
+			std::pop_heap(queue.begin(), queue.end());
+			auto entry = queue.back();
+			queue.pop_back();
+
+			auto i = queued.find(entry.id);
+			if (i == queued.end() || i->second->priority != entry.priority)
+			{
+				continue;
+			}
+
+			request = i->second;
+			queued.erase(i);
+		}
+
+		auto& result = request->result;
+		if (request->is_file)
+		{
+			NBUNNY_PROFILE_SCOPE("ResourceLoader.read");
+
+			std::ifstream stream(request->filename, std::ios::binary);
+			if (stream)
+			{
+				std::stringstream buffer;
+				buffer << stream.rdbuf();
+				result.data = buffer.str();
+			}
+			else
+			{
+				result.error = "couldn't open '" + request->filename + "'";
+				result.status = STATUS_FAILED;
+			}
+		}
+
+		if (result.status == STATUS_PENDING)
+		{
+			std::shared_ptr<const BakeCache> current_bake_cache;
+			if (result.kind == KIND_MODEL || result.kind == KIND_STATIC_MESH)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				current_bake_cache = bake_cache;
+			}
+
+			if (current_bake_cache)
+			{
+				BakeHash hash;
+				hash.update((double)result.kind);
+				hash.update(result.data.data(), result.data.size());
+
+				if (!load_baked(*current_bake_cache, hash.get_value(), result))
+				{
+					decode(result.kind, result);
+					if (result.is_decoded)
+					{
+						current_bake_cache->save(hash.get_value(), result.format, result.bones, result.meshes);
+					}
+				}
+			}
+			else
+			{
+				decode(result.kind, result);
+			}
+		}
+
+		finished.push(request);
+	}
+}
+
+bool nbunny::ResourceLoader::load_baked(const BakeCache& bake_cache, std::uint64_t key, Result& result)
+{
+	NBUNNY_PROFILE_SCOPE("ResourceLoader.load_baked");
+
+	auto file = bake_cache.load(key);
+	if (!file)
+	{
+		return false;
+	}
+
+	result.format = file->get_format();
+	result.bones = file->get_bones();
+	result.baked = std::move(file);
+	result.is_decoded = true;
+
+	result.data.clear();
+	result.data.shrink_to_fit();
+	result.status = STATUS_DONE;
+
+	return true;
+}
+
+#ifndef NBUNNY_NO_LUA
+
+static const char* KINDS[] = {
+	"file",
+	"lua",
+	"model",
+	"staticmesh",
+	nullptr
+};
+
+static void push_value(lua_State* L, const nbunny::ResourceDocument& document, const nbunny::ResourceValue& value)
+{
+	switch (value.type)
+	{
+		case nbunny::ResourceValue::TYPE_BOOLEAN:
+			lua_pushboolean(L, value.number != 0.0);
+			break;
+		case nbunny::ResourceValue::TYPE_NUMBER:
+			lua_pushnumber(L, value.number);
+			break;
+		case nbunny::ResourceValue::TYPE_STRING:
+			{
+				auto& string = document.get_string(value);
+				lua_pushlstring(L, string.data(), string.size());
+			}
+			break;
+		case nbunny::ResourceValue::TYPE_TABLE:
+			{
+				luaL_checkstack(L, 4, "resource tables nested too deep");
+
+				auto array = document.get_array(value);
+				auto fields = document.get_fields(value);
+				lua_createtable(L, (int)array.size(), (int)fields.size());
+
+				for (std::size_t i = 0; i < array.size(); ++i)
+				{
+					push_value(L, document, array[i]);
+					lua_rawseti(L, -2, (int)i + 1);
+				}
+
+				for (auto& field: fields)
+				{
+					push_value(L, document, field.first);
+					push_value(L, document, field.second);
+					lua_rawset(L, -3);
+				}
+			}
+			break;
+		default:
+			lua_pushnil(L);
+			break;
+	}
+}
+
+static void push_vector(lua_State* L, const float value[3])
+{
+	lua_createtable(L, 3, 0);
+	for (int i = 0; i < 3; ++i)
+	{
+		lua_pushnumber(L, value[i]);
+		lua_rawseti(L, -2, i + 1);
+	}
+}
+
+// indices is nullptr if the mesh isn't indexed.
+static void push_mesh(
+	lua_State* L,
+	const std::string& name,
+	const float* vertices, std::size_t vertex_count,
+	const std::uint32_t* indices, std::size_t index_count,
+	const float min[3], const float max[3])
+{
+	lua_createtable(L, 0, 8);
+
+	lua_pushlstring(L, name.data(), name.size());
+	lua_setfield(L, -2, "name");
+
+	lua_pushlightuserdata(L, const_cast<float*>(vertices));
+	lua_setfield(L, -2, "vertices");
+	lua_pushinteger(L, (lua_Integer)vertex_count);
+	lua_setfield(L, -2, "vertexCount");
+
+	if (indices)
+	{
+		lua_pushlightuserdata(L, const_cast<std::uint32_t*>(indices));
+		lua_setfield(L, -2, "indices");
+	}
+	lua_pushinteger(L, (lua_Integer)index_count);
+	lua_setfield(L, -2, "indexCount");
+
+	if (vertex_count > 0)
+	{
+		push_vector(L, min);
+		lua_setfield(L, -2, "min");
+		push_vector(L, max);
+		lua_setfield(L, -2, "max");
+	}
+}
+
+static void push_meshes(lua_State* L, const nbunny::ResourceLoader::Result& result)
+{
+	lua_createtable(L, 0, 3);
+
+	lua_createtable(L, (int)result.format.size(), 0);
+	for (std::size_t i = 0; i < result.format.size(); ++i)
+	{
+		auto& attribute = result.format[i];
+
+		lua_createtable(L, 3, 0);
+		lua_pushlstring(L, attribute.name.data(), attribute.name.size());
+		lua_rawseti(L, -2, 1);
+		lua_pushlstring(L, attribute.type.data(), attribute.type.size());
+		lua_rawseti(L, -2, 2);
+		lua_pushinteger(L, attribute.count);
+		lua_rawseti(L, -2, 3);
+
+		lua_rawseti(L, -2, (int)i + 1);
+	}
+	lua_setfield(L, -2, "format");
+
+	lua_createtable(L, (int)result.bones.size(), 0);
+	for (std::size_t i = 0; i < result.bones.size(); ++i)
+	{
+		lua_pushlstring(L, result.bones[i].data(), result.bones[i].size());
+		lua_rawseti(L, -2, (int)i + 1);
+	}
+	lua_setfield(L, -2, "bones");
+
+	if (result.baked)
+	{
+		auto& meshes = result.baked->get_meshes();
+
+		lua_createtable(L, (int)meshes.size(), 0);
+		for (std::size_t i = 0; i < meshes.size(); ++i)
+		{
+			auto& mesh = meshes[i];
+			push_mesh(L, mesh.name, mesh.vertices, mesh.vertex_count, mesh.indices, mesh.index_count, mesh.min, mesh.max);
+			lua_rawseti(L, -2, (int)i + 1);
+		}
+	}
+	else
+	{
+		lua_createtable(L, (int)result.meshes.size(), 0);
+		for (std::size_t i = 0; i < result.meshes.size(); ++i)
+		{
+			auto& mesh = result.meshes[i];
+			push_mesh(
+				L,
+				mesh.name,
+				mesh.vertices.data(), mesh.vertex_count,
+				mesh.indices.empty() ? nullptr : mesh.indices.data(), mesh.indices.size(),
+				mesh.min, mesh.max);
+			lua_rawseti(L, -2, (int)i + 1);
+		}
+	}
+	lua_setfield(L, -2, "meshes");
+}
+
+static int nbunny_resource_loader_submit(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ResourceLoader>(L, 1);
+	auto kind = (nbunny::ResourceLoader::Kind)luaL_checkoption(L, 2, nullptr, KINDS);
+	auto filename = luaL_checkstring(L, 3);
+	auto priority = (float)luaL_optnumber(L, 4, 0);
+
+	lua_pushinteger(L, self.submit(kind, filename, priority));
+	return 1;
+}
+
+static int nbunny_resource_loader_submit_data(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ResourceLoader>(L, 1);
+	auto kind = (nbunny::ResourceLoader::Kind)luaL_checkoption(L, 2, nullptr, KINDS);
+
+	std::size_t length;
+	auto data = luaL_checklstring(L, 3, &length);
+	auto priority = (float)luaL_optnumber(L, 4, 0);
+
+	lua_pushinteger(L, self.submit_data(kind, std::string(data, length), priority));
+	return 1;
+}
+
+static int nbunny_resource_loader_poll(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ResourceLoader>(L, 1);
+
+	auto id = self.poll();
+	if (id == 0)
+	{
+		lua_pushnil(L);
+	}
+	else
+	{
+		lua_pushinteger(L, id);
+	}
+
+	return 1;
+}
+
+// Returns the file (as a string), the table, or (for models and static
+// meshes) the decoded meshes and true. Pointers are valid until the request
+// is released.
+//
+// On failure, returns nil, the error, and the file (if it was read).
+static int nbunny_resource_loader_get_result(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ResourceLoader>(L, 1);
+	auto id = (std::uint32_t)luaL_checkinteger(L, 2);
+
+	auto result = self.get_result(id);
+	if (!result)
+	{
+		lua_pushnil(L);
+		lua_pushstring(L, "request not finished");
+		return 2;
+	}
+
+	if (result->status == nbunny::ResourceLoader::STATUS_FAILED)
+	{
+		lua_pushnil(L);
+		lua_pushlstring(L, result->error.data(), result->error.size());
+		if (result->data.empty())
+		{
+			return 2;
+		}
+
+		lua_pushlstring(L, result->data.data(), result->data.size());
+		return 3;
+	}
+
+	if (result->kind == nbunny::ResourceLoader::KIND_FILE)
+	{
+		lua_pushlstring(L, result->data.data(), result->data.size());
+		return 1;
+	}
+
+	if (result->is_decoded)
+	{
+		push_meshes(L, *result);
+		lua_pushboolean(L, true);
+		return 2;
+	}
+
+	push_value(L, result->document, result->document.get_root());
+	lua_pushboolean(L, false);
+	return 2;
+}
+
+static int nbunny_resource_loader_set_priority(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ResourceLoader>(L, 1);
+	self.set_priority((std::uint32_t)luaL_checkinteger(L, 2), (float)luaL_checknumber(L, 3));
+	return 0;
+}
+
+// Takes the directory of a nbunny.bakecache, or nil to stop baking.
+static int nbunny_resource_loader_set_bake_directory(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ResourceLoader>(L, 1);
+	if (lua_isnoneornil(L, 2))
+	{
+		self.set_bake_cache(nullptr);
+	}
+	else
+	{
+		self.set_bake_cache(std::make_shared<const nbunny::BakeCache>(luaL_checkstring(L, 2)));
+	}
+
+	return 0;
+}
+
+static int nbunny_resource_loader_release(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::ResourceLoader>(L, 1);
+	self.release((std::uint32_t)luaL_checkinteger(L, 2));
+	return 0;
+}
+
+extern "C"
+NBUNNY_EXPORT int luaopen_nbunny_resourceloader(lua_State* L)
+{
+	sol::usertype<nbunny::ResourceLoader> T(
+		sol::call_constructor, sol::constructors<nbunny::ResourceLoader(), nbunny::ResourceLoader(std::size_t)>(),
+		"getNumThreads", &nbunny::ResourceLoader::get_num_threads,
+		"setBakeDirectory", &nbunny_resource_loader_set_bake_directory,
+		"submit", &nbunny_resource_loader_submit,
+		"submitData", &nbunny_resource_loader_submit_data,
+		"setPriority", &nbunny_resource_loader_set_priority,
+		"poll", &nbunny_resource_loader_poll,
+		"getResult", &nbunny_resource_loader_get_result,
+		"release", &nbunny_resource_loader_release,
+		"getNumPending", &nbunny::ResourceLoader::get_num_pending);
+
+	sol::stack::push(L, T);
+
+	return 1;
+}
+
+#endif
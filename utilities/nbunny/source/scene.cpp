@@ -8,10 +8,14 @@
 // file, You can obtain one at http://mozilla.org/MPL/2.0/.
 ////////////////////////////////////////////////////////////////////////////////
 
+#include <cstdint>
+#include <functional>
 #include <limits>
-#include <unordered_map>
 #include <glm/gtc/matrix_transform.hpp>
 #include "nbunny/nbunny.hpp"
+#include "nbunny/light.hpp"
+#include "nbunny/profiler.hpp"
+#include "nbunny/replay.hpp"
 #include "nbunny/scene.hpp"
 
 void nbunny::SceneNodeTransform::tick()
@@ -97,11 +101,138 @@ bool nbunny::SceneNodeMaterial::operator <(const SceneNodeMaterial& other) const
 	return false;
 }
 
+void nbunny::SceneNode::set_parent(const std::shared_ptr<SceneNode>& node, const std::shared_ptr<SceneNode>& parent)
+{
+	auto oldParent = node->parent.lock();
+	if (oldParent)
+	{
+		oldParent->children.erase(
+			std::remove_if(
+				oldParent->children.begin(),
+				oldParent->children.end(),
+				[&node](auto& a)
+				{
+					return !(node.owner_before(a) || a.owner_before(node));
+				}
+			),
+			oldParent->children.end()
+		);
+
+		node->parent.reset();
+		node->transform->parent.reset();
+	}
+
+	if (parent)
+	{
+		node->parent = parent;
+		parent->children.push_back(node);
+
+		node->transform->parent = parent->transform;
+	}
+}
+
+bool nbunny::SceneNode::is_light() const
+{
+	return kind >= SCENE_NODE_KIND_LIGHT;
+}
+
+// Sorts nodes by keys, keeping nodes with equal keys in order.
+//
+// std::stable_sort takes its buffer from the heap, so this sorts (key, index)
+// pairs with std::sort instead and breaks ties by index.
+template <typename Key, typename Less>
+static void sort_scene_nodes(
+	nbunny::FrameVector<std::shared_ptr<nbunny::SceneNode>>& nodes,
+	const nbunny::FrameVector<Key>& keys,
+	Less less)
+{
+	nbunny::FrameVector<std::pair<Key, std::uint32_t>> entries;
+	entries.reserve(nodes.size());
+	for (std::size_t i = 0; i < nodes.size(); ++i)
+	{
+		entries.emplace_back(keys[i], (std::uint32_t)i);
+	}
+
+	std::sort(
+		entries.begin(),
+		entries.end(),
+		[&](const auto& a, const auto& b)
+		{
+			if (less(a.first, b.first))
+			{
+				return true;
+			}
+			else if (less(b.first, a.first))
+			{
+				return false;
+			}
+
+			return a.second < b.second;
+		}
+	);
+
+	nbunny::FrameVector<std::shared_ptr<nbunny::SceneNode>> result;
+	result.reserve(nodes.size());
+	for (auto& entry: entries)
+	{
+		result.push_back(std::move(nodes[entry.second]));
+	}
+
+	nodes.swap(result);
+}
+
+static void sort_by_material(nbunny::FrameVector<std::shared_ptr<nbunny::SceneNode>>& nodes)
+{
+	NBUNNY_PROFILE_SCOPE("SceneNode.sortByMaterial");
+	nbunny::FrameVector<const nbunny::SceneNodeMaterial*> materials(nodes.size());
+	for (std::size_t i = 0; i < nodes.size(); ++i)
+	{
+		materials[i] = &nodes[i]->material;
+	}
+
+	sort_scene_nodes(
+		nodes,
+		materials,
+		[](const nbunny::SceneNodeMaterial* a, const nbunny::SceneNodeMaterial* b)
+		{
+			return *a < *b;
+		}
+	);
+}
+
+// Sorts by projected depth. Less decides the order: std::less<float> for
+// near to far, std::greater<float> for far to near.
+template <typename Less>
+static void sort_by_position(
+	nbunny::FrameVector<std::shared_ptr<nbunny::SceneNode>>& nodes,
+	const nbunny::Camera& camera,
+	float delta,
+	Less less)
+{
+	NBUNNY_PROFILE_SCOPE("SceneNode.sortByPosition");
+
+	// Each node's depth is projected once, up front.
+	nbunny::FrameVector<float> depths(nodes.size());
+	for (std::size_t i = 0; i < nodes.size(); ++i)
+	{
+		auto world = glm::vec3(nodes[i]->transform->get_global(delta) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+		auto p = glm::project(
+			world,
+			camera.view,
+			camera.projection,
+			glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)
+		);
+		depths[i] = glm::floor(p.z * 1000);
+	}
+
+	sort_scene_nodes(nodes, depths, less);
+}
+
 void nbunny::SceneNode::walk_by_material(
 	const std::shared_ptr<SceneNode>& node,
 	const Camera& camera,
 	float delta,
-	std::vector<std::shared_ptr<SceneNode>>& result)
+	FrameVector<std::shared_ptr<SceneNode>>& result)
 {
 	if (!camera.enable_cull || camera.inside(*node.get(), delta))
 	{
@@ -117,14 +248,7 @@ void nbunny::SceneNode::walk_by_material(
 	auto parent = node->parent.lock();
 	if (!parent)
 	{
-		std::stable_sort(
-			result.begin(),
-			result.end(),
-			[&](const auto& a, const auto& b)
-			{
-				return a->material < b->material;
-			}
-		);
+		sort_by_material(result);
 	}
 }
 
@@ -132,7 +256,7 @@ void nbunny::SceneNode::walk_by_position(
 	const std::shared_ptr<SceneNode>& node,
 	const Camera& camera,
 	float delta,
-	std::vector<std::shared_ptr<SceneNode>>& result)
+	FrameVector<std::shared_ptr<SceneNode>>& result)
 {
 	if (!camera.enable_cull || camera.inside(*node.get(), delta))
 	{
@@ -148,44 +272,58 @@ void nbunny::SceneNode::walk_by_position(
 	auto parent = node->parent.lock();
 	if (!parent)
 	{
-		std::unordered_map<SceneNode*, glm::vec3> screen_positions;
-		std::stable_sort(
-			result.begin(),
-			result.end(),
-			[&](const auto& a, const auto& b)
-			{
-				auto aScreenPosition = screen_positions.find(a.get());
-				if (aScreenPosition == screen_positions.end())
-				{
-					auto world = glm::vec3(b->transform->get_global(delta) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-					auto p = glm::project(
-						world,
-						camera.view,
-						camera.projection,
-						glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)
-					);
-					aScreenPosition = screen_positions.insert(std::make_pair(a.get(), p)).first;
-				}
+		sort_by_position(result, camera, delta, std::less<float>());
+	}
+}
 
-				auto bScreenPosition = screen_positions.find(b.get());
-				if (bScreenPosition == screen_positions.end())
-				{
-					auto world = glm::vec3(a->transform->get_global(delta) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-					auto p = glm::project(
-						world,
-						camera.view,
-						camera.projection,
-						glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)
-					);
-					bScreenPosition = screen_positions.insert(std::make_pair(b.get(), p)).first;
-				}
+static void collect_by_kind(
+	const std::shared_ptr<nbunny::SceneNode>& node,
+	const nbunny::Camera& camera,
+	float delta,
+	nbunny::FrameVector<std::shared_ptr<nbunny::SceneNode>>& opaque,
+	nbunny::FrameVector<std::shared_ptr<nbunny::SceneNode>>& translucent,
+	nbunny::LightClusters& lights)
+{
+	if (node->is_light())
+	{
+		lights.add(node, camera, delta);
+	}
+	else if (!camera.enable_cull || camera.inside(*node.get(), delta))
+	{
+		if (node->kind == nbunny::SCENE_NODE_KIND_PARTICLES || node->material.is_translucent)
+		{
+			translucent.push_back(node);
+		}
+		else
+		{
+			opaque.push_back(node);
+		}
+	}
 
-				return glm::floor(aScreenPosition->second.z * 1000) < glm::floor(bScreenPosition->second.z);
-			}
-		);
+	for (auto& child: node->children)
+	{
+		auto c = child.lock();
+		collect_by_kind(c, camera, delta, opaque, translucent, lights);
 	}
 }
 
+void nbunny::SceneNode::walk_by_kind(
+	const std::shared_ptr<SceneNode>& node,
+	const Camera& camera,
+	float delta,
+	FrameVector<std::shared_ptr<SceneNode>>& opaque,
+	FrameVector<std::shared_ptr<SceneNode>>& translucent,
+	LightClusters& lights)
+{
+	lights.begin(camera);
+	collect_by_kind(node, camera, delta, opaque, translucent, lights);
+	lights.end(camera);
+
+	sort_by_material(opaque);
+	// Blending needs the farthest nodes drawn first.
+	sort_by_position(translucent, camera, delta, std::greater<float>());
+}
+
 static glm::vec3 get_positive_vertex(
 	const glm::vec3& min,
 	const glm::vec3& max,
@@ -384,6 +522,8 @@ void nbunny::Camera::compute_planes() const
 	is_dirty = false;
 }
 
+#ifndef NBUNNY_NO_LUA
+
 typedef std::shared_ptr<nbunny::SceneNode> SceneNodePointer;
 
 const static int SCENE_NODE_REFERENCE_KEY = 0;
@@ -436,40 +576,24 @@ static SceneNodePointer nbunny_scene_node_create(sol::object reference, sol::thi
 	lua_State* L = S;
 	result->reference = set_scene_node_reference(L);
 
+	nbunny::Recorder::get_instance().create_node(result);
+
 	return result;
 }
 
 static int nbunny_scene_node_set_parent(lua_State* L)
 {
 	auto& node = sol::stack::get<SceneNodePointer>(L, 1);
-	auto oldParent = node->parent.lock();
-	if (oldParent)
-	{
-		oldParent->children.erase(
-			std::remove_if(
-				oldParent->children.begin(),
-				oldParent->children.end(),
-				[&node](auto& a)
-				{
-					return !(node.owner_before(a) || a.owner_before(node));
-				}
-			),
-			oldParent->children.end()
-		);
-
-		node->parent.reset();
-		node->transform->parent.reset();
-	}
 
+	SceneNodePointer parent;
 	if (!lua_isnil(L, 2) && (lua_isboolean(L, 2) || lua_toboolean(L, 2)))
 	{
-		auto parent = sol::stack::get<SceneNodePointer>(L, 2);
-		node->parent = parent;
-		parent->children.push_back(node);
-
-		node->transform->parent = parent->transform;
+		parent = sol::stack::get<SceneNodePointer>(L, 2);
 	}
 
+	nbunny::SceneNode::set_parent(node, parent);
+	nbunny::Recorder::get_instance().set_parent(node);
+
 	return 0;
 }
 
@@ -522,9 +646,17 @@ static int nbunny_scene_node_set_min(lua_State* L)
 	float y = (float)luaL_checknumber(L, 3);
 	float z = (float)luaL_checknumber(L, 4);
 	self->min = glm::vec3(x, y, z);
+	nbunny::Recorder::get_instance().set_bounds(self.get());
 	return 0;
 }
 
+static int nbunny_scene_node_get_pointer(lua_State* L)
+{
+	auto& self = sol::stack::get<SceneNodePointer>(L, 1);
+	lua_pushlightuserdata(L, self.get());
+	return 1;
+}
+
 static int nbunny_scene_node_get_max(lua_State* L)
 {
 	auto& self = sol::stack::get<SceneNodePointer>(L, 1);
@@ -541,26 +673,20 @@ static int nbunny_scene_node_set_max(lua_State* L)
 	float y = (float)luaL_checknumber(L, 3);
 	float z = (float)luaL_checknumber(L, 4);
 	self->max = glm::vec3(x, y, z);
+	nbunny::Recorder::get_instance().set_bounds(self.get());
 	return 0;
 }
 
-static int nbunny_scene_node_walk_by_material(lua_State* L)
+static void push_scene_nodes(lua_State* L, const nbunny::FrameVector<SceneNodePointer>& nodes)
 {
-	auto& self = sol::stack::get<SceneNodePointer>(L, 1);
-	auto& camera = sol::stack::get<nbunny::Camera>(L, 2);
-	float delta = (float)luaL_checknumber(L, 3);
-
-	std::vector<SceneNodePointer> result;
-	nbunny::SceneNode::walk_by_material(self, camera, delta, result);
-
-	lua_createtable(L, (int)result.size(), 0);
+	lua_createtable(L, (int)nodes.size(), 0);
 
 	int index = 1;
-	for (std::size_t i = 0; i < result.size(); ++i)
+	for (std::size_t i = 0; i < nodes.size(); ++i)
 	{
 		lua_pushinteger(L, index);
 
-		get_scene_node_reference(L, result[i]->reference);
+		get_scene_node_reference(L, nodes[i]->reference);
 		if (!lua_isnil(L, -1))
 		{
 			++index;
@@ -568,6 +694,21 @@ static int nbunny_scene_node_walk_by_material(lua_State* L)
 
 		lua_rawset(L, -3);
 	}
+}
+
+static int nbunny_scene_node_walk_by_material(lua_State* L)
+{
+	auto& self = sol::stack::get<SceneNodePointer>(L, 1);
+	auto& camera = sol::stack::get<nbunny::Camera>(L, 2);
+	float delta = (float)luaL_checknumber(L, 3);
+
+	NBUNNY_PROFILE_SCOPE("SceneNode.walkByMaterial");
+	nbunny::Recorder::get_instance().walk_by_material(self, camera, delta);
+
+	nbunny::FrameVector<SceneNodePointer> result;
+	nbunny::SceneNode::walk_by_material(self, camera, delta, result);
+
+	push_scene_nodes(L, result);
 
 	return 1;
 }
@@ -578,26 +719,103 @@ static int nbunny_scene_node_walk_by_position(lua_State* L)
 	auto& camera = sol::stack::get<nbunny::Camera>(L, 2);
 	float delta = (float)luaL_checknumber(L, 3);
 
-	std::vector<SceneNodePointer> result;
+	NBUNNY_PROFILE_SCOPE("SceneNode.walkByPosition");
+	nbunny::Recorder::get_instance().walk_by_position(self, camera, delta);
+
+	nbunny::FrameVector<SceneNodePointer> result;
 	nbunny::SceneNode::walk_by_position(self, camera, delta, result);
 
-	lua_createtable(L, (int)result.size(), 0);
+	push_scene_nodes(L, result);
+
+	return 1;
+}
+
+static int nbunny_scene_node_get_kind(lua_State* L)
+{
+	static const char* KINDS[] = { "geometry", "particles", "light", "ambient", "directional", "point", "fog" };
+
+	auto& self = sol::stack::get<SceneNodePointer>(L, 1);
+	lua_pushstring(L, KINDS[self->kind]);
+	return 1;
+}
+
+static int nbunny_scene_node_set_kind(lua_State* L)
+{
+	static const char* KINDS[] = { "geometry", "particles", "light", "ambient", "directional", "point", "fog", nullptr };
+
+	auto& self = sol::stack::get<SceneNodePointer>(L, 1);
+	self->kind = (nbunny::SceneNodeKind)luaL_checkoption(L, 2, "geometry", KINDS);
+
+	nbunny::Recorder::get_instance().set_kind(self.get());
+
+	return 0;
+}
+
+// Argument 2 is if the light is global and argument 3 is the radius (or the
+// far distance, for fog).
+static int nbunny_scene_node_set_light(lua_State* L)
+{
+	auto& self = sol::stack::get<SceneNodePointer>(L, 1);
+	self->is_global_light = lua_toboolean(L, 2) != 0;
+	self->light_radius = (float)luaL_optnumber(L, 3, 0.0);
+
+	nbunny::Recorder::get_instance().set_kind(self.get());
+
+	return 0;
+}
+
+// Collected nodes are skipped, like in the other walks, unless keep_holes is
+// true; then they're false, so indices into the point lights still line up
+// with the clusters.
+static void push_light_scene_nodes(lua_State* L, const std::vector<SceneNodePointer>& nodes, bool keep_holes)
+{
+	lua_createtable(L, (int)nodes.size(), 0);
 
 	int index = 1;
-	for (std::size_t i = 0; i < result.size(); ++i)
+	for (std::size_t i = 0; i < nodes.size(); ++i)
 	{
 		lua_pushinteger(L, index);
 
-		get_scene_node_reference(L, result[i]->reference);
+		get_scene_node_reference(L, nodes[i]->reference);
 		if (!lua_isnil(L, -1))
 		{
 			++index;
 		}
+		else if (keep_holes)
+		{
+			lua_pop(L, 1);
+			lua_pushboolean(L, false);
+			++index;
+		}
 
 		lua_rawset(L, -3);
 	}
+}
 
-	return 1;
+// Returns the opaque nodes, translucent nodes, global lights, local lights,
+// point lights, and fog. See nbunny::SceneNode::walk_by_kind.
+static int nbunny_scene_node_walk_by_kind(lua_State* L)
+{
+	auto& self = sol::stack::get<SceneNodePointer>(L, 1);
+	auto& camera = sol::stack::get<nbunny::Camera>(L, 2);
+	float delta = (float)luaL_checknumber(L, 3);
+	auto& lights = sol::stack::get<nbunny::LightClusters>(L, 4);
+
+	NBUNNY_PROFILE_SCOPE("SceneNode.walkByKind");
+	nbunny::Recorder::get_instance().walk_by_kind(self, camera, delta);
+
+	nbunny::FrameVector<SceneNodePointer> opaque;
+	nbunny::FrameVector<SceneNodePointer> translucent;
+	nbunny::SceneNode::walk_by_kind(self, camera, delta, opaque, translucent, lights);
+
+	push_scene_nodes(L, opaque);
+	push_scene_nodes(L, translucent);
+	push_light_scene_nodes(L, lights.get_global_lights(), false);
+	push_light_scene_nodes(L, lights.get_local_lights(), false);
+	push_light_scene_nodes(L, lights.get_point_lights(), true);
+	push_light_scene_nodes(L, lights.get_fog(), false);
+
+	return 6;
 }
 
 extern "C"
@@ -610,12 +828,17 @@ NBUNNY_EXPORT int luaopen_nbunny_scenenode(lua_State* L)
 		"getTransform", &nbunny_scene_node_get_transform,
 		"getMaterial", &nbunny_scene_node_get_material,
 		"getReference", &nbunny_scene_node_get_reference,
+		"getPointer", &nbunny_scene_node_get_pointer,
 		"getMin", &nbunny_scene_node_get_min,
 		"setMin", &nbunny_scene_node_set_min,
 		"getMax", &nbunny_scene_node_get_max,
 		"setMax", &nbunny_scene_node_set_max,
+		"getKind", &nbunny_scene_node_get_kind,
+		"setKind", &nbunny_scene_node_set_kind,
+		"setLight", &nbunny_scene_node_set_light,
 		"walkByMaterial", &nbunny_scene_node_walk_by_material,
-		"walkByPosition", &nbunny_scene_node_walk_by_position);
+		"walkByPosition", &nbunny_scene_node_walk_by_position,
+		"walkByKind", &nbunny_scene_node_walk_by_kind);
 
 	sol::stack::push(L, T);
 
@@ -655,6 +878,7 @@ static int nbunny_scene_node_transform_set_current_rotation(lua_State* L)
 	float z = (float)luaL_checknumber(L, 4);
 	float w = (float)luaL_checknumber(L, 5);
 	transform->currentRotation = glm::quat(w, x, y, z);
+	nbunny::Recorder::get_instance().set_transform(transform.get());
 	return 0;
 }
 
@@ -674,6 +898,7 @@ static int nbunny_scene_node_transform_set_current_scale(lua_State* L)
 	float y = (float)luaL_checknumber(L, 3);
 	float z = (float)luaL_checknumber(L, 4);
 	transform->currentScale = glm::vec3(x, y, z);
+	nbunny::Recorder::get_instance().set_transform(transform.get());
 	return 0;
 }
 
@@ -693,6 +918,7 @@ static int nbunny_scene_node_transform_set_current_offset(lua_State* L)
 	float y = (float)luaL_checknumber(L, 3);
 	float z = (float)luaL_checknumber(L, 4);
 	transform->currentOffset = glm::vec3(x, y, z);
+	nbunny::Recorder::get_instance().set_transform(transform.get());
 	return 0;
 }
 
@@ -712,6 +938,7 @@ static int nbunny_scene_node_transform_set_current_translation(lua_State* L)
 	float y = (float)luaL_checknumber(L, 3);
 	float z = (float)luaL_checknumber(L, 4);
 	transform->currentTranslation = glm::vec3(x, y, z);
+	nbunny::Recorder::get_instance().set_transform(transform.get());
 	return 0;
 }
 
@@ -733,6 +960,7 @@ static int nbunny_scene_node_transform_set_previous_rotation(lua_State* L)
 	float z = (float)luaL_checknumber(L, 4);
 	float w = (float)luaL_checknumber(L, 5);
 	transform->previousRotation = glm::quat(w, x, y, z);
+	nbunny::Recorder::get_instance().set_transform(transform.get());
 	return 0;
 }
 
@@ -752,6 +980,7 @@ static int nbunny_scene_node_transform_set_previous_scale(lua_State* L)
 	float y = (float)luaL_checknumber(L, 3);
 	float z = (float)luaL_checknumber(L, 4);
 	transform->previousScale = glm::vec3(x, y, z);
+	nbunny::Recorder::get_instance().set_transform(transform.get());
 	return 0;
 }
 
@@ -771,6 +1000,7 @@ static int nbunny_scene_node_transform_set_previous_translation(lua_State* L)
 	float y = (float)luaL_checknumber(L, 3);
 	float z = (float)luaL_checknumber(L, 4);
 	transform->previousTranslation = glm::vec3(x, y, z);
+	nbunny::Recorder::get_instance().set_transform(transform.get());
 	return 0;
 }
 static int nbunny_scene_node_transform_get_previous_offset(lua_State* L)
@@ -789,9 +1019,23 @@ static int nbunny_scene_node_transform_set_previous_offset(lua_State* L)
 	float y = (float)luaL_checknumber(L, 3);
 	float z = (float)luaL_checknumber(L, 4);
 	transform->previousOffset = glm::vec3(x, y, z);
+	nbunny::Recorder::get_instance().set_transform(transform.get());
 	return 0;
 }
 
+static void nbunny_scene_node_transform_tick(nbunny::SceneNodeTransform& transform)
+{
+	transform.tick();
+	nbunny::Recorder::get_instance().set_transform(&transform);
+}
+
+static int nbunny_scene_node_transform_get_pointer(lua_State* L)
+{
+	auto& transform = sol::stack::get<SceneNodeTransformPointer>(L, 1);
+	lua_pushlightuserdata(L, transform.get());
+	return 1;
+}
+
 static int nbunny_scene_node_transform_get_global_delta_transform(lua_State* L)
 {
 	auto& transform = sol::stack::get<SceneNodeTransformPointer>(L, 1);
@@ -848,7 +1092,8 @@ NBUNNY_EXPORT int luaopen_nbunny_scenenodetransform(lua_State* L)
 		"setPreviousOffset", &nbunny_scene_node_transform_set_previous_offset,
 		"getGlobalDeltaTransform", &nbunny_scene_node_transform_get_global_delta_transform,
 		"getLocalDeltaTransform", &nbunny_scene_node_transform_get_local_delta_transform,
-		"tick", &nbunny::SceneNodeTransform::tick);
+		"getPointer", &nbunny_scene_node_transform_get_pointer,
+		"tick", &nbunny_scene_node_transform_tick);
 
 	sol::stack::push(L, T);
 
@@ -863,6 +1108,18 @@ static int nbunny_scene_node_material_get_shader(const nbunny::SceneNodeMaterial
 static void nbunny_scene_node_material_set_shader(nbunny::SceneNodeMaterial& material, int shader)
 {
 	material.shader = shader;
+	nbunny::Recorder::get_instance().set_material(&material);
+}
+
+static bool nbunny_scene_node_material_get_is_translucent(const nbunny::SceneNodeMaterial& material)
+{
+	return material.is_translucent;
+}
+
+static void nbunny_scene_node_material_set_is_translucent(nbunny::SceneNodeMaterial& material, bool value)
+{
+	material.is_translucent = value;
+	nbunny::Recorder::get_instance().set_translucent(&material);
 }
 
 static int nbunny_scene_node_material_set_textures(lua_State* L)
@@ -876,6 +1133,7 @@ static int nbunny_scene_node_material_set_textures(lua_State* L)
 	}
 
 	std::sort(material.textures.begin(), material.textures.end());
+	nbunny::Recorder::get_instance().set_material(&material);
 
 	return 0;
 }
@@ -900,6 +1158,8 @@ NBUNNY_EXPORT int luaopen_nbunny_scenenodematerial(lua_State* L)
 		"setShader", &nbunny_scene_node_material_set_shader,
 		"getTextures", &nbunny_scene_node_material_get_textures,
 		"setTextures", &nbunny_scene_node_material_set_textures,
+		"getIsTranslucent", &nbunny_scene_node_material_get_is_translucent,
+		"setIsTranslucent", &nbunny_scene_node_material_set_is_translucent,
 		"getMaterial", &nbunny_scene_node_material_set_textures);
 
 	sol::stack::push(L, T);
@@ -941,6 +1201,13 @@ static int nbunny_camera_set_projection(lua_State* L)
 	return 0;
 }
 
+static int nbunny_camera_get_pointer(lua_State* L)
+{
+	auto& camera = sol::stack::get<nbunny::Camera&>(L, 1);
+	lua_pushlightuserdata(L, &camera);
+	return 1;
+}
+
 static int nbunny_camera_enable_cull(lua_State* L)
 {
 	auto& camera = sol::stack::get<nbunny::Camera&>(L, 1);
@@ -974,9 +1241,12 @@ NBUNNY_EXPORT int luaopen_nbunny_camera(lua_State* L)
 		"disableCull", &nbunny_camera_disable_cull,
 		"getCullEnabled", &nbunny_camera_get_cull_enabled,
 		"setView", &nbunny_camera_set_view,
-		"setProjection", &nbunny_camera_set_projection);
+		"setProjection", &nbunny_camera_set_projection,
+		"getPointer", &nbunny_camera_get_pointer);
 
 	sol::stack::push(L, T);
 
 	return 1;
 }
+
+#endif
@@ -0,0 +1,303 @@
+////////////////////////////////////////////////////////////////////////////////
+// source/scheduler.cpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include "nbunny/nbunny.hpp"
+#include "nbunny/profiler.hpp"
+#include "nbunny/scheduler.hpp"
+
+nbunny::WorkStealingPool::WorkStealingPool(std::size_t num_threads) :
+	pending(0)
+{
+	// The last queue belongs to the thread calling run.
+	for (std::size_t i = 0; i < num_threads + 1; ++i)
+	{
+		queues.emplace_back(new Queue());
+	}
+
+	for (std::size_t i = 0; i < num_threads; ++i)
+	{
+		threads.emplace_back(&WorkStealingPool::work, this, i);
+	}
+}
+
+nbunny::WorkStealingPool::~WorkStealingPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	condition.notify_all();
+
+	for (auto& thread: threads)
+	{
+		thread.join();
+	}
+}
+
+nbunny::WorkStealingPool& nbunny::WorkStealingPool::get_instance()
+{
+	static WorkStealingPool instance(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+	return instance;
+}
+
+std::size_t nbunny::WorkStealingPool::get_num_threads() const
+{
+	return threads.size();
+}
+
+bool nbunny::WorkStealingPool::pop(std::size_t index, Task*& result)
+{
+	{
+		auto& queue = *queues[index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			result = queue.tasks.back();
+			queue.tasks.pop_back();
+			return true;
+		}
+	}
+
+	for (std::size_t i = 1; i < queues.size(); ++i)
+	{
+		auto& queue = *queues[(index + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			result = queue.tasks.front();
+			queue.tasks.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void nbunny::WorkStealingPool::execute(std::size_t index)
+{
+	Task* task;
+	while (pop(index, task))
+	{
+		(*task)();
+
+		if (--pending == 0)
+		{
+			std::lock_guard<std::mutex> lock(done_mutex);
+			done_condition.notify_all();
+		}
+	}
+}
+
+void nbunny::WorkStealingPool::work(std::size_t index)
+{
+	std::size_t current_generation = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [&] { return stopping || generation != current_generation; });
+
+			if (stopping)
+			{
+				return;
+			}
+
+			current_generation = generation;
+		}
+
+		execute(index);
+	}
+}
+
+void nbunny::WorkStealingPool::run(std::vector<Task>& tasks)
+{
+	if (tasks.empty())
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> run_lock(run_mutex);
+
+	pending = tasks.size();
+	for (std::size_t i = 0; i < tasks.size(); ++i)
+	{
+		auto& queue = *queues[i % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(&tasks[i]);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		++generation;
+	}
+	condition.notify_all();
+
+	execute(queues.size() - 1);
+
+	// Other threads may still be finishing stolen tasks.
+	std::unique_lock<std::mutex> lock(done_mutex);
+	done_condition.wait(lock, [&] { return pending == 0; });
+}
+
+nbunny::KernelScheduler::KernelScheduler(std::size_t num_threads)
+{
+	if (num_threads == 0)
+	{
+		pool = &WorkStealingPool::get_instance();
+	}
+	else
+	{
+		own_pool = std::make_unique<WorkStealingPool>(num_threads);
+		pool = own_pool.get();
+	}
+}
+
+std::size_t nbunny::KernelScheduler::get_num_threads() const
+{
+	return pool->get_num_threads();
+}
+
+void nbunny::KernelScheduler::add(Kernel& kernel, const Components& reads, const Components& writes)
+{
+	Entry entry;
+	entry.kernel = &kernel;
+	entry.reads = reads;
+	entry.writes = writes;
+	entry.wave = 0;
+
+	for (auto& other: entries)
+	{
+		bool conflicts =
+			(other.writes & (reads | writes)).any() ||
+			(writes & other.reads).any() ||
+			other.kernel == &kernel;
+
+		if (conflicts)
+		{
+			entry.wave = std::max(entry.wave, other.wave + 1);
+		}
+	}
+
+	num_waves = std::max(num_waves, entry.wave + 1);
+	entries.push_back(entry);
+}
+
+void nbunny::KernelScheduler::run()
+{
+	NBUNNY_PROFILE_SCOPE("KernelScheduler.run");
+
+	std::vector<WorkStealingPool::Task> tasks;
+	for (std::size_t wave = 0; wave < num_waves; ++wave)
+	{
+		tasks.clear();
+		for (auto& entry: entries)
+		{
+			if (entry.wave != wave)
+			{
+				continue;
+			}
+
+			auto kernel = entry.kernel;
+			auto num_chunks = kernel->get_num_chunks();
+			for (std::size_t chunk = 0; chunk < num_chunks; ++chunk)
+			{
+				tasks.push_back([kernel, chunk] { kernel->run_chunk(chunk); });
+			}
+		}
+
+		pool->run(tasks);
+	}
+
+	entries.clear();
+	num_waves = 0;
+}
+
+std::size_t nbunny::KernelScheduler::get_num_waves() const
+{
+	return num_waves;
+}
+
+#ifndef NBUNNY_NO_LUA
+
+static nbunny::KernelScheduler::Components get_components(lua_State* L, int index)
+{
+	nbunny::KernelScheduler::Components result;
+	if (lua_isnoneornil(L, index))
+	{
+		return result;
+	}
+
+	luaL_checktype(L, index, LUA_TTABLE);
+
+	int count = (int)lua_objlen(L, index);
+	for (int i = 1; i <= count; ++i)
+	{
+		lua_rawgeti(L, index, i);
+		auto component = luaL_checkinteger(L, -1);
+		if (component < 0 || component >= (lua_Integer)nbunny::KernelScheduler::MAX_COMPONENTS)
+		{
+			luaL_error(L, "component %d out of range", (int)component);
+		}
+
+		result.set((std::size_t)component);
+		lua_pop(L, 1);
+	}
+
+	return result;
+}
+
+static int nbunny_kernel_scheduler_get_num_threads(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::KernelScheduler>(L, 1);
+	lua_pushinteger(L, (lua_Integer)self.get_num_threads());
+	return 1;
+}
+
+// Argument 2 is the kernel, and arguments 3 and 4 are arrays of the
+// components read and written, respectively.
+static int nbunny_kernel_scheduler_add(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::KernelScheduler>(L, 1);
+	auto& kernel = sol::stack::get<nbunny::Kernel&>(L, 2);
+	self.add(kernel, get_components(L, 3), get_components(L, 4));
+	return 0;
+}
+
+static int nbunny_kernel_scheduler_run(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::KernelScheduler>(L, 1);
+	self.run();
+	return 0;
+}
+
+static int nbunny_kernel_scheduler_get_num_waves(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::KernelScheduler>(L, 1);
+	lua_pushinteger(L, (lua_Integer)self.get_num_waves());
+	return 1;
+}
+
+extern "C"
+NBUNNY_EXPORT int luaopen_nbunny_kernelscheduler(lua_State* L)
+{
+	sol::usertype<nbunny::KernelScheduler> T(
+		sol::call_constructor, sol::constructors<nbunny::KernelScheduler(), nbunny::KernelScheduler(std::size_t)>(),
+		"getNumThreads", &nbunny_kernel_scheduler_get_num_threads,
+		"add", &nbunny_kernel_scheduler_add,
+		"run", &nbunny_kernel_scheduler_run,
+		"getNumWaves", &nbunny_kernel_scheduler_get_num_waves);
+
+	sol::stack::push(L, T);
+
+	return 1;
+}
+
+#endif
@@ -9,6 +9,7 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include "nbunny/nbunny.hpp"
+#include "nbunny/replay.hpp"
 #include "nbunny/skeleton.hpp"
 
 static int nbunny_keyframe_get_time(lua_State* L)
@@ -84,12 +85,20 @@ static int nbunny_keyframe_set_translation(lua_State* L)
 	return 0;
 }
 
+static int nbunny_keyframe_get_pointer(lua_State* L)
+{
+	auto& keyFrame = sol::stack::get<nbunny::KeyFrame>(L, 1);
+	lua_pushlightuserdata(L, &keyFrame);
+	return 1;
+}
+
 static int nbunny_keyframe_interpolate(lua_State* L)
 {
 	auto& self = sol::stack::get<nbunny::KeyFrame>(L, 1);
 	auto& other = sol::stack::get<nbunny::KeyFrame>(L, 2);
 	float time = (float)luaL_checknumber(L, 3);
 	auto result = glm::transpose(nbunny::KeyFrame::interpolate(self, other, time));
+	nbunny::Recorder::get_instance().interpolate(self, other, time);
 	auto pointer = glm::value_ptr(result);
 
 	for (int i = 0; i < 16; ++i)
@@ -113,7 +122,8 @@ NBUNNY_EXPORT int luaopen_nbunny_skeletonkeyframe(lua_State* L)
 		"setScale", &nbunny_keyframe_set_scale,
 		"getTranslation", &nbunny_keyframe_get_translation,
 		"setTranslation", &nbunny_keyframe_set_translation,
-		"interpolate", &nbunny_keyframe_interpolate);
+		"interpolate", &nbunny_keyframe_interpolate,
+		"getPointer", &nbunny_keyframe_get_pointer);
 
 	sol::stack::push(L, T);
 
@@ -0,0 +1,347 @@
+////////////////////////////////////////////////////////////////////////////////
+// source/spatial.cpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "nbunny/nbunny.hpp"
+#include "nbunny/spatial.hpp"
+
+std::uint64_t nbunny::SpatialIndex::get_key(int layer, int i, int j)
+{
+	auto l = (std::uint64_t)(std::uint32_t)layer;
+	auto u = (std::uint64_t)((std::uint32_t)(i - MIN_COORDINATE) & 0xffff);
+	auto v = (std::uint64_t)((std::uint32_t)(j - MIN_COORDINATE) & 0xffff);
+
+	return (l << 32) | (u << 16) | v;
+}
+
+int nbunny::SpatialIndex::clamp_coordinate(long long value)
+{
+	return (int)std::min<long long>(std::max<long long>(value, MIN_COORDINATE), MAX_COORDINATE);
+}
+
+void nbunny::SpatialIndex::insert(int handle, Entry& entry)
+{
+	auto& bucket = buckets[get_key(entry.layer, entry.i, entry.j)];
+	entry.slot = bucket.size();
+	bucket.push_back(handle);
+
+	++layers[entry.layer];
+}
+
+void nbunny::SpatialIndex::erase(const Entry& entry)
+{
+	auto key = get_key(entry.layer, entry.i, entry.j);
+	auto bucket = buckets.find(key);
+	if (bucket == buckets.end())
+	{
+		return;
+	}
+
+	// Swap with the last handle in the bucket so removal is O(1).
+	auto& handles = bucket->second;
+	int last = handles.back();
+	handles[entry.slot] = last;
+	handles.pop_back();
+
+	if (entry.slot < handles.size())
+	{
+		entries[last].slot = entry.slot;
+	}
+
+	if (handles.empty())
+	{
+		buckets.erase(bucket);
+	}
+
+	auto layer = layers.find(entry.layer);
+	if (layer != layers.end() && --layer->second == 0)
+	{
+		layers.erase(layer);
+	}
+}
+
+void nbunny::SpatialIndex::update(int handle, int layer, int i, int j)
+{
+	i = clamp_coordinate(i);
+	j = clamp_coordinate(j);
+
+	auto existing = entries.find(handle);
+	if (existing != entries.end())
+	{
+		auto& entry = existing->second;
+		if (entry.layer == layer && entry.i == i && entry.j == j)
+		{
+			return;
+		}
+
+		erase(entry);
+
+		entry.layer = layer;
+		entry.i = i;
+		entry.j = j;
+		insert(handle, entry);
+	}
+	else
+	{
+		auto& entry = entries[handle];
+		entry.layer = layer;
+		entry.i = i;
+		entry.j = j;
+		insert(handle, entry);
+	}
+}
+
+void nbunny::SpatialIndex::remove(int handle)
+{
+	auto existing = entries.find(handle);
+	if (existing != entries.end())
+	{
+		erase(existing->second);
+		entries.erase(existing);
+	}
+}
+
+bool nbunny::SpatialIndex::has(int handle) const
+{
+	return entries.find(handle) != entries.end();
+}
+
+std::size_t nbunny::SpatialIndex::count() const
+{
+	return entries.size();
+}
+
+void nbunny::SpatialIndex::clear()
+{
+	buckets.clear();
+	entries.clear();
+	layers.clear();
+}
+
+template <typename F>
+void nbunny::SpatialIndex::visit(int layer, int i1, int j1, int i2, int j2, F&& f) const
+{
+	if (i1 > i2)
+	{
+		std::swap(i1, i2);
+	}
+
+	if (j1 > j2)
+	{
+		std::swap(j1, j2);
+	}
+
+	i1 = clamp_coordinate(i1);
+	j1 = clamp_coordinate(j1);
+	i2 = clamp_coordinate(i2);
+	j2 = clamp_coordinate(j2);
+
+	auto visit_layer = [&](int l)
+	{
+		auto width = (long long)(i2 - i1) + 1;
+		auto height = (long long)(j2 - j1) + 1;
+
+		if (width * height > (long long)buckets.size())
+		{
+			// The rectangle covers more tiles than there are occupied
+			// buckets, so it's cheaper to walk the buckets instead.
+			for (auto& bucket: buckets)
+			{
+				// Every handle in a bucket shares the same tile.
+				auto& entry = entries.at(bucket.second.front());
+				if (entry.layer == l &&
+					entry.i >= i1 && entry.i <= i2 &&
+					entry.j >= j1 && entry.j <= j2)
+				{
+					for (auto handle: bucket.second)
+					{
+						f(handle, entry.i, entry.j);
+					}
+				}
+			}
+		}
+		else
+		{
+			for (int i = i1; i <= i2; ++i)
+			{
+				for (int j = j1; j <= j2; ++j)
+				{
+					auto bucket = buckets.find(get_key(l, i, j));
+					if (bucket != buckets.end())
+					{
+						for (auto handle: bucket->second)
+						{
+							f(handle, i, j);
+						}
+					}
+				}
+			}
+		}
+	};
+
+	if (layer < 0)
+	{
+		for (auto& l: layers)
+		{
+			visit_layer(l.first);
+		}
+	}
+	else if (layers.find(layer) != layers.end())
+	{
+		visit_layer(layer);
+	}
+}
+
+void nbunny::SpatialIndex::query(int layer, int i1, int j1, int i2, int j2, std::vector<int>& result) const
+{
+	visit(layer, i1, j1, i2, j2, [&](int handle, int, int)
+	{
+		result.push_back(handle);
+	});
+}
+
+void nbunny::SpatialIndex::query_near(int layer, int i, int j, int distance, std::vector<int>& result) const
+{
+	distance = std::max(distance, 0);
+
+	int i1 = clamp_coordinate((long long)i - distance);
+	int j1 = clamp_coordinate((long long)j - distance);
+	int i2 = clamp_coordinate((long long)i + distance);
+	int j2 = clamp_coordinate((long long)j + distance);
+
+	visit(layer, i1, j1, i2, j2, [&](int handle, int s, int t)
+	{
+		if (std::abs((long long)s - i) + std::abs((long long)t - j) <= distance)
+		{
+			result.push_back(handle);
+		}
+	});
+}
+
+#ifndef NBUNNY_NO_LUA
+
+static int get_coordinate(lua_State* L, int index)
+{
+	lua_Number value = luaL_checknumber(L, index);
+	if (value != value)
+	{
+		return 0;
+	}
+
+	value = std::floor(value);
+	value = std::min<lua_Number>(value, std::numeric_limits<int>::max());
+	value = std::max<lua_Number>(value, std::numeric_limits<int>::min());
+
+	return (int)value;
+}
+
+static void push_handles(lua_State* L, const std::vector<int>& handles)
+{
+	lua_createtable(L, (int)handles.size(), 0);
+
+	for (std::size_t i = 0; i < handles.size(); ++i)
+	{
+		lua_pushinteger(L, handles[i]);
+		lua_rawseti(L, -2, (int)i + 1);
+	}
+}
+
+static int nbunny_spatial_index_update(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::SpatialIndex>(L, 1);
+	int handle = (int)luaL_checkinteger(L, 2);
+	int layer = (int)luaL_checkinteger(L, 3);
+	int i = get_coordinate(L, 4);
+	int j = get_coordinate(L, 5);
+	self.update(handle, layer, i, j);
+	return 0;
+}
+
+static int nbunny_spatial_index_remove(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::SpatialIndex>(L, 1);
+	self.remove((int)luaL_checkinteger(L, 2));
+	return 0;
+}
+
+static int nbunny_spatial_index_has(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::SpatialIndex>(L, 1);
+	lua_pushboolean(L, self.has((int)luaL_checkinteger(L, 2)));
+	return 1;
+}
+
+static int nbunny_spatial_index_get_count(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::SpatialIndex>(L, 1);
+	lua_pushinteger(L, (lua_Integer)self.count());
+	return 1;
+}
+
+static int nbunny_spatial_index_clear(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::SpatialIndex>(L, 1);
+	self.clear();
+	return 0;
+}
+
+// Argument 2 is the layer; nil searches every layer.
+static int nbunny_spatial_index_query(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::SpatialIndex>(L, 1);
+	int layer = lua_isnoneornil(L, 2) ? -1 : (int)luaL_checkinteger(L, 2);
+	int i1 = get_coordinate(L, 3);
+	int j1 = get_coordinate(L, 4);
+	int i2 = get_coordinate(L, 5);
+	int j2 = get_coordinate(L, 6);
+
+	std::vector<int> result;
+	self.query(layer, i1, j1, i2, j2, result);
+	push_handles(L, result);
+
+	return 1;
+}
+
+static int nbunny_spatial_index_query_near(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::SpatialIndex>(L, 1);
+	int layer = lua_isnoneornil(L, 2) ? -1 : (int)luaL_checkinteger(L, 2);
+	int i = get_coordinate(L, 3);
+	int j = get_coordinate(L, 4);
+	int distance = get_coordinate(L, 5);
+
+	std::vector<int> result;
+	self.query_near(layer, i, j, distance, result);
+	push_handles(L, result);
+
+	return 1;
+}
+
+extern "C"
+NBUNNY_EXPORT int luaopen_nbunny_spatialindex(lua_State* L)
+{
+	sol::usertype<nbunny::SpatialIndex> T(
+		sol::call_constructor, sol::constructors<nbunny::SpatialIndex()>(),
+		"update", &nbunny_spatial_index_update,
+		"remove", &nbunny_spatial_index_remove,
+		"has", &nbunny_spatial_index_has,
+		"getCount", &nbunny_spatial_index_get_count,
+		"clear", &nbunny_spatial_index_clear,
+		"query", &nbunny_spatial_index_query,
+		"queryNear", &nbunny_spatial_index_query_near);
+
+	sol::stack::push(L, T);
+
+	return 1;
+}
+
+#endif
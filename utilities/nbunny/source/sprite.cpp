@@ -0,0 +1,164 @@
+////////////////////////////////////////////////////////////////////////////////
+// source/sprite.cpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include "nbunny/nbunny.hpp"
+#include "nbunny/profiler.hpp"
+#include "nbunny/sprite.hpp"
+
+void nbunny::SpriteProjector::clear()
+{
+	sprites.clear();
+}
+
+void nbunny::SpriteProjector::add(const std::shared_ptr<SceneNode>& node, const glm::vec3& offset)
+{
+	sprites.push_back({ node->transform, offset });
+}
+
+std::size_t nbunny::SpriteProjector::get_count() const
+{
+	return sprites.size();
+}
+
+void nbunny::SpriteProjector::project(const Camera& camera, float delta, int width, int height)
+{
+	NBUNNY_PROFILE_SCOPE("SpriteProjector.project");
+
+	auto count = sprites.size();
+	positions.resize(count);
+	order.resize(count);
+	result.resize(count * FLOATS_PER_SPRITE);
+
+	// Sprites on the same node are next to each other once sorted by
+	// transform, so each global transform is computed once.
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		order[i] = (std::uint32_t)i;
+	}
+
+	std::sort(
+		order.begin(), order.end(),
+		[&](std::uint32_t a, std::uint32_t b)
+		{
+			return sprites[a].transform < sprites[b].transform;
+		});
+
+	auto view_projection = camera.projection * camera.view;
+	auto half_width = width / 2.0f;
+	auto half_height = height / 2.0f;
+
+	const SceneNodeTransform* previous_transform = nullptr;
+	glm::vec3 origin;
+	for (auto index: order)
+	{
+		auto& sprite = sprites[index];
+		if (sprite.transform.get() != previous_transform)
+		{
+			origin = glm::vec3(sprite.transform->get_global(delta)[3]);
+			previous_transform = sprite.transform.get();
+		}
+
+		auto clip = view_projection * glm::vec4(origin + sprite.offset, 1.0f);
+		auto ndc = glm::vec3(clip) / clip.w;
+
+		positions[index] = glm::vec3(
+			(ndc.x + 1.0f) * half_width,
+			(1.0f - ndc.y) * half_height,
+			ndc.z * 0.5f + 0.5f);
+	}
+
+	// Ties keep the order the sprites were added in, so sprites at the same
+	// depth don't flicker from frame to frame.
+	std::sort(
+		order.begin(), order.end(),
+		[&](std::uint32_t a, std::uint32_t b)
+		{
+			if (positions[a].z != positions[b].z)
+			{
+				return positions[a].z > positions[b].z;
+			}
+
+			return a < b;
+		});
+
+	auto output = result.data();
+	for (auto index: order)
+	{
+		auto& position = positions[index];
+		output[0] = (float)index;
+		output[1] = position.x;
+		output[2] = position.y;
+		output[3] = position.z;
+		output += FLOATS_PER_SPRITE;
+	}
+}
+
+const float* nbunny::SpriteProjector::get_result() const
+{
+	return result.data();
+}
+
+#ifndef NBUNNY_NO_LUA
+
+// Arguments are the scene node and the offset (x, y, z).
+static int nbunny_sprite_projector_add(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::SpriteProjector>(L, 1);
+	auto& node = sol::stack::get<std::shared_ptr<nbunny::SceneNode>>(L, 2);
+	auto offset = glm::vec3(
+		(float)luaL_optnumber(L, 3, 0.0),
+		(float)luaL_optnumber(L, 4, 0.0),
+		(float)luaL_optnumber(L, 5, 0.0));
+
+	self.add(node, offset);
+	return 0;
+}
+
+// Arguments are the camera, delta, and the width and height of the viewport.
+// Returns the number of sprites; read the results with getPointer.
+static int nbunny_sprite_projector_project(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::SpriteProjector>(L, 1);
+	auto& camera = sol::stack::get<nbunny::Camera>(L, 2);
+	float delta = (float)luaL_checknumber(L, 3);
+	int width = (int)luaL_checkinteger(L, 4);
+	int height = (int)luaL_checkinteger(L, 5);
+
+	self.project(camera, delta, width, height);
+
+	lua_pushinteger(L, (lua_Integer)self.get_count());
+	return 1;
+}
+
+static int nbunny_sprite_projector_get_pointer(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::SpriteProjector>(L, 1);
+	lua_pushlightuserdata(L, const_cast<float*>(self.get_result()));
+	return 1;
+}
+
+extern "C"
+NBUNNY_EXPORT int luaopen_nbunny_spriteprojector(lua_State* L)
+{
+	sol::usertype<nbunny::SpriteProjector> T(
+		sol::call_constructor, sol::constructors<nbunny::SpriteProjector()>(),
+		"clear", &nbunny::SpriteProjector::clear,
+		"add", &nbunny_sprite_projector_add,
+		"getCount", &nbunny::SpriteProjector::get_count,
+		"project", &nbunny_sprite_projector_project,
+		"getPointer", &nbunny_sprite_projector_get_pointer);
+
+	sol::stack::push(L, T);
+
+	return 1;
+}
+
+#endif
@@ -0,0 +1,458 @@
+////////////////////////////////////////////////////////////////////////////////
+// source/water.cpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include "nbunny/nbunny.hpp"
+#include "nbunny/profiler.hpp"
+#include "nbunny/water.hpp"
+
+// Coordinates along one side of a block of size quads, every step quads.
+// The last quad is cut short if size isn't a multiple of step.
+static int get_num_coordinates(int size, int step)
+{
+	return (size + step - 1) / step + 1;
+}
+
+static int get_coordinate(int index, int size, int step)
+{
+	return std::min(index * step, size);
+}
+
+// Moves a coordinate on an edge to the nearest vertex of a coarser block
+// with the given step. The ends of the edge never move.
+static int snap_coordinate(int coordinate, int size, int step)
+{
+	if (coordinate == 0 || coordinate == size)
+	{
+		return coordinate;
+	}
+
+	return std::min((coordinate + step / 2) / step * step, size);
+}
+
+int nbunny::WaterMesh::get_width() const
+{
+	return width;
+}
+
+int nbunny::WaterMesh::get_height() const
+{
+	return height;
+}
+
+void nbunny::WaterMesh::resize(int width, int height)
+{
+	width = std::max(width, 0);
+	height = std::max(height, 0);
+
+	if (this->width == width && this->height == height)
+	{
+		return;
+	}
+
+	this->width = width;
+	this->height = height;
+
+	int new_blocks_width = (width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	int new_blocks_height = (height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	if (new_blocks_width != blocks_width || new_blocks_height != blocks_height)
+	{
+		blocks_width = new_blocks_width;
+		blocks_height = new_blocks_height;
+
+		blocks.clear();
+		blocks.resize(blocks_width * blocks_height);
+		vertices.resize(blocks.size() * VERTICES_PER_BLOCK * FLOATS_PER_VERTEX);
+	}
+
+	for (int j = 0; j < blocks_height; ++j)
+	{
+		for (int i = 0; i < blocks_width; ++i)
+		{
+			auto& block = blocks[j * blocks_width + i];
+			int block_width = std::min(BLOCK_SIZE, width - i * BLOCK_SIZE);
+			int block_height = std::min(BLOCK_SIZE, height - j * BLOCK_SIZE);
+
+			if (block.width != block_width || block.height != block_height)
+			{
+				block.width = block_width;
+				block.height = block_height;
+				block.is_dirty = true;
+				block.is_indices_dirty = true;
+			}
+		}
+	}
+
+	is_dirty = true;
+}
+
+float nbunny::WaterMesh::get_scale() const
+{
+	return scale;
+}
+
+void nbunny::WaterMesh::set_scale(float value)
+{
+	if (scale == value)
+	{
+		return;
+	}
+
+	scale = value;
+	for (auto& block: blocks)
+	{
+		block.is_dirty = true;
+	}
+}
+
+void nbunny::WaterMesh::enable_lod(float distance)
+{
+	is_lod_enabled = true;
+	lod_distance = std::max(distance, 1.0f);
+}
+
+void nbunny::WaterMesh::disable_lod()
+{
+	is_lod_enabled = false;
+}
+
+bool nbunny::WaterMesh::get_is_lod_enabled() const
+{
+	return is_lod_enabled;
+}
+
+void nbunny::WaterMesh::set_focus(float x, float z)
+{
+	focus = glm::vec2(x, z);
+}
+
+int nbunny::WaterMesh::get_lod_step(int block_i, int block_j) const
+{
+	if (!is_lod_enabled)
+	{
+		return 1;
+	}
+
+	auto& block = blocks[block_j * blocks_width + block_i];
+	auto min = glm::vec2(block_i * BLOCK_SIZE, block_j * BLOCK_SIZE);
+	auto max = min + glm::vec2(block.width, block.height);
+	auto distance = glm::length(glm::clamp(focus, min, max) - focus);
+
+	int step = 1;
+	for (float d = lod_distance; d <= distance && step < BLOCK_SIZE; d += lod_distance)
+	{
+		step *= 2;
+	}
+
+	return step;
+}
+
+int nbunny::WaterMesh::get_step(int block_i, int block_j, int step) const
+{
+	if (block_i < 0 || block_i >= blocks_width || block_j < 0 || block_j >= blocks_height)
+	{
+		return step;
+	}
+
+	return blocks[block_j * blocks_width + block_i].step;
+}
+
+void nbunny::WaterMesh::invalidate_indices(int block_i, int block_j)
+{
+	if (block_i >= 0 && block_i < blocks_width && block_j >= 0 && block_j < blocks_height)
+	{
+		blocks[block_j * blocks_width + block_i].is_indices_dirty = true;
+	}
+}
+
+void nbunny::WaterMesh::build_vertices(int block_i, int block_j)
+{
+	int index = block_j * blocks_width + block_i;
+	auto& block = blocks[index];
+
+	int num_x = get_num_coordinates(block.width, block.step);
+	int num_z = get_num_coordinates(block.height, block.step);
+
+	auto inverse_scale = 1.0f / scale;
+	auto output = &vertices[index * VERTICES_PER_BLOCK * FLOATS_PER_VERTEX];
+	for (int k = 0; k < num_z; ++k)
+	{
+		float z = (float)(block_j * BLOCK_SIZE + get_coordinate(k, block.height, block.step));
+		for (int l = 0; l < num_x; ++l)
+		{
+			float x = (float)(block_i * BLOCK_SIZE + get_coordinate(l, block.width, block.step));
+
+			output[0] = x;
+			output[1] = 0.0f;
+			output[2] = z;
+			output[3] = 0.0f;
+			output[4] = 1.0f;
+			output[5] = 0.0f;
+			output[6] = x * inverse_scale;
+			output[7] = z * inverse_scale;
+			output += FLOATS_PER_VERTEX;
+		}
+	}
+}
+
+void nbunny::WaterMesh::build_indices(int block_i, int block_j)
+{
+	int index = block_j * blocks_width + block_i;
+	auto& block = blocks[index];
+	int step = block.step;
+
+	int num_x = get_num_coordinates(block.width, step);
+	int num_z = get_num_coordinates(block.height, step);
+
+	int left = get_step(block_i - 1, block_j, step);
+	int right = get_step(block_i + 1, block_j, step);
+	int top = get_step(block_i, block_j - 1, step);
+	int bottom = get_step(block_i, block_j + 1, step);
+
+	auto base = (std::uint32_t)(index * VERTICES_PER_BLOCK);
+	auto get_index = [&](int l, int k)
+	{
+		int x = get_coordinate(l, block.width, step);
+		int z = get_coordinate(k, block.height, step);
+
+		if (k == 0 && top > step)
+		{
+			x = snap_coordinate(x, block.width, top);
+		}
+		else if (k == num_z - 1 && bottom > step)
+		{
+			x = snap_coordinate(x, block.width, bottom);
+		}
+
+		if (l == 0 && left > step)
+		{
+			z = snap_coordinate(z, block.height, left);
+		}
+		else if (l == num_x - 1 && right > step)
+		{
+			z = snap_coordinate(z, block.height, right);
+		}
+
+		l = x == block.width ? num_x - 1 : x / step;
+		k = z == block.height ? num_z - 1 : z / step;
+
+		return base + (std::uint32_t)(k * num_x + l);
+	};
+
+	block.indices.clear();
+	auto add_triangle = [&](std::uint32_t a, std::uint32_t b, std::uint32_t c)
+	{
+		// Stitched edges collapse some triangles.
+		if (a != b && b != c && c != a)
+		{
+			block.indices.push_back(a);
+			block.indices.push_back(b);
+			block.indices.push_back(c);
+		}
+	};
+
+	for (int k = 0; k < num_z - 1; ++k)
+	{
+		for (int l = 0; l < num_x - 1; ++l)
+		{
+			auto top_left = get_index(l, k);
+			auto top_right = get_index(l + 1, k);
+			auto bottom_left = get_index(l, k + 1);
+			auto bottom_right = get_index(l + 1, k + 1);
+
+			add_triangle(top_right, bottom_left, bottom_right);
+			add_triangle(top_right, top_left, bottom_left);
+		}
+	}
+}
+
+bool nbunny::WaterMesh::update()
+{
+	NBUNNY_PROFILE_SCOPE("WaterMesh.update");
+
+	bool is_changed = is_dirty;
+	is_dirty = false;
+
+	for (int j = 0; j < blocks_height; ++j)
+	{
+		for (int i = 0; i < blocks_width; ++i)
+		{
+			auto& block = blocks[j * blocks_width + i];
+			int step = get_lod_step(i, j);
+			if (block.step != step)
+			{
+				block.step = step;
+				block.is_dirty = true;
+
+				// Neighbors stitch their edges to this block.
+				block.is_indices_dirty = true;
+				invalidate_indices(i - 1, j);
+				invalidate_indices(i + 1, j);
+				invalidate_indices(i, j - 1);
+				invalidate_indices(i, j + 1);
+			}
+		}
+	}
+
+	std::size_t first_block = blocks.size();
+	std::size_t last_block = 0;
+	for (int j = 0; j < blocks_height; ++j)
+	{
+		for (int i = 0; i < blocks_width; ++i)
+		{
+			std::size_t index = j * blocks_width + i;
+			auto& block = blocks[index];
+			if (block.is_dirty)
+			{
+				build_vertices(i, j);
+				block.is_dirty = false;
+
+				first_block = std::min(first_block, index);
+				last_block = std::max(last_block, index);
+			}
+		}
+	}
+
+	if (first_block < blocks.size())
+	{
+		dirty_vertex_start = first_block * VERTICES_PER_BLOCK;
+		dirty_vertex_count = (last_block - first_block + 1) * VERTICES_PER_BLOCK;
+		is_changed = true;
+	}
+	else
+	{
+		dirty_vertex_start = 0;
+		dirty_vertex_count = 0;
+	}
+
+	for (int j = 0; j < blocks_height; ++j)
+	{
+		for (int i = 0; i < blocks_width; ++i)
+		{
+			auto& block = blocks[j * blocks_width + i];
+			if (block.is_indices_dirty)
+			{
+				build_indices(i, j);
+				block.is_indices_dirty = false;
+				is_changed = true;
+			}
+		}
+	}
+
+	if (is_changed)
+	{
+		indices.clear();
+		for (auto& block: blocks)
+		{
+			indices.insert(indices.end(), block.indices.begin(), block.indices.end());
+		}
+	}
+
+	return is_changed;
+}
+
+std::size_t nbunny::WaterMesh::get_vertex_count() const
+{
+	return blocks.size() * VERTICES_PER_BLOCK;
+}
+
+const float* nbunny::WaterMesh::get_vertices() const
+{
+	return vertices.data();
+}
+
+std::size_t nbunny::WaterMesh::get_dirty_vertex_start() const
+{
+	return dirty_vertex_start;
+}
+
+std::size_t nbunny::WaterMesh::get_dirty_vertex_count() const
+{
+	return dirty_vertex_count;
+}
+
+std::size_t nbunny::WaterMesh::get_index_count() const
+{
+	return indices.size();
+}
+
+const std::uint32_t* nbunny::WaterMesh::get_indices() const
+{
+	return indices.data();
+}
+
+#ifndef NBUNNY_NO_LUA
+
+static int nbunny_water_mesh_get_size(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::WaterMesh>(L, 1);
+	lua_pushinteger(L, self.get_width());
+	lua_pushinteger(L, self.get_height());
+	return 2;
+}
+
+static int nbunny_water_mesh_resize(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::WaterMesh>(L, 1);
+	self.resize((int)luaL_checkinteger(L, 2), (int)luaL_checkinteger(L, 3));
+	return 0;
+}
+
+// Returns the first vertex (from 0) and number of vertices written by the
+// last update.
+static int nbunny_water_mesh_get_dirty_vertices(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::WaterMesh>(L, 1);
+	lua_pushinteger(L, (lua_Integer)self.get_dirty_vertex_start());
+	lua_pushinteger(L, (lua_Integer)self.get_dirty_vertex_count());
+	return 2;
+}
+
+static int nbunny_water_mesh_get_vertex_pointer(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::WaterMesh>(L, 1);
+	lua_pushlightuserdata(L, const_cast<float*>(self.get_vertices()));
+	return 1;
+}
+
+static int nbunny_water_mesh_get_index_pointer(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::WaterMesh>(L, 1);
+	lua_pushlightuserdata(L, const_cast<std::uint32_t*>(self.get_indices()));
+	return 1;
+}
+
+extern "C"
+NBUNNY_EXPORT int luaopen_nbunny_watermesh(lua_State* L)
+{
+	sol::usertype<nbunny::WaterMesh> T(
+		sol::call_constructor, sol::constructors<nbunny::WaterMesh()>(),
+		"getSize", &nbunny_water_mesh_get_size,
+		"resize", &nbunny_water_mesh_resize,
+		"getScale", &nbunny::WaterMesh::get_scale,
+		"setScale", &nbunny::WaterMesh::set_scale,
+		"enableLOD", &nbunny::WaterMesh::enable_lod,
+		"disableLOD", &nbunny::WaterMesh::disable_lod,
+		"getIsLODEnabled", &nbunny::WaterMesh::get_is_lod_enabled,
+		"setFocus", &nbunny::WaterMesh::set_focus,
+		"update", &nbunny::WaterMesh::update,
+		"getVertexCount", &nbunny::WaterMesh::get_vertex_count,
+		"getDirtyVertices", &nbunny_water_mesh_get_dirty_vertices,
+		"getVertexPointer", &nbunny_water_mesh_get_vertex_pointer,
+		"getIndexCount", &nbunny::WaterMesh::get_index_count,
+		"getIndexPointer", &nbunny_water_mesh_get_index_pointer);
+
+	sol::stack::push(L, T);
+
+	return 1;
+}
+
+#endif
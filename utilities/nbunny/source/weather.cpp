@@ -0,0 +1,914 @@
+////////////////////////////////////////////////////////////////////////////////
+// source/weather.cpp
+//
+// This file is a part of ItsyScape.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "nbunny/nbunny.hpp"
+#include "nbunny/profiler.hpp"
+#include "nbunny/weather.hpp"
+
+int nbunny::WeatherMap::get_i() const
+{
+	return i;
+}
+
+int nbunny::WeatherMap::get_j() const
+{
+	return j;
+}
+
+void nbunny::WeatherMap::set_position(int i, int j)
+{
+	if (this->i != i || this->j != j)
+	{
+		this->i = i;
+		this->j = j;
+		is_dirty = true;
+	}
+}
+
+float nbunny::WeatherMap::get_cell_size() const
+{
+	return cell_size;
+}
+
+void nbunny::WeatherMap::set_cell_size(float value)
+{
+	if (cell_size != value)
+	{
+		cell_size = value;
+		is_dirty = true;
+	}
+}
+
+int nbunny::WeatherMap::get_width() const
+{
+	return width;
+}
+
+int nbunny::WeatherMap::get_height() const
+{
+	return height;
+}
+
+void nbunny::WeatherMap::resize(int width, int height)
+{
+	this->width = std::max(width, 0);
+	this->height = std::max(height, 0);
+
+	heights.assign((std::size_t)this->width * (std::size_t)this->height, -std::numeric_limits<float>::infinity());
+	is_dirty = true;
+}
+
+bool nbunny::WeatherMap::Area::is_empty() const
+{
+	return min_i > max_i || min_j > max_j;
+}
+
+nbunny::WeatherMap::Area nbunny::WeatherMap::Area::merge(const Area& other) const
+{
+	Area result;
+	result.min_i = std::min(min_i, other.min_i);
+	result.min_j = std::min(min_j, other.min_j);
+	result.max_i = std::max(max_i, other.max_i);
+	result.max_j = std::max(max_j, other.max_j);
+
+	return result;
+}
+
+nbunny::WeatherMap::Area nbunny::WeatherMap::Area::intersect(const Area& other) const
+{
+	Area result;
+	result.min_i = std::max(min_i, other.min_i);
+	result.min_j = std::max(min_j, other.min_j);
+	result.max_i = std::min(max_i, other.max_i);
+	result.max_j = std::min(max_j, other.max_j);
+
+	return result;
+}
+
+nbunny::WeatherMap::Map* nbunny::WeatherMap::find_map(int id)
+{
+	for (auto& map: maps)
+	{
+		if (map.id == id)
+		{
+			return &map;
+		}
+	}
+
+	return nullptr;
+}
+
+const nbunny::WeatherMap::Map* nbunny::WeatherMap::find_map(int id) const
+{
+	for (auto& map: maps)
+	{
+		if (map.id == id)
+		{
+			return &map;
+		}
+	}
+
+	return nullptr;
+}
+
+void nbunny::WeatherMap::set_map(int id, int width, int height, float cell_size)
+{
+	auto map = find_map(id);
+	if (map)
+	{
+		invalidate(map->area);
+	}
+	else
+	{
+		maps.emplace_back();
+		map = &maps.back();
+		map->id = id;
+	}
+
+	map->width = std::max(width, 0);
+	map->height = std::max(height, 0);
+	map->cell_size = cell_size;
+	map->heights.assign((std::size_t)map->width * (std::size_t)map->height, -std::numeric_limits<float>::infinity());
+	map->transform = glm::mat4(1.0f);
+	map->inverse_transform = glm::mat4(1.0f);
+	map->area = get_area(*map);
+
+	invalidate(map->area);
+}
+
+void nbunny::WeatherMap::remove_map(int id)
+{
+	for (auto iter = maps.begin(); iter != maps.end(); ++iter)
+	{
+		if (iter->id == id)
+		{
+			invalidate(iter->area);
+			maps.erase(iter);
+			break;
+		}
+	}
+}
+
+bool nbunny::WeatherMap::has_map(int id) const
+{
+	return find_map(id) != nullptr;
+}
+
+float* nbunny::WeatherMap::get_map_heights(int id)
+{
+	auto map = find_map(id);
+	if (!map)
+	{
+		return nullptr;
+	}
+
+	return map->heights.data();
+}
+
+void nbunny::WeatherMap::invalidate_map(int id)
+{
+	auto map = find_map(id);
+	if (map)
+	{
+		invalidate(map->area);
+	}
+}
+
+void nbunny::WeatherMap::set_map_transform(int id, const glm::mat4& transform)
+{
+	auto map = find_map(id);
+	if (!map)
+	{
+		return;
+	}
+
+	auto previous_area = map->area;
+
+	map->transform = transform;
+	map->inverse_transform = glm::inverse(transform);
+	map->area = get_area(*map);
+
+	// A moving map usually covers most of the same tiles it did before, so
+	// both are done as one.
+	if (previous_area.is_empty() || map->area.is_empty())
+	{
+		invalidate(previous_area);
+		invalidate(map->area);
+	}
+	else
+	{
+		invalidate(previous_area.merge(map->area));
+	}
+}
+
+// The tiles under the map's corners (on the XZ plane) once transformed,
+// clipped to the grid.
+nbunny::WeatherMap::Area nbunny::WeatherMap::get_area(const Map& map) const
+{
+	float map_width = map.width * map.cell_size;
+	float map_height = map.height * map.cell_size;
+	glm::vec4 corners[] = {
+		glm::vec4(0.0f, 0.0f, 0.0f, 1.0f),
+		glm::vec4(map_width, 0.0f, 0.0f, 1.0f),
+		glm::vec4(0.0f, 0.0f, map_height, 1.0f),
+		glm::vec4(map_width, 0.0f, map_height, 1.0f)
+	};
+
+	float min_x = std::numeric_limits<float>::infinity();
+	float min_z = std::numeric_limits<float>::infinity();
+	float max_x = -std::numeric_limits<float>::infinity();
+	float max_z = -std::numeric_limits<float>::infinity();
+	for (auto& corner: corners)
+	{
+		auto p = map.transform * corner;
+		min_x = std::min(min_x, p.x);
+		min_z = std::min(min_z, p.z);
+		max_x = std::max(max_x, p.x);
+		max_z = std::max(max_z, p.z);
+	}
+
+	Area result;
+	if (map.width == 0 || map.height == 0 || !std::isfinite(min_x) || !std::isfinite(max_x))
+	{
+		return result;
+	}
+
+	// Tile i starts at (i - 1) * cell_size and is at i - this->i in the
+	// grid.
+	result.min_i = std::max((int)std::floor(min_x / cell_size) + 1 - i, 0);
+	result.min_j = std::max((int)std::floor(min_z / cell_size) + 1 - j, 0);
+	result.max_i = std::min((int)std::floor(max_x / cell_size) + 1 - i, width - 1);
+	result.max_j = std::min((int)std::floor(max_z / cell_size) + 1 - j, height - 1);
+
+	return result;
+}
+
+void nbunny::WeatherMap::invalidate(const Area& area)
+{
+	if (!area.is_empty())
+	{
+		dirty_areas.push_back(area);
+	}
+}
+
+// Each tile in the area takes the height of the map tile under its center,
+// found by taking the center back into map space.
+void nbunny::WeatherMap::rasterize(const Map& map, const Area& area)
+{
+	auto clipped = area.intersect(map.area);
+	if (clipped.is_empty())
+	{
+		return;
+	}
+
+	auto& transform = map.transform;
+	auto step = glm::vec4(map.inverse_transform[0]) * cell_size;
+
+	for (int current_j = clipped.min_j; current_j <= clipped.max_j; ++current_j)
+	{
+		auto x = (clipped.min_i + i - 0.5f) * cell_size;
+		auto z = (current_j + j - 0.5f) * cell_size;
+		auto local = map.inverse_transform * glm::vec4(x, 0.0f, z, 1.0f);
+
+		auto row = &heights[(std::size_t)current_j * width];
+		for (int current_i = clipped.min_i; current_i <= clipped.max_i; ++current_i, local += step)
+		{
+			auto map_i = (int)std::floor(local.x / map.cell_size);
+			auto map_j = (int)std::floor(local.z / map.cell_size);
+			if (map_i < 0 || map_j < 0 || map_i >= map.width || map_j >= map.height)
+			{
+				continue;
+			}
+
+			auto local_height = map.heights[(std::size_t)map_j * map.width + map_i];
+			if (local_height == -std::numeric_limits<float>::infinity())
+			{
+				continue;
+			}
+
+			float result;
+			if (local_height == std::numeric_limits<float>::infinity())
+			{
+				result = local_height;
+			}
+			else
+			{
+				auto center_x = (map_i + 0.5f) * map.cell_size;
+				auto center_z = (map_j + 0.5f) * map.cell_size;
+				result = transform[0][1] * center_x + transform[1][1] * local_height + transform[2][1] * center_z + transform[3][1];
+			}
+
+			row[current_i] = std::max(row[current_i], result);
+		}
+	}
+}
+
+void nbunny::WeatherMap::update()
+{
+	NBUNNY_PROFILE_SCOPE("WeatherMap.update");
+
+	if (is_dirty)
+	{
+		std::fill(heights.begin(), heights.end(), -std::numeric_limits<float>::infinity());
+
+		Area everything;
+		everything.max_i = width - 1;
+		everything.max_j = height - 1;
+
+		for (auto& map: maps)
+		{
+			map.area = get_area(map);
+			rasterize(map, everything);
+		}
+
+		dirty_areas.clear();
+		is_dirty = false;
+
+		return;
+	}
+
+	for (auto& area: dirty_areas)
+	{
+		for (int current_j = area.min_j; current_j <= area.max_j; ++current_j)
+		{
+			auto row = heights.begin() + (std::size_t)current_j * width;
+			std::fill(row + area.min_i, row + area.max_i + 1, -std::numeric_limits<float>::infinity());
+		}
+
+		for (auto& map: maps)
+		{
+			rasterize(map, area);
+		}
+	}
+
+	dirty_areas.clear();
+}
+
+float nbunny::WeatherMap::get_height_at(int i, int j) const
+{
+	auto index = (long long)(j - this->j) * width + (i - this->i);
+	if (index >= 0 && index < (long long)heights.size())
+	{
+		return heights[index];
+	}
+
+	return std::numeric_limits<float>::infinity();
+}
+
+float* nbunny::WeatherMap::get_heights()
+{
+	return heights.data();
+}
+
+nbunny::WeatherRandom::WeatherRandom(std::uint32_t seed) :
+	state(seed ? seed : 1)
+{
+	// Nothing.
+}
+
+float nbunny::WeatherRandom::next()
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+
+	// The top 24 bits fit exactly in a float.
+	return (state >> 8) * (1.0f / 16777216.0f);
+}
+
+int nbunny::WeatherRandom::next(int min, int max)
+{
+	auto range = (float)(max - min + 1);
+	return min + std::min((int)(next() * range), max - min);
+}
+
+static float* write_position(float* result, float x, float y, float z)
+{
+	result[0] = x;
+	result[1] = y;
+	result[2] = z;
+	return result + 3;
+}
+
+static glm::vec3 get_fall_direction(const glm::vec3& gravity, const glm::vec3& wind)
+{
+	auto direction = gravity + wind;
+	auto length = glm::length(direction);
+	if (length == 0.0f)
+	{
+		return glm::vec3(0.0f);
+	}
+
+	return -direction / length;
+}
+
+// Particles are kept in map space, like the Lua versions, so the tile under
+// one is its position over the cell size, plus 1.
+static float get_ground(const nbunny::WeatherMap& map, float x, float z)
+{
+	auto cell_size = map.get_cell_size();
+	auto i = (int)std::floor(x / cell_size + 1.0f);
+	auto j = (int)std::floor(z / cell_size + 1.0f);
+
+	return std::max(map.get_height_at(i, j), 0.0f);
+}
+
+void nbunny::RainWeather::resize(std::size_t count)
+{
+	x.assign(count, 0.0f);
+	y.assign(count, 0.0f);
+	z.assign(count, 0.0f);
+	length.assign(count, 0.0f);
+	moving.assign(count, 0);
+}
+
+std::size_t nbunny::RainWeather::get_count() const
+{
+	return length.size();
+}
+
+void nbunny::RainWeather::update(const WeatherMap& map, int width, int height, float delta, float* result)
+{
+	NBUNNY_PROFILE_SCOPE("RainWeather.update");
+
+	auto start_i = map.get_i();
+	auto start_j = map.get_j();
+	auto cell_size = map.get_cell_size();
+	auto velocity = (gravity + wind) * delta;
+	auto speed = glm::length(gravity) * delta;
+	auto direction = get_fall_direction(gravity, wind);
+
+	auto count = get_count();
+	for (std::size_t p = 0; p < count; ++p)
+	{
+		if (length[p] <= 0.0f)
+		{
+			auto s = random.next() * cell_size;
+			auto t = random.next() * cell_size;
+			auto i = random.next(start_i, start_i + width);
+			auto j = random.next(start_j, start_j + height);
+
+			x[p] = (i - 1) * cell_size + s;
+			y[p] = random.next() * (max_height - min_height) + min_height;
+			z[p] = (j - 1) * cell_size + t;
+			length[p] = random.next() * (max_length - min_length) + min_length;
+			moving[p] = 1;
+		}
+		else if (moving[p])
+		{
+			if (y[p] <= get_ground(map, x[p], z[p]))
+			{
+				moving[p] = 0;
+			}
+			else
+			{
+				x[p] += velocity.x;
+				y[p] += velocity.y;
+				z[p] += velocity.z;
+			}
+		}
+		else
+		{
+			length[p] -= speed;
+		}
+
+		// Two quads crossed along the Y axis, from the head of the streak
+		// to the tail (which is also raised by the size).
+		auto head_x = x[p], head_y = y[p], head_z = z[p];
+		auto tail_x = head_x + direction.x * length[p];
+		auto tail_y = head_y + direction.y * length[p] + size;
+		auto tail_z = head_z + direction.z * length[p];
+
+		result = write_position(result, head_x - size, head_y, head_z);
+		result = write_position(result, head_x + size, head_y, head_z);
+		result = write_position(result, tail_x + size, tail_y, tail_z);
+		result = write_position(result, head_x - size, head_y, head_z);
+		result = write_position(result, tail_x + size, tail_y, tail_z);
+		result = write_position(result, tail_x - size, tail_y, tail_z);
+
+		result = write_position(result, head_x, head_y, head_z - size);
+		result = write_position(result, tail_x, tail_y, tail_z - size);
+		result = write_position(result, tail_x, tail_y, tail_z + size);
+		result = write_position(result, head_x, head_y, head_z - size);
+		result = write_position(result, tail_x, tail_y, tail_z + size);
+		result = write_position(result, head_x, head_y, head_z + size);
+	}
+}
+
+// Position, then texture coordinate.
+static const float SPORE_QUAD[nbunny::FungalWeather::VERTICES_PER_PARTICLE][5] = {
+	{ -1, -1,  0, 0, 0 },
+	{  1, -1,  0, 1, 0 },
+	{  1,  1,  0, 1, 1 },
+	{ -1, -1,  0, 0, 0 },
+	{  1,  1,  0, 1, 1 },
+	{ -1,  1,  0, 0, 1 },
+
+	{  0, -1, -1, 0, 0 },
+	{  0,  1, -1, 1, 0 },
+	{  0,  1,  1, 1, 1 },
+	{  0, -1, -1, 0, 0 },
+	{  0,  1,  1, 1, 1 },
+	{  0, -1,  1, 0, 1 }
+};
+
+void nbunny::FungalWeather::resize(std::size_t count)
+{
+	x.assign(count, 0.0f);
+	y.assign(count, 0.0f);
+	z.assign(count, 0.0f);
+	size.assign(count, 0.0f);
+	age.assign(count, 0.0f);
+	alpha.assign(count, 0.0f);
+	color.assign(count, 0);
+	moving.assign(count, 0);
+}
+
+std::size_t nbunny::FungalWeather::get_count() const
+{
+	return size.size();
+}
+
+void nbunny::FungalWeather::update(const WeatherMap& map, int width, int height, float delta, float* result)
+{
+	NBUNNY_PROFILE_SCOPE("FungalWeather.update");
+
+	if (colors.empty())
+	{
+		colors.push_back(glm::vec4(1.0f));
+	}
+
+	auto start_i = map.get_i();
+	auto start_j = map.get_j();
+	auto cell_size = map.get_cell_size();
+	auto velocity = (gravity + wind) * delta;
+	auto speed = glm::length(gravity) * delta;
+	auto num_colors = (int)colors.size();
+
+	auto count = get_count();
+	for (std::size_t p = 0; p < count; ++p)
+	{
+		if (alpha[p] >= size[p])
+		{
+			auto s = random.next() * cell_size;
+			auto t = random.next() * cell_size;
+			auto i = random.next(start_i, start_i + width);
+			auto j = random.next(start_j, start_j + height);
+
+			x[p] = (i - 1) * cell_size + s;
+			y[p] = random.next() * (max_height - min_height) + min_height;
+			z[p] = (j - 1) * cell_size + t;
+			size[p] = (random.next() * (max_size - min_size) + min_size) / 10.0f;
+			age[p] = 0.0f;
+			alpha[p] = 0.0f;
+			color[p] = (std::uint32_t)random.next(0, num_colors - 1);
+			moving[p] = 1;
+		}
+		else
+		{
+			age[p] += delta;
+
+			if (moving[p])
+			{
+				auto ground = get_ground(map, x[p], z[p]);
+				if (y[p] <= ground && gravity.y <= 0.0f)
+				{
+					moving[p] = 0;
+				}
+				else if (y[p] >= ground + ceiling && gravity.y >= 0.0f)
+				{
+					moving[p] = 0;
+				}
+				else
+				{
+					x[p] += velocity.x;
+					y[p] += velocity.y;
+					z[p] += velocity.z;
+				}
+			}
+			else
+			{
+				alpha[p] += speed;
+			}
+		}
+
+		auto& c = colors[color[p]];
+		auto a = 1.0f - std::max(std::min(alpha[p] / size[p], 1.0f), 0.0f);
+		auto sway_x = x[p] + std::cos(age[p]) * size[p] * 2.0f;
+		auto sway_y = y[p] + std::sin(age[p]) * size[p] * 2.0f;
+
+		for (int v = 0; v < VERTICES_PER_PARTICLE; ++v)
+		{
+			auto& input = SPORE_QUAD[v];
+			result[0] = input[0] * size[p] + sway_x;
+			result[1] = input[1] * size[p] + sway_y;
+			result[2] = input[2] * size[p] + z[p];
+			result[3] = input[3];
+			result[4] = input[4];
+			result[5] = c.x;
+			result[6] = c.y;
+			result[7] = c.z;
+			result[8] = a;
+			result += FLOATS_PER_VERTEX;
+		}
+	}
+}
+
+#ifndef NBUNNY_NO_LUA
+
+static int nbunny_weather_map_get_position(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::WeatherMap>(L, 1);
+	lua_pushinteger(L, self.get_i());
+	lua_pushinteger(L, self.get_j());
+	return 2;
+}
+
+static int nbunny_weather_map_set_position(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::WeatherMap>(L, 1);
+	self.set_position((int)luaL_checkinteger(L, 2), (int)luaL_checkinteger(L, 3));
+	return 0;
+}
+
+static int nbunny_weather_map_get_size(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::WeatherMap>(L, 1);
+	lua_pushinteger(L, self.get_width());
+	lua_pushinteger(L, self.get_height());
+	return 2;
+}
+
+static int nbunny_weather_map_resize(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::WeatherMap>(L, 1);
+	self.resize((int)luaL_checkinteger(L, 2), (int)luaL_checkinteger(L, 3));
+	return 0;
+}
+
+static int nbunny_weather_map_get_height_at(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::WeatherMap>(L, 1);
+	lua_pushnumber(L, self.get_height_at((int)luaL_checkinteger(L, 2), (int)luaL_checkinteger(L, 3)));
+	return 1;
+}
+
+// Returns the heights as a light userdata, for ffi.cast("float*", ...). Only
+// valid until the map is resized.
+static int nbunny_weather_map_get_pointer(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::WeatherMap>(L, 1);
+	lua_pushlightuserdata(L, self.get_heights());
+	return 1;
+}
+
+static int nbunny_weather_map_set_map(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::WeatherMap>(L, 1);
+	self.set_map(
+		(int)luaL_checkinteger(L, 2),
+		(int)luaL_checkinteger(L, 3),
+		(int)luaL_checkinteger(L, 4),
+		(float)luaL_checknumber(L, 5));
+	return 0;
+}
+
+// Like getPointer, but for the heights of the map with the ID (see
+// nbunny::WeatherMap::get_map_heights). Returns nil if there's no such map.
+static int nbunny_weather_map_get_map_pointer(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::WeatherMap>(L, 1);
+	auto heights = self.get_map_heights((int)luaL_checkinteger(L, 2));
+	if (heights)
+	{
+		lua_pushlightuserdata(L, heights);
+	}
+	else
+	{
+		lua_pushnil(L);
+	}
+
+	return 1;
+}
+
+// Arguments 3 through 18 are the matrix in row-major order, like
+// Transform.getMatrix.
+static int nbunny_weather_map_set_map_transform(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::WeatherMap>(L, 1);
+	auto id = (int)luaL_checkinteger(L, 2);
+
+	glm::mat4 transform;
+	for (int row = 0; row < 4; ++row)
+	{
+		for (int column = 0; column < 4; ++column)
+		{
+			transform[column][row] = (float)luaL_checknumber(L, 3 + row * 4 + column);
+		}
+	}
+
+	self.set_map_transform(id, transform);
+	return 0;
+}
+
+extern "C"
+NBUNNY_EXPORT int luaopen_nbunny_weathermap(lua_State* L)
+{
+	sol::usertype<nbunny::WeatherMap> T(
+		sol::call_constructor, sol::constructors<nbunny::WeatherMap()>(),
+		"getPosition", &nbunny_weather_map_get_position,
+		"setPosition", &nbunny_weather_map_set_position,
+		"getCellSize", &nbunny::WeatherMap::get_cell_size,
+		"setCellSize", &nbunny::WeatherMap::set_cell_size,
+		"getSize", &nbunny_weather_map_get_size,
+		"resize", &nbunny_weather_map_resize,
+		"getHeightAt", &nbunny_weather_map_get_height_at,
+		"getPointer", &nbunny_weather_map_get_pointer,
+		"setMap", &nbunny_weather_map_set_map,
+		"removeMap", &nbunny::WeatherMap::remove_map,
+		"hasMap", &nbunny::WeatherMap::has_map,
+		"getMapPointer", &nbunny_weather_map_get_map_pointer,
+		"invalidateMap", &nbunny::WeatherMap::invalidate_map,
+		"setMapTransform", &nbunny_weather_map_set_map_transform,
+		"update", &nbunny::WeatherMap::update);
+
+	sol::stack::push(L, T);
+
+	return 1;
+}
+
+static glm::vec3 check_vec3(lua_State* L, int index)
+{
+	return glm::vec3(
+		(float)luaL_checknumber(L, index),
+		(float)luaL_checknumber(L, index + 1),
+		(float)luaL_checknumber(L, index + 2));
+}
+
+// Arguments are the map, the width and height of the area to spawn particles
+// in, the delta, and a pointer from Data.getPointer (e.g., a ByteData of
+// getVertexCount() vertices).
+template <typename T>
+static int nbunny_weather_update(lua_State* L)
+{
+	auto& self = sol::stack::get<T>(L, 1);
+	auto& map = sol::stack::get<nbunny::WeatherMap>(L, 2);
+	auto width = (int)luaL_checkinteger(L, 3);
+	auto height = (int)luaL_checkinteger(L, 4);
+	auto delta = (float)luaL_checknumber(L, 5);
+	auto result = (float*)lua_touserdata(L, 6);
+	if (!result)
+	{
+		return luaL_argerror(L, 6, "expected pointer");
+	}
+
+	self.update(map, width, height, delta, result);
+	return 0;
+}
+
+template <typename T>
+static int nbunny_weather_resize(lua_State* L)
+{
+	auto& self = sol::stack::get<T>(L, 1);
+	self.resize((std::size_t)std::max(luaL_checkinteger(L, 2), (lua_Integer)0));
+	return 0;
+}
+
+template <typename T>
+static int nbunny_weather_get_vertex_count(lua_State* L)
+{
+	auto& self = sol::stack::get<T>(L, 1);
+	lua_pushinteger(L, (lua_Integer)(self.get_count() * T::VERTICES_PER_PARTICLE));
+	return 1;
+}
+
+template <typename T>
+static int nbunny_weather_set_gravity(lua_State* L)
+{
+	auto& self = sol::stack::get<T>(L, 1);
+	self.gravity = check_vec3(L, 2);
+	return 0;
+}
+
+template <typename T>
+static int nbunny_weather_set_wind(lua_State* L)
+{
+	auto& self = sol::stack::get<T>(L, 1);
+	self.wind = check_vec3(L, 2);
+	return 0;
+}
+
+template <typename T>
+static int nbunny_weather_set_height(lua_State* L)
+{
+	auto& self = sol::stack::get<T>(L, 1);
+	self.min_height = (float)luaL_checknumber(L, 2);
+	self.max_height = (float)luaL_checknumber(L, 3);
+	return 0;
+}
+
+static int nbunny_rain_weather_set_length(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::RainWeather>(L, 1);
+	self.min_length = (float)luaL_checknumber(L, 2);
+	self.max_length = (float)luaL_checknumber(L, 3);
+	return 0;
+}
+
+static int nbunny_rain_weather_set_size(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::RainWeather>(L, 1);
+	self.size = (float)luaL_checknumber(L, 2);
+	return 0;
+}
+
+extern "C"
+NBUNNY_EXPORT int luaopen_nbunny_rainweather(lua_State* L)
+{
+	sol::usertype<nbunny::RainWeather> T(
+		sol::call_constructor, sol::constructors<nbunny::RainWeather()>(),
+		"resize", &nbunny_weather_resize<nbunny::RainWeather>,
+		"getVertexCount", &nbunny_weather_get_vertex_count<nbunny::RainWeather>,
+		"setGravity", &nbunny_weather_set_gravity<nbunny::RainWeather>,
+		"setWind", &nbunny_weather_set_wind<nbunny::RainWeather>,
+		"setHeight", &nbunny_weather_set_height<nbunny::RainWeather>,
+		"setLength", &nbunny_rain_weather_set_length,
+		"setSize", &nbunny_rain_weather_set_size,
+		"update", &nbunny_weather_update<nbunny::RainWeather>);
+
+	sol::stack::push(L, T);
+
+	return 1;
+}
+
+static int nbunny_fungal_weather_set_size(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::FungalWeather>(L, 1);
+	self.min_size = (float)luaL_checknumber(L, 2);
+	self.max_size = (float)luaL_checknumber(L, 3);
+	return 0;
+}
+
+static int nbunny_fungal_weather_set_ceiling(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::FungalWeather>(L, 1);
+	self.ceiling = (float)luaL_checknumber(L, 2);
+	return 0;
+}
+
+// Arguments are r, g, b, a for each color.
+static int nbunny_fungal_weather_set_colors(lua_State* L)
+{
+	auto& self = sol::stack::get<nbunny::FungalWeather>(L, 1);
+
+	int count = (lua_gettop(L) - 1) / 4;
+	if (count == 0)
+	{
+		return luaL_argerror(L, 2, "expected at least one color");
+	}
+
+	self.colors.clear();
+	for (int i = 0; i < count; ++i)
+	{
+		int index = 2 + i * 4;
+		self.colors.push_back(glm::vec4(
+			(float)luaL_checknumber(L, index),
+			(float)luaL_checknumber(L, index + 1),
+			(float)luaL_checknumber(L, index + 2),
+			(float)luaL_checknumber(L, index + 3)));
+	}
+
+	return 0;
+}
+
+extern "C"
+NBUNNY_EXPORT int luaopen_nbunny_fungalweather(lua_State* L)
+{
+	sol::usertype<nbunny::FungalWeather> T(
+		sol::call_constructor, sol::constructors<nbunny::FungalWeather()>(),
+		"resize", &nbunny_weather_resize<nbunny::FungalWeather>,
+		"getVertexCount", &nbunny_weather_get_vertex_count<nbunny::FungalWeather>,
+		"setGravity", &nbunny_weather_set_gravity<nbunny::FungalWeather>,
+		"setWind", &nbunny_weather_set_wind<nbunny::FungalWeather>,
+		"setHeight", &nbunny_weather_set_height<nbunny::FungalWeather>,
+		"setSize", &nbunny_fungal_weather_set_size,
+		"setCeiling", &nbunny_fungal_weather_set_ceiling,
+		"setColors", &nbunny_fungal_weather_set_colors,
+		"update", &nbunny_weather_update<nbunny::FungalWeather>);
+
+	sol::stack::push(L, T);
+
+	return 1;
+}
+
+#endif
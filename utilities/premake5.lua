@@ -24,6 +24,8 @@ solution "ItsyScape.Utilities"
 		language "C++"
 		kind "ConsoleApp"
 
+		cppdialect "C++17"
+
 		configuration "Debug"
 			targetsuffix "_debug"
 			objdir "obj/debug"
@@ -33,6 +35,9 @@ solution "ItsyScape.Utilities"
 			targetdir "bin"
 		configuration {}
 			runtime "release"
+		configuration "not windows"
+			links { "pthread" }
+		configuration {}
 
 		links { "assimp" }
 
@@ -41,6 +46,7 @@ solution "ItsyScape.Utilities"
 		}
 
 		includedirs {
+			"nbunny/include/",
 			path.join(_OPTIONS["deps"] or _DEFAULTS["deps"], "include"),
 		}
 
@@ -82,3 +88,60 @@ solution "ItsyScape.Utilities"
 		libdirs {
 			path.join(_OPTIONS["deps"] or _DEFAULTS["deps"], "lib")
 		}
+
+		configuration "not windows"
+			links { "pthread" }
+		configuration {}
+
+	-- Builds the native core of nbunny without Lua, so it can be measured on
+	-- its own. See bench/main.cpp.
+	project "Bench"
+		language "C++"
+		kind "ConsoleApp"
+
+		cppdialect "C++17"
+
+		configuration "Debug"
+			targetsuffix "_debug"
+			objdir "obj/debug"
+			targetdir "bin"
+		configuration "Release"
+			objdir "obj/release"
+			targetdir "bin"
+		configuration {}
+			runtime "release"
+		configuration "not windows"
+			links { "pthread" }
+		configuration {}
+
+		defines { "NBUNNY_NO_LUA" }
+
+		files {
+			"bench/allocations.cpp",
+			"bench/main.cpp",
+			"nbunny/source/archetype.cpp",
+			"nbunny/source/arena.cpp",
+			"nbunny/source/bake.cpp",
+			"nbunny/source/cache.cpp",
+			"nbunny/source/light.cpp",
+			"nbunny/source/map.cpp",
+			"nbunny/source/movement.cpp",
+			"nbunny/source/profiler.cpp",
+			"nbunny/source/replay.cpp",
+			"nbunny/source/resource.cpp",
+			"nbunny/source/scene.cpp",
+			"nbunny/source/scheduler.cpp",
+			"nbunny/source/spatial.cpp",
+			"nbunny/source/sprite.cpp",
+			"nbunny/source/water.cpp",
+			"nbunny/source/weather.cpp"
+		}
+
+		includedirs {
+			"nbunny/include/",
+			path.join(_OPTIONS["deps"] or _DEFAULTS["deps"], "include"),
+		}
+
+		libdirs {
+			path.join(_OPTIONS["deps"] or _DEFAULTS["deps"], "lib")
+		}